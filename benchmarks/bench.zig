@@ -1,4 +1,5 @@
 const std = @import("std");
+const builtin = @import("builtin");
 const build_options = @import("build_options");
 const gpu = @import("gpu");
 const cpu = @import("cpu");
@@ -18,6 +19,7 @@ pub fn main() !void {
     var file_size: usize = 10 * 1024 * 1024; // 10MB
     var pattern: []const u8 = "the";
     var iterations: usize = 5;
+    var huge_pages = false;
 
     // Parse arguments
     var i: usize = 1;
@@ -31,6 +33,8 @@ pub fn main() !void {
         } else if (std.mem.eql(u8, args[i], "--iterations") and i + 1 < args.len) {
             i += 1;
             iterations = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, args[i], "--hugepages")) {
+            huge_pages = true;
         }
     }
 
@@ -38,11 +42,12 @@ pub fn main() !void {
     std.debug.print("Configuration:\n", .{});
     std.debug.print("  Data size:   {d:.2} MB\n", .{@as(f64, @floatFromInt(file_size)) / (1024 * 1024)});
     std.debug.print("  Pattern:     \"{s}\"\n", .{pattern});
-    std.debug.print("  Iterations:  {d}\n\n", .{iterations});
+    std.debug.print("  Iterations:  {d}\n", .{iterations});
+    std.debug.print("  Huge pages:  {s}\n\n", .{if (huge_pages) "advised" else "off"});
 
     // Generate test data (English-like text)
     std.debug.print("Generating test data...\n", .{});
-    const text = try generateTestData(allocator, file_size);
+    const text = try generateTestData(allocator, file_size, huge_pages);
     defer allocator.free(text);
 
     const options = SearchOptions{};
@@ -287,7 +292,7 @@ fn verifyCorrectness(allocator: std.mem.Allocator, text: []const u8, pattern: []
     }
 }
 
-fn generateTestData(allocator: std.mem.Allocator, size: usize) ![]u8 {
+fn generateTestData(allocator: std.mem.Allocator, size: usize, huge_pages: bool) ![]u8 {
     const words = [_][]const u8{
         "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
         "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
@@ -296,6 +301,8 @@ fn generateTestData(allocator: std.mem.Allocator, size: usize) ![]u8 {
     };
 
     var text = try allocator.alloc(u8, size);
+    // Advise before the first write, so the faults can take huge pages
+    if (huge_pages) adviseHugePages(text);
     var prng = std.Random.DefaultPrng.init(@intCast(std.time.timestamp()));
     const random = prng.random();
 
@@ -321,3 +328,14 @@ fn generateTestData(allocator: std.mem.Allocator, size: usize) ![]u8 {
 
     return text;
 }
+
+/// MADV_HUGEPAGE over the whole pages of `buf` (Linux; ignored elsewhere)
+fn adviseHugePages(buf: []u8) void {
+    if (builtin.os.tag != .linux) return;
+    const page = std.heap.pageSize();
+    const start = std.mem.alignForward(usize, @intFromPtr(buf.ptr), page);
+    const end = std.mem.alignBackward(usize, @intFromPtr(buf.ptr) + buf.len, page);
+    if (end <= start) return;
+    const pages: [*]align(std.heap.page_size_min) u8 = @ptrFromInt(start);
+    std.posix.madvise(pages, end - start, std.posix.MADV.HUGEPAGE) catch {};
+}
@@ -219,6 +219,25 @@ pub fn build(b: *std.Build) void {
     });
     metal_module.addAnonymousImport("search.metal", .{ .root_source_file = preprocessed_metal });
 
+    // Hot query set compiled into a specialized engine (--builtin-query=NAME,
+    // where NAME is the file's stem); without the option, no set is built in
+    const query_file = b.option([]const u8, "query-file", "Literal patterns, one per line, compiled into a --builtin-query engine");
+    const query_set_source = if (query_file) |path| b.fmt(
+        \\pub const NAME: ?[]const u8 = "{s}";
+        \\pub const PATTERNS = @embedFile("query_file");
+        \\
+    , .{std.fs.path.stem(path)}) else
+        \\pub const NAME: ?[]const u8 = null;
+        \\pub const PATTERNS = "";
+        \\
+    ;
+    const query_set_module = b.addModule("query_set", .{
+        .root_source_file = b.addWriteFiles().add("query_set.zig", query_set_source),
+    });
+    if (query_file) |path| {
+        query_set_module.addAnonymousImport("query_file", .{ .root_source_file = .{ .cwd_relative = path } });
+    }
+
     // Create gpu module for reuse
     const gpu_module = b.addModule("gpu", .{
         .root_source_file = b.path("src/gpu/mod.zig"),
@@ -276,6 +295,7 @@ pub fn build(b: *std.Build) void {
                 .{ .name = "cpu", .module = cpu_module },
                 .{ .name = "cpu_gnu", .module = cpu_gnu_module },
                 .{ .name = "pcre", .module = pcre_module },
+                .{ .name = "query_set", .module = query_set_module },
             },
         }),
     });
@@ -437,6 +457,7 @@ pub fn build(b: *std.Build) void {
                 .{ .name = "spirv", .module = spirv_module },
                 .{ .name = "gpu", .module = gpu_module },
                 .{ .name = "cpu", .module = cpu_module },
+                .{ .name = "query_set", .module = query_set_module },
             },
         }),
     });
@@ -0,0 +1,404 @@
+const std = @import("std");
+const flate = std.compress.flate;
+
+// ============================================================================
+// Archive members as search inputs (--search-archives)
+//
+// Tar streams (plain or gzip-compressed) are read entry by entry: the gzip
+// layer inflates as the tar reader consumes it, and only the member being
+// searched is held in memory. Zip archives are indexed through their central
+// directory, so members can be inflated and searched independently, in
+// parallel; stored members are searched in place. Everything is read from
+// the mapped archive without extracting to disk. Under a memory budget,
+// members larger than a chunk are handed out as a Stream and searched as
+// they are inflated, never held whole.
+// ============================================================================
+
+/// Largest member searched; match positions are 32-bit
+pub const MAX_MEMBER_SIZE: usize = std.math.maxInt(u32);
+
+pub const Format = enum {
+    tar,
+    tar_gz,
+    gzip, // a single compressed file, searched as one member
+    zip,
+};
+
+/// Recognize an archive by its leading bytes; null for anything else
+pub fn detect(data: []const u8) ?Format {
+    if (std.mem.startsWith(u8, data, "PK\x03\x04") or std.mem.startsWith(u8, data, "PK\x05\x06")) return .zip;
+    if (isTarHeader(data)) return .tar;
+    if (std.mem.startsWith(u8, data, "\x1f\x8b")) {
+        // Inflate just enough to see whether a tar header comes out
+        var source: std.Io.Reader = .fixed(data);
+        var window: [flate.max_window_len]u8 = undefined;
+        var inflate: flate.Decompress = .init(&source, .gzip, &window);
+        const head = inflate.reader.peek(TAR_MAGIC_END) catch return .gzip;
+        return if (isTarHeader(head)) .tar_gz else .gzip;
+    }
+    return null;
+}
+
+const TAR_MAGIC_OFFSET = 257;
+const TAR_MAGIC_END = TAR_MAGIC_OFFSET + 5;
+
+fn isTarHeader(block: []const u8) bool {
+    return block.len >= TAR_MAGIC_END and std.mem.eql(u8, block[TAR_MAGIC_OFFSET..TAR_MAGIC_END], "ustar");
+}
+
+/// One archive member ready to be searched
+pub const Member = struct {
+    name: []const u8,
+    data: []const u8,
+    stream: ?*Stream = null, // read the member from here instead; `data` is empty
+    oversized: bool = false, // larger than MAX_MEMBER_SIZE; `data` is empty
+};
+
+/// A member read as it is inflated, for members too large to hold whole
+pub const Stream = struct {
+    reader: *std.Io.Reader,
+    remaining: u64, // bytes of the member not yet read; maxInt for a whole gzip
+
+    /// Fill `buffer` as far as the member allows; 0 at its end
+    pub fn read(self: *Stream, buffer: []u8) !usize {
+        const want: usize = @intCast(@min(buffer.len, self.remaining));
+        const n = try self.reader.readSliceShort(buffer[0..want]);
+        self.remaining = if (n < want) 0 else self.remaining - n;
+        return n;
+    }
+
+    /// Append the rest of the member to `list`, for a member that has to be
+    /// searched whole after all
+    pub fn readAll(self: *Stream, allocator: std.mem.Allocator, list: *std.ArrayListUnmanaged(u8)) !void {
+        while (true) {
+            if (list.items.len > MAX_MEMBER_SIZE) return error.FileTooBig;
+            try list.ensureUnusedCapacity(allocator, 64 * 1024);
+            const n = try self.read(list.unusedCapacitySlice());
+            if (n == 0) return;
+            list.items.len += n;
+        }
+    }
+};
+
+/// One deflated member (zip) or gzip file as a Stream. Set up in place, as
+/// the readers point into the struct.
+pub const Inflater = struct {
+    source: std.Io.Reader,
+    window: [flate.max_window_len]u8 = undefined,
+    inflate: flate.Decompress = undefined,
+    stream: Stream = undefined,
+
+    pub fn init(self: *Inflater, compressed: []const u8, container: flate.Container, size: u64) *Stream {
+        self.* = .{ .source = .fixed(compressed) };
+        self.inflate = .init(&self.source, container, &self.window);
+        self.stream = .{ .reader = &self.inflate.reader, .remaining = size };
+        return &self.stream;
+    }
+};
+
+/// Regular files of a tar stream, in archive order. Each member's data (or
+/// stream) is valid until the next call to next().
+pub const TarStream = struct {
+    source: std.Io.Reader,
+    window: [flate.max_window_len]u8 = undefined,
+    inflate: flate.Decompress = undefined,
+    iter: std.tar.Iterator = undefined,
+    file_name_buffer: [std.fs.max_path_bytes]u8 = undefined,
+    link_name_buffer: [std.fs.max_path_bytes]u8 = undefined,
+    data: std.ArrayListUnmanaged(u8) = .{},
+    stream: Stream = undefined,
+    streaming: bool = false, // the last member was handed out as `stream`
+    allocator: std.mem.Allocator,
+
+    /// Set up in place, as the readers point into the struct. `data` is the
+    /// whole archive, gzip-compressed for .tar_gz.
+    pub fn init(self: *TarStream, allocator: std.mem.Allocator, data: []const u8, format: Format) void {
+        self.* = .{ .source = .fixed(data), .allocator = allocator };
+        var reader: *std.Io.Reader = &self.source;
+        if (format == .tar_gz) {
+            self.inflate = .init(&self.source, .gzip, &self.window);
+            reader = &self.inflate.reader;
+        }
+        self.iter = .init(reader, .{
+            .file_name_buffer = &self.file_name_buffer,
+            .link_name_buffer = &self.link_name_buffer,
+        });
+    }
+
+    pub fn deinit(self: *TarStream) void {
+        self.data.deinit(self.allocator);
+    }
+
+    /// The next regular file. Members larger than `stream_over` bytes are
+    /// returned as a Stream over the tar reader instead of read into memory.
+    pub fn next(self: *TarStream, stream_over: u64) !?Member {
+        // What the caller left of a streamed member is skipped like any other
+        if (self.streaming) self.iter.unread_file_bytes = self.stream.remaining;
+        self.streaming = false;
+        while (try self.iter.next()) |file| {
+            if (file.kind != .file) continue;
+            if (file.size > stream_over) {
+                self.stream = .{ .reader = self.iter.reader, .remaining = file.size };
+                self.streaming = true;
+                return .{ .name = file.name, .data = &.{}, .stream = &self.stream };
+            }
+            // Skipped bytes are discarded by the following next()
+            if (file.size > MAX_MEMBER_SIZE) return .{ .name = file.name, .data = &.{}, .oversized = true };
+            try self.data.resize(self.allocator, @intCast(file.size));
+            var writer: std.Io.Writer = .fixed(self.data.items);
+            try self.iter.streamRemaining(file, &writer);
+            return .{ .name = file.name, .data = self.data.items };
+        }
+        return null;
+    }
+};
+
+/// Inflate a gzip file that is not a tarball
+pub fn gunzip(allocator: std.mem.Allocator, data: []const u8) ![]u8 {
+    var source: std.Io.Reader = .fixed(data);
+    var window: [flate.max_window_len]u8 = undefined;
+    var inflate: flate.Decompress = .init(&source, .gzip, &window);
+    return inflate.reader.allocRemaining(allocator, .limited(MAX_MEMBER_SIZE)) catch |err| switch (err) {
+        error.StreamTooLong => error.FileTooBig,
+        else => |e| e,
+    };
+}
+
+// ----------------------------------------------------------------------------
+// Zip
+// ----------------------------------------------------------------------------
+
+const EOCD_SIG = 0x06054b50;
+const EOCD_LEN = 22;
+const CENTRAL_SIG = 0x02014b50;
+const CENTRAL_LEN = 46;
+const LOCAL_SIG = 0x04034b50;
+const LOCAL_LEN = 30;
+
+const METHOD_STORE = 0;
+const METHOD_DEFLATE = 8;
+
+/// A zip archive indexed by its central directory
+pub const Zip = struct {
+    data: []const u8,
+    entries: []Entry, // regular files only, in directory order
+    allocator: std.mem.Allocator,
+
+    pub const Entry = struct {
+        name: []const u8,
+        method: u16,
+        encrypted: bool,
+        local_offset: u32,
+        compressed_size: u32,
+        size: u32,
+    };
+
+    pub fn init(allocator: std.mem.Allocator, data: []const u8) !Zip {
+        const eocd = try findEndRecord(data);
+        const count = readInt(u16, data, eocd + 10);
+        const dir_size = readInt(u32, data, eocd + 12);
+        const dir_offset = readInt(u32, data, eocd + 16);
+        if (count == 0xffff or dir_offset == 0xffffffff) return error.Zip64Unsupported;
+        if (@as(usize, dir_offset) + dir_size > eocd) return error.InvalidZip;
+
+        var entries: std.ArrayListUnmanaged(Entry) = .{};
+        errdefer entries.deinit(allocator);
+        var pos: usize = dir_offset;
+        for (0..count) |_| {
+            if (pos + CENTRAL_LEN > eocd or readInt(u32, data, pos) != CENTRAL_SIG) return error.InvalidZip;
+            const name_len = readInt(u16, data, pos + 28);
+            const extra_len = readInt(u16, data, pos + 30);
+            const comment_len = readInt(u16, data, pos + 32);
+            const name_end = pos + CENTRAL_LEN + name_len;
+            if (name_end > eocd) return error.InvalidZip;
+            const entry = Entry{
+                .name = data[pos + CENTRAL_LEN .. name_end],
+                .method = readInt(u16, data, pos + 10),
+                .encrypted = readInt(u16, data, pos + 8) & 1 != 0,
+                .local_offset = readInt(u32, data, pos + 42),
+                .compressed_size = readInt(u32, data, pos + 20),
+                .size = readInt(u32, data, pos + 24),
+            };
+            if (entry.size == 0xffffffff or entry.compressed_size == 0xffffffff or entry.local_offset == 0xffffffff) {
+                return error.Zip64Unsupported;
+            }
+            // Directories are entries whose name ends in '/'
+            if (!std.mem.endsWith(u8, entry.name, "/")) try entries.append(allocator, entry);
+            pos = name_end + extra_len + comment_len;
+        }
+        return .{ .data = data, .entries = try entries.toOwnedSlice(allocator), .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Zip) void {
+        self.allocator.free(self.entries);
+    }
+
+    /// Entry `idx` as a Stream inflated through `inflater`, or null when it
+    /// is stored (extract() returns those in place)
+    pub fn open(self: *const Zip, idx: usize, inflater: *Inflater) !?*Stream {
+        const entry = self.entries[idx];
+        if (entry.method == METHOD_STORE) return null;
+        if (entry.method != METHOD_DEFLATE) return error.UnsupportedCompression;
+        return inflater.init(try self.storedBytes(idx), .raw, entry.size);
+    }
+
+    /// Contents of entry `idx`. Stored members are returned in place;
+    /// deflated ones are inflated into `buffer`.
+    pub fn extract(self: *const Zip, idx: usize, allocator: std.mem.Allocator, buffer: *std.ArrayListUnmanaged(u8)) ![]const u8 {
+        const entry = self.entries[idx];
+        const compressed = try self.storedBytes(idx);
+        switch (entry.method) {
+            METHOD_STORE => return compressed,
+            METHOD_DEFLATE => {
+                try buffer.resize(allocator, entry.size);
+                var source: std.Io.Reader = .fixed(compressed);
+                var window: [flate.max_window_len]u8 = undefined;
+                var inflate: flate.Decompress = .init(&source, .raw, &window);
+                try inflate.reader.readSliceAll(buffer.items);
+                return buffer.items;
+            },
+            else => return error.UnsupportedCompression,
+        }
+    }
+
+    /// The stored bytes of entry `idx`
+    fn storedBytes(self: *const Zip, idx: usize) ![]const u8 {
+        const entry = self.entries[idx];
+        if (entry.encrypted) return error.EncryptedMember;
+
+        // The local header repeats the name and has its own extra field
+        const local: usize = entry.local_offset;
+        if (local + LOCAL_LEN > self.data.len or readInt(u32, self.data, local) != LOCAL_SIG) return error.InvalidZip;
+        const start = local + LOCAL_LEN + readInt(u16, self.data, local + 26) + readInt(u16, self.data, local + 28);
+        if (start + entry.compressed_size > self.data.len) return error.InvalidZip;
+        return self.data[start..][0..entry.compressed_size];
+    }
+
+    /// The end-of-central-directory record sits in the last 64K + 22 bytes,
+    /// before an optional archive comment
+    fn findEndRecord(data: []const u8) !usize {
+        if (data.len < EOCD_LEN) return error.InvalidZip;
+        const lowest = data.len -| (EOCD_LEN + std.math.maxInt(u16));
+        var pos = data.len - EOCD_LEN;
+        while (true) : (pos -= 1) {
+            if (readInt(u32, data, pos) == EOCD_SIG) return pos;
+            if (pos == lowest) return error.InvalidZip;
+        }
+    }
+
+    fn readInt(comptime T: type, data: []const u8, pos: usize) T {
+        return std.mem.readInt(T, data[pos..][0..@sizeOf(T)], .little);
+    }
+};
+
+test "archive: zip central directory and stored members" {
+    const allocator = std.testing.allocator;
+    const body = "line one\nneedle here\n";
+    const name = "logs/app.log";
+
+    // Build a one-member stored zip by hand
+    var zip: std.ArrayListUnmanaged(u8) = .{};
+    defer zip.deinit(allocator);
+    var local: [LOCAL_LEN]u8 = @splat(0);
+    std.mem.writeInt(u32, local[0..4], LOCAL_SIG, .little);
+    std.mem.writeInt(u32, local[18..22], body.len, .little);
+    std.mem.writeInt(u32, local[22..26], body.len, .little);
+    std.mem.writeInt(u16, local[26..28], name.len, .little);
+    try zip.appendSlice(allocator, &local);
+    try zip.appendSlice(allocator, name);
+    try zip.appendSlice(allocator, body);
+
+    const dir_offset = zip.items.len;
+    var central: [CENTRAL_LEN]u8 = @splat(0);
+    std.mem.writeInt(u32, central[0..4], CENTRAL_SIG, .little);
+    std.mem.writeInt(u32, central[20..24], body.len, .little);
+    std.mem.writeInt(u32, central[24..28], body.len, .little);
+    std.mem.writeInt(u16, central[28..30], name.len, .little);
+    try zip.appendSlice(allocator, &central);
+    try zip.appendSlice(allocator, name);
+
+    var eocd: [EOCD_LEN]u8 = @splat(0);
+    std.mem.writeInt(u32, eocd[0..4], EOCD_SIG, .little);
+    std.mem.writeInt(u16, eocd[8..10], 1, .little);
+    std.mem.writeInt(u16, eocd[10..12], 1, .little);
+    std.mem.writeInt(u32, eocd[12..16], @intCast(zip.items.len - dir_offset), .little);
+    std.mem.writeInt(u32, eocd[16..20], @intCast(dir_offset), .little);
+    try zip.appendSlice(allocator, &eocd);
+
+    try std.testing.expectEqual(Format.zip, detect(zip.items).?);
+    try std.testing.expectEqual(@as(?Format, null), detect(body));
+
+    var archive = try Zip.init(allocator, zip.items);
+    defer archive.deinit();
+    try std.testing.expectEqual(@as(usize, 1), archive.entries.len);
+    try std.testing.expectEqualStrings(name, archive.entries[0].name);
+
+    var buffer: std.ArrayListUnmanaged(u8) = .{};
+    defer buffer.deinit(allocator);
+    try std.testing.expectEqualStrings(body, try archive.extract(0, allocator, &buffer));
+}
+
+/// Append a regular-file entry to a hand-built ustar archive
+fn appendTarEntry(allocator: std.mem.Allocator, tar: *std.ArrayListUnmanaged(u8), name: []const u8, body: []const u8) !void {
+    var header: [512]u8 = @splat(0);
+    @memcpy(header[0..name.len], name);
+    @memcpy(header[100..107], "0000644");
+    @memcpy(header[108..115], "0000000");
+    @memcpy(header[116..123], "0000000");
+    _ = try std.fmt.bufPrint(header[124..135], "{o:0>11}", .{body.len});
+    @memcpy(header[136..147], "00000000000");
+    header[156] = '0';
+    @memcpy(header[257..263], "ustar\x00");
+    @memcpy(header[263..265], "00");
+    @memset(header[148..156], ' ');
+    var sum: u32 = 0;
+    for (header) |b| sum += b;
+    _ = try std.fmt.bufPrint(header[148..155], "{o:0>6}\x00", .{sum});
+
+    try tar.appendSlice(allocator, &header);
+    try tar.appendSlice(allocator, body);
+    try tar.appendNTimes(allocator, 0, (512 - body.len % 512) % 512);
+}
+
+test "archive: tar members past the stream size are read as they come" {
+    const allocator = std.testing.allocator;
+    const big = "first\n" ++ ("filler line\n" ** 60) ++ "needle at the end\n";
+    const small = "needle two\n";
+
+    var tar: std.ArrayListUnmanaged(u8) = .{};
+    defer tar.deinit(allocator);
+    try appendTarEntry(allocator, &tar, "big.log", big);
+    try appendTarEntry(allocator, &tar, "small.log", small);
+    try appendTarEntry(allocator, &tar, "big2.log", big);
+    try tar.appendNTimes(allocator, 0, 1024);
+    try std.testing.expectEqual(Format.tar, detect(tar.items).?);
+
+    const stream = try allocator.create(TarStream);
+    defer allocator.destroy(stream);
+    stream.init(allocator, tar.items, .tar);
+    defer stream.deinit();
+
+    // A member larger than the budget is read whole, a piece at a time
+    const first = (try stream.next(64)).?;
+    try std.testing.expectEqualStrings("big.log", first.name);
+    try std.testing.expectEqual(@as(usize, 0), first.data.len);
+    var read: std.ArrayListUnmanaged(u8) = .{};
+    defer read.deinit(allocator);
+    var piece: [64]u8 = undefined;
+    while (true) {
+        const n = try first.stream.?.read(&piece);
+        if (n == 0) break;
+        try read.appendSlice(allocator, piece[0..n]);
+    }
+    try std.testing.expectEqualStrings(big, read.items);
+
+    const second = (try stream.next(64)).?;
+    try std.testing.expectEqualStrings("small.log", second.name);
+    try std.testing.expectEqualStrings(small, second.data);
+
+    // What is left of a streamed member is skipped
+    const third = (try stream.next(64)).?;
+    try std.testing.expectEqualStrings("big2.log", third.name);
+    try std.testing.expectEqual(@as(usize, 10), try third.stream.?.read(piece[0..10]));
+    try std.testing.expect((try stream.next(64)) == null);
+}
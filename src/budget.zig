@@ -0,0 +1,101 @@
+const std = @import("std");
+const gpu = @import("gpu");
+
+// ============================================================================
+// Memory budget (--max-memory)
+//
+// One limit decides how much of an input is searched at a time, how many
+// workers run, and whether the GPU's fixed buffers fit. Inputs larger than
+// the chunk size are searched one line-aligned chunk after another, so the
+// engines' buffers and result arrays scale with the chunk instead of the
+// input; output is already streamed per worker once it passes the sink's
+// spill size.
+// ============================================================================
+
+/// Process-wide allowance outside the workers: arguments, patterns, GPU
+/// session bookkeeping
+const BASE_RESERVE: usize = 16 * 1024 * 1024;
+
+/// Fixed cost of a worker besides its chunk: output sink, compiled matchers
+const WORKER_RESERVE: usize = 2 * 1024 * 1024;
+
+/// A chunk's search costs a few times the chunk itself: the input bytes,
+/// engine scratch (field copies, inverted runs) and the result array
+const CHUNK_COST_FACTOR: usize = 4;
+
+pub const MIN_CHUNK: usize = 1024 * 1024;
+pub const MAX_CHUNK: usize = gpu.MAX_GPU_BUFFER_SIZE;
+
+/// GPU result buffer, allocated in full by each GPU search
+const GPU_RESULTS: usize = @sizeOf(gpu.MatchResult) * gpu.MAX_RESULTS;
+
+pub const Budget = struct {
+    limit: usize = 0, // bytes; 0 means unlimited
+
+    pub fn enabled(self: Budget) bool {
+        return self.limit > 0;
+    }
+
+    /// Workers that fit next to each other, each with at least a minimum chunk
+    pub fn workers(self: Budget, requested: usize) usize {
+        if (!self.enabled()) return requested;
+        const per_worker = WORKER_RESERVE + MIN_CHUNK * CHUNK_COST_FACTOR;
+        const fit = (self.limit -| BASE_RESERVE) / per_worker;
+        return std.math.clamp(fit, 1, @max(requested, 1));
+    }
+
+    /// Bytes of input each of `num_workers` searches at a time; 0 when the
+    /// input need not be chunked
+    pub fn chunkSize(self: Budget, num_workers: usize) usize {
+        if (!self.enabled()) return 0;
+        return std.math.clamp(self.share(num_workers, self.gpuFits(num_workers)), MIN_CHUNK, MAX_CHUNK);
+    }
+
+    /// Largest input handed to the GPU: a chunk, or 0 (CPU only) when its
+    /// buffers do not fit
+    pub fn gpuMaxInput(self: Budget, num_workers: usize) usize {
+        if (!self.enabled()) return MAX_CHUNK;
+        return if (self.gpuFits(num_workers)) self.chunkSize(num_workers) else 0;
+    }
+
+    /// The GPU's result buffer and one input chunk are set aside first, when
+    /// the workers still get a minimum chunk each beside them
+    fn gpuFits(self: Budget, num_workers: usize) bool {
+        return self.share(num_workers, true) >= MIN_CHUNK;
+    }
+
+    /// Unclamped chunk size: what is left after the reserves, split so that
+    /// every worker's chunk costs CHUNK_COST_FACTOR times its size and the
+    /// GPU, when `with_gpu`, holds one more chunk of input
+    fn share(self: Budget, num_workers: usize, with_gpu: bool) usize {
+        const n = @max(num_workers, 1);
+        const left = self.limit -| BASE_RESERVE -| n * WORKER_RESERVE;
+        if (!with_gpu) return left / (n * CHUNK_COST_FACTOR);
+        return (left -| GPU_RESULTS) / (n * CHUNK_COST_FACTOR + 1);
+    }
+};
+
+test "budget: chunk size and workers follow the limit" {
+    const unlimited = Budget{};
+    try std.testing.expectEqual(@as(usize, 8), unlimited.workers(8));
+    try std.testing.expectEqual(@as(usize, 0), unlimited.chunkSize(8));
+
+    // 512MB shared by 8 workers: each gets a chunk well under the input cap
+    const container = Budget{ .limit = 512 * 1024 * 1024 };
+    try std.testing.expectEqual(@as(usize, 8), container.workers(8));
+    const chunk = container.chunkSize(8);
+    try std.testing.expect(chunk >= MIN_CHUNK and chunk * CHUNK_COST_FACTOR * 8 <= container.limit);
+
+    // ... and the GPU keeps its buffers beside them
+    const gpu_input = container.gpuMaxInput(8);
+    try std.testing.expect(gpu_input >= MIN_CHUNK);
+    const used = BASE_RESERVE + GPU_RESULTS + gpu_input + 8 * (WORKER_RESERVE + chunk * CHUNK_COST_FACTOR);
+    try std.testing.expect(used <= container.limit);
+    const single = Budget{ .limit = 128 * 1024 * 1024 };
+    try std.testing.expect(single.gpuMaxInput(1) >= MIN_CHUNK);
+
+    // 32MB cannot host 16 workers or the GPU's result buffer
+    const tight = Budget{ .limit = 32 * 1024 * 1024 };
+    try std.testing.expect(tight.workers(16) < 16);
+    try std.testing.expectEqual(@as(usize, 0), tight.gpuMaxInput(tight.workers(16)));
+}
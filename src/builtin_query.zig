@@ -0,0 +1,333 @@
+const std = @import("std");
+const gpu = @import("gpu");
+const query_set = @import("query_set");
+
+const MatchResult = gpu.MatchResult;
+const SearchResult = gpu.SearchResult;
+
+// ============================================================================
+// Builtin query (zig build -Dquery-file=FILE, grep --builtin-query=NAME)
+//
+// The query file, one literal per line, is compiled at comptime into a
+// matcher specialized for that set, so nothing is parsed or built at
+// startup. A single pattern gets a BMH skip table and a compare of
+// comptime-known length. A set gets an Aho-Corasick DFA with all 256
+// transitions filled in (one table load per byte). While the DFA is in its
+// root state, it skips every byte that starts no pattern.
+// ============================================================================
+
+/// Name for --builtin-query (the query file's stem), or null when the
+/// binary was built without -Dquery-file
+pub const name: ?[]const u8 = query_set.NAME;
+
+/// The compiled patterns, in file order
+pub const patterns: []const []const u8 = parsePatterns(query_set.PATTERNS);
+
+comptime {
+    if (name != null and patterns.len == 0) @compileError("-Dquery-file names a file with no patterns");
+}
+
+fn parsePatterns(comptime source: []const u8) []const []const u8 {
+    comptime {
+        @setEvalBranchQuota(source.len * 10 + 1000);
+        var list: []const []const u8 = &.{};
+        var lines = std.mem.splitScalar(u8, source, '\n');
+        while (lines.next()) |line| {
+            const pattern = std.mem.trimRight(u8, line, "\r");
+            if (pattern.len > 0) list = list ++ [_][]const u8{pattern};
+        }
+        const final = list[0..list.len].*;
+        return &final;
+    }
+}
+
+/// The engine for the compiled set
+const Compiled = Matcher(patterns);
+
+const Match = struct { start: usize, len: usize };
+
+/// Engine specialized for `set`, which must be non-empty unless it is never
+/// searched
+fn Matcher(comptime set: []const []const u8) type {
+    return struct {
+        /// Single pattern: BMH with a comptime skip table
+        const Single = struct {
+            const pattern = set[0];
+
+            const skip: [256]usize = blk: {
+                var table = [_]usize{pattern.len} ** 256;
+                for (pattern[0 .. pattern.len - 1], 0..) |c, i| table[c] = pattern.len - 1 - i;
+                break :blk table;
+            };
+
+            fn next(text: []const u8, from: usize) ?Match {
+                var pos = from;
+                while (pos + pattern.len <= text.len) {
+                    const last = text[pos + pattern.len - 1];
+                    if (last == pattern[pattern.len - 1] and std.mem.eql(u8, text[pos..][0..pattern.len], pattern)) {
+                        return .{ .start = pos, .len = pattern.len };
+                    }
+                    pos += skip[last];
+                }
+                return null;
+            }
+        };
+
+        /// Pattern set: Aho-Corasick DFA built at comptime
+        const Dfa = struct {
+            const State = u16;
+
+            const num_states = blk: {
+                var n: usize = 1;
+                for (set) |p| n += p.len;
+                if (n >= std.math.maxInt(State)) @compileError("query set too large for a u16 DFA");
+                break :blk n;
+            };
+
+            const Tables = struct {
+                next: [num_states][256]State,
+                /// Length of the longest pattern ending in each state, 0 for none
+                out: [num_states]u32,
+                /// Bytes that start some pattern (the root state skips the rest)
+                first: [256]bool,
+                len: usize,
+            };
+
+            const tables: Tables = build();
+
+            const max_len = blk: {
+                var n: usize = 0;
+                for (set) |p| n = @max(n, p.len);
+                break :blk n;
+            };
+
+            fn build() Tables {
+                @setEvalBranchQuota(num_states * 256 * 8 + 1000);
+                const NONE = std.math.maxInt(State);
+                var t = Tables{
+                    .next = [_][256]State{[_]State{NONE} ** 256} ** num_states,
+                    .out = [_]u32{0} ** num_states,
+                    .first = [_]bool{false} ** 256,
+                    .len = 1,
+                };
+
+                // Trie
+                for (set) |p| {
+                    var s: State = 0;
+                    for (p) |c| {
+                        if (t.next[s][c] == NONE) {
+                            t.next[s][c] = @intCast(t.len);
+                            t.len += 1;
+                        }
+                        s = t.next[s][c];
+                    }
+                    t.out[s] = @max(t.out[s], @as(u32, @intCast(p.len)));
+                    t.first[p[0]] = true;
+                }
+
+                // Breadth-first: failure links fill the missing transitions and
+                // carry the outputs of suffix states
+                var fail = [_]State{0} ** num_states;
+                var queue: [num_states]State = undefined;
+                var head: usize = 0;
+                var tail: usize = 0;
+                for (&t.next[0]) |*dst| {
+                    if (dst.* == NONE) {
+                        dst.* = 0;
+                    } else {
+                        queue[tail] = dst.*;
+                        tail += 1;
+                    }
+                }
+                while (head < tail) : (head += 1) {
+                    const s = queue[head];
+                    for (0..256) |c| {
+                        const child = t.next[s][c];
+                        if (child == NONE) {
+                            t.next[s][c] = t.next[fail[s]][c];
+                        } else {
+                            fail[child] = t.next[fail[s]][c];
+                            t.out[child] = @max(t.out[child], t.out[fail[child]]);
+                            queue[tail] = child;
+                            tail += 1;
+                        }
+                    }
+                }
+                return t;
+            }
+
+            const Scanner = struct {
+                pos: usize = 0,
+                state: State = 0,
+
+                /// Next leftmost-longest match, resuming after its end. The DFA
+                /// reports matches by end position, so once one is found the
+                /// scan goes on while a match starting no later could still
+                /// end: up to max_len bytes past its start, or until the DFA
+                /// falls back to the root.
+                fn next(self: *Scanner, text: []const u8) ?Match {
+                    var pos = self.pos;
+                    var state = self.state;
+                    var best: ?Match = null;
+                    while (pos < text.len) {
+                        if (best) |b| {
+                            if (state == 0 or pos >= b.start + max_len) break;
+                        }
+                        if (state == 0) {
+                            while (pos < text.len and !tables.first[text[pos]]) pos += 1;
+                            if (pos == text.len) break;
+                        }
+                        state = tables.next[state][text[pos]];
+                        pos += 1;
+                        // The longest pattern ending here starts leftmost
+                        const len = tables.out[state];
+                        if (len != 0 and (best == null or pos - len <= best.?.start)) best = .{ .start = pos - len, .len = len };
+                    }
+                    if (best) |b| {
+                        self.* = .{ .pos = b.start + b.len };
+                        return b;
+                    }
+                    self.* = .{ .pos = pos, .state = state };
+                    return null;
+                }
+            };
+        };
+
+        /// Matches of the compiled set, resumable from any position
+        const Scanner = struct {
+            dfa: Dfa.Scanner = .{},
+            pos: usize = 0,
+
+            fn next(self: *Scanner, text: []const u8) ?Match {
+                if (set.len == 1) {
+                    const m = Single.next(text, self.pos) orelse return null;
+                    self.pos = m.start + m.len;
+                    return m;
+                }
+                return self.dfa.next(text);
+            }
+
+            /// Continue from `pos` (forward only), forgetting partial matches
+            fn skipTo(self: *Scanner, pos: usize) void {
+                if (set.len == 1) {
+                    self.pos = @max(self.pos, pos);
+                } else if (pos > self.dfa.pos) {
+                    self.dfa = .{ .pos = pos };
+                }
+            }
+        };
+
+        /// Search `text` with the set. Under `invert`, the lines between
+        /// matching lines are returned whole, as for -v.
+        fn search(text: []const u8, invert: bool, eol: u8, allocator: std.mem.Allocator) !SearchResult {
+            var matches: std.ArrayListUnmanaged(MatchResult) = .{};
+            defer matches.deinit(allocator);
+
+            // For -v, the first byte not yet known to belong to a matching line
+            var cursor: usize = 0;
+
+            var scanner = Scanner{};
+            while (scanner.next(text)) |m| {
+                const line_start = if (std.mem.lastIndexOfScalar(u8, text[0..m.start], eol)) |nl| nl + 1 else 0;
+                if (invert) {
+                    try appendLines(&matches, allocator, text, eol, cursor, line_start);
+                    cursor = if (std.mem.indexOfScalarPos(u8, text, m.start, eol)) |nl| nl + 1 else text.len;
+                    scanner.skipTo(cursor);
+                    continue;
+                }
+                try matches.append(allocator, .{
+                    .position = @intCast(m.start),
+                    .pattern_idx = 0,
+                    .match_len = @intCast(m.len),
+                    .line_start = @intCast(line_start),
+                });
+            }
+            if (invert) try appendLines(&matches, allocator, text, eol, cursor, text.len);
+
+            const total_matches: u64 = matches.items.len;
+            const result = try matches.toOwnedSlice(allocator);
+            return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
+        }
+    };
+}
+
+/// Search `text` with the compiled set. Under `invert`, the lines between
+/// matching lines are returned whole, as for -v.
+pub fn search(text: []const u8, invert: bool, eol: u8, allocator: std.mem.Allocator) !SearchResult {
+    return Compiled.search(text, invert, eol, allocator);
+}
+
+/// Append every line starting in [from, to) as a whole-line match
+fn appendLines(
+    matches: *std.ArrayListUnmanaged(MatchResult),
+    allocator: std.mem.Allocator,
+    text: []const u8,
+    eol: u8,
+    from: usize,
+    to: usize,
+) !void {
+    var line_start = from;
+    while (line_start < to) {
+        const line_end = std.mem.indexOfScalarPos(u8, text, line_start, eol) orelse text.len;
+        try matches.append(allocator, .{
+            .position = @intCast(line_start),
+            .pattern_idx = 0,
+            .match_len = @intCast(line_end - line_start),
+            .line_start = @intCast(line_start),
+        });
+        line_start = line_end + 1;
+    }
+}
+
+fn expectMatches(result: SearchResult, expected: []const [2]u32) !void {
+    try std.testing.expectEqual(expected.len, result.matches.len);
+    for (result.matches, expected) |m, e| {
+        try std.testing.expectEqual(e[0], m.position);
+        try std.testing.expectEqual(e[1], m.match_len);
+    }
+}
+
+test "builtin_query: single pattern" {
+    const allocator = std.testing.allocator;
+    var result = try Matcher(&.{"needle"}).search("a needle\nno\nneedle needle\n", false, '\n', allocator);
+    defer result.deinit();
+    try expectMatches(result, &.{ .{ 2, 6 }, .{ 12, 6 }, .{ 19, 6 } });
+    try std.testing.expectEqual(@as(u32, 12), result.matches[2].line_start);
+}
+
+test "builtin_query: pattern set" {
+    const allocator = std.testing.allocator;
+    const Set = Matcher(&.{ "error", "warn", "fatal" });
+    var result = try Set.search("ok\nwarn: x\nfatal error\ndone", false, '\n', allocator);
+    defer result.deinit();
+    try expectMatches(result, &.{ .{ 3, 4 }, .{ 11, 5 }, .{ 17, 5 } });
+}
+
+test "builtin_query: -v returns the lines between matches" {
+    const allocator = std.testing.allocator;
+    const text = "ok\nwarn: x\nfatal error\ndone";
+
+    var set = try Matcher(&.{ "error", "warn", "fatal" }).search(text, true, '\n', allocator);
+    defer set.deinit();
+    try expectMatches(set, &.{ .{ 0, 2 }, .{ 23, 4 } });
+
+    var single = try Matcher(&.{"warn"}).search(text, true, '\n', allocator);
+    defer single.deinit();
+    try expectMatches(single, &.{ .{ 0, 2 }, .{ 11, 11 }, .{ 23, 4 } });
+}
+
+test "builtin_query: leftmost-longest matches in text order" {
+    const allocator = std.testing.allocator;
+
+    var suffix = try Matcher(&.{ "abc", "b" }).search("abc xbx", false, '\n', allocator);
+    defer suffix.deinit();
+    try expectMatches(suffix, &.{ .{ 0, 3 }, .{ 5, 1 } });
+
+    var nested = try Matcher(&.{ "he", "she", "hers" }).search("ushers his", false, '\n', allocator);
+    defer nested.deinit();
+    try expectMatches(nested, &.{.{ 1, 3 }});
+
+    var single = try Matcher(&.{"aa"}).search("aaaaa", false, '\n', allocator);
+    defer single.deinit();
+    try expectMatches(single, &.{ .{ 0, 2 }, .{ 2, 2 } });
+}
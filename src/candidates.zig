@@ -0,0 +1,291 @@
+const std = @import("std");
+const gpu = @import("gpu");
+const sidecar = @import("sidecar.zig");
+
+// ============================================================================
+// Candidate sets (--save-candidates=ID, --within=ID)
+//
+// A narrowing investigation ("ERROR", then "ERROR.*db", then ...) only ever
+// needs the lines the previous step selected. --save-candidates records, per
+// file, the byte ranges of the selected lines (adjacent lines merged) and
+// the line number each range starts at, together with the file's size and
+// mtime. --within maps each file and hands only those ranges to the engines,
+// so a refinement costs in proportion to the previous result rather than
+// the corpus. Sets live in $XDG_CACHE_HOME/grep/candidates/ID, or
+// ~/.cache/grep/candidates/ID.
+//
+// Layout (little endian):
+//   header (16 bytes): magic, version, file count
+//   per file: path length u32, run count u32, size u64, mtime i64,
+//             path (padded to 8), runs (start u64, end u64, first line u64)
+// ============================================================================
+
+pub const Run = sidecar.Run;
+
+const MAGIC = "GRPCAND1";
+const VERSION: u32 = 1;
+const HEADER_SIZE: usize = 16;
+const FILE_HEADER_SIZE: usize = 24;
+const RUN_SIZE: usize = 24;
+const MAX_ID_LEN = 64;
+
+/// The selected lines of one file
+pub const File = struct {
+    path: []const u8,
+    size: u64,
+    mtime: i64,
+    runs: []const Run, // ascending, non-adjacent
+
+    /// The ranges still describe this version of the file
+    pub fn isFresh(self: *const File, size: u64, mtime: i128) bool {
+        return self.size == size and self.mtime == truncateMtime(mtime);
+    }
+};
+
+pub const Set = struct {
+    allocator: std.mem.Allocator,
+    files: std.ArrayListUnmanaged(File) = .{}, // path and runs owned
+    by_path: std.StringHashMapUnmanaged(usize) = .{},
+    mutex: std.Thread.Mutex = .{}, // add() runs on the -r worker threads
+
+    pub fn init(allocator: std.mem.Allocator) Set {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Set) void {
+        for (self.files.items) |f| {
+            self.allocator.free(f.path);
+            self.allocator.free(f.runs);
+        }
+        self.files.deinit(self.allocator);
+        self.by_path.deinit(self.allocator);
+    }
+
+    pub fn get(self: *const Set, path: []const u8) ?*const File {
+        const idx = self.by_path.get(path) orelse return null;
+        return &self.files.items[idx];
+    }
+
+    /// Record the lines of `data` (the contents of `path`) holding
+    /// `matches`, whose line_num must be set. Files with no lines are not
+    /// recorded; --within skips them.
+    pub fn add(self: *Set, path: []const u8, stat: std.fs.File.Stat, data: []const u8, eol: u8, matches: []const gpu.MatchResult) !void {
+        if (matches.len == 0) return;
+        const allocator = self.allocator;
+        const sorted = try allocator.dupe(gpu.MatchResult, matches);
+        defer allocator.free(sorted);
+        std.mem.sort(gpu.MatchResult, sorted, {}, struct {
+            fn lessThan(_: void, a: gpu.MatchResult, b: gpu.MatchResult) bool {
+                return a.line_start < b.line_start;
+            }
+        }.lessThan);
+
+        var runs: std.ArrayListUnmanaged(Run) = .{};
+        errdefer runs.deinit(allocator);
+        for (sorted) |m| {
+            const start: usize = m.line_start;
+            const end = if (std.mem.indexOfScalarPos(u8, data, start, eol)) |e| e + 1 else data.len;
+            if (runs.items.len > 0) {
+                const last = &runs.items[runs.items.len - 1];
+                if (start < last.end) continue; // another match on the same line
+                if (start == last.end) {
+                    last.end = end;
+                    continue;
+                }
+            }
+            try runs.append(allocator, .{ .start = start, .end = end, .first_line = m.line_num - 1 });
+        }
+
+        const owned_path = try allocator.dupe(u8, path);
+        errdefer allocator.free(owned_path);
+        const owned_runs = try runs.toOwnedSlice(allocator);
+        errdefer allocator.free(owned_runs);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        try self.put(.{ .path = owned_path, .size = stat.size, .mtime = truncateMtime(stat.mtime), .runs = owned_runs });
+    }
+
+    /// Take ownership of `file`, replacing an earlier entry for its path
+    fn put(self: *Set, file: File) !void {
+        const entry = try self.by_path.getOrPut(self.allocator, file.path);
+        if (entry.found_existing) {
+            const old = &self.files.items[entry.value_ptr.*];
+            self.allocator.free(old.runs);
+            old.runs = file.runs;
+            old.size = file.size;
+            old.mtime = file.mtime;
+            self.allocator.free(file.path);
+            return;
+        }
+        errdefer self.by_path.removeByPtr(entry.key_ptr);
+        try self.files.append(self.allocator, file);
+        entry.value_ptr.* = self.files.items.len - 1;
+    }
+
+    /// Load set `id` from the cache directory
+    pub fn load(allocator: std.mem.Allocator, id: []const u8) !Set {
+        const path = try setPath(allocator, id);
+        defer allocator.free(path);
+        return read(allocator, std.fs.cwd(), path);
+    }
+
+    /// Store the set as `id` in the cache directory
+    pub fn save(self: *Set, id: []const u8) !void {
+        const path = try setPath(self.allocator, id);
+        defer self.allocator.free(path);
+        if (std.fs.path.dirname(path)) |dir| try std.fs.cwd().makePath(dir);
+        try self.write(std.fs.cwd(), path);
+    }
+
+    fn read(allocator: std.mem.Allocator, dir: std.fs.Dir, path: []const u8) !Set {
+        const file = try dir.openFile(path, .{});
+        defer file.close();
+        const data = try file.readToEndAlloc(allocator, std.math.maxInt(u32));
+        defer allocator.free(data);
+        if (data.len < HEADER_SIZE or !std.mem.eql(u8, data[0..8], MAGIC)) return error.InvalidCandidates;
+        if (readInt(u32, data, 8) != VERSION) return error.InvalidCandidates;
+
+        var set = Set.init(allocator);
+        errdefer set.deinit();
+        var offset = HEADER_SIZE;
+        for (0..readInt(u32, data, 12)) |_| {
+            if (data.len - offset < FILE_HEADER_SIZE) return error.InvalidCandidates;
+            const path_len = readInt(u32, data, offset);
+            const run_count = readInt(u32, data, offset + 4);
+            const size = readInt(u64, data, offset + 8);
+            const mtime: i64 = @bitCast(readInt(u64, data, offset + 16));
+            offset += FILE_HEADER_SIZE;
+            const runs_start = offset + std.mem.alignForward(usize, path_len, 8);
+            const runs_end = runs_start + @as(usize, run_count) * RUN_SIZE;
+            if (runs_end > data.len) return error.InvalidCandidates;
+
+            const owned_path = try allocator.dupe(u8, data[offset..][0..path_len]);
+            errdefer allocator.free(owned_path);
+            const runs = try allocator.alloc(Run, run_count);
+            errdefer allocator.free(runs);
+            for (runs, 0..) |*run, i| {
+                const r = data[runs_start + i * RUN_SIZE ..][0..RUN_SIZE];
+                run.* = .{
+                    .start = std.math.cast(usize, readInt(u64, r, 0)) orelse return error.InvalidCandidates,
+                    .end = std.math.cast(usize, readInt(u64, r, 8)) orelse return error.InvalidCandidates,
+                    .first_line = readInt(u64, r, 16),
+                };
+                if (run.start > run.end or run.end > size) return error.InvalidCandidates;
+            }
+            try set.put(.{ .path = owned_path, .size = size, .mtime = mtime, .runs = runs });
+            offset = runs_end;
+        }
+        return set;
+    }
+
+    fn write(self: *Set, dir: std.fs.Dir, path: []const u8) !void {
+        const allocator = self.allocator;
+        // In path order, whatever order the workers finished in
+        std.mem.sort(File, self.files.items, {}, struct {
+            fn lessThan(_: void, a: File, b: File) bool {
+                return std.mem.lessThan(u8, a.path, b.path);
+            }
+        }.lessThan);
+        for (self.files.items, 0..) |f, i| self.by_path.putAssumeCapacity(f.path, i);
+
+        var bytes: std.ArrayListUnmanaged(u8) = .{};
+        defer bytes.deinit(allocator);
+        var header = [_]u8{0} ** HEADER_SIZE;
+        @memcpy(header[0..8], MAGIC);
+        std.mem.writeInt(u32, header[8..12], VERSION, .little);
+        std.mem.writeInt(u32, header[12..16], @intCast(self.files.items.len), .little);
+        try bytes.appendSlice(allocator, &header);
+
+        for (self.files.items) |f| {
+            var fh: [FILE_HEADER_SIZE]u8 = undefined;
+            std.mem.writeInt(u32, fh[0..4], @intCast(f.path.len), .little);
+            std.mem.writeInt(u32, fh[4..8], @intCast(f.runs.len), .little);
+            std.mem.writeInt(u64, fh[8..16], f.size, .little);
+            std.mem.writeInt(u64, fh[16..24], @bitCast(f.mtime), .little);
+            try bytes.appendSlice(allocator, &fh);
+            try bytes.appendSlice(allocator, f.path);
+            try bytes.appendNTimes(allocator, 0, std.mem.alignForward(usize, f.path.len, 8) - f.path.len);
+            for (f.runs) |run| {
+                var r: [RUN_SIZE]u8 = undefined;
+                std.mem.writeInt(u64, r[0..8], run.start, .little);
+                std.mem.writeInt(u64, r[8..16], run.end, .little);
+                std.mem.writeInt(u64, r[16..24], run.first_line, .little);
+                try bytes.appendSlice(allocator, &r);
+            }
+        }
+
+        // Write to a temporary file and rename so readers never see a partial set
+        const tmp_path = try std.mem.concat(allocator, u8, &.{ path, ".tmp" });
+        defer allocator.free(tmp_path);
+        {
+            const out = try dir.createFile(tmp_path, .{});
+            defer out.close();
+            try out.writeAll(bytes.items);
+        }
+        try dir.rename(tmp_path, path);
+    }
+};
+
+/// IDs name files in the cache directory: letters, digits, '-', '_' and '.'
+/// (not leading), up to 64 bytes
+pub fn validId(id: []const u8) bool {
+    if (id.len == 0 or id.len > MAX_ID_LEN or id[0] == '.') return false;
+    for (id) |c| {
+        if (!std.ascii.isAlphanumeric(c) and c != '-' and c != '_' and c != '.') return false;
+    }
+    return true;
+}
+
+fn setPath(allocator: std.mem.Allocator, id: []const u8) ![]u8 {
+    if (!validId(id)) return error.InvalidCandidateId;
+    if (std.posix.getenv("XDG_CACHE_HOME")) |cache| {
+        if (cache.len > 0) return std.fs.path.join(allocator, &.{ cache, "grep", "candidates", id });
+    }
+    const home = std.posix.getenv("HOME") orelse return error.NoCacheDirectory;
+    return std.fs.path.join(allocator, &.{ home, ".cache", "grep", "candidates", id });
+}
+
+fn readInt(comptime T: type, bytes: []const u8, offset: usize) T {
+    return std.mem.readInt(T, bytes[offset..][0..@sizeOf(T)], .little);
+}
+
+fn truncateMtime(mtime: i128) i64 {
+    return @truncate(mtime);
+}
+
+test "candidates: selected lines round-trip as merged runs" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const data = "ok\nERROR a\nERROR b\nok\nERROR c";
+    const stat = std.fs.File.Stat{ .inode = 1, .size = data.len, .mode = 0, .kind = .file, .atime = 0, .mtime = 42, .ctime = 0 };
+    const matches = [_]gpu.MatchResult{
+        .{ .position = 22, .pattern_idx = 0, .match_len = 5, .line_start = 22, .line_num = 5 },
+        .{ .position = 3, .pattern_idx = 0, .match_len = 5, .line_start = 3, .line_num = 2 },
+        .{ .position = 11, .pattern_idx = 0, .match_len = 5, .line_start = 11, .line_num = 3 },
+        .{ .position = 17, .pattern_idx = 0, .match_len = 1, .line_start = 11, .line_num = 3 },
+    };
+    var set = Set.init(allocator);
+    defer set.deinit();
+    try set.add("logs/app.log", stat, data, '\n', &matches);
+    try set.add("logs/empty.log", stat, data, '\n', &.{});
+    try set.write(tmp.dir, "s1");
+
+    var loaded = try Set.read(allocator, tmp.dir, "s1");
+    defer loaded.deinit();
+    try std.testing.expectEqual(@as(usize, 1), loaded.files.items.len);
+    const file = loaded.get("logs/app.log").?;
+    try std.testing.expect(file.isFresh(data.len, 42));
+    try std.testing.expect(!file.isFresh(data.len + 1, 42));
+    try std.testing.expectEqual(@as(usize, 2), file.runs.len);
+    try std.testing.expectEqualStrings("ERROR a\nERROR b\n", data[file.runs[0].start..file.runs[0].end]);
+    try std.testing.expectEqual(@as(u64, 1), file.runs[0].first_line);
+    try std.testing.expectEqualStrings("ERROR c", data[file.runs[1].start..file.runs[1].end]);
+    try std.testing.expectEqual(@as(u64, 4), file.runs[1].first_line);
+
+    try std.testing.expect(validId("db-timeouts.2"));
+    try std.testing.expect(!validId("../x"));
+    try std.testing.expect(!validId(".hidden"));
+}
@@ -2,6 +2,11 @@ const std = @import("std");
 const gpu = @import("gpu");
 const regex = @import("regex");
 
+pub const MultiRegex = @import("multi_regex.zig").MultiRegex;
+const unicode_fold = @import("unicode_fold.zig");
+pub const isUnicodeLiteral = unicode_fold.isUnicodeLiteral;
+const long_literal = @import("long_literal.zig");
+
 const SearchOptions = gpu.SearchOptions;
 const SearchResult = gpu.SearchResult;
 const MatchResult = gpu.MatchResult;
@@ -13,14 +18,22 @@ const BoolVec16 = @Vector(16, bool);
 const BoolVec32 = @Vector(32, bool);
 
 // Constants for vectorized operations
-const NEWLINE_VEC16: Vec16 = @splat('\n');
-const NEWLINE_VEC32: Vec32 = @splat('\n');
 const UPPER_A_VEC16: Vec16 = @splat('A');
 const UPPER_Z_VEC16: Vec16 = @splat('Z');
 const CASE_DIFF_VEC16: Vec16 = @splat(32);
 
 /// CPU-based search using SIMD-optimized Boyer-Moore-Horspool algorithm
 pub fn search(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
+    // -i with a non-ASCII pattern needs Unicode case folding (handles -v too)
+    if (options.case_insensitive and unicode_fold.hasNonAscii(pattern)) {
+        return unicode_fold.search(text, pattern, options, allocator);
+    }
+
+    // Patterns past the BMH skip limit go to Two-Way (handles -v too)
+    if (long_literal.applies(pattern)) {
+        return searchLong(text, pattern, options, allocator);
+    }
+
     // Handle invert_match separately - find non-matching lines
     if (options.invert_match) {
         return searchInverted(text, pattern, options, allocator);
@@ -28,7 +41,7 @@ pub fn search(text: []const u8, pattern: []const u8, options: SearchOptions, all
 
     // Empty pattern matches all lines (GNU grep behavior)
     if (pattern.len == 0) {
-        return searchAllLines(text, allocator);
+        return searchAllLines(text, options.record_sep, allocator);
     }
 
     if (text.len < pattern.len) {
@@ -43,9 +56,9 @@ pub fn search(text: []const u8, pattern: []const u8, options: SearchOptions, all
     var pos: usize = 0;
     var total_matches: u64 = 0;
 
-    // Pre-compute lowercase pattern if case insensitive
-    var lower_pattern_buf: [1024]u8 = undefined;
-    const lower_pattern = if (options.case_insensitive and pattern.len <= 1024) blk: {
+    // Pre-compute lowercase pattern if case insensitive (long ones went to searchLong)
+    var lower_pattern_buf: [gpu.LONG_PATTERN_LEN]u8 = undefined;
+    const lower_pattern = if (options.case_insensitive) blk: {
         toLowerSlice(pattern, lower_pattern_buf[0..pattern.len]);
         break :blk lower_pattern_buf[0..pattern.len];
     } else pattern;
@@ -68,7 +81,7 @@ pub fn search(text: []const u8, pattern: []const u8, options: SearchOptions, all
                     .position = @intCast(pos),
                     .pattern_idx = 0,
                     .match_len = @intCast(pattern.len),
-                    .line_start = @intCast(findLineStartSIMD(text, pos)),
+                    .line_start = @intCast(findLineStartSIMD(text, pos, options.record_sep)),
                 });
                 total_matches += 1;
             }
@@ -86,6 +99,47 @@ pub fn search(text: []const u8, pattern: []const u8, options: SearchOptions, all
     return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
 }
 
+/// Two-Way search for patterns too long for BMH; with -v, emits the gaps
+/// between matching lines
+fn searchLong(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
+    var finder = try long_literal.Finder.init(allocator, pattern, options.case_insensitive);
+    defer finder.deinit(allocator);
+
+    var matches: std.ArrayListUnmanaged(MatchResult) = .{};
+    defer matches.deinit(allocator);
+
+    const eol = options.record_sep;
+    // For -v, the first byte not yet known to belong to a matching line
+    var cursor: usize = 0;
+
+    var from: usize = 0;
+    while (finder.find(text, from)) |pos| {
+        from = pos + finder.step();
+        if (options.word_boundary and !checkWordBoundary(text, pos, pos + pattern.len)) continue;
+
+        const line_start = findLineStartSIMD(text, pos, eol);
+        if (options.invert_match) {
+            try appendLines(&matches, allocator, text, cursor, line_start, eol);
+            cursor = @min(findNextNewlineSIMD(text, pos, eol) + 1, text.len);
+            from = @max(from, cursor);
+            continue;
+        }
+        try matches.append(allocator, MatchResult{
+            .position = @intCast(pos),
+            .pattern_idx = 0,
+            .match_len = @intCast(pattern.len),
+            .line_start = @intCast(line_start),
+        });
+    }
+    if (options.invert_match) {
+        try appendLines(&matches, allocator, text, cursor, text.len, eol);
+    }
+
+    const total_matches: u64 = matches.items.len;
+    const result = try matches.toOwnedSlice(allocator);
+    return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
+}
+
 /// SIMD-optimized pattern matching at a specific position
 inline fn matchAtPositionSIMD(text: []const u8, pos: usize, pattern: []const u8, case_insensitive: bool) bool {
     if (pos + pattern.len > text.len) return false;
@@ -151,9 +205,10 @@ inline fn toLowerSlice(src: []const u8, dst: []u8) void {
     }
 }
 
-/// SIMD-optimized line start finder
-fn findLineStartSIMD(text: []const u8, pos: usize) usize {
+/// SIMD-optimized line start finder; `eol` is the record terminator
+fn findLineStartSIMD(text: []const u8, pos: usize, eol: u8) usize {
     if (pos == 0) return 0;
+    const eol_vec: Vec16 = @splat(eol);
 
     var i = pos - 1;
 
@@ -161,14 +216,14 @@ fn findLineStartSIMD(text: []const u8, pos: usize) usize {
     while (i >= 16) {
         const start = i - 15;
         const chunk: Vec16 = text[start..][0..16].*;
-        const newlines = chunk == NEWLINE_VEC16;
+        const newlines = chunk == eol_vec;
 
         // Find the last newline in this chunk
         if (@reduce(.Or, newlines)) {
             // Find the rightmost newline
             var j: usize = 15;
             while (j < 16) : (j -%= 1) {
-                if (text[start + j] == '\n') {
+                if (text[start + j] == eol) {
                     return start + j + 1;
                 }
                 if (j == 0) break;
@@ -179,16 +234,17 @@ fn findLineStartSIMD(text: []const u8, pos: usize) usize {
 
     // Handle remaining bytes
     while (i > 0) {
-        if (text[i] == '\n') return i + 1;
+        if (text[i] == eol) return i + 1;
         i -= 1;
     }
 
-    if (text[0] == '\n') return 1;
+    if (text[0] == eol) return 1;
     return 0;
 }
 
 /// SIMD-optimized search for all lines (empty pattern)
-fn searchAllLines(text: []const u8, allocator: std.mem.Allocator) !SearchResult {
+fn searchAllLines(text: []const u8, eol: u8, allocator: std.mem.Allocator) !SearchResult {
+    const eol_vec: Vec32 = @splat(eol);
     var matches: std.ArrayListUnmanaged(MatchResult) = .{};
     defer matches.deinit(allocator);
 
@@ -199,13 +255,13 @@ fn searchAllLines(text: []const u8, allocator: std.mem.Allocator) !SearchResult
     var i: usize = 0;
     while (i + 32 <= text.len) {
         const chunk: Vec32 = text[i..][0..32].*;
-        const newlines = chunk == NEWLINE_VEC32;
+        const newlines = chunk == eol_vec;
 
         // Check if any newlines in this chunk
         if (@reduce(.Or, newlines)) {
             // Process byte by byte to find exact positions
             for (0..32) |j| {
-                if (text[i + j] == '\n') {
+                if (text[i + j] == eol) {
                     try matches.append(allocator, MatchResult{
                         .position = @intCast(line_start),
                         .pattern_idx = 0,
@@ -222,7 +278,7 @@ fn searchAllLines(text: []const u8, allocator: std.mem.Allocator) !SearchResult
 
     // Handle remaining bytes
     while (i < text.len) {
-        if (text[i] == '\n') {
+        if (text[i] == eol) {
             try matches.append(allocator, MatchResult{
                 .position = @intCast(line_start),
                 .pattern_idx = 0,
@@ -250,65 +306,71 @@ fn searchAllLines(text: []const u8, allocator: std.mem.Allocator) !SearchResult
     return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
 }
 
-/// Search for lines that don't contain the pattern (for -v/--invert-match)
+/// Search for lines that don't contain the pattern (for -v/--invert-match).
+/// Runs the forward matcher once over the whole buffer and emits the gaps
+/// between matching lines, instead of probing every line separately.
 fn searchInverted(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
+    // Empty pattern matches every line, so nothing survives the inversion
+    if (pattern.len == 0) {
+        return SearchResult{ .matches = &.{}, .total_matches = 0, .allocator = allocator };
+    }
+
     var matches: std.ArrayListUnmanaged(MatchResult) = .{};
     defer matches.deinit(allocator);
 
-    var total_matches: u64 = 0;
-
-    // Pre-compute lowercase pattern if case insensitive
-    var lower_pattern_buf: [1024]u8 = undefined;
-    const lower_pattern = if (options.case_insensitive and pattern.len <= 1024) blk: {
+    // Pre-compute lowercase pattern if case insensitive (long ones went to searchLong)
+    var lower_pattern_buf: [gpu.LONG_PATTERN_LEN]u8 = undefined;
+    const lower_pattern = if (options.case_insensitive) blk: {
         toLowerSlice(pattern, lower_pattern_buf[0..pattern.len]);
         break :blk lower_pattern_buf[0..pattern.len];
     } else pattern;
 
-    // Process line by line
-    var line_start: usize = 0;
-    while (line_start < text.len) {
-        // Find line end using SIMD
-        const line_end = findNextNewlineSIMD(text, line_start);
-        const line = text[line_start..line_end];
-
-        // Check if line contains pattern
-        const has_match = if (pattern.len == 0 or line.len < pattern.len)
-            false
-        else
-            lineContainsPatternSIMD(line, lower_pattern, options);
-
-        // For invert match, we want lines that DON'T have matches
-        if (!has_match) {
-            try matches.append(allocator, MatchResult{
-                .position = @intCast(line_start),
-                .pattern_idx = 0,
-                .match_len = @intCast(line.len),
-                .line_start = @intCast(line_start),
-            });
-            total_matches += 1;
-        }
+    const skip_table = gpu.buildSkipTable(pattern, options.case_insensitive);
+    const eol = options.record_sep;
 
-        // Move to next line
-        line_start = line_end + 1;
+    // `cursor` is the first byte not yet known to belong to a matching line
+    var cursor: usize = 0;
+    while (nextMatch(text, cursor, lower_pattern, &skip_table, options)) |hit| {
+        try appendLines(&matches, allocator, text, cursor, findLineStartSIMD(text, hit, eol), eol);
+        cursor = @min(findNextNewlineSIMD(text, hit, eol) + 1, text.len);
     }
+    try appendLines(&matches, allocator, text, cursor, text.len, eol);
 
+    const total_matches: u64 = matches.items.len;
     const result = try matches.toOwnedSlice(allocator);
     return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
 }
 
-/// SIMD-optimized newline finder
-fn findNextNewlineSIMD(text: []const u8, start: usize) usize {
+/// Append a whole-line result for every line in text[from..to]; `to` is a
+/// line start (or the end of the buffer)
+fn appendLines(matches: *std.ArrayListUnmanaged(MatchResult), allocator: std.mem.Allocator, text: []const u8, from: usize, to: usize, eol: u8) !void {
+    var line_start = from;
+    while (line_start < to) {
+        const line_end = findNextNewlineSIMD(text, line_start, eol);
+        try matches.append(allocator, MatchResult{
+            .position = @intCast(line_start),
+            .pattern_idx = 0,
+            .match_len = @intCast(line_end - line_start),
+            .line_start = @intCast(line_start),
+        });
+        line_start = line_end + 1;
+    }
+}
+
+/// SIMD-optimized newline finder; `eol` is the record terminator
+fn findNextNewlineSIMD(text: []const u8, start: usize, eol: u8) usize {
     var i = start;
+    const eol_vec: Vec32 = @splat(eol);
 
     // Search 32 bytes at a time
     while (i + 32 <= text.len) {
         const chunk: Vec32 = text[i..][0..32].*;
-        const newlines = chunk == NEWLINE_VEC32;
+        const newlines = chunk == eol_vec;
 
         if (@reduce(.Or, newlines)) {
             // Find the first newline
             for (0..32) |j| {
-                if (text[i + j] == '\n') return i + j;
+                if (text[i + j] == eol) return i + j;
             }
         }
         i += 32;
@@ -316,38 +378,31 @@ fn findNextNewlineSIMD(text: []const u8, start: usize) usize {
 
     // Handle remaining bytes
     while (i < text.len) {
-        if (text[i] == '\n') return i;
+        if (text[i] == eol) return i;
         i += 1;
     }
 
     return text.len;
 }
 
-/// SIMD-optimized check if a line contains the pattern
-fn lineContainsPatternSIMD(line: []const u8, pattern: []const u8, options: SearchOptions) bool {
-    if (line.len < pattern.len) return false;
-
-    const skip_table = gpu.buildSkipTable(pattern, options.case_insensitive);
-    var pos: usize = 0;
+/// Position of the next valid occurrence of `pattern` at or after `from`.
+/// `pattern` is already lowercased under -i.
+fn nextMatch(text: []const u8, from: usize, pattern: []const u8, skip_table: *const [256]u8, options: SearchOptions) ?usize {
+    var pos = from;
 
-    while (pos + pattern.len <= line.len) {
-        if (matchAtPositionSIMD(line, pos, pattern, options.case_insensitive)) {
-            var valid = true;
-            if (options.word_boundary) {
-                valid = checkWordBoundary(line, pos, pos + pattern.len);
-            }
-            if (valid) return true;
+    while (pos + pattern.len <= text.len) {
+        if (matchAtPositionSIMD(text, pos, pattern, options.case_insensitive)) {
+            if (!options.word_boundary or checkWordBoundary(text, pos, pos + pattern.len)) return pos;
         }
 
         const skip_char = if (options.case_insensitive)
-            toLowerChar(line[pos + pattern.len - 1])
+            toLowerChar(text[pos + pattern.len - 1])
         else
-            line[pos + pattern.len - 1];
-        const skip = skip_table[skip_char];
-        pos += @max(skip, 1);
+            text[pos + pattern.len - 1];
+        pos += @max(skip_table[skip_char], 1);
     }
 
-    return false;
+    return null;
 }
 
 fn checkWordBoundary(text: []const u8, start: usize, end: usize) bool {
@@ -362,144 +417,238 @@ inline fn isWordChar(c: u8) bool {
 
 /// CPU-based regex search using Thompson NFA
 /// Supports BRE (Basic Regular Expressions) and ERE (Extended Regular Expressions)
+/// Compiles the pattern for this call only; callers searching many inputs
+/// should hold a CompiledRegex instead.
 pub fn searchRegex(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
-    // Handle invert_match separately
-    if (options.invert_match) {
-        return searchRegexInverted(text, pattern, options, allocator);
+    var compiled = try CompiledRegex.init(allocator, pattern, options);
+    defer compiled.deinit();
+    return compiled.search(text, allocator);
+}
+
+/// A BRE/ERE pattern compiled once and reused across inputs. Patterns the
+/// regex engine rejects fall back to a literal search, as searchRegex always has.
+pub const CompiledRegex = struct {
+    pattern: []const u8,
+    options: SearchOptions,
+    compiled: ?regex.Regex = null, // null: empty pattern or literal fallback
+
+    pub fn init(allocator: std.mem.Allocator, pattern: []const u8, options: SearchOptions) !CompiledRegex {
+        var self = CompiledRegex{ .pattern = pattern, .options = options };
+        // Non-ASCII literals under -i go to the Unicode case-folding search,
+        // which applies -w and -x itself; under -x, even the empty pattern
+        // compiles (to `^$`)
+        if (isUnicodeLiteral(pattern, options)) return self;
+        if (!options.line_regexp and pattern.len == 0) return self;
+
+        // -w and -x become \b and anchors in the automaton (already ERE);
+        // otherwise convert a BRE pattern to ERE if needed
+        const ere_pattern = if (options.word_boundary or options.line_regexp)
+            try boundSource(allocator, pattern, options)
+        else if (!options.extended)
+            try convertBREtoERE(pattern, allocator)
+        else
+            null;
+        defer if (ere_pattern) |p| allocator.free(p);
+
+        // -U: `\n` in the pattern stands for the newline byte
+        const nl_pattern = if (options.multiline)
+            try translateNewlineEscapes(ere_pattern orelse pattern, allocator)
+        else
+            null;
+        defer if (nl_pattern) |p| allocator.free(p);
+
+        const actual_pattern = nl_pattern orelse ere_pattern orelse pattern;
+
+        // Compile the regex pattern
+        self.compiled = regex.Regex.compile(allocator, actual_pattern, .{
+            .case_insensitive = options.case_insensitive,
+            .extended = true, // Always use ERE internally after conversion
+            .multiline = true, // Enable multiline mode for ^ and $ to match at line boundaries
+        }) catch |err| blk: {
+            // If regex compilation fails, fall back to literal search
+            if (err == error.InvalidPattern or err == error.UnmatchedParen or err == error.UnmatchedBracket) {
+                break :blk null;
+            }
+            return err;
+        };
+        return self;
     }
 
-    // Empty pattern matches all lines (GNU grep behavior)
-    if (pattern.len == 0) {
-        return searchAllLines(text, allocator);
-    }
-
-    // Convert BRE pattern to ERE if needed
-    const ere_pattern = if (!options.extended)
-        try convertBREtoERE(pattern, allocator)
-    else
-        null;
-    defer if (ere_pattern) |p| allocator.free(p);
-
-    const actual_pattern = ere_pattern orelse pattern;
-
-    // Compile the regex pattern
-    var compiled = regex.Regex.compile(allocator, actual_pattern, .{
-        .case_insensitive = options.case_insensitive,
-        .extended = true, // Always use ERE internally after conversion
-        .multiline = true, // Enable multiline mode for ^ and $ to match at line boundaries
-    }) catch |err| {
-        // If regex compilation fails, fall back to literal search
-        if (err == error.InvalidPattern or err == error.UnmatchedParen or err == error.UnmatchedBracket) {
-            return search(text, pattern, .{
+    pub fn deinit(self: *CompiledRegex) void {
+        if (self.compiled) |*c| c.deinit();
+    }
+
+    pub fn search(self: *CompiledRegex, text: []const u8, allocator: std.mem.Allocator) !SearchResult {
+        const options = self.options;
+
+        // Empty pattern matches all lines (GNU grep behavior)
+        if (self.pattern.len == 0 and !options.line_regexp) {
+            return if (options.invert_match)
+                SearchResult{ .matches = &.{}, .total_matches = 0, .allocator = allocator }
+            else
+                searchAllLines(text, options.record_sep, allocator);
+        }
+
+        const compiled = if (self.compiled) |*c| c else {
+            return search(text, self.pattern, .{
                 .case_insensitive = options.case_insensitive,
                 .word_boundary = options.word_boundary,
+                .line_regexp = options.line_regexp,
                 .invert_match = options.invert_match,
                 .fixed_string = true,
+                .record_sep = options.record_sep,
             }, allocator);
+        };
+
+        // Handle invert_match separately
+        if (options.invert_match) {
+            return searchRegexInverted(text, compiled, options, allocator);
+        }
+
+        var matches: std.ArrayListUnmanaged(MatchResult) = .{};
+        defer matches.deinit(allocator);
+
+        var total_matches: u64 = 0;
+
+        // Find all matches
+        const all_matches = try compiled.findAll(text, allocator);
+        defer {
+            for (all_matches) |*m| m.deinit();
+            allocator.free(all_matches);
+        }
+
+        for (all_matches) |m| {
+            const line_start = findLineStartSIMD(text, m.start, options.record_sep);
+
+            try matches.append(allocator, MatchResult{
+                .position = @intCast(m.start),
+                .pattern_idx = 0,
+                .match_len = @intCast(m.end - m.start),
+                .line_start = @intCast(line_start),
+            });
+            total_matches += 1;
         }
-        return err;
-    };
-    defer compiled.deinit();
 
+        const result = try matches.toOwnedSlice(allocator);
+        return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
+    }
+};
+
+/// Search for lines that don't match the regex pattern (for -v/--invert-match).
+/// Uses the same whole-buffer findAll as the forward path and emits the gaps
+/// between matching lines.
+fn searchRegexInverted(text: []const u8, compiled: *regex.Regex, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
     var matches: std.ArrayListUnmanaged(MatchResult) = .{};
     defer matches.deinit(allocator);
 
-    var total_matches: u64 = 0;
-
-    // Find all matches
     const all_matches = try compiled.findAll(text, allocator);
     defer {
         for (all_matches) |*m| m.deinit();
         allocator.free(all_matches);
     }
 
+    const eol = options.record_sep;
+    var cursor: usize = 0;
     for (all_matches) |m| {
-        // Word boundary check if requested
-        if (options.word_boundary) {
-            if (!checkWordBoundary(text, m.start, m.end)) continue;
-        }
+        // Matches on a line already known to match add nothing
+        if (m.start < cursor) continue;
 
-        const line_start = findLineStartSIMD(text, m.start);
-
-        try matches.append(allocator, MatchResult{
-            .position = @intCast(m.start),
-            .pattern_idx = 0,
-            .match_len = @intCast(m.end - m.start),
-            .line_start = @intCast(line_start),
-        });
-        total_matches += 1;
+        try appendLines(&matches, allocator, text, cursor, findLineStartSIMD(text, m.start, eol), eol);
+        cursor = @min(findNextNewlineSIMD(text, m.start, eol) + 1, text.len);
     }
+    try appendLines(&matches, allocator, text, cursor, text.len, eol);
 
+    const total_matches: u64 = matches.items.len;
     const result = try matches.toOwnedSlice(allocator);
     return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
 }
 
-/// Search for lines that don't match the regex pattern (for -v/--invert-match)
-fn searchRegexInverted(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
-    var matches: std.ArrayListUnmanaged(MatchResult) = .{};
-    defer matches.deinit(allocator);
+/// ERE (or, with -P, PCRE) source with -w and -x compiled in: the pattern,
+/// escaped if fixed and converted if BRE, is grouped between `^` and `$`,
+/// or for -w between `(?<!\w)` and `(?!\w)`, so the automaton tries every
+/// alternative under the assertions instead of rejecting its first match.
+/// -w asserts that no word character touches the match, as GNU grep does,
+/// rather than `\b`'s word/non-word transition, which would reject `-v` in
+/// "use -v now". Backreferences are renumbered past the added group.
+pub fn boundSource(allocator: std.mem.Allocator, pattern: []const u8, options: SearchOptions) ![]u8 {
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    errdefer out.deinit(allocator);
+
+    // An empty pattern under -x selects empty lines
+    if (pattern.len == 0) {
+        if (options.line_regexp) try out.appendSlice(allocator, "^$");
+        return out.toOwnedSlice(allocator);
+    }
 
-    var total_matches: u64 = 0;
+    const open: []const u8 = if (options.line_regexp) "^(" else "(?<!\\w)(";
+    const close: []const u8 = if (options.line_regexp) ")$" else ")(?!\\w)";
+    try out.appendSlice(allocator, open);
+    if (options.perl) try out.appendSlice(allocator, "?:");
 
-    // Convert BRE pattern to ERE if needed
-    const ere_pattern = if (!options.extended)
-        try convertBREtoERE(pattern, allocator)
-    else
-        null;
-    defer if (ere_pattern) |p| allocator.free(p);
-
-    const actual_pattern = ere_pattern orelse pattern;
-
-    // Compile the regex pattern
-    var compiled = regex.Regex.compile(allocator, actual_pattern, .{
-        .case_insensitive = options.case_insensitive,
-        .extended = true,
-        .multiline = true, // Enable multiline mode for ^ and $ to match at line boundaries
-    }) catch |err| {
-        // If regex compilation fails, fall back to literal search
-        if (err == error.InvalidPattern or err == error.UnmatchedParen or err == error.UnmatchedBracket) {
-            return searchInverted(text, pattern, .{
-                .case_insensitive = options.case_insensitive,
-                .word_boundary = options.word_boundary,
-                .invert_match = true,
-                .fixed_string = true,
-            }, allocator);
+    if (options.fixed_string) {
+        for (pattern) |c| {
+            if (std.mem.indexOfScalar(u8, "\\.[]()*+?{}|^$", c) != null) try out.append(allocator, '\\');
+            try out.append(allocator, c);
         }
-        return err;
-    };
-    defer compiled.deinit();
+    } else {
+        const ere = if (!options.extended and !options.perl) try convertBREtoERE(pattern, allocator) else null;
+        defer if (ere) |e| allocator.free(e);
+        const src = ere orelse pattern;
+
+        var i: usize = 0;
+        while (i < src.len) : (i += 1) {
+            if (src[i] == '\\' and i + 1 < src.len) {
+                const next = src[i + 1];
+                try out.append(allocator, '\\');
+                // \1..\8 shift to \2..\9; PCRE's group is non-capturing
+                try out.append(allocator, if (!options.perl and next >= '1' and next <= '8') next + 1 else next);
+                i += 1;
+            } else {
+                try out.append(allocator, src[i]);
+            }
+        }
+    }
 
-    // Process line by line
-    var line_start: usize = 0;
-    while (line_start < text.len) {
-        const line_end = findNextNewlineSIMD(text, line_start);
-        const line = text[line_start..line_end];
+    try out.appendSlice(allocator, close);
+    return out.toOwnedSlice(allocator);
+}
 
-        // Check if line matches pattern
-        const has_match = compiled.isMatch(line);
+/// Options for a pattern rewritten by boundSource
+pub fn boundOptions(options: SearchOptions) SearchOptions {
+    var bound = options;
+    bound.word_boundary = false;
+    bound.line_regexp = false;
+    bound.fixed_string = false;
+    bound.extended = !options.perl;
+    return bound;
+}
 
-        // For invert match, we want lines that DON'T have matches
-        if (!has_match) {
-            try matches.append(allocator, MatchResult{
-                .position = @intCast(line_start),
-                .pattern_idx = 0,
-                .match_len = @intCast(line.len),
-                .line_start = @intCast(line_start),
-            });
-            total_matches += 1;
-        }
+/// Replace each `\n` escape in an ERE with a literal newline byte, leaving
+/// other escapes (including an escaped backslash before `n`) untouched
+fn translateNewlineEscapes(pattern: []const u8, allocator: std.mem.Allocator) ![]u8 {
+    var result: std.ArrayListUnmanaged(u8) = .{};
+    defer result.deinit(allocator);
 
-        line_start = line_end + 1;
+    var i: usize = 0;
+    while (i < pattern.len) : (i += 1) {
+        if (pattern[i] == '\\' and i + 1 < pattern.len) {
+            if (pattern[i + 1] == 'n') {
+                try result.append(allocator, '\n');
+            } else {
+                try result.appendSlice(allocator, pattern[i .. i + 2]);
+            }
+            i += 1;
+        } else {
+            try result.append(allocator, pattern[i]);
+        }
     }
-
-    const result = try matches.toOwnedSlice(allocator);
-    return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
+    return result.toOwnedSlice(allocator);
 }
 
 /// Convert BRE (Basic Regular Expression) pattern to ERE (Extended Regular Expression)
 /// In BRE: \+ \? \| \( \) \{ \} are special, unescaped versions are literal
 /// In ERE: + ? | ( ) { } are special, escaped versions are literal
-fn convertBREtoERE(bre_pattern: []const u8, allocator: std.mem.Allocator) ![]u8 {
+pub fn convertBREtoERE(bre_pattern: []const u8, allocator: std.mem.Allocator) ![]u8 {
     var result: std.ArrayListUnmanaged(u8) = .{};
     defer result.deinit(allocator);
 
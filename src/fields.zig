@@ -0,0 +1,267 @@
+const std = @import("std");
+const gpu = @import("gpu");
+
+// ============================================================================
+// Field-restricted search (--field-sep, --fields, --csv)
+//
+// The selected fields of every record are gathered into one buffer, each
+// ended by the record terminator, so the engines see one field per line: a
+// pattern cannot match across a separator, and ^/$ anchor to the field.
+// Matches are then mapped back onto the records they came from. Field
+// boundaries are found with 32-byte vector compares against the separator,
+// the terminator and, for CSV, the quote character.
+// ============================================================================
+
+/// Upper bound on comma-separated items in a --fields list
+pub const MAX_RANGES = 32;
+
+/// 1-based inclusive field range; an open range ("4-") ends at maxInt
+pub const Range = struct { first: u32, last: u32 };
+
+pub const Selector = struct {
+    sep: u8 = '\t',
+    quoted: bool = false, // --csv: separators inside "..." do not split a field
+    ranges: [MAX_RANGES]Range = undefined,
+    num_ranges: usize = 0,
+
+    /// Parse a cut(1)-style list such as "7", "1,3-5" or "4-"
+    pub fn parseList(self: *Selector, list: []const u8) !void {
+        self.num_ranges = 0;
+        var items = std.mem.splitScalar(u8, list, ',');
+        while (items.next()) |item| {
+            if (item.len == 0) return error.InvalidFieldList;
+            if (self.num_ranges == MAX_RANGES) return error.InvalidFieldList;
+            var range: Range = undefined;
+            if (std.mem.indexOfScalar(u8, item, '-')) |dash| {
+                range.first = if (dash == 0) 1 else try parseField(item[0..dash]);
+                range.last = if (dash + 1 == item.len) std.math.maxInt(u32) else try parseField(item[dash + 1 ..]);
+            } else {
+                range.first = try parseField(item);
+                range.last = range.first;
+            }
+            if (range.first > range.last) return error.InvalidFieldList;
+            self.ranges[self.num_ranges] = range;
+            self.num_ranges += 1;
+        }
+        if (self.num_ranges == 0) return error.InvalidFieldList;
+    }
+
+    fn parseField(digits: []const u8) !u32 {
+        const n = std.fmt.parseInt(u32, digits, 10) catch return error.InvalidFieldList;
+        if (n == 0) return error.InvalidFieldList;
+        return n;
+    }
+
+    fn selects(self: *const Selector, field: u32) bool {
+        for (self.ranges[0..self.num_ranges]) |r| {
+            if (field >= r.first and field <= r.last) return true;
+        }
+        return false;
+    }
+};
+
+/// The selected fields of one input, gathered for the engines
+pub const Extract = struct {
+    buffer: []u8, // selected fields, each followed by the terminator
+    segments: []Segment, // one per field in `buffer`, in order
+    allocator: std.mem.Allocator,
+
+    const Segment = struct {
+        buf: u32, // offset in `buffer`
+        src: u32, // offset of the same bytes in the input
+        len: u32,
+        record: u32, // start of the input record holding the field
+    };
+
+    pub fn init(allocator: std.mem.Allocator, text: []const u8, eol: u8, selector: *const Selector) !Extract {
+        var scan = Scanner{ .text = text, .eol = eol, .selector = selector, .allocator = allocator };
+        errdefer scan.buffer.deinit(allocator);
+        errdefer scan.segments.deinit(allocator);
+        try scan.run();
+        return .{
+            .buffer = try scan.buffer.toOwnedSlice(allocator),
+            .segments = try scan.segments.toOwnedSlice(allocator),
+            .allocator = allocator,
+        };
+    }
+
+    pub fn deinit(self: *Extract) void {
+        self.allocator.free(self.buffer);
+        self.allocator.free(self.segments);
+    }
+
+    /// Map engine results over `buffer` back onto `text`. With `invert`,
+    /// the result is every record in which no selected field matched.
+    pub fn mapBack(self: *const Extract, allocator: std.mem.Allocator, text: []const u8, eol: u8, found: gpu.SearchResult, invert: bool) !gpu.SearchResult {
+        var matches: std.ArrayListUnmanaged(gpu.MatchResult) = .{};
+        defer matches.deinit(allocator);
+
+        if (!invert) {
+            for (found.matches) |m| {
+                const seg = self.segments[self.segmentOf(m.position)];
+                const offset = m.position - seg.buf;
+                try matches.append(allocator, .{
+                    .position = seg.src + offset,
+                    .pattern_idx = m.pattern_idx,
+                    .match_len = @min(m.match_len, seg.len -| offset),
+                    .line_start = seg.record,
+                });
+            }
+            const result = try matches.toOwnedSlice(allocator);
+            return .{ .matches = result, .total_matches = found.total_matches, .allocator = allocator };
+        }
+
+        // Walk the records alongside the (ordered) hit records
+        var next: usize = 0;
+        var record: usize = 0;
+        while (record < text.len) {
+            const record_end = std.mem.indexOfScalarPos(u8, text, record, eol) orelse text.len;
+            var hit = false;
+            while (next < found.matches.len) {
+                const seg_record = self.segments[self.segmentOf(found.matches[next].position)].record;
+                if (seg_record > record) break;
+                if (seg_record == record) hit = true;
+                next += 1;
+            }
+            if (!hit) {
+                try matches.append(allocator, .{
+                    .position = @intCast(record),
+                    .pattern_idx = 0,
+                    .match_len = @intCast(record_end - record),
+                    .line_start = @intCast(record),
+                });
+            }
+            record = record_end + 1;
+        }
+        const result = try matches.toOwnedSlice(allocator);
+        return .{ .matches = result, .total_matches = result.len, .allocator = allocator };
+    }
+
+    fn segmentOf(self: *const Extract, pos: u32) usize {
+        var lo: usize = 0;
+        var hi: usize = self.segments.len;
+        while (lo + 1 < hi) {
+            const mid = (lo + hi) / 2;
+            if (self.segments[mid].buf <= pos) lo = mid else hi = mid;
+        }
+        return lo;
+    }
+};
+
+/// Splits records into fields and copies out the selected ones
+const Scanner = struct {
+    text: []const u8,
+    eol: u8,
+    selector: *const Selector,
+    allocator: std.mem.Allocator,
+    buffer: std.ArrayListUnmanaged(u8) = .{},
+    segments: std.ArrayListUnmanaged(Extract.Segment) = .{},
+    record: usize = 0,
+    field: u32 = 1,
+    field_start: usize = 0,
+    in_quotes: bool = false,
+
+    const Vec32 = @Vector(32, u8);
+
+    fn run(self: *Scanner) !void {
+        const text = self.text;
+        const sep_vec: Vec32 = @splat(self.selector.sep);
+        const eol_vec: Vec32 = @splat(self.eol);
+        const quote_vec: Vec32 = @splat('"');
+
+        var i: usize = 0;
+        while (i + 32 <= text.len) : (i += 32) {
+            const chunk: Vec32 = text[i..][0..32].*;
+            var mask: u32 = @as(u32, @bitCast(chunk == sep_vec)) | @as(u32, @bitCast(chunk == eol_vec));
+            if (self.selector.quoted) mask |= @as(u32, @bitCast(chunk == quote_vec));
+            while (mask != 0) : (mask &= mask - 1) {
+                try self.special(i + @ctz(mask));
+            }
+        }
+        while (i < text.len) : (i += 1) {
+            const c = text[i];
+            if (c == self.selector.sep or c == self.eol or (self.selector.quoted and c == '"')) try self.special(i);
+        }
+        // Last record without a terminator
+        if (self.record < text.len) try self.endField(text.len);
+    }
+
+    /// Handle a separator, terminator or quote at `pos`
+    fn special(self: *Scanner, pos: usize) !void {
+        const c = self.text[pos];
+        if (self.selector.quoted and c == '"') {
+            self.in_quotes = !self.in_quotes; // "" inside a quoted field toggles twice
+        } else if (c == self.eol) {
+            try self.endField(pos);
+            self.record = pos + 1;
+            self.field = 1;
+            self.field_start = pos + 1;
+            self.in_quotes = false; // quoted fields do not span records
+        } else if (!self.in_quotes) {
+            try self.endField(pos);
+            self.field += 1;
+            self.field_start = pos + 1;
+        }
+    }
+
+    fn endField(self: *Scanner, end: usize) !void {
+        if (!self.selector.selects(self.field)) return;
+        var start = self.field_start;
+        var stop = end;
+        if (self.selector.quoted and stop - start >= 2 and self.text[start] == '"' and self.text[stop - 1] == '"') {
+            start += 1;
+            stop -= 1;
+        }
+        try self.segments.append(self.allocator, .{
+            .buf = @intCast(self.buffer.items.len),
+            .src = @intCast(start),
+            .len = @intCast(stop - start),
+            .record = @intCast(self.record),
+        });
+        try self.buffer.appendSlice(self.allocator, self.text[start..stop]);
+        try self.buffer.append(self.allocator, self.eol);
+    }
+};
+
+test "fields: parse field lists" {
+    var sel = Selector{};
+    try sel.parseList("2,4-5,9-");
+    try std.testing.expect(!sel.selects(1));
+    try std.testing.expect(sel.selects(2));
+    try std.testing.expect(sel.selects(5));
+    try std.testing.expect(!sel.selects(6));
+    try std.testing.expect(sel.selects(1000));
+    try std.testing.expectError(error.InvalidFieldList, sel.parseList("0"));
+    try std.testing.expectError(error.InvalidFieldList, sel.parseList("3,,4"));
+    try std.testing.expectError(error.InvalidFieldList, sel.parseList("5-2"));
+}
+
+test "fields: csv columns map back to records" {
+    const allocator = std.testing.allocator;
+    const text =
+        \\id,name,status
+        \\1,"Smith, ERROR",ok
+        \\2,Jones,ERROR
+        \\
+    ;
+    var sel = Selector{ .sep = ',', .quoted = true };
+    try sel.parseList("3");
+    var extract = try Extract.init(allocator, text, '\n', &sel);
+    defer extract.deinit();
+    try std.testing.expectEqualStrings("status\nok\nERROR\n", extract.buffer);
+
+    // "ERROR" in column 3 only: the quoted comma in column 2 does not split it
+    const at: u32 = @intCast(std.mem.indexOf(u8, extract.buffer, "ERROR").?);
+    var hits = [_]gpu.MatchResult{.{ .position = at, .pattern_idx = 0, .match_len = 5, .line_start = at }};
+    const found = gpu.SearchResult{ .matches = &hits, .total_matches = 1, .allocator = allocator };
+
+    var result = try extract.mapBack(allocator, text, '\n', found, false);
+    defer result.deinit();
+    const jones = std.mem.indexOf(u8, text, "2,Jones").?;
+    try std.testing.expectEqual(@as(u32, @intCast(jones)), result.matches[0].line_start);
+    try std.testing.expectEqualStrings("ERROR", text[result.matches[0].position..][0..5]);
+
+    var others = try extract.mapBack(allocator, text, '\n', found, true);
+    defer others.deinit();
+    try std.testing.expectEqual(@as(usize, 2), others.matches.len);
+}
@@ -29,6 +29,59 @@ pub const MetalSearcher = struct {
 
     const Self = @This();
 
+    /// PassConfig in search.metal, one per ordered pass
+    const PassConfig = extern struct {
+        pass: u32,
+        num_groups: u32,
+        _pad1: u32 = 0,
+        _pad2: u32 = 0,
+    };
+
+    const NUM_PASSES = std.enums.values(mod.ResultPass).len;
+
+    /// Fill `pass_buffer` with a PassConfig per pass for `num_threads`
+    /// threads; each is bound at its own offset for its dispatch
+    fn setPassGroups(self: *Self, pass_buffer: anytype, num_threads: usize) void {
+        const group = @min(self.threads_per_group, num_threads);
+        const configs: *[NUM_PASSES]PassConfig = @ptrCast(@alignCast(pass_buffer.contents()));
+        for (configs, 0..) |*config, i| {
+            config.* = .{ .pass = @intCast(i), .num_groups = @intCast((num_threads + group - 1) / group) };
+        }
+    }
+
+    /// Encode the count, scan and write dispatches of an ordered search; the
+    /// encoder's other buffers are already bound. Dispatches of one encoder
+    /// run in order, each seeing the previous one's writes.
+    fn encodeOrderedPasses(self: *Self, encoder: anytype, pass_buffer: anytype, pass_index: usize, num_threads: usize) void {
+        const group = @min(self.threads_per_group, num_threads);
+        for ([_]mod.ResultPass{ .count, .scan, .write }) |pass| {
+            encoder.setBufferOffsetAtIndex(pass_buffer, @intFromEnum(pass) * @sizeOf(PassConfig), pass_index);
+            const width = if (pass == .scan) group else num_threads;
+            encoder.dispatchThreadsThreadsPerThreadgroup(
+                mtl.MTLSize{ .width = width, .height = 1, .depth = 1 },
+                mtl.MTLSize{ .width = group, .height = 1, .depth = 1 },
+            );
+        }
+    }
+
+    /// Encode the single dispatch of a lines_only search, or the ordered
+    /// passes otherwise
+    fn encodePasses(self: *Self, encoder: anytype, pass_buffer: anytype, pass_index: usize, num_threads: usize, lines_only: bool) void {
+        if (!lines_only) return self.encodeOrderedPasses(encoder, pass_buffer, pass_index, num_threads);
+        const group = @min(self.threads_per_group, num_threads);
+        encoder.setBufferOffsetAtIndex(pass_buffer, @intFromEnum(mod.ResultPass.lines) * @sizeOf(PassConfig), pass_index);
+        encoder.dispatchThreadsThreadsPerThreadgroup(
+            mtl.MTLSize{ .width = num_threads, .height = 1, .depth = 1 },
+            mtl.MTLSize{ .width = group, .height = 1, .depth = 1 },
+        );
+    }
+
+    /// Selected lines of a lines_only search from its bitmap
+    fn readLineBitmap(text: []const u8, bitmap: anytype, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
+        const bits: [*]const u32 = @ptrCast(@alignCast(bitmap.contents()));
+        return mod.linesFromBitmap(text, bits[0..mod.lineBitmapWords(text.len)], options.invert_match, allocator);
+    }
+
     pub fn init(allocator: std.mem.Allocator) !*Self {
         const device = mtl.createSystemDefaultDevice() orelse return error.NoMetalDevice;
         errdefer device.release();
@@ -106,7 +159,7 @@ pub const MetalSearcher = struct {
     }
 
     pub fn search(self: *Self, text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
-        if (pattern.len == 0 or pattern.len > mod.MAX_PATTERN_LEN) {
+        if (pattern.len == 0) {
             return error.InvalidPatternLength;
         }
         if (text.len > MAX_GPU_BUFFER_SIZE) {
@@ -142,8 +195,8 @@ pub const MetalSearcher = struct {
         var config_buffer = self.device.newBufferWithLengthOptions(@sizeOf(SearchConfig), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
         defer config_buffer.release();
 
-        // Create results buffer
-        const results_size = @sizeOf(MatchResult) * MAX_RESULTS;
+        // Create results buffer; a lines_only search reads back its line bitmap instead
+        const results_size = @sizeOf(MatchResult) * (if (options.lines_only) 1 else MAX_RESULTS);
         var results_buffer = self.device.newBufferWithLengthOptions(results_size, mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
         defer results_buffer.release();
 
@@ -161,6 +214,20 @@ pub const MetalSearcher = struct {
         const chunk_size: u32 = @intCast(@max(64, (text.len + MAX_THREADS - 1) / MAX_THREADS));
         const num_threads = @min(MAX_THREADS, (text.len + chunk_size - 1) / chunk_size);
 
+        // Offsets of the ordered passes: per thread within its group, per group
+        var thread_offsets_buffer = self.device.newBufferWithLengthOptions(@max(num_threads, 1) * @sizeOf(u32), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer thread_offsets_buffer.release();
+        var group_offsets_buffer = self.device.newBufferWithLengthOptions(@max(num_threads, 1) * @sizeOf(u32), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer group_offsets_buffer.release();
+        var pass_buffer = self.device.newBufferWithLengthOptions(NUM_PASSES * @sizeOf(PassConfig), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer pass_buffer.release();
+        self.setPassGroups(&pass_buffer, num_threads);
+        // Line bitmap of a lines_only search; a placeholder word otherwise
+        const bitmap_words = if (options.lines_only) mod.lineBitmapWords(text.len) else 1;
+        var line_bits_buffer = self.device.newBufferWithLengthOptions(bitmap_words * @sizeOf(u32), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer line_bits_buffer.release();
+        if (line_bits_buffer.contents()) |ptr| @memset(@as([*]u32, @ptrCast(@alignCast(ptr)))[0..bitmap_words], 0);
+
         // Set up config with calculated chunk size
         if (config_buffer.contents()) |ptr| {
             const config_ptr: *SearchConfig = @ptrCast(@alignCast(ptr));
@@ -171,6 +238,7 @@ pub const MetalSearcher = struct {
                 .flags = options.toFlags(),
                 .positions_per_thread = chunk_size,
                 .batch_offset = 0,
+                .probe_offset = mod.probeOffset(pattern),
             };
         }
 
@@ -185,15 +253,17 @@ pub const MetalSearcher = struct {
         encoder.setBufferOffsetAtIndex(results_buffer, 0, 4);
         encoder.setBufferOffsetAtIndex(counters_buffer, 0, 5);
         encoder.setBufferOffsetAtIndex(counters_buffer, 4, 6);
+        encoder.setBufferOffsetAtIndex(thread_offsets_buffer, 0, 7);
+        encoder.setBufferOffsetAtIndex(group_offsets_buffer, 0, 8);
+        encoder.setBufferOffsetAtIndex(line_bits_buffer, 0, 10);
 
-        const grid_size = mtl.MTLSize{ .width = num_threads, .height = 1, .depth = 1 };
-        const threadgroup_size = mtl.MTLSize{ .width = @min(self.threads_per_group, num_threads), .height = 1, .depth = 1 };
-
-        encoder.dispatchThreadsThreadsPerThreadgroup(grid_size, threadgroup_size);
+        self.encodePasses(&encoder, pass_buffer, 9, num_threads, options.lines_only);
         encoder.endEncoding();
         cmd_buffer.commit();
         cmd_buffer.waitUntilCompleted();
 
+        if (options.lines_only) return readLineBitmap(text, line_bits_buffer, options, allocator);
+
         const result_count = counters_ptr[0];
         const total_matches = counters_ptr[1];
 
@@ -217,6 +287,8 @@ pub const MetalSearcher = struct {
             .case_insensitive = options.case_insensitive,
         }, allocator);
         defer gpu_regex.deinit();
+        // The shared Metal NFA has no -w edge assertions; the CPU runs these
+        if (gpu_regex.hasWordAssertions()) return error.UnsupportedPattern;
 
         // Find line boundaries
         var line_offsets: std.ArrayListUnmanaged(u32) = .{};
@@ -298,8 +370,8 @@ pub const MetalSearcher = struct {
             @as(*mod.RegexHeader, @ptrCast(@alignCast(ptr))).* = gpu_regex.header;
         }
 
-        // Create results buffer
-        const results_size = @sizeOf(RegexMatchResult) * MAX_RESULTS;
+        // Create results buffer; a lines_only search reads back its line bitmap instead
+        const results_size = @sizeOf(RegexMatchResult) * (if (options.lines_only) 1 else MAX_RESULTS);
         var results_buffer = self.device.newBufferWithLengthOptions(results_size, mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
         defer results_buffer.release();
 
@@ -327,6 +399,21 @@ pub const MetalSearcher = struct {
         const MAX_GRID_WIDTH: usize = 65536;
         var batch_start: usize = 0;
 
+        // Offsets of the ordered passes, reused by every batch; each batch's
+        // results follow the previous batch's in the results buffer
+        const max_batch = @min(MAX_GRID_WIDTH, num_lines);
+        var thread_offsets_buffer = self.device.newBufferWithLengthOptions(max_batch * @sizeOf(u32), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer thread_offsets_buffer.release();
+        var group_offsets_buffer = self.device.newBufferWithLengthOptions(max_batch * @sizeOf(u32), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer group_offsets_buffer.release();
+        var pass_buffer = self.device.newBufferWithLengthOptions(NUM_PASSES * @sizeOf(PassConfig), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer pass_buffer.release();
+        // Line bitmap of a lines_only search; a placeholder word otherwise
+        const bitmap_words = if (options.lines_only) mod.lineBitmapWords(text.len) else 1;
+        var line_bits_buffer = self.device.newBufferWithLengthOptions(bitmap_words * @sizeOf(u32), mtl.MTLResourceOptions.MTLResourceCPUCacheModeDefaultCache) orelse return error.BufferCreationFailed;
+        defer line_bits_buffer.release();
+        if (line_bits_buffer.contents()) |ptr| @memset(@as([*]u32, @ptrCast(@alignCast(ptr)))[0..bitmap_words], 0);
+
         while (batch_start < num_lines) {
             const batch_size = @min(MAX_GRID_WIDTH, num_lines - batch_start);
 
@@ -351,11 +438,12 @@ pub const MetalSearcher = struct {
             // Offset into line arrays for this batch
             encoder.setBufferOffsetAtIndex(line_offsets_buffer, batch_start * @sizeOf(u32), 8);
             encoder.setBufferOffsetAtIndex(line_lengths_buffer, batch_start * @sizeOf(u32), 9);
+            encoder.setBufferOffsetAtIndex(thread_offsets_buffer, 0, 10);
+            encoder.setBufferOffsetAtIndex(group_offsets_buffer, 0, 11);
+            encoder.setBufferOffsetAtIndex(line_bits_buffer, 0, 13);
 
-            const grid_size = mtl.MTLSize{ .width = batch_size, .height = 1, .depth = 1 };
-            const threadgroup_size = mtl.MTLSize{ .width = @min(self.threads_per_group, batch_size), .height = 1, .depth = 1 };
-
-            encoder.dispatchThreadsThreadsPerThreadgroup(grid_size, threadgroup_size);
+            self.setPassGroups(&pass_buffer, batch_size);
+            self.encodePasses(&encoder, pass_buffer, 12, batch_size, options.lines_only);
             encoder.endEncoding();
             cmd_buffer.commit();
             cmd_buffer.waitUntilCompleted();
@@ -363,6 +451,8 @@ pub const MetalSearcher = struct {
             batch_start += batch_size;
         }
 
+        if (options.lines_only) return readLineBitmap(text, line_bits_buffer, options, allocator);
+
         const result_count = counters_ptr[0];
         const total_matches = counters_ptr[1];
 
@@ -21,7 +21,9 @@ pub const regex_compiler = @import("regex_compiler.zig");
 pub const BATCH_SIZE: usize = 1024 * 1024;
 pub const MAX_GPU_BUFFER_SIZE: usize = 64 * 1024 * 1024;
 pub const MIN_GPU_SIZE: usize = 128 * 1024;
-pub const MAX_PATTERN_LEN: u32 = 256;
+/// Patterns longer than this outgrow the u8 BMH skip table: the CPU
+/// switches to Two-Way, and the GPU kernels probe the rarest byte first
+pub const LONG_PATTERN_LEN: usize = 255;
 pub const MAX_RESULTS: u32 = 1000000;
 
 pub const EMBEDDED_METAL_SHADER = if (build_options.is_macos) @import("metal_shader").EMBEDDED_METAL_SHADER else "";
@@ -34,10 +36,23 @@ pub const SearchConfig = extern struct {
     flags: u32,
     positions_per_thread: u32,
     batch_offset: u32 = 0,
-    _pad2: u32 = 0,
+    probe_offset: u32 = 0, // pattern byte compared before a full match (probeOffset)
     _pad3: u32 = 0,
 };
 
+/// Dispatches of an ordered search: count matches per thread and scan them
+/// per workgroup, scan the workgroup totals into offsets, then write each
+/// thread's matches at its offset. Results come back sorted by position.
+pub const ResultPass = enum(u32) {
+    count = 0,
+    scan = 1,
+    write = 2,
+    lines = 3, // mark matching lines in the line bitmap instead (lines_only)
+};
+
+/// Threads per workgroup of the ordered passes (local_size_x in the shaders)
+pub const PASS_GROUP_SIZE: usize = 64;
+
 pub const SearchFlags = struct {
     pub const CASE_INSENSITIVE: u32 = 1;
     pub const WORD_BOUNDARY: u32 = 2;
@@ -59,16 +74,21 @@ pub const MatchResult = extern struct {
 pub const SearchOptions = struct {
     case_insensitive: bool = false,
     word_boundary: bool = false,
+    line_regexp: bool = false, // -x: the pattern must match a whole line
     invert_match: bool = false,
     fixed_string: bool = true,
     extended: bool = false, // ERE mode (-E), when false uses BRE (-G)
     perl: bool = false, // PCRE mode (-P) for Perl-compatible regex
+    record_sep: u8 = '\n', // record terminator: '\n', or 0 for -z (CPU engines only)
+    multiline: bool = false, // -U: matches may cross line ends (CPU engines only)
+    lines_only: bool = false, // report which lines match, not where (GPU engines only)
 
     pub fn toFlags(self: SearchOptions) u32 {
         var flags: u32 = 0;
         if (self.case_insensitive) flags |= SearchFlags.CASE_INSENSITIVE;
         if (self.word_boundary) flags |= SearchFlags.WORD_BOUNDARY;
-        if (self.invert_match) flags |= SearchFlags.INVERT_MATCH;
+        // A line bitmap is inverted on the host
+        if (self.invert_match and !self.lines_only) flags |= SearchFlags.INVERT_MATCH;
         if (self.fixed_string) flags |= SearchFlags.FIXED_STRING;
         return flags;
     }
@@ -84,6 +104,58 @@ pub const SearchResult = struct {
     }
 };
 
+/// Words of a line bitmap over `text_len` bytes: bit i is set by the
+/// lines_only pass when the line starting at byte i matches
+pub fn lineBitmapWords(text_len: usize) usize {
+    return @max(1, (text_len + 31) / 32);
+}
+
+/// Turn a line bitmap read back from the GPU into one whole-line result per
+/// selected line; under `invert` the lines whose start bit is clear are
+/// selected. Set bits are found a word at a time, so sparse bitmaps cost
+/// little beyond the line ends of the lines they name.
+pub fn linesFromBitmap(text: []const u8, bits: []const u32, invert: bool, allocator: std.mem.Allocator) !SearchResult {
+    var lines: std.ArrayListUnmanaged(MatchResult) = .{};
+    errdefer lines.deinit(allocator);
+
+    if (invert) {
+        var start: usize = 0;
+        var line_num: u32 = 1;
+        while (start < text.len) : (line_num += 1) {
+            const end = std.mem.indexOfScalarPos(u8, text, start, '\n') orelse text.len;
+            const bit = @as(u32, 1) << @intCast(start & 31);
+            if (bits[start / 32] & bit == 0) try lines.append(allocator, lineResult(start, end, line_num));
+            start = end + 1;
+        }
+    } else {
+        var marked: usize = 0;
+        for (bits) |word| marked += @popCount(word);
+        try lines.ensureTotalCapacityPrecise(allocator, marked);
+        for (bits, 0..) |word, i| {
+            var rest = word;
+            while (rest != 0) : (rest &= rest - 1) {
+                const start = i * 32 + @ctz(rest);
+                if (start >= text.len) break;
+                const end = std.mem.indexOfScalarPos(u8, text, start, '\n') orelse text.len;
+                lines.appendAssumeCapacity(lineResult(start, end, 0));
+            }
+        }
+    }
+
+    const matches = try lines.toOwnedSlice(allocator);
+    return .{ .matches = matches, .total_matches = matches.len, .allocator = allocator };
+}
+
+fn lineResult(start: usize, end: usize, line_num: u32) MatchResult {
+    return .{
+        .position = @intCast(start),
+        .pattern_idx = 0,
+        .match_len = @intCast(end - start),
+        .line_start = @intCast(start),
+        .line_num = line_num,
+    };
+}
+
 // ============================================================================
 // GPU Regex Types (match shader structs in regex_ops.h / regex_ops.glsl)
 // ============================================================================
@@ -113,6 +185,9 @@ pub const RegexStateType = enum(u8) {
     lookbehind_neg = 15, // (?<!...) negative lookbehind
     atomic_group = 16, // (?>...) atomic group (no backtrack)
     non_greedy = 17, // Non-greedy quantifier marker
+    // Set by regex_compiler for (?<!\w) and (?!\w), the edges of a -w match
+    not_word_before = 18, // no word character before this position
+    not_word_after = 19, // no word character at this position
 };
 
 /// Compiled regex state (GPU-aligned, matches shader struct)
@@ -175,7 +250,9 @@ pub fn buildSkipTable(pattern: []const u8, case_insensitive: bool) [256]u8 {
 
     if (pattern.len > 1) {
         for (pattern[0 .. pattern.len - 1], 0..) |c, i| {
-            const skip: u8 = @intCast(pattern.len - 1 - i);
+            // Patterns past 255 bytes keep a shift of 255 for their early
+            // bytes: shorter than BMH allows, never longer
+            const skip: u8 = @intCast(@min(pattern.len - 1 - i, 255));
             skip_table[c] = skip;
             if (case_insensitive) {
                 if (c >= 'A' and c <= 'Z') skip_table[c + 32] = skip;
@@ -186,6 +263,39 @@ pub fn buildSkipTable(pattern: []const u8, case_insensitive: bool) [256]u8 {
     return skip_table;
 }
 
+/// Rough frequency class of a byte in text and source (higher is commoner)
+fn byteRank(c: u8) u8 {
+    if (std.mem.indexOfScalar(u8, " etaoinsr", c) != null) return 7;
+    if (std.mem.indexOfScalar(u8, "hldcum\n", c) != null) return 6;
+    if (std.ascii.isLower(c)) return 5;
+    if (std.ascii.isDigit(c) or std.mem.indexOfScalar(u8, ".,_-()\"'/=:;\t", c) != null) return 4;
+    if (std.ascii.isUpper(c)) return 3;
+    if (std.ascii.isPrint(c)) return 2;
+    return 1;
+}
+
+/// Offset of the least common byte of `pattern` (the first, on ties)
+pub fn rareByteOffset(pattern: []const u8) usize {
+    var best: usize = 0;
+    var best_rank: u8 = std.math.maxInt(u8);
+    for (pattern, 0..) |c, i| {
+        const rank = byteRank(c);
+        if (rank < best_rank) {
+            best = i;
+            best_rank = rank;
+        }
+    }
+    return best;
+}
+
+/// Byte the literal kernels compare before verifying a whole candidate:
+/// the last one (paired with the skip table) for BMH-sized patterns, the
+/// rarest one for long patterns
+pub fn probeOffset(pattern: []const u8) u32 {
+    if (pattern.len <= LONG_PATTERN_LEN) return @intCast(pattern.len -| 1);
+    return @intCast(rareByteOffset(pattern));
+}
+
 // Use library's Backend enum
 pub const Backend = e_jerk_gpu.Backend;
 
@@ -18,8 +18,41 @@ pub const CompiledGpuRegex = struct {
         self.allocator.free(self.states);
         self.allocator.free(self.bitmaps);
     }
+
+    /// Whether the NFA holds the -w edge assertions, which only the Vulkan
+    /// kernel implements
+    pub fn hasWordAssertions(self: *const CompiledGpuRegex) bool {
+        for (self.states) |state| {
+            if (state.type == @intFromEnum(RegexStateType.not_word_before) or
+                state.type == @intFromEnum(RegexStateType.not_word_after)) return true;
+        }
+        return false;
+    }
 };
 
+/// `(?<!\w)` and `(?!\w)`, which -w puts around a pattern, as the
+/// zero-width assertions not_word_before and not_word_after; null for any
+/// other state. The lookaround's sub-pattern must be a lone `\w` class.
+pub fn wordAssertion(states: []const regex_lib.State, idx: usize) ?RegexStateType {
+    const state = states[idx];
+    const kind: RegexStateType = switch (state.type) {
+        .lookbehind_neg => .not_word_before,
+        .lookahead_neg => .not_word_after,
+        else => return null,
+    };
+    const sub_idx = state.data.lookaround.sub_pattern_start;
+    if (sub_idx >= states.len) return null;
+    const sub = states[sub_idx];
+    if (sub.type != .char_class or sub.data.char_class.negated) return null;
+    if (sub.out == regex_lib.State.NONE or sub.out >= states.len or states[sub.out].type != .match) return null;
+    const bitmap = sub.data.char_class.bitmap.bitmap;
+    for (0..256) |c| {
+        const in_class = bitmap[c >> 3] & (@as(u8, 1) << @intCast(c & 7)) != 0;
+        if (in_class != (std.ascii.isAlphanumeric(@intCast(c)) or c == '_')) return null;
+    }
+    return kind;
+}
+
 /// Convert CPU regex to GPU-compatible format
 pub fn compileForGpu(pattern: []const u8, options: regex_lib.Regex.Options, allocator: std.mem.Allocator) !CompiledGpuRegex {
     // Compile the regex on CPU first
@@ -63,6 +96,10 @@ pub fn convertToGpuFormat(cpu_regex: *regex_lib.Regex, allocator: std.mem.Alloca
     var bitmap_offset: u32 = 0;
     for (states, 0..) |state, i| {
         gpu_states[i] = convertState(state, &bitmap_offset, bitmaps);
+        if (wordAssertion(states, i)) |kind| {
+            gpu_states[i].type = @intFromEnum(kind);
+            gpu_states[i].out2 = 0xFFFF;
+        }
     }
 
     // Build header
@@ -167,6 +204,27 @@ test "compile character class pattern for GPU" {
     try std.testing.expect(compiled.bitmaps.len > 0);
 }
 
+test "compile -w edge assertions for GPU" {
+    const allocator = std.testing.allocator;
+    var compiled = try compileForGpu("(?<!\\w)(-v)(?!\\w)", .{}, allocator);
+    defer compiled.deinit();
+
+    var before: usize = 0;
+    var after: usize = 0;
+    for (compiled.states) |state| {
+        if (state.type == @intFromEnum(RegexStateType.not_word_before)) before += 1;
+        if (state.type == @intFromEnum(RegexStateType.not_word_after)) after += 1;
+    }
+    try std.testing.expectEqual(@as(usize, 1), before);
+    try std.testing.expectEqual(@as(usize, 1), after);
+    try std.testing.expect(compiled.hasWordAssertions());
+
+    // Any other lookaround keeps its own state type
+    var other = try compileForGpu("(?<!x)y", .{}, allocator);
+    defer other.deinit();
+    try std.testing.expect(!other.hasWordAssertions());
+}
+
 test "compile anchored pattern for GPU" {
     const allocator = std.testing.allocator;
     var compiled = try compileForGpu("^hello$", .{}, allocator);
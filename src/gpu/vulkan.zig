@@ -84,6 +84,13 @@ pub const VulkanSearcher = struct {
     const Self = @This();
     const BufferAllocation = struct { buffer: vk.Buffer, memory: vk.DeviceMemory, size: vk.DeviceSize, mapped: ?*anyopaque };
 
+    /// Push constants of the ordered result passes (PassConstants in the shaders)
+    const PassConstants = extern struct {
+        pass: u32 = 0,
+        num_groups: u32,
+        num_lines: u32 = 0, // regex shader only
+    };
+
     pub fn init(allocator: std.mem.Allocator) !*Self {
         const vkb = vk.BaseWrapper.load(try getVkGetInstanceProcAddr());
 
@@ -164,12 +171,16 @@ pub const VulkanSearcher = struct {
             .{ .binding = 3, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null },
             .{ .binding = 4, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null },
             .{ .binding = 5, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null },
+            .{ .binding = 6, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // ThreadOffsetBuffer
+            .{ .binding = 7, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // GroupOffsetBuffer
+            .{ .binding = 8, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // LineBitmapBuffer
         };
 
+        const pass_constant_range = vk.PushConstantRange{ .stage_flags = .{ .compute_bit = true }, .offset = 0, .size = @sizeOf(PassConstants) };
         const descriptor_set_layout = vkd.createDescriptorSetLayout(device, &.{ .binding_count = bindings.len, .p_bindings = &bindings }, null) catch return error.DescriptorSetLayoutCreationFailed;
         errdefer vkd.destroyDescriptorSetLayout(device, descriptor_set_layout, null);
 
-        const pipeline_layout = vkd.createPipelineLayout(device, &.{ .set_layout_count = 1, .p_set_layouts = @ptrCast(&descriptor_set_layout), .push_constant_range_count = 0, .p_push_constant_ranges = null }, null) catch return error.PipelineLayoutCreationFailed;
+        const pipeline_layout = vkd.createPipelineLayout(device, &.{ .set_layout_count = 1, .p_set_layouts = @ptrCast(&descriptor_set_layout), .push_constant_range_count = 1, .p_push_constant_ranges = @ptrCast(&pass_constant_range) }, null) catch return error.PipelineLayoutCreationFailed;
         errdefer vkd.destroyPipelineLayout(device, pipeline_layout, null);
 
         var compute_pipeline: vk.Pipeline = undefined;
@@ -181,7 +192,7 @@ pub const VulkanSearcher = struct {
         }), null, @ptrCast(&compute_pipeline)) catch return error.ComputePipelineCreationFailed;
         errdefer vkd.destroyPipeline(device, compute_pipeline, null);
 
-        const descriptor_pool = vkd.createDescriptorPool(device, &.{ .max_sets = 1, .pool_size_count = 1, .p_pool_sizes = @ptrCast(&vk.DescriptorPoolSize{ .type = .storage_buffer, .descriptor_count = 6 }) }, null) catch return error.DescriptorPoolCreationFailed;
+        const descriptor_pool = vkd.createDescriptorPool(device, &.{ .max_sets = 1, .pool_size_count = 1, .p_pool_sizes = @ptrCast(&vk.DescriptorPoolSize{ .type = .storage_buffer, .descriptor_count = bindings.len }) }, null) catch return error.DescriptorPoolCreationFailed;
         errdefer vkd.destroyDescriptorPool(device, descriptor_pool, null);
 
         const command_pool = vkd.createCommandPool(device, &.{ .queue_family_index = selected_queue_family, .flags = .{ .reset_command_buffer_bit = true } }, null) catch return error.CommandPoolCreationFailed;
@@ -232,7 +243,7 @@ pub const VulkanSearcher = struct {
         }, null) catch return error.ShaderModuleCreationFailed;
         errdefer vkd.destroyShaderModule(device, regex_shader_module, null);
 
-        // Regex pipeline needs 9 bindings to match search_regex.comp
+        // Regex pipeline needs 13 bindings to match search_regex.comp
         const regex_bindings = [_]vk.DescriptorSetLayoutBinding{
             .{ .binding = 0, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // TextBuffer
             .{ .binding = 1, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // StatesBuffer
@@ -243,6 +254,10 @@ pub const VulkanSearcher = struct {
             .{ .binding = 6, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // CounterBuffer
             .{ .binding = 7, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // LineOffsetsBuffer
             .{ .binding = 8, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // LineLengthsBuffer
+            .{ .binding = 9, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // LineMatchBuffer
+            .{ .binding = 10, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // ThreadOffsetBuffer
+            .{ .binding = 11, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // GroupOffsetBuffer
+            .{ .binding = 12, .descriptor_type = .storage_buffer, .descriptor_count = 1, .stage_flags = .{ .compute_bit = true }, .p_immutable_samplers = null }, // LineBitmapBuffer
         };
 
         const regex_descriptor_set_layout = vkd.createDescriptorSetLayout(device, &.{
@@ -254,8 +269,8 @@ pub const VulkanSearcher = struct {
         const regex_pipeline_layout = vkd.createPipelineLayout(device, &.{
             .set_layout_count = 1,
             .p_set_layouts = @ptrCast(&regex_descriptor_set_layout),
-            .push_constant_range_count = 0,
-            .p_push_constant_ranges = null,
+            .push_constant_range_count = 1,
+            .p_push_constant_ranges = @ptrCast(&pass_constant_range),
         }, null) catch return error.PipelineLayoutCreationFailed;
         errdefer vkd.destroyPipelineLayout(device, regex_pipeline_layout, null);
 
@@ -330,6 +345,49 @@ pub const VulkanSearcher = struct {
         return BufferAllocation{ .buffer = buffer, .memory = memory, .size = size, .mapped = mapped };
     }
 
+    /// Record the count, scan and write dispatches of an ordered search, each
+    /// followed by a barrier so the next pass sees its writes
+    fn recordOrderedPasses(self: *Self, command_buffer: vk.CommandBuffer, layout: vk.PipelineLayout, constants: PassConstants) void {
+        const barrier = vk.MemoryBarrier{
+            .src_access_mask = .{ .shader_write_bit = true },
+            .dst_access_mask = .{ .shader_read_bit = true, .shader_write_bit = true },
+        };
+        for ([_]mod.ResultPass{ .count, .scan, .write }) |pass| {
+            var pc = constants;
+            pc.pass = @intFromEnum(pass);
+            self.vkd.cmdPushConstants(command_buffer, layout, .{ .compute_bit = true }, 0, @sizeOf(PassConstants), &pc);
+            self.vkd.cmdDispatch(command_buffer, if (pass == .scan) 1 else constants.num_groups, 1, 1);
+            if (pass != .write) {
+                self.vkd.cmdPipelineBarrier(command_buffer, .{ .compute_shader_bit = true }, .{ .compute_shader_bit = true }, .{}, 1, @ptrCast(&barrier), 0, undefined, 0, undefined);
+            }
+        }
+    }
+
+    /// Record the single dispatch of a lines_only search, or the ordered
+    /// passes otherwise
+    fn recordPasses(self: *Self, command_buffer: vk.CommandBuffer, layout: vk.PipelineLayout, constants: PassConstants, lines_only: bool) void {
+        if (!lines_only) return self.recordOrderedPasses(command_buffer, layout, constants);
+        var pc = constants;
+        pc.pass = @intFromEnum(mod.ResultPass.lines);
+        self.vkd.cmdPushConstants(command_buffer, layout, .{ .compute_bit = true }, 0, @sizeOf(PassConstants), &pc);
+        self.vkd.cmdDispatch(command_buffer, constants.num_groups, 1, 1);
+    }
+
+    /// Zeroed line bitmap of a lines_only search over `text_len` bytes, or a
+    /// placeholder word to bind otherwise
+    fn createLineBitmap(self: *Self, text_len: usize, lines_only: bool) !BufferAllocation {
+        const words = if (lines_only) mod.lineBitmapWords(text_len) else 1;
+        const buf = try self.createBuffer(@intCast(words * @sizeOf(u32)));
+        @memset(@as([*]u32, @ptrCast(@alignCast(buf.mapped)))[0..words], 0);
+        return buf;
+    }
+
+    /// Selected lines of a lines_only search from its bitmap
+    fn readLineBitmap(text: []const u8, bitmap: BufferAllocation, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
+        const bits: [*]const u32 = @ptrCast(@alignCast(bitmap.mapped));
+        return mod.linesFromBitmap(text, bits[0..mod.lineBitmapWords(text.len)], options.invert_match, allocator);
+    }
+
     fn destroyBuffer(self: *Self, buf: BufferAllocation) void {
         self.vkd.unmapMemory(self.device, buf.memory);
         self.vkd.freeMemory(self.device, buf.memory, null);
@@ -337,7 +395,7 @@ pub const VulkanSearcher = struct {
     }
 
     pub fn search(self: *Self, text: []const u8, pattern: []const u8, options: SearchOptions, result_allocator: std.mem.Allocator) !SearchResult {
-        if (pattern.len == 0 or pattern.len > mod.MAX_PATTERN_LEN) return error.InvalidPatternLength;
+        if (pattern.len == 0) return error.InvalidPatternLength;
         if (text.len > MAX_GPU_BUFFER_SIZE) return error.TextTooLarge;
 
         const text_size: vk.DeviceSize = @intCast(((text.len + 3) / 4) * 4);
@@ -354,13 +412,25 @@ pub const VulkanSearcher = struct {
         const config_buffer = try self.createBuffer(@sizeOf(SearchConfig));
         defer self.destroyBuffer(config_buffer);
 
-        const results_size: vk.DeviceSize = @intCast(@sizeOf(MatchResult) * MAX_RESULTS);
+        // A lines_only search reads back its line bitmap instead of results
+        const results_size: vk.DeviceSize = @intCast(@sizeOf(MatchResult) * (if (options.lines_only) 1 else MAX_RESULTS));
         const results_buffer = try self.createBuffer(results_size);
         defer self.destroyBuffer(results_buffer);
 
         const counters_buffer = try self.createBuffer(8);
         defer self.destroyBuffer(counters_buffer);
 
+        // Offsets of the ordered passes: per thread within its workgroup, per workgroup
+        const workgroups = @max(1, (text.len + 64 * 64 - 1) / (64 * 64));
+        const thread_offsets_size: vk.DeviceSize = @intCast(workgroups * mod.PASS_GROUP_SIZE * @sizeOf(u32));
+        const thread_offsets_buffer = try self.createBuffer(thread_offsets_size);
+        defer self.destroyBuffer(thread_offsets_buffer);
+        const group_offsets_size: vk.DeviceSize = @intCast(workgroups * @sizeOf(u32));
+        const group_offsets_buffer = try self.createBuffer(group_offsets_size);
+        defer self.destroyBuffer(group_offsets_buffer);
+        const line_bits_buffer = try self.createLineBitmap(text.len, options.lines_only);
+        defer self.destroyBuffer(line_bits_buffer);
+
         @memcpy(@as([*]u8, @ptrCast(text_buffer.mapped))[0..text.len], text);
         @memcpy(@as([*]u8, @ptrCast(pattern_buffer.mapped))[0..pattern.len], pattern);
 
@@ -373,6 +443,7 @@ pub const VulkanSearcher = struct {
             .num_patterns = 1,
             .flags = options.toFlags(),
             .positions_per_thread = 1,
+            .probe_offset = mod.probeOffset(pattern),
         };
 
         const counters_ptr: *[2]u32 = @ptrCast(@alignCast(counters_buffer.mapped));
@@ -389,10 +460,13 @@ pub const VulkanSearcher = struct {
             .{ .buffer = config_buffer.buffer, .offset = 0, .range = @sizeOf(SearchConfig) },
             .{ .buffer = results_buffer.buffer, .offset = 0, .range = results_size },
             .{ .buffer = counters_buffer.buffer, .offset = 0, .range = 8 },
+            .{ .buffer = thread_offsets_buffer.buffer, .offset = 0, .range = thread_offsets_size },
+            .{ .buffer = group_offsets_buffer.buffer, .offset = 0, .range = group_offsets_size },
+            .{ .buffer = line_bits_buffer.buffer, .offset = 0, .range = line_bits_buffer.size },
         };
 
-        var writes: [6]vk.WriteDescriptorSet = undefined;
-        for (0..6) |i| {
+        var writes: [buffer_infos.len]vk.WriteDescriptorSet = undefined;
+        for (0..buffer_infos.len) |i| {
             writes[i] = .{
                 .dst_set = descriptor_set,
                 .dst_binding = @intCast(i),
@@ -404,7 +478,7 @@ pub const VulkanSearcher = struct {
                 .p_texel_buffer_view = undefined,
             };
         }
-        self.vkd.updateDescriptorSets(self.device, 6, &writes, 0, undefined);
+        self.vkd.updateDescriptorSets(self.device, writes.len, &writes, 0, undefined);
 
         var command_buffer: vk.CommandBuffer = undefined;
         self.vkd.allocateCommandBuffers(self.device, &.{ .command_pool = self.command_pool, .level = .primary, .command_buffer_count = 1 }, @ptrCast(&command_buffer)) catch return error.CommandBufferAllocationFailed;
@@ -414,8 +488,7 @@ pub const VulkanSearcher = struct {
         self.vkd.cmdBindPipeline(command_buffer, .compute, self.compute_pipeline);
         self.vkd.cmdBindDescriptorSets(command_buffer, .compute, self.pipeline_layout, 0, 1, @ptrCast(&descriptor_set), 0, undefined);
 
-        const workgroups = @max(1, (text.len + 64 * 64 - 1) / (64 * 64));
-        self.vkd.cmdDispatch(command_buffer, @intCast(workgroups), 1, 1);
+        self.recordPasses(command_buffer, self.pipeline_layout, .{ .num_groups = @intCast(workgroups) }, options.lines_only);
         self.vkd.endCommandBuffer(command_buffer) catch return error.CommandBufferEndFailed;
 
         self.vkd.queueSubmit(self.compute_queue, 1, @ptrCast(&vk.SubmitInfo{
@@ -430,6 +503,11 @@ pub const VulkanSearcher = struct {
         _ = self.vkd.waitForFences(self.device, 1, @ptrCast(&self.fence), .true, std.math.maxInt(u64)) catch return error.FenceWaitFailed;
         self.vkd.resetFences(self.device, 1, @ptrCast(&self.fence)) catch return error.FenceResetFailed;
 
+        if (options.lines_only) {
+            self.vkd.resetDescriptorPool(self.device, self.descriptor_pool, .{}) catch {};
+            return readLineBitmap(text, line_bits_buffer, options, result_allocator);
+        }
+
         const result_count = counters_ptr[0];
         const total_matches = counters_ptr[1];
 
@@ -506,7 +584,8 @@ pub const VulkanSearcher = struct {
         const header_buffer = try self.createBuffer(16); // 4 u32s
         defer self.destroyBuffer(header_buffer);
 
-        const results_size: vk.DeviceSize = @intCast(@sizeOf(RegexMatchResult) * MAX_RESULTS);
+        // A lines_only search reads back its line bitmap instead of results
+        const results_size: vk.DeviceSize = @intCast(@sizeOf(RegexMatchResult) * (if (options.lines_only) 1 else MAX_RESULTS));
         const results_buffer = try self.createBuffer(results_size);
         defer self.destroyBuffer(results_buffer);
 
@@ -520,6 +599,21 @@ pub const VulkanSearcher = struct {
         const line_lengths_buffer = try self.createBuffer(line_offsets_size);
         defer self.destroyBuffer(line_lengths_buffer);
 
+        // Per-line match and offsets of the ordered passes, one thread per line
+        const workgroups = @max(1, (num_lines + mod.PASS_GROUP_SIZE - 1) / mod.PASS_GROUP_SIZE);
+        const num_threads = workgroups * mod.PASS_GROUP_SIZE;
+        const line_matches_size: vk.DeviceSize = @intCast(num_threads * 2 * @sizeOf(u32));
+        const line_matches_buffer = try self.createBuffer(line_matches_size);
+        defer self.destroyBuffer(line_matches_buffer);
+        const thread_offsets_size: vk.DeviceSize = @intCast(num_threads * @sizeOf(u32));
+        const thread_offsets_buffer = try self.createBuffer(thread_offsets_size);
+        defer self.destroyBuffer(thread_offsets_buffer);
+        const group_offsets_size: vk.DeviceSize = @intCast(workgroups * @sizeOf(u32));
+        const group_offsets_buffer = try self.createBuffer(group_offsets_size);
+        defer self.destroyBuffer(group_offsets_buffer);
+        const line_bits_buffer = try self.createLineBitmap(text.len, options.lines_only);
+        defer self.destroyBuffer(line_bits_buffer);
+
         // Upload data
         @memcpy(@as([*]u8, @ptrCast(text_buffer.mapped))[0..text.len], text);
 
@@ -547,7 +641,7 @@ pub const VulkanSearcher = struct {
 
         // Upload config
         var search_flags: u32 = 0;
-        if (options.invert_match) search_flags |= 16; // FLAG_INVERT_MATCH
+        if (options.invert_match and !options.lines_only) search_flags |= 16; // FLAG_INVERT_MATCH
         @as(*RegexSearchConfig, @ptrCast(@alignCast(config_buffer.mapped))).* = .{
             .text_len = @intCast(text.len),
             .num_states = @intCast(gpu_regex.states.len),
@@ -574,13 +668,13 @@ pub const VulkanSearcher = struct {
         counters_ptr[0] = 0;
         counters_ptr[1] = 0;
 
-        // Allocate descriptor set for regex pipeline (need a separate pool for 9 descriptors)
+        // Allocate descriptor set for regex pipeline (need a separate pool for 13 descriptors)
         const regex_pool = self.vkd.createDescriptorPool(self.device, &.{
             .max_sets = 1,
             .pool_size_count = 1,
             .p_pool_sizes = @ptrCast(&vk.DescriptorPoolSize{
                 .type = .storage_buffer,
-                .descriptor_count = 9,
+                .descriptor_count = 13,
             }),
         }, null) catch return error.DescriptorPoolCreationFailed;
         defer self.vkd.destroyDescriptorPool(self.device, regex_pool, null);
@@ -592,7 +686,7 @@ pub const VulkanSearcher = struct {
             .p_set_layouts = @ptrCast(&self.regex_descriptor_set_layout),
         }, @ptrCast(&descriptor_set)) catch return error.DescriptorSetAllocationFailed;
 
-        // Update descriptor set with all 9 buffers
+        // Update descriptor set with all 13 buffers
         const buffer_infos = [_]vk.DescriptorBufferInfo{
             .{ .buffer = text_buffer.buffer, .offset = 0, .range = text_size },
             .{ .buffer = states_buffer.buffer, .offset = 0, .range = @max(states_size, 16) },
@@ -603,10 +697,14 @@ pub const VulkanSearcher = struct {
             .{ .buffer = counters_buffer.buffer, .offset = 0, .range = 8 },
             .{ .buffer = line_offsets_buffer.buffer, .offset = 0, .range = line_offsets_size },
             .{ .buffer = line_lengths_buffer.buffer, .offset = 0, .range = line_offsets_size },
+            .{ .buffer = line_matches_buffer.buffer, .offset = 0, .range = line_matches_size },
+            .{ .buffer = thread_offsets_buffer.buffer, .offset = 0, .range = thread_offsets_size },
+            .{ .buffer = group_offsets_buffer.buffer, .offset = 0, .range = group_offsets_size },
+            .{ .buffer = line_bits_buffer.buffer, .offset = 0, .range = line_bits_buffer.size },
         };
 
-        var writes: [9]vk.WriteDescriptorSet = undefined;
-        for (0..9) |i| {
+        var writes: [buffer_infos.len]vk.WriteDescriptorSet = undefined;
+        for (0..buffer_infos.len) |i| {
             writes[i] = .{
                 .dst_set = descriptor_set,
                 .dst_binding = @intCast(i),
@@ -618,7 +716,7 @@ pub const VulkanSearcher = struct {
                 .p_texel_buffer_view = undefined,
             };
         }
-        self.vkd.updateDescriptorSets(self.device, 9, &writes, 0, undefined);
+        self.vkd.updateDescriptorSets(self.device, writes.len, &writes, 0, undefined);
 
         // Allocate and record command buffer
         var command_buffer: vk.CommandBuffer = undefined;
@@ -633,9 +731,11 @@ pub const VulkanSearcher = struct {
         self.vkd.cmdBindPipeline(command_buffer, .compute, self.regex_compute_pipeline);
         self.vkd.cmdBindDescriptorSets(command_buffer, .compute, self.regex_pipeline_layout, 0, 1, @ptrCast(&descriptor_set), 0, undefined);
 
-        // Dispatch one thread per line (local_size_x = 64 in shader)
-        const workgroups = @max(1, (num_lines + 63) / 64);
-        self.vkd.cmdDispatch(command_buffer, @intCast(workgroups), 1, 1);
+        // One thread per line (local_size_x = 64 in shader), in ordered passes
+        self.recordPasses(command_buffer, self.regex_pipeline_layout, .{
+            .num_groups = @intCast(workgroups),
+            .num_lines = @intCast(num_lines),
+        }, options.lines_only);
         self.vkd.endCommandBuffer(command_buffer) catch return error.CommandBufferEndFailed;
 
         // Submit and wait
@@ -651,6 +751,8 @@ pub const VulkanSearcher = struct {
         _ = self.vkd.waitForFences(self.device, 1, @ptrCast(&self.fence), .true, std.math.maxInt(u64)) catch return error.FenceWaitFailed;
         self.vkd.resetFences(self.device, 1, @ptrCast(&self.fence)) catch return error.FenceResetFailed;
 
+        if (options.lines_only) return readLineBitmap(text, line_bits_buffer, options, result_allocator);
+
         // Read results
         const result_count = counters_ptr[0];
         const total_matches = counters_ptr[1];
@@ -0,0 +1,254 @@
+const std = @import("std");
+const gpu = @import("gpu");
+const output = @import("output.zig");
+const timerange = @import("timerange.zig");
+
+// ============================================================================
+// Match histograms (--histogram=FIELD_REGEX:BUCKET)
+//
+// Instead of printing the selected lines, count them per time bucket. Each
+// input's selected lines are gathered into one buffer and the field pattern
+// runs over it once; the first field match on a line is parsed with
+// --time-format, and the line is counted in the bucket its timestamp falls
+// in. An empty FIELD_REGEX looks for the timestamp near the start of the
+// line, as --since/--until do. Every worker thread counts into a partial
+// histogram of its own; the partials are merged once, as the workers finish.
+// ============================================================================
+
+/// Buckets between the first and last non-empty one are printed with their
+/// zero counts unless there would be more than this many
+const MAX_FILLED_BUCKETS: i64 = 100_000;
+
+/// Widest bar in the table
+const BAR_WIDTH: u64 = 40;
+
+pub const OutputFormat = enum { table, json };
+
+pub const Spec = struct {
+    field: []const u8, // pattern whose match holds the timestamp ("" = the line)
+    width: i64, // bucket width in seconds
+    format: timerange.Format = .{},
+
+    /// Parse FIELD_REGEX:BUCKET, split at the last ':' (the regex may hold
+    /// colons, the bucket cannot). BUCKET is a count of s, m, h or d.
+    pub fn parse(arg: []const u8) !Spec {
+        const colon = std.mem.lastIndexOfScalar(u8, arg, ':') orelse return error.InvalidHistogram;
+        return .{ .field = arg[0..colon], .width = try parseDuration(arg[colon + 1 ..]) };
+    }
+
+    fn bucketOf(self: Spec, stamp: timerange.Fields) i64 {
+        return @divFloor(stamp.toSeconds(), self.width) * self.width;
+    }
+};
+
+fn parseDuration(text: []const u8) !i64 {
+    var digits: usize = 0;
+    while (digits < text.len and std.ascii.isDigit(text[digits])) digits += 1;
+    const n = std.fmt.parseInt(i64, text[0..digits], 10) catch return error.InvalidHistogram;
+    const unit: i64 = switch (text.len - digits) {
+        0 => 1,
+        1 => switch (text[digits]) {
+            's' => 1,
+            'm' => 60,
+            'h' => 3600,
+            'd' => 86400,
+            else => return error.InvalidHistogram,
+        },
+        else => return error.InvalidHistogram,
+    };
+    if (n <= 0) return error.InvalidHistogram;
+    return std.math.mul(i64, n, unit) catch error.InvalidHistogram;
+}
+
+/// Counts for one worker thread, merged into `shared` by publish()
+pub const Partial = struct {
+    allocator: std.mem.Allocator,
+    shared: ?*Histogram = null,
+    counts: std.AutoHashMapUnmanaged(i64, u64) = .{}, // bucket start -> lines
+    unstamped: u64 = 0, // selected lines with no parseable timestamp
+
+    /// Count the lines of `lines` (each terminated by `eol`, the last one
+    /// possibly not). `fields` are the field pattern's matches over `lines`,
+    /// in order, or null to look for the timestamp in the line itself.
+    pub fn countLines(self: *Partial, spec: Spec, lines: []const u8, eol: u8, fields: ?[]const gpu.MatchResult) !void {
+        var next_field: usize = 0;
+        var start: usize = 0;
+        while (start < lines.len) {
+            const end = std.mem.indexOfScalarPos(u8, lines, start, eol) orelse lines.len;
+            const stamp = if (fields) |found| blk: {
+                while (next_field < found.len and found[next_field].line_start < start) next_field += 1;
+                if (next_field == found.len or found[next_field].line_start != start) break :blk null;
+                const m = found[next_field];
+                break :blk spec.format.find(lines[m.position..][0..m.match_len]);
+            } else spec.format.find(lines[start..end]);
+
+            if (stamp) |s| {
+                const entry = try self.counts.getOrPut(self.allocator, spec.bucketOf(s));
+                entry.value_ptr.* = if (entry.found_existing) entry.value_ptr.* + 1 else 1;
+            } else {
+                self.unstamped += 1;
+            }
+            start = end + 1;
+        }
+    }
+
+    /// Merge into the shared histogram and start over
+    pub fn publish(self: *Partial) void {
+        const shared = self.shared orelse return;
+        shared.merge(self) catch std.debug.print("grep: --histogram: out of memory\n", .{});
+        self.counts.clearRetainingCapacity();
+        self.unstamped = 0;
+    }
+
+    pub fn deinit(self: *Partial) void {
+        self.publish();
+        self.counts.deinit(self.allocator);
+    }
+};
+
+/// The merged counts of a run
+pub const Histogram = struct {
+    allocator: std.mem.Allocator,
+    spec: Spec,
+    mutex: std.Thread.Mutex = .{},
+    counts: std.AutoHashMapUnmanaged(i64, u64) = .{},
+    unstamped: u64 = 0,
+
+    pub fn init(allocator: std.mem.Allocator, spec: Spec) Histogram {
+        return .{ .allocator = allocator, .spec = spec };
+    }
+
+    pub fn deinit(self: *Histogram) void {
+        self.counts.deinit(self.allocator);
+    }
+
+    fn merge(self: *Histogram, partial: *const Partial) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        var it = partial.counts.iterator();
+        while (it.next()) |kv| {
+            const entry = try self.counts.getOrPut(self.allocator, kv.key_ptr.*);
+            entry.value_ptr.* = if (entry.found_existing) entry.value_ptr.* + kv.value_ptr.* else kv.value_ptr.*;
+        }
+        self.unstamped += partial.unstamped;
+    }
+
+    /// Print one row per bucket, oldest first
+    pub fn write(self: *Histogram, out: *output.Sink, format: OutputFormat) !void {
+        const buckets = try self.allocator.alloc(i64, self.counts.count());
+        defer self.allocator.free(buckets);
+        var keys = self.counts.keyIterator();
+        var n: usize = 0;
+        while (keys.next()) |k| : (n += 1) buckets[n] = k.*;
+        std.mem.sort(i64, buckets, {}, std.sort.asc(i64));
+
+        var max: u64 = 1;
+        var vals = self.counts.valueIterator();
+        while (vals.next()) |v| max = @max(max, v.*);
+
+        const width = self.spec.width;
+        const fill = buckets.len > 0 and @divFloor(buckets[buckets.len - 1] - buckets[0], width) < MAX_FILLED_BUCKETS;
+        var buf: [128]u8 = undefined;
+
+        if (format == .json) {
+            out.write(try std.fmt.bufPrint(&buf, "{{\"bucket_seconds\":{d},\"buckets\":[", .{width}));
+        }
+        var first = true;
+        var idx: usize = 0;
+        var bucket: i64 = if (buckets.len > 0) buckets[0] else 0;
+        while (idx < buckets.len) {
+            const count = if (bucket == buckets[idx]) self.counts.get(bucket).? else 0;
+            if (bucket == buckets[idx]) idx += 1;
+            var stamp: [19]u8 = undefined;
+            formatStamp(&stamp, bucket, if (format == .json) 'T' else ' ');
+            switch (format) {
+                .table => {
+                    out.write(try std.fmt.bufPrint(&buf, "{s} {d:>10} ", .{ &stamp, count }));
+                    var bar: [BAR_WIDTH]u8 = undefined;
+                    @memset(&bar, '#');
+                    out.write(bar[0..@intCast((count * BAR_WIDTH + max - 1) / max)]);
+                    out.write("\n");
+                },
+                .json => {
+                    out.write(try std.fmt.bufPrint(&buf, "{s}{{\"start\":\"{s}\",\"count\":{d}}}", .{ if (first) "" else ",", &stamp, count }));
+                },
+            }
+            first = false;
+            bucket = if (fill) bucket + width else if (idx < buckets.len) buckets[idx] else bucket;
+        }
+        switch (format) {
+            .table => if (self.unstamped > 0) {
+                out.write(try std.fmt.bufPrint(&buf, "{s: <19} {d:>10}\n", .{ "(no timestamp)", self.unstamped }));
+            },
+            .json => out.write(try std.fmt.bufPrint(&buf, "],\"no_timestamp\":{d}}}\n", .{self.unstamped})),
+        }
+    }
+};
+
+/// "YYYY-MM-DD HH:MM:SS" for seconds on the toSeconds() timeline
+fn formatStamp(buf: *[19]u8, seconds: i64, separator: u8) void {
+    const days = @divFloor(seconds, 86400);
+    const secs = seconds - days * 86400;
+    const date = civilFromDays(days);
+    _ = std.fmt.bufPrint(buf, "{d:0>4}-{d:0>2}-{d:0>2}{c}{d:0>2}:{d:0>2}:{d:0>2}", .{
+        @as(u64, @intCast(std.math.clamp(date.year, 0, 9999))),
+        @as(u64, @intCast(date.month)),
+        @as(u64, @intCast(date.day)),
+        separator,
+        @as(u64, @intCast(@divFloor(secs, 3600))),
+        @as(u64, @intCast(@mod(@divFloor(secs, 60), 60))),
+        @as(u64, @intCast(@mod(secs, 60))),
+    }) catch unreachable;
+}
+
+/// Civil date for days since 1970-01-01 (inverse of timerange's daysFromCivil)
+fn civilFromDays(days: i64) struct { year: i64, month: i64, day: i64 } {
+    const z = days + 719468;
+    const era = @divFloor(z, 146097);
+    const doe = z - era * 146097;
+    const yoe = @divFloor(doe - @divFloor(doe, 1460) + @divFloor(doe, 36524) - @divFloor(doe, 146096), 365);
+    const doy = doe - (365 * yoe + @divFloor(yoe, 4) - @divFloor(yoe, 100));
+    const mp = @divFloor(5 * doy + 2, 153);
+    const month = if (mp < 10) mp + 3 else mp - 9;
+    return .{
+        .year = yoe + era * 400 + @intFromBool(month <= 2),
+        .month = month,
+        .day = doy - @divFloor(153 * mp + 2, 5) + 1,
+    };
+}
+
+test "histogram: bucket spec and civil dates" {
+    const spec = try Spec.parse("\\d\\d:\\d\\d:5m");
+    try std.testing.expectEqualStrings("\\d\\d:\\d\\d", spec.field);
+    try std.testing.expectEqual(@as(i64, 300), spec.width);
+    try std.testing.expectEqual(@as(i64, 86400), (try Spec.parse(":1d")).width);
+    try std.testing.expectError(error.InvalidHistogram, Spec.parse("x:0m"));
+    try std.testing.expectError(error.InvalidHistogram, Spec.parse("x:5w"));
+
+    var stamp: [19]u8 = undefined;
+    const fields = timerange.Fields{ .year = 2024, .month = 2, .day = 29, .hour = 23, .minute = 59, .second = 7 };
+    formatStamp(&stamp, fields.toSeconds(), ' ');
+    try std.testing.expectEqualStrings("2024-02-29 23:59:07", &stamp);
+}
+
+test "histogram: lines counted per bucket" {
+    const allocator = std.testing.allocator;
+    var hist = Histogram.init(allocator, try Spec.parse(":1m"));
+    defer hist.deinit();
+    var partial = Partial{ .allocator = allocator, .shared = &hist };
+    defer partial.deinit();
+
+    const lines =
+        \\2024-05-01 14:03:10 ERROR a
+        \\2024-05-01 14:03:59 ERROR b
+        \\2024-05-01 14:05:00 ERROR c
+        \\no stamp ERROR d
+    ;
+    try partial.countLines(hist.spec, lines, '\n', null);
+    partial.publish();
+    try std.testing.expectEqual(@as(u64, 1), hist.unstamped);
+    const minute = (timerange.Fields{ .year = 2024, .month = 5, .day = 1, .hour = 14, .minute = 3 }).toSeconds();
+    try std.testing.expectEqual(@as(u64, 2), hist.counts.get(minute).?);
+    try std.testing.expectEqual(@as(u64, 1), hist.counts.get(minute + 120).?);
+    try std.testing.expect(hist.counts.get(minute + 60) == null);
+}
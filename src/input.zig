@@ -0,0 +1,284 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+// ============================================================================
+// File input helpers shared by the search paths in main.zig
+// ============================================================================
+
+/// How a mapped file is about to be read
+pub const Access = enum {
+    whole, // scanned front to back in one go: fault it all in up front
+    partial, // only parts are touched (time windows, indexed blocks, chunks)
+};
+
+/// Read-only view of a file's contents. Regular files are memory-mapped so that
+/// paths which only look at part of a file (time windows, index-selected
+/// blocks) never pay to read the rest; anything that cannot be mapped is read
+/// into a heap buffer instead. Large mappings ask for huge pages, so the SIMD
+/// scan loops take fewer TLB misses.
+pub const MappedFile = struct {
+    data: []const u8,
+    mapping: ?[]align(std.heap.page_size_min) u8 = null,
+    owned: ?[]u8 = null,
+    allocator: std.mem.Allocator,
+
+    pub fn init(allocator: std.mem.Allocator, file: std.fs.File, size: u64, access: Access) !MappedFile {
+        // procfs/sysfs report size 0 but still have content
+        if (size == 0) return readAll(allocator, file);
+
+        const len = std.math.cast(usize, size) orelse return error.FileTooBig;
+        const mapping = std.posix.mmap(null, len, std.posix.PROT.READ, .{ .TYPE = .PRIVATE }, file.handle, 0) catch {
+            return readAll(allocator, file);
+        };
+        // Huge-page advice must precede the faults it should apply to
+        adviseHugePages(mapping);
+        if (access == .whole) populate(mapping);
+        return .{ .data = mapping, .mapping = mapping, .allocator = allocator };
+    }
+
+    fn readAll(allocator: std.mem.Allocator, file: std.fs.File) !MappedFile {
+        const bytes = try file.readToEndAlloc(allocator, std.math.maxInt(u32));
+        return .{ .data = bytes, .owned = bytes, .allocator = allocator };
+    }
+
+    pub fn deinit(self: *MappedFile) void {
+        if (self.mapping) |m| std.posix.munmap(m);
+        if (self.owned) |o| self.allocator.free(o);
+        self.* = undefined;
+    }
+};
+
+/// Buffers at least this large are worth backing with huge pages
+pub const HUGE_PAGE_MIN: usize = 2 * 1024 * 1024;
+
+/// MADV_POPULATE_READ (Linux 5.14+): fault pages in now, synchronously
+const MADV_POPULATE_READ = 22;
+
+/// The whole pages inside `bytes`, or null if there are none
+fn innerPages(bytes: []const u8) ?[]align(std.heap.page_size_min) u8 {
+    const page = std.heap.pageSize();
+    const start = std.mem.alignForward(usize, @intFromPtr(bytes.ptr), page);
+    const end = std.mem.alignBackward(usize, @intFromPtr(bytes.ptr) + bytes.len, page);
+    if (end <= start) return null;
+    const pages: [*]align(std.heap.page_size_min) u8 = @ptrFromInt(start);
+    return pages[0 .. end - start];
+}
+
+/// Ask for transparent huge pages under a large mapping or heap buffer.
+/// Advisory: kernels without THP (or without it for file pages) ignore it.
+pub fn adviseHugePages(bytes: []const u8) void {
+    if (builtin.os.tag != .linux or bytes.len < HUGE_PAGE_MIN) return;
+    const pages = innerPages(bytes) orelse return;
+    std.posix.madvise(pages.ptr, pages.len, std.posix.MADV.HUGEPAGE) catch {};
+}
+
+/// Fault a mapping in before it is scanned, so the scan never stalls on
+/// page faults; falls back to asynchronous readahead on older kernels
+fn populate(mapping: []align(std.heap.page_size_min) u8) void {
+    if (builtin.os.tag == .linux) {
+        std.posix.madvise(mapping.ptr, mapping.len, MADV_POPULATE_READ) catch {
+            std.posix.madvise(mapping.ptr, mapping.len, std.posix.MADV.WILLNEED) catch {};
+        };
+        return;
+    }
+    std.posix.madvise(mapping.ptr, mapping.len, std.posix.MADV.WILLNEED) catch {};
+}
+
+/// Start reading `bytes` of a file mapping in ahead of the scan cursor;
+/// returns the bytes requested
+pub fn prefetchPages(bytes: []const u8) usize {
+    if (bytes.len == 0) return 0;
+    const start = std.mem.alignBackward(usize, @intFromPtr(bytes.ptr), std.heap.pageSize());
+    const len = @intFromPtr(bytes.ptr) + bytes.len - start;
+    const pages: [*]align(std.heap.page_size_min) u8 = @ptrFromInt(start);
+    std.posix.madvise(pages, len, std.posix.MADV.WILLNEED) catch return 0;
+    return len;
+}
+
+/// Drop the resident pages lying wholly inside `bytes`, part of a read-only
+/// file mapping; touching them again reads them back from the file
+pub fn releasePages(bytes: []const u8) void {
+    const pages = innerPages(bytes) orelse return;
+    std.posix.madvise(pages.ptr, pages.len, std.posix.MADV.DONTNEED) catch {};
+}
+
+/// Count '\n' bytes with 32-byte vector compares
+pub fn countNewlines(bytes: []const u8) usize {
+    return countTerminators(bytes, '\n');
+}
+
+/// Count `eol` bytes (line terminators, '\0' under -z) the same way
+pub fn countTerminators(bytes: []const u8, eol: u8) usize {
+    const Vec32 = @Vector(32, u8);
+    const terminator: Vec32 = @splat(eol);
+    var count: usize = 0;
+    var i: usize = 0;
+    while (i + 32 <= bytes.len) : (i += 32) {
+        const chunk: Vec32 = bytes[i..][0..32].*;
+        const mask: u32 = @bitCast(chunk == terminator);
+        count += @popCount(mask);
+    }
+    while (i < bytes.len) : (i += 1) {
+        if (bytes[i] == eol) count += 1;
+    }
+    return count;
+}
+
+/// Text encodings recognized by their byte order mark
+pub const Encoding = enum {
+    utf8, // also anything without a BOM
+    utf16le,
+    utf16be,
+};
+
+pub fn detectEncoding(bytes: []const u8) Encoding {
+    if (bytes.len >= 2) {
+        if (bytes[0] == 0xFF and bytes[1] == 0xFE) return .utf16le;
+        if (bytes[0] == 0xFE and bytes[1] == 0xFF) return .utf16be;
+    }
+    return .utf8;
+}
+
+/// Source bytes between offset checkpoints in a Transcoded input
+const CHECKPOINT_INTERVAL: usize = 4096;
+
+/// UTF-8 copy of a UTF-16 input, so every engine can search it unchanged.
+/// Newlines survive one for one, so line numbers need no mapping; byte
+/// offsets (-b) are mapped back to the source through checkpoints taken
+/// every CHECKPOINT_INTERVAL source bytes. Unpaired surrogates become U+FFFD.
+pub const Transcoded = struct {
+    text: []const u8,
+    buffer: []u8,
+    checkpoints: []Checkpoint,
+    allocator: std.mem.Allocator,
+
+    const Checkpoint = struct {
+        text: usize, // offset in `text`
+        source: u64, // offset of the same code point in the source
+    };
+
+    pub fn init(allocator: std.mem.Allocator, bytes: []const u8, encoding: Encoding) !Transcoded {
+        std.debug.assert(encoding != .utf8);
+        const big_endian = encoding == .utf16be;
+        // Units arrive in host order unless the encoding's endianness differs
+        const swap = big_endian != (builtin.cpu.arch.endian() == .big);
+
+        // Each 2-byte unit becomes at most 3 UTF-8 bytes (a pair: 4 from 4)
+        const buffer = try allocator.alloc(u8, (bytes.len / 2) * 3);
+        errdefer allocator.free(buffer);
+        adviseHugePages(buffer);
+        var checkpoints: std.ArrayListUnmanaged(Checkpoint) = .{};
+        errdefer checkpoints.deinit(allocator);
+
+        var src: usize = 2; // past the BOM
+        var dst: usize = 0;
+        var next_checkpoint: usize = src;
+        while (src + 2 <= bytes.len) {
+            if (src >= next_checkpoint) {
+                try checkpoints.append(allocator, .{ .text = dst, .source = src });
+                next_checkpoint = src + CHECKPOINT_INTERVAL;
+            }
+
+            // Fast path: 16 ASCII units narrow straight to 16 bytes
+            if (src + 32 <= bytes.len) {
+                const raw: @Vector(32, u8) = bytes[src..][0..32].*;
+                var units: @Vector(16, u16) = @bitCast(raw);
+                if (swap) units = @byteSwap(units);
+                if (@reduce(.Max, units) < 0x80) {
+                    const narrow: @Vector(16, u8) = @truncate(units);
+                    buffer[dst..][0..16].* = narrow;
+                    dst += 16;
+                    src += 32;
+                    continue;
+                }
+            }
+
+            const unit = readUnit(bytes[src..], big_endian);
+            var cp: u21 = unit;
+            var used: usize = 2;
+            if (unit >= 0xD800 and unit < 0xDC00) {
+                cp = 0xFFFD;
+                if (src + 4 <= bytes.len) {
+                    const low = readUnit(bytes[src + 2 ..], big_endian);
+                    if (low >= 0xDC00 and low < 0xE000) {
+                        cp = 0x10000 + ((@as(u21, unit) - 0xD800) << 10) + (low - 0xDC00);
+                        used = 4;
+                    }
+                }
+            } else if (unit >= 0xDC00 and unit < 0xE000) {
+                cp = 0xFFFD;
+            }
+            dst += std.unicode.utf8Encode(cp, buffer[dst..]) catch unreachable;
+            src += used;
+        }
+
+        return .{
+            .text = buffer[0..dst],
+            .buffer = buffer,
+            .checkpoints = try checkpoints.toOwnedSlice(allocator),
+            .allocator = allocator,
+        };
+    }
+
+    pub fn deinit(self: *Transcoded) void {
+        self.allocator.free(self.buffer);
+        self.allocator.free(self.checkpoints);
+        self.* = undefined;
+    }
+
+    /// Source byte offset of the code point at `pos` in `text`
+    pub fn sourceOffset(self: *const Transcoded, pos: usize) u64 {
+        if (self.checkpoints.len == 0) return 2;
+
+        // Last checkpoint at or before pos, then walk forward from it
+        var lo: usize = 0;
+        var hi: usize = self.checkpoints.len;
+        while (lo + 1 < hi) {
+            const mid = (lo + hi) / 2;
+            if (self.checkpoints[mid].text <= pos) lo = mid else hi = mid;
+        }
+        var t = self.checkpoints[lo].text;
+        var s = self.checkpoints[lo].source;
+        while (t < pos and t < self.text.len) {
+            const len = std.unicode.utf8ByteSequenceLength(self.text[t]) catch 1;
+            t += len;
+            s += if (len == 4) 4 else 2;
+        }
+        return s;
+    }
+};
+
+inline fn readUnit(bytes: []const u8, big_endian: bool) u16 {
+    return std.mem.readInt(u16, bytes[0..2], if (big_endian) .big else .little);
+}
+
+test "input: count newlines" {
+    try std.testing.expectEqual(@as(usize, 0), countNewlines(""));
+    try std.testing.expectEqual(@as(usize, 2), countNewlines("a\nb\n"));
+    const long = "line\n" ** 40 ++ "tail";
+    try std.testing.expectEqual(@as(usize, 40), countNewlines(long));
+    const records = "rec\x00" ** 40 ++ "line\n";
+    try std.testing.expectEqual(@as(usize, 40), countTerminators(records, 0));
+}
+
+test "input: utf-16 transcoding maps offsets to the source" {
+    const allocator = std.testing.allocator;
+    // An ASCII line long enough for the vector path, then π, = and a surrogate pair
+    const line = "id=1 ok padding padding padding\n";
+    var src: std.ArrayListUnmanaged(u8) = .{};
+    defer src.deinit(allocator);
+    try src.appendSlice(allocator, "\xFF\xFE");
+    for (line) |c| try src.appendSlice(allocator, &.{ c, 0 });
+    try src.appendSlice(allocator, "\xC0\x03=\x00\x3D\xD8\x00\xDE \x00e\x00\n\x00");
+
+    try std.testing.expectEqual(Encoding.utf16le, detectEncoding(src.items));
+    var utf8 = try Transcoded.init(allocator, src.items, .utf16le);
+    defer utf8.deinit();
+
+    try std.testing.expectEqualStrings(line ++ "π=😀 e\n", utf8.text);
+    try std.testing.expectEqual(@as(u64, 2), utf8.sourceOffset(0));
+    const pi = line.len;
+    try std.testing.expectEqual(@as(u64, 2 + 2 * line.len), utf8.sourceOffset(pi));
+    // π (2 bytes) and '=' are one unit each; the emoji is a surrogate pair
+    try std.testing.expectEqual(@as(u64, 2 + 2 * line.len + 8), utf8.sourceOffset(pi + 2 + 1 + 4));
+}
@@ -0,0 +1,207 @@
+const std = @import("std");
+const gpu = @import("gpu");
+
+const Vec32 = @Vector(32, u8);
+
+const UPPER_A_VEC32: Vec32 = @splat('A');
+const UPPER_Z_VEC32: Vec32 = @splat('Z');
+const CASE_DIFF_VEC32: Vec32 = @splat(32);
+
+// ============================================================================
+// Long literal search (Crochemore-Perrin Two-Way)
+//
+// BMH stops paying off once a pattern outgrows its u8 skip table, and -i
+// used to lowercase the pattern into a fixed stack buffer. Two-Way splits
+// the (folded) pattern at a critical factorization u|v, matches v left to
+// right and then u right to left, and shifts by the period so the scan is
+// linear in the text with no limit on pattern length. Between candidates
+// the finder jumps with a vector scan for the pattern's rarest byte, and
+// each half is verified 32 bytes at a time.
+// ============================================================================
+
+/// Whether `pattern` goes to the Two-Way finder rather than BMH
+pub fn applies(pattern: []const u8) bool {
+    return pattern.len > gpu.LONG_PATTERN_LEN;
+}
+
+pub const Finder = struct {
+    /// Pattern, lowercased under -i
+    needle: []const u8,
+    owned: bool,
+    case_insensitive: bool,
+    /// Start of the right half v of the critical factorization
+    crit: usize,
+    /// Shift after a mismatch in the left half (or after a match)
+    period: usize,
+    /// u is a suffix of v's period, so the matched prefix can be remembered
+    /// across a shift instead of compared again
+    periodic: bool,
+    /// Prefilter: needle[rare_offset] is its least common byte
+    rare_offset: usize,
+
+    pub fn init(allocator: std.mem.Allocator, pattern: []const u8, case_insensitive: bool) !Finder {
+        std.debug.assert(pattern.len > 0);
+        const needle: []const u8 = if (case_insensitive) blk: {
+            const lower = try allocator.alloc(u8, pattern.len);
+            _ = std.ascii.lowerString(lower, pattern);
+            break :blk lower;
+        } else pattern;
+
+        // Of the two maximal suffixes, the later one gives a critical position
+        const by_less = maximalSuffix(needle, false);
+        const by_greater = maximalSuffix(needle, true);
+        const split = if (by_less.pos > by_greater.pos) by_less else by_greater;
+
+        const periodic = std.mem.eql(u8, needle[0..split.pos], needle[split.period..][0..split.pos]);
+        return .{
+            .needle = needle,
+            .owned = case_insensitive,
+            .case_insensitive = case_insensitive,
+            .crit = split.pos,
+            .period = if (periodic) split.period else @max(split.pos, needle.len - split.pos) + 1,
+            .periodic = periodic,
+            .rare_offset = gpu.rareByteOffset(needle),
+        };
+    }
+
+    pub fn deinit(self: *Finder, allocator: std.mem.Allocator) void {
+        if (self.owned) allocator.free(self.needle);
+    }
+
+    /// Start of the first occurrence at or after `from`
+    pub fn find(self: *const Finder, text: []const u8, from: usize) ?usize {
+        const n = self.needle.len;
+        const rare = self.needle[self.rare_offset];
+        var pos = from;
+        // Length of the needle prefix known to match at `pos` (periodic only)
+        var memory: usize = 0;
+
+        while (pos + n <= text.len) {
+            if (memory == 0) {
+                const probe = pos + self.rare_offset;
+                const hit = findByte(text, probe, rare, self.case_insensitive) orelse return null;
+                pos += hit - probe;
+                if (pos + n > text.len) return null;
+            }
+
+            // Right half, left to right
+            const right_from = @max(self.crit, memory);
+            if (firstMismatch(self.needle[right_from..], text[pos + right_from ..][0 .. n - right_from], self.case_insensitive)) |i| {
+                pos += right_from + i - self.crit + 1;
+                memory = 0;
+                continue;
+            }
+
+            // Left half, right to left, down to the remembered prefix
+            const left_to = if (self.periodic) memory else 0;
+            if (lastMismatch(self.needle[left_to..self.crit], text[pos + left_to ..][0 .. self.crit - left_to], self.case_insensitive) == null) return pos;
+
+            pos += self.period;
+            memory = if (self.periodic) n - self.period else 0;
+        }
+        return null;
+    }
+
+    /// How far to resume past a match: no occurrence starts closer than the
+    /// period, so overlapping occurrences are still all found
+    pub fn step(self: *const Finder) usize {
+        return @min(self.period, self.needle.len);
+    }
+};
+
+const Suffix = struct { pos: usize, period: usize };
+
+/// Start and period of the lexicographically maximal suffix of `needle`,
+/// under byte order or (with `reversed`) its reverse
+fn maximalSuffix(needle: []const u8, reversed: bool) Suffix {
+    var left: usize = 0;
+    var right: usize = 1;
+    var offset: usize = 0;
+    var period: usize = 1;
+
+    while (right + offset < needle.len) {
+        const a = needle[right + offset];
+        const b = needle[left + offset];
+        if (if (reversed) a > b else a < b) {
+            // Suffix at `right` is smaller: the period spans everything so far
+            right += offset + 1;
+            offset = 0;
+            period = right - left;
+        } else if (a == b) {
+            // Advance through a repetition of the current period
+            if (offset + 1 == period) {
+                right += offset + 1;
+                offset = 0;
+            } else {
+                offset += 1;
+            }
+        } else {
+            // Suffix at `right` is larger: restart from it
+            left = right;
+            right += 1;
+            offset = 0;
+            period = 1;
+        }
+    }
+    return .{ .pos = left, .period = period };
+}
+
+inline fn toLowerVec32(v: Vec32) Vec32 {
+    const is_upper = (v >= UPPER_A_VEC32) & (v <= UPPER_Z_VEC32);
+    return @select(u8, is_upper, v + CASE_DIFF_VEC32, v);
+}
+
+inline fn fold(c: u8, case_insensitive: bool) u8 {
+    return if (case_insensitive) std.ascii.toLower(c) else c;
+}
+
+/// Index of the first byte where `hay` differs from `needle` (equal lengths)
+fn firstMismatch(needle: []const u8, hay: []const u8, case_insensitive: bool) ?usize {
+    var i: usize = 0;
+    while (i + 32 <= needle.len) : (i += 32) {
+        var h: Vec32 = hay[i..][0..32].*;
+        if (case_insensitive) h = toLowerVec32(h);
+        const p: Vec32 = needle[i..][0..32].*;
+        const diff: u32 = @bitCast(h != p);
+        if (diff != 0) return i + @ctz(diff);
+    }
+    while (i < needle.len) : (i += 1) {
+        if (fold(hay[i], case_insensitive) != needle[i]) return i;
+    }
+    return null;
+}
+
+/// Index of the last byte where `hay` differs from `needle` (equal lengths)
+fn lastMismatch(needle: []const u8, hay: []const u8, case_insensitive: bool) ?usize {
+    var end = needle.len;
+    while (end >= 32) : (end -= 32) {
+        var h: Vec32 = hay[end - 32 ..][0..32].*;
+        if (case_insensitive) h = toLowerVec32(h);
+        const p: Vec32 = needle[end - 32 ..][0..32].*;
+        const diff: u32 = @bitCast(h != p);
+        if (diff != 0) return end - 1 - @clz(diff);
+    }
+    while (end > 0) : (end -= 1) {
+        if (fold(hay[end - 1], case_insensitive) != needle[end - 1]) return end - 1;
+    }
+    return null;
+}
+
+/// Position of the next `byte` (either case under -i) at or after `from`
+fn findByte(text: []const u8, from: usize, byte: u8, case_insensitive: bool) ?usize {
+    if (!case_insensitive or !std.ascii.isAlphabetic(byte)) {
+        return std.mem.indexOfScalarPos(u8, text, from, byte);
+    }
+    const target: Vec32 = @splat(byte);
+    var i = from;
+    while (i + 32 <= text.len) : (i += 32) {
+        const chunk: Vec32 = text[i..][0..32].*;
+        const hits: u32 = @bitCast(toLowerVec32(chunk) == target);
+        if (hits != 0) return i + @ctz(hits);
+    }
+    while (i < text.len) : (i += 1) {
+        if (std.ascii.toLower(text[i]) == byte) return i;
+    }
+    return null;
+}
+
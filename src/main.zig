@@ -4,6 +4,21 @@ const gpu = @import("gpu");
 const cpu = @import("cpu");
 const cpu_gnu = @import("cpu_gnu");
 const pcre = @import("pcre");
+const input = @import("input.zig");
+const timerange = @import("timerange.zig");
+const sidecar = @import("sidecar.zig");
+const output = @import("output.zig");
+const scheduler = @import("scheduler.zig");
+const records = @import("records.zig");
+const fields = @import("fields.zig");
+const archive = @import("archive.zig");
+const budget = @import("budget.zig");
+const stats = @import("stats.zig");
+const numa = @import("numa.zig");
+const builtin_query = @import("builtin_query.zig");
+const watch = @import("watch.zig");
+const candidates = @import("candidates.zig");
+const histogram = @import("histogram.zig");
 
 const SearchOptions = gpu.SearchOptions;
 
@@ -65,6 +80,7 @@ pub fn main() !u8 {
     var verbose = false;
     var count_only = false;
     var line_numbers = false;
+    var byte_offset = false;
     var files_with_matches = false;
     var files_without_match = false;
     var quiet_mode = false;
@@ -73,7 +89,30 @@ pub fn main() !u8 {
     var after_context: u32 = 0;
     var recursive = false;
     var color_mode: ColorMode = .never;
+    var sort_mode: output.SortMode = .path;
     var config = AutoSelectConfig{};
+    var since: ?[]const u8 = null;
+    var until: ?[]const u8 = null;
+    var time_format: []const u8 = timerange.DEFAULT_FORMAT;
+    var sidecar_build = false;
+    var use_sidecar = true;
+    var explicit_pattern = false;
+    var files_from: ?[]const u8 = null;
+    var num_threads: usize = 0;
+    var record_start: ?[]const u8 = null;
+    var max_span: usize = records.DEFAULT_MAX_SPAN;
+    var field_list: ?[]const u8 = null;
+    var field_sep: ?u8 = null;
+    var csv = false;
+    var search_archives = false;
+    var max_memory: usize = 0;
+    var show_stats = false;
+    var builtin_name: ?[]const u8 = null;
+    var watch_mode = false;
+    var save_candidates_id: ?[]const u8 = null;
+    var within_id: ?[]const u8 = null;
+    var histogram_spec: ?[]const u8 = null;
+    var histogram_format: histogram.OutputFormat = .table;
 
     // Parse arguments
     var i: usize = 1;
@@ -83,6 +122,8 @@ pub fn main() !u8 {
             options.case_insensitive = true;
         } else if (std.mem.eql(u8, arg, "-w") or std.mem.eql(u8, arg, "--word-regexp")) {
             options.word_boundary = true;
+        } else if (std.mem.eql(u8, arg, "-x") or std.mem.eql(u8, arg, "--line-regexp")) {
+            options.line_regexp = true;
         } else if (std.mem.eql(u8, arg, "-v") or std.mem.eql(u8, arg, "--invert-match")) {
             options.invert_match = true;
         } else if (std.mem.eql(u8, arg, "-F") or std.mem.eql(u8, arg, "--fixed-strings")) {
@@ -103,6 +144,12 @@ pub fn main() !u8 {
             count_only = true;
         } else if (std.mem.eql(u8, arg, "-n") or std.mem.eql(u8, arg, "--line-number")) {
             line_numbers = true;
+        } else if (std.mem.eql(u8, arg, "-b") or std.mem.eql(u8, arg, "--byte-offset")) {
+            byte_offset = true;
+        } else if (std.mem.eql(u8, arg, "-z") or std.mem.eql(u8, arg, "--null-data")) {
+            options.record_sep = 0;
+        } else if (std.mem.eql(u8, arg, "-U") or std.mem.eql(u8, arg, "--multiline")) {
+            options.multiline = true;
         } else if (std.mem.eql(u8, arg, "-l") or std.mem.eql(u8, arg, "--files-with-matches")) {
             files_with_matches = true;
         } else if (std.mem.eql(u8, arg, "-L") or std.mem.eql(u8, arg, "--files-without-match")) {
@@ -195,11 +242,14 @@ pub fn main() !u8 {
                 return 2;
             }
             try patterns.append(allocator, args[i]);
+            explicit_pattern = true;
         } else if (std.mem.startsWith(u8, arg, "-e")) {
             // -ePATTERN (no space)
             try patterns.append(allocator, arg[2..]);
+            explicit_pattern = true;
         } else if (std.mem.startsWith(u8, arg, "--regexp=")) {
             try patterns.append(allocator, arg["--regexp=".len..]);
+            explicit_pattern = true;
         } else if (std.mem.eql(u8, arg, "--cpu") or std.mem.eql(u8, arg, "--cpu-optimized")) {
             backend_mode = .cpu;
         } else if (std.mem.eql(u8, arg, "--gnu")) {
@@ -246,6 +296,78 @@ pub fn main() !u8 {
                 std.debug.print("Invalid --gpu-bias value: {s}\n", .{val});
                 return 2;
             };
+        } else if (std.mem.startsWith(u8, arg, "--since=")) {
+            since = arg["--since=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--until=")) {
+            until = arg["--until=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--time-format=")) {
+            time_format = arg["--time-format=".len..];
+        } else if (std.mem.eql(u8, arg, "--sidecar-build")) {
+            sidecar_build = true;
+        } else if (std.mem.eql(u8, arg, "--no-sidecar")) {
+            use_sidecar = false;
+        } else if (std.mem.startsWith(u8, arg, "--builtin-query=")) {
+            builtin_name = arg["--builtin-query=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--files-from=")) {
+            files_from = arg["--files-from=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--max-span=")) {
+            const val = arg["--max-span=".len..];
+            max_span = parseSize(val) catch {
+                std.debug.print("Invalid --max-span value: {s}\n", .{val});
+                return 2;
+            };
+        } else if (std.mem.startsWith(u8, arg, "--max-memory=")) {
+            const val = arg["--max-memory=".len..];
+            max_memory = parseSize(val) catch {
+                std.debug.print("Invalid --max-memory value: {s}\n", .{val});
+                return 2;
+            };
+        } else if (std.mem.startsWith(u8, arg, "--record-start=")) {
+            record_start = arg["--record-start=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--fields=")) {
+            field_list = arg["--fields=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--field-sep=")) {
+            const val = arg["--field-sep=".len..];
+            if (std.mem.eql(u8, val, "\\t")) {
+                field_sep = '\t';
+            } else if (val.len == 1) {
+                field_sep = val[0];
+            } else {
+                std.debug.print("Invalid --field-sep value: {s} (expected a single character)\n", .{val});
+                return 2;
+            }
+        } else if (std.mem.eql(u8, arg, "--csv")) {
+            csv = true;
+        } else if (std.mem.startsWith(u8, arg, "--sort=")) {
+            const val = arg["--sort=".len..];
+            sort_mode = std.meta.stringToEnum(output.SortMode, val) orelse {
+                std.debug.print("Invalid --sort value: {s} (expected path or none)\n", .{val});
+                return 2;
+            };
+        } else if (std.mem.eql(u8, arg, "--stats")) {
+            show_stats = true;
+        } else if (std.mem.startsWith(u8, arg, "--save-candidates=")) {
+            save_candidates_id = arg["--save-candidates=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--within=")) {
+            within_id = arg["--within=".len..];
+        } else if (std.mem.eql(u8, arg, "--watch")) {
+            watch_mode = true;
+        } else if (std.mem.startsWith(u8, arg, "--histogram=")) {
+            histogram_spec = arg["--histogram=".len..];
+        } else if (std.mem.startsWith(u8, arg, "--histogram-format=")) {
+            const val = arg["--histogram-format=".len..];
+            histogram_format = std.meta.stringToEnum(histogram.OutputFormat, val) orelse {
+                std.debug.print("Invalid --histogram-format value: {s} (expected table or json)\n", .{val});
+                return 2;
+            };
+        } else if (std.mem.eql(u8, arg, "--search-archives")) {
+            search_archives = true;
+        } else if (std.mem.startsWith(u8, arg, "--threads=")) {
+            const val = arg["--threads=".len..];
+            num_threads = std.fmt.parseInt(usize, val, 10) catch {
+                std.debug.print("Invalid --threads value: {s}\n", .{val});
+                return 2;
+            };
         } else if (std.mem.eql(u8, arg, "--verbose") or std.mem.eql(u8, arg, "-V")) {
             verbose = true;
         } else if (std.mem.eql(u8, arg, "-h") or std.mem.eql(u8, arg, "--help")) {
@@ -269,6 +391,7 @@ pub fn main() !u8 {
                 switch (c) {
                     'i' => options.case_insensitive = true,
                     'w' => options.word_boundary = true,
+                    'x' => options.line_regexp = true,
                     'v' => options.invert_match = true,
                     'F' => {
                         options.fixed_string = true;
@@ -290,6 +413,9 @@ pub fn main() !u8 {
                     },
                     'c' => count_only = true,
                     'n' => line_numbers = true,
+                    'b' => byte_offset = true,
+                    'z' => options.record_sep = 0,
+                    'U' => options.multiline = true,
                     'l' => files_with_matches = true,
                     'L' => files_without_match = true,
                     'q' => quiet_mode = true,
@@ -313,6 +439,48 @@ pub fn main() !u8 {
         }
     }
 
+    // --sidecar-build takes only file operands
+    if (sidecar_build) {
+        if (!explicit_pattern and patterns.items.len > 0) try files.insert(allocator, 0, patterns.items[0]);
+        if (files.items.len == 0) {
+            std.debug.print("Option --sidecar-build requires FILE operands\n", .{});
+            return 2;
+        }
+        const format = timerange.Format{ .spec = time_format };
+        format.validate() catch {
+            std.debug.print("Invalid --time-format value: {s}\n", .{time_format});
+            return 2;
+        };
+        var ok = true;
+        for (files.items) |path| {
+            if (!buildSidecars(allocator, path, recursive, format, verbose)) ok = false;
+        }
+        return if (ok) 0 else 2;
+    }
+
+    // --builtin-query searches with the set compiled in by -Dquery-file, so
+    // every operand is a file
+    if (builtin_name) |name| {
+        const compiled = builtin_query.name orelse {
+            std.debug.print("grep: no query set is built in (build with -Dquery-file=FILE)\n", .{});
+            return 2;
+        };
+        if (!std.mem.eql(u8, name, compiled)) {
+            std.debug.print("grep: unknown builtin query: {s} (built in: {s})\n", .{ name, compiled });
+            return 2;
+        }
+        if (explicit_pattern or options.case_insensitive or options.word_boundary or options.line_regexp or options.perl or options.multiline) {
+            std.debug.print("grep: --builtin-query cannot be combined with -e, -i, -w, -x, -P or -U\n", .{});
+            return 2;
+        }
+        try files.insertSlice(allocator, 0, patterns.items);
+        patterns.clearRetainingCapacity();
+        try patterns.appendSlice(allocator, builtin_query.patterns);
+        options.fixed_string = true;
+        options.extended = false;
+        backend_mode = .cpu;
+    }
+
     // If no patterns specified, error
     if (patterns.items.len == 0) {
         std.debug.print("Error: No pattern specified\n", .{});
@@ -320,8 +488,192 @@ pub fn main() !u8 {
         return 2;
     }
 
+    // -x, and -w on regexes, are compiled into the patterns as anchors and
+    // word-edge assertions, so each regex engine (CPU, GPU, union, PCRE)
+    // applies them within its scan. Fixed strings keep the literal engines'
+    // -w check, which already resumes past a rejected occurrence. Literals
+    // for the Unicode case-folding search stay as they are: it checks -w
+    // and -x itself, and a rewritten pattern would reach the ASCII-only
+    // folding of the regex engines instead.
+    var bound_patterns: std.ArrayListUnmanaged([]u8) = .{};
+    defer {
+        for (bound_patterns.items) |p| allocator.free(p);
+        bound_patterns.deinit(allocator);
+    }
+    const unicode_literals = for (patterns.items) |p| {
+        if (!cpu.isUnicodeLiteral(p, options)) break false;
+    } else patterns.items.len > 0;
+    if (!unicode_literals and (options.line_regexp or (options.word_boundary and !options.fixed_string))) {
+        try bound_patterns.ensureTotalCapacity(allocator, patterns.items.len);
+        for (patterns.items) |*p| {
+            const source = try cpu.boundSource(allocator, p.*, options);
+            bound_patterns.appendAssumeCapacity(source);
+            p.* = source;
+        }
+        options = cpu.boundOptions(options);
+    }
+
+    // --within searches only the lines a saved candidate set selected, by
+    // default in the files it names; --save-candidates records this run's
+    if (within_id != null or save_candidates_id != null) {
+        if (before_context > 0 or after_context > 0 or options.multiline or record_start != null or
+            since != null or until != null or search_archives)
+        {
+            std.debug.print("grep: --within and --save-candidates cannot be combined with context, -U, --record-start, --since/--until or --search-archives\n", .{});
+            return 2;
+        }
+    }
+    if (save_candidates_id) |id| {
+        if (!candidates.validId(id)) {
+            std.debug.print("Invalid --save-candidates value: {s} (letters, digits, '-', '_' and '.')\n", .{id});
+            return 2;
+        }
+        if (quiet_mode) {
+            std.debug.print("grep: --save-candidates cannot be combined with -q\n", .{});
+            return 2;
+        }
+    }
+    var within_set: ?candidates.Set = null;
+    defer if (within_set) |*set| set.deinit();
+    if (within_id) |id| {
+        within_set = candidates.Set.load(allocator, id) catch |err| {
+            std.debug.print("grep: --within={s}: {}\n", .{ id, err });
+            return 2;
+        };
+        if (files.items.len == 0 and files_from == null) {
+            if (within_set.?.files.items.len == 0) return 1;
+            for (within_set.?.files.items) |f| try files.append(allocator, f.path);
+        }
+    }
+
     // If no files specified, read from stdin
-    const read_stdin = files.items.len == 0;
+    const read_stdin = files.items.len == 0 and files_from == null;
+    if (save_candidates_id != null) {
+        const names_stdin = for (files.items) |f| {
+            if (std.mem.eql(u8, f, "-")) break true;
+        } else false;
+        if (read_stdin or names_stdin) {
+            std.debug.print("grep: --save-candidates requires FILE operands\n", .{});
+            return 2;
+        }
+    }
+
+    if (files_from) |list_path| {
+        if (list_path.len == 0) {
+            std.debug.print("Option --files-from requires a FILE argument\n", .{});
+            return 2;
+        }
+        if (std.mem.eql(u8, list_path, "-")) {
+            for (files.items) |f| {
+                if (std.mem.eql(u8, f, "-")) {
+                    std.debug.print("grep: standard input cannot be both --files-from and a FILE\n", .{});
+                    return 2;
+                }
+            }
+        }
+    }
+
+    // --watch prints JSON line deltas for the files below its directories
+    if (watch_mode) {
+        if (files.items.len == 0 or files_from != null) {
+            std.debug.print("grep: --watch requires DIRECTORY operands\n", .{});
+            return 2;
+        }
+        if (count_only or files_with_matches or files_without_match or quiet_mode or only_matching or
+            before_context > 0 or after_context > 0 or options.multiline or record_start != null or
+            since != null or until != null or search_archives)
+        {
+            std.debug.print("grep: --watch cannot be combined with -c, -l, -L, -q, -o, context, -U, --record-start, --since/--until or --search-archives\n", .{});
+            return 2;
+        }
+    }
+
+    // --histogram counts the selected lines per time bucket and prints the
+    // table once every input has been searched
+    var hist: ?histogram.Histogram = null;
+    defer if (hist) |*h| h.deinit();
+    if (histogram_spec) |arg| {
+        var spec = histogram.Spec.parse(arg) catch {
+            std.debug.print("Invalid --histogram value: {s} (expected FIELD_REGEX:BUCKET, e.g. :5m)\n", .{arg});
+            return 2;
+        };
+        spec.format = .{ .spec = time_format };
+        spec.format.validate() catch {
+            std.debug.print("Invalid --time-format value: {s}\n", .{time_format});
+            return 2;
+        };
+        if (count_only or files_with_matches or files_without_match or quiet_mode or only_matching or
+            before_context > 0 or after_context > 0 or options.multiline or record_start != null or
+            watch_mode or save_candidates_id != null)
+        {
+            std.debug.print("grep: --histogram cannot be combined with -c, -l, -L, -q, -o, context, -U, --record-start, --watch or --save-candidates\n", .{});
+            return 2;
+        }
+        hist = histogram.Histogram.init(allocator, spec);
+    }
+
+    if (record_start) |start| {
+        if (start.len == 0) {
+            std.debug.print("Option --record-start requires a REGEX argument\n", .{});
+            return 2;
+        }
+        if (options.record_sep != '\n') {
+            std.debug.print("grep: --record-start cannot be combined with -z\n", .{});
+            return 2;
+        }
+        if (before_context > 0 or after_context > 0) {
+            std.debug.print("grep: --record-start cannot be combined with context options\n", .{});
+            return 2;
+        }
+    }
+
+    // --max-memory bounds the worker count, the bytes each worker searches
+    // at a time, and whether the GPU's buffers fit at all
+    const memory = budget.Budget{ .limit = max_memory };
+    const multi_file = recursive or files_from != null;
+    const workers = memory.workers(if (num_threads > 0) num_threads else scheduler.defaultWorkers());
+    const concurrent = if (multi_file or search_archives) workers else 1;
+    if (memory.enabled()) {
+        config.max_gpu_file_size = @min(config.max_gpu_file_size, memory.gpuMaxInput(concurrent));
+    }
+
+    var input_opts = InputOptions{
+        .use_sidecar = use_sidecar,
+        .record_start = record_start,
+        .max_span = max_span,
+        .chunk_size = memory.chunkSize(concurrent),
+    };
+    if (search_archives) {
+        // Files are already spread over workers with -r/--files-from
+        input_opts.archive_workers = if (multi_file) 1 else workers;
+    }
+    // A budget searches large inputs in sequential chunks instead
+    if (!multi_file and !memory.enabled()) input_opts.segment_workers = workers;
+    if (within_set) |*set| input_opts.within = set;
+    if (field_list) |list| {
+        var selector = fields.Selector{ .sep = field_sep orelse if (csv) ',' else '\t', .quoted = csv };
+        selector.parseList(list) catch {
+            std.debug.print("Invalid --fields value: {s}\n", .{list});
+            return 2;
+        };
+        if (record_start != null or options.multiline) {
+            std.debug.print("grep: --fields cannot be combined with --record-start or -U\n", .{});
+            return 2;
+        }
+        input_opts.fields = selector;
+    } else if (field_sep != null or csv) {
+        std.debug.print("grep: --field-sep and --csv require --fields=LIST\n", .{});
+        return 2;
+    }
+    if (since != null or until != null) {
+        input_opts.time_range = timerange.TimeRange.init(.{ .spec = time_format }, since, until) catch |err| {
+            switch (err) {
+                error.InvalidTimeFormat => std.debug.print("Invalid --time-format value: {s}\n", .{time_format}),
+                error.InvalidTimestamp => std.debug.print("Invalid --since/--until value for format '{s}'\n", .{time_format}),
+            }
+            return 2;
+        };
+    }
 
     if (verbose) {
         std.debug.print("grep - GPU-accelerated grep\n", .{});
@@ -330,6 +682,14 @@ pub fn main() !u8 {
             std.debug.print("  - \"{s}\" (len={d})\n", .{ p, p.len });
         }
         std.debug.print("Mode: {s}\n", .{@tagName(backend_mode)});
+        if (memory.enabled()) {
+            std.debug.print("Memory budget: {d}MB, {d} workers, {d}KB chunks, GPU input up to {d}KB\n", .{
+                max_memory / (1024 * 1024),
+                workers,
+                input_opts.chunk_size / 1024,
+                config.max_gpu_file_size / 1024,
+            });
+        }
         std.debug.print("Options: case_insensitive={}, word_boundary={}, invert={}\n", .{
             options.case_insensitive,
             options.word_boundary,
@@ -351,7 +711,8 @@ pub fn main() !u8 {
     // Track whether we found any matches (for exit code)
     var found_match = false;
     var had_error = false;
-    const show_filename = files.items.len > 1;
+    // A path list can name any number of files
+    const show_filename = files.items.len > 1 or files_from != null;
 
     // Resolve color mode: 'auto' checks if stdout is a tty
     const effective_color_mode: ColorMode = switch (color_mode) {
@@ -362,6 +723,7 @@ pub fn main() !u8 {
     const output_opts = OutputOptions{
         .count_only = count_only,
         .line_numbers = line_numbers,
+        .byte_offset = byte_offset,
         .files_with_matches = files_with_matches,
         .files_without_match = files_without_match,
         .quiet_mode = quiet_mode,
@@ -370,11 +732,52 @@ pub fn main() !u8 {
         .before_context = before_context,
         .after_context = after_context,
         .color_mode = effective_color_mode,
+        .sort = sort_mode,
+    };
+
+    var gpu_session = GpuSession{ .allocator = allocator };
+    defer gpu_session.deinit();
+
+    var ctx = Context{
+        .allocator = allocator,
+        .patterns = patterns.items,
+        .options = options,
+        .backend_mode = backend_mode,
+        .config = config,
+        .verbose = verbose,
+        .output_opts = output_opts,
+        .input_opts = input_opts,
+        .gpu_session = &gpu_session,
+        .builtin_query = builtin_name != null,
     };
+    var saved_set = candidates.Set.init(allocator);
+    defer saved_set.deinit();
+    if (save_candidates_id != null) ctx.save_candidates = &saved_set;
+    if (hist) |*h| ctx.histogram = h;
+    var run_stats = stats.Stats.init();
+    if (show_stats) ctx.stats = &run_stats;
+    defer if (ctx.stats) |st| st.print();
+
+    if (watch_mode) return runWatch(&ctx, files.items);
+
+    // -r and --files-from fan out over worker threads
+    if (multi_file) {
+        const result = searchFiles(&ctx, files.items, files_from, recursive, workers);
+        if (save_candidates_id) |id| {
+            if (!saveCandidates(&saved_set, id)) return 2;
+        }
+        if (ctx.histogram) |h| writeHistogram(allocator, h, histogram_format);
+        if (result.had_error and !(quiet_mode and result.found)) return 2;
+        return if (result.found) 0 else 1;
+    }
+
+    var worker = Worker.init(allocator);
+    defer worker.deinit();
 
     // Process each file or stdin
     if (read_stdin) {
-        const result = processStdin(allocator, patterns.items, options, backend_mode, config, verbose, output_opts, null);
+        const result = processStdin(&ctx, &worker, null);
+        worker.out.finish();
         if (result.found) found_match = true;
         if (result.had_error) had_error = true;
         // For quiet mode, exit early on first match
@@ -382,37 +785,27 @@ pub fn main() !u8 {
     } else {
         for (files.items) |filepath| {
             // Handle "-" as stdin
-            if (std.mem.eql(u8, filepath, "-")) {
-                const result = processStdin(allocator, patterns.items, options, backend_mode, config, verbose, output_opts, if (show_filename) "(standard input)" else null);
-                if (result.found) found_match = true;
-                if (result.had_error) had_error = true;
-            } else if (recursive) {
-                // Check if path is a directory
-                const stat = std.fs.cwd().statFile(filepath) catch |err| {
-                    std.debug.print("grep: {s}: {}\n", .{ filepath, err });
-                    had_error = true;
-                    continue;
-                };
-                if (stat.kind == .directory) {
-                    // In recursive mode, always show filenames
-                    var recursive_opts = output_opts;
-                    recursive_opts.show_filename = true;
-                    processDirectory(allocator, filepath, patterns.items, options, backend_mode, config, verbose, recursive_opts, &found_match, &had_error, quiet_mode);
-                } else {
-                    const result = processFile(allocator, filepath, patterns.items, options, backend_mode, config, verbose, output_opts);
-                    if (result.found) found_match = true;
-                    if (result.had_error) had_error = true;
-                }
-            } else {
-                const result = processFile(allocator, filepath, patterns.items, options, backend_mode, config, verbose, output_opts);
-                if (result.found) found_match = true;
-                if (result.had_error) had_error = true;
-            }
+            const result = if (std.mem.eql(u8, filepath, "-"))
+                processStdin(&ctx, &worker, if (show_filename) "(standard input)" else null)
+            else
+                processFile(&ctx, &worker, filepath);
+            worker.out.finish();
+            if (result.found) found_match = true;
+            if (result.had_error) had_error = true;
             // For quiet mode, exit early on first match
             if (quiet_mode and found_match) return 0;
         }
     }
 
+    if (save_candidates_id) |id| {
+        if (!saveCandidates(&saved_set, id)) had_error = true;
+    }
+    if (ctx.histogram) |h| {
+        // Worker threads publish as they deinit; this worker outlives the table
+        worker.histogram.publish();
+        writeHistogram(allocator, h, histogram_format);
+    }
+
     // Exit codes: 0 = match found, 1 = no match, 2 = error
     if (had_error) return 2;
     if (found_match) return 0;
@@ -434,6 +827,7 @@ const ColorMode = enum {
 const OutputOptions = struct {
     count_only: bool = false,
     line_numbers: bool = false,
+    byte_offset: bool = false, // -b: prefix the source byte offset of each line
     files_with_matches: bool = false,
     files_without_match: bool = false,
     quiet_mode: bool = false,
@@ -442,6 +836,7 @@ const OutputOptions = struct {
     before_context: u32 = 0, // -B N: show N lines before match
     after_context: u32 = 0, // -A N: show N lines after match
     color_mode: ColorMode = .never,
+    sort: output.SortMode = .path, // output order of inputs searched in parallel
 };
 
 // ANSI color escape codes
@@ -460,6 +855,9 @@ fn doSearch(text: []const u8, pattern: []const u8, options: SearchOptions, alloc
             cpu_gnu.search(text, pattern, options, allocator)
         else
             cpu.search(text, pattern, options, allocator);
+    } else if (!use_gnu and cpu.isUnicodeLiteral(pattern, options)) {
+        // A metacharacter-free pattern under -i: Unicode case-folding literal search
+        return cpu.search(text, pattern, options, allocator);
     } else if (options.perl) {
         // Use PCRE2 for Perl-compatible regex (-P flag)
         return pcre.searchPcre(text, pattern, options, allocator);
@@ -471,8 +869,18 @@ fn doSearch(text: []const u8, pattern: []const u8, options: SearchOptions, alloc
     }
 }
 
-/// Search for multiple patterns in text, combining results (OR semantics)
-fn searchMultiPattern(allocator: std.mem.Allocator, text: []const u8, all_patterns: []const []const u8, options: SearchOptions, backend_mode: BackendMode) !gpu.SearchResult {
+/// Search for multiple patterns in text, combining results (OR semantics).
+/// Uses the worker's union automaton when the patterns allow one, otherwise
+/// searches each pattern separately and merges the lines.
+fn searchMultiPattern(ctx: *const Context, worker: *Worker, text: []const u8) !gpu.SearchResult {
+    if (worker.matchers.multiRegex(ctx)) |multi| {
+        return multi.search(text, ctx.allocator);
+    }
+
+    const allocator = ctx.allocator;
+    const all_patterns = ctx.patterns;
+    const options = ctx.options;
+    const backend_mode = ctx.backend_mode;
     if (all_patterns.len == 0) {
         return gpu.SearchResult{ .matches = &.{}, .total_matches = 0, .allocator = allocator };
     }
@@ -527,14 +935,14 @@ const LineInfo = struct {
 };
 
 /// Build an array of line boundaries from text
-fn buildLineIndex(allocator: std.mem.Allocator, text: []const u8) ![]LineInfo {
+fn buildLineIndex(allocator: std.mem.Allocator, text: []const u8, eol: u8) ![]LineInfo {
     var lines: std.ArrayListUnmanaged(LineInfo) = .{};
     errdefer lines.deinit(allocator);
 
     var line_start: usize = 0;
     var i: usize = 0;
     while (i < text.len) : (i += 1) {
-        if (text[i] == '\n') {
+        if (text[i] == eol) {
             try lines.append(allocator, .{ .start = line_start, .end = i });
             line_start = i + 1;
         }
@@ -566,6 +974,7 @@ fn findLineNumber(lines: []const LineInfo, pos: usize) usize {
 
 /// Output a line with colored match highlighting
 fn outputLineWithColor(
+    out: *output.Sink,
     text: []const u8,
     line_start: usize,
     line_end: usize,
@@ -575,7 +984,7 @@ fn outputLineWithColor(
     const line = text[line_start..line_end];
 
     if (!color) {
-        _ = std.posix.write(std.posix.STDOUT_FILENO, line) catch {};
+        out.write(line);
         return;
     }
 
@@ -598,7 +1007,7 @@ fn outputLineWithColor(
 
     if (span_count == 0) {
         // No matches in this line, output as-is
-        _ = std.posix.write(std.posix.STDOUT_FILENO, line) catch {};
+        out.write(line);
         return;
     }
 
@@ -614,32 +1023,34 @@ fn outputLineWithColor(
     for (match_spans[0..span_count]) |span| {
         // Output text before match
         if (pos < span.start) {
-            _ = std.posix.write(std.posix.STDOUT_FILENO, line[pos..span.start]) catch {};
+            out.write(line[pos..span.start]);
         }
         // Output match with color
-        _ = std.posix.write(std.posix.STDOUT_FILENO, COLOR_MATCH_START) catch {};
-        _ = std.posix.write(std.posix.STDOUT_FILENO, line[span.start..span.end]) catch {};
-        _ = std.posix.write(std.posix.STDOUT_FILENO, COLOR_RESET) catch {};
+        out.write(COLOR_MATCH_START);
+        out.write(line[span.start..span.end]);
+        out.write(COLOR_RESET);
         pos = span.end;
     }
     // Output remaining text after last match
     if (pos < line.len) {
-        _ = std.posix.write(std.posix.STDOUT_FILENO, line[pos..]) catch {};
+        out.write(line[pos..]);
     }
 }
 
 /// Output matches with context lines
 fn outputWithContext(
-    text: []const u8,
+    out: *output.Sink,
+    in: SearchInput,
+    eol: u8,
     matches: []const gpu.MatchResult,
     output_opts: OutputOptions,
-    filename_prefix: ?[]const u8,
     allocator: std.mem.Allocator,
 ) void {
     if (matches.len == 0) return;
+    const text = in.text;
 
     // Build line index
-    const lines = buildLineIndex(allocator, text) catch return;
+    const lines = buildLineIndex(allocator, text, eol) catch return;
     defer allocator.free(lines);
 
     if (lines.len == 0) return;
@@ -691,7 +1102,7 @@ fn outputWithContext(
     for (ranges.items) |range| {
         // Print separator between groups
         if (!first_range) {
-            _ = std.posix.write(std.posix.STDOUT_FILENO, "--\n") catch {};
+            out.write("--\n");
         }
         first_range = false;
 
@@ -702,238 +1113,991 @@ fn outputWithContext(
             const is_match = match_lines.contains(line_idx);
             const separator: []const u8 = if (is_match) ":" else "-";
 
-            if (filename_prefix) |prefix| {
-                _ = std.posix.write(std.posix.STDOUT_FILENO, prefix) catch {};
-                _ = std.posix.write(std.posix.STDOUT_FILENO, separator) catch {};
+            if (in.label) |prefix| {
+                out.write(prefix);
+                out.write(separator);
             }
             if (output_opts.line_numbers) {
-                var num_buf: [16]u8 = undefined;
-                const num_str = std.fmt.bufPrint(&num_buf, "{d}{s}", .{ line_idx + 1, separator }) catch continue;
-                _ = std.posix.write(std.posix.STDOUT_FILENO, num_str) catch {};
+                var num_buf: [24]u8 = undefined;
+                const num_str = std.fmt.bufPrint(&num_buf, "{d}{s}", .{ in.line_base + line_idx + 1, separator }) catch continue;
+                out.write(num_str);
             }
+            if (output_opts.byte_offset) writeByteOffset(out, in, line.start, separator);
             // Use color only for matching lines
             const use_color = output_opts.color_mode == .always and is_match;
-            outputLineWithColor(text, line.start, line.end, matches, use_color);
-            _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
+            outputLineWithColor(out, text, line.start, line.end, matches, use_color);
+            out.write(&[1]u8{eol});
         }
     }
 }
 
-fn processStdin(allocator: std.mem.Allocator, all_patterns: []const []const u8, options: SearchOptions, backend_mode: BackendMode, config: AutoSelectConfig, verbose: bool, output_opts: OutputOptions, filename_prefix: ?[]const u8) ProcessResult {
-    // Read all stdin into a buffer
-    var stdin_list: std.ArrayListUnmanaged(u8) = .{};
-    defer stdin_list.deinit(allocator);
+/// Everything a search needs besides the input itself; built once in main()
+const Context = struct {
+    allocator: std.mem.Allocator,
+    patterns: []const []const u8,
+    options: SearchOptions,
+    backend_mode: BackendMode,
+    config: AutoSelectConfig,
+    verbose: bool,
+    output_opts: OutputOptions,
+    input_opts: InputOptions = .{},
+    gpu_session: *GpuSession,
+    stats: ?*stats.Stats = null, // --stats counters
+    save_candidates: ?*candidates.Set = null, // --save-candidates: collects each file's selected lines
+    builtin_query: bool = false, // --builtin-query: patterns are the compiled-in set
+    histogram: ?*histogram.Histogram = null, // --histogram: count selected lines per time bucket instead of printing them
+};
 
-    var buf: [4096]u8 = undefined;
-    while (true) {
-        const bytes_read = std.posix.read(std.posix.STDIN_FILENO, &buf) catch |err| {
-            if (err == error.WouldBlock) continue;
-            std.debug.print("grep: error reading stdin: {}\n", .{err});
-            return .{ .found = false, .had_error = true };
-        };
-        if (bytes_read == 0) break;
-        stdin_list.appendSlice(allocator, buf[0..bytes_read]) catch {
-            std.debug.print("grep: out of memory\n", .{});
-            return .{ .found = false, .had_error = true };
-        };
-        if (stdin_list.items.len > gpu.MAX_GPU_BUFFER_SIZE) break;
+/// Input-side options that decide which bytes of each input reach the engines
+const InputOptions = struct {
+    time_range: ?timerange.TimeRange = null, // --since/--until window
+    use_sidecar: bool = true, // consult FILE.grepidx block indexes when fresh
+    record_start: ?[]const u8 = null, // --record-start: ERE starting each multi-line record
+    max_span: usize = records.DEFAULT_MAX_SPAN, // --max-span: longest -U match, segment overlap
+    fields: ?fields.Selector = null, // --fields/--field-sep/--csv: search only these columns
+    archive_workers: usize = 0, // --search-archives: threads per zip (0 = archives off)
+    chunk_size: usize = 0, // --max-memory: search larger inputs in chunks of this size (0 = whole)
+    segment_workers: usize = 1, // threads splitting one large file (single-file runs)
+    within: ?*const candidates.Set = null, // --within: search only these lines of each file
+};
+
+/// One searchable buffer plus how its results are labelled
+const SearchInput = struct {
+    text: []const u8,
+    label: ?[]const u8 = null, // printed before each output line (null hides it)
+    list_name: ?[]const u8 = null, // printed by -l/-L
+    line_base: u64 = 0, // lines preceding `text` in the underlying input (for -n)
+    source: ?output.FileRegion = null, // file bytes identical to `text`, for zero-copy output
+    byte_base: usize = 0, // offset of `text` within the (decoded) input, for -b
+    transcoded: ?*const input.Transcoded = null, // maps decoded offsets back to a UTF-16 source
+    records: ?*const records.RecordMap = null, // --record-start boundaries within `text`
+};
+
+/// End of the line or record starting at `start`, before its terminator
+fn recordEnd(in: SearchInput, eol: u8, start: usize) usize {
+    if (in.records) |map| return map.end(map.indexOf(start));
+    return std.mem.indexOfScalarPos(u8, in.text, start, eol) orelse in.text.len;
+}
+
+/// Print the -b prefix for `pos` in `in.text`: its offset in the source bytes
+fn writeByteOffset(out: *output.Sink, in: SearchInput, pos: usize, separator: []const u8) void {
+    const decoded = in.byte_base + pos;
+    const offset: u64 = if (in.transcoded) |t| t.sourceOffset(decoded) else decoded;
+    var buf: [32]u8 = undefined;
+    out.write(std.fmt.bufPrint(&buf, "{d}{s}", .{ offset, separator }) catch return);
+}
+
+/// GPU state shared by every input of a run. Hardware detection and searcher
+/// setup happen once, on first use, and searches take turns on the single
+/// device context. A backend that fails to initialize is not retried.
+const GpuSession = struct {
+    allocator: std.mem.Allocator,
+    mutex: std.Thread.Mutex = .{},
+    metal: ?*gpu.metal.MetalSearcher = null,
+    vulkan: ?*gpu.vulkan.VulkanSearcher = null,
+    metal_failed: bool = false,
+    vulkan_failed: bool = false,
+    detected_config: ?AutoSelectConfig = null,
+
+    fn deinit(self: *GpuSession) void {
+        if (build_options.is_macos) {
+            if (self.metal) |searcher| searcher.deinit();
+        }
+        if (self.vulkan) |searcher| searcher.deinit();
     }
-    const text = stdin_list.items;
 
-    const file_size = text.len;
+    /// For auto mode, detect hardware capabilities to adjust thresholds
+    fn adjustedConfig(self: *GpuSession, ctx: *const Context) AutoSelectConfig {
+        if (ctx.backend_mode != .auto or ctx.config.hardware_detected) return ctx.config;
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.detected_config) |config| return config;
 
-    // For auto mode, detect hardware capabilities
-    var adjusted_config = config;
-    if (backend_mode == .auto and !config.hardware_detected) {
+        var adjusted_config = ctx.config;
         if (build_options.is_macos) {
-            if (gpu.metal.MetalSearcher.init(allocator)) |searcher| {
+            if (self.metalLocked(ctx.verbose)) |searcher| {
                 adjusted_config.applyHardwareCapabilities(searcher.capabilities);
-                searcher.deinit();
-            } else |_| {}
+                if (ctx.verbose) printHardware(searcher.capabilities, adjusted_config);
+            }
         } else {
-            if (gpu.vulkan.VulkanSearcher.init(allocator)) |searcher| {
+            if (self.vulkanLocked(ctx.verbose)) |searcher| {
                 adjusted_config.applyHardwareCapabilities(searcher.capabilities);
-                searcher.deinit();
-            } else |_| {}
+                if (ctx.verbose) printHardware(searcher.capabilities, adjusted_config);
+            }
+        }
+        // Hardware limits never raise the memory budget's cap
+        adjusted_config.max_gpu_file_size = @min(adjusted_config.max_gpu_file_size, ctx.config.max_gpu_file_size);
+        self.detected_config = adjusted_config;
+        return adjusted_config;
+    }
+
+    fn metalLocked(self: *GpuSession, verbose: bool) ?*gpu.metal.MetalSearcher {
+        if (self.metal == null and !self.metal_failed) {
+            self.metal = gpu.metal.MetalSearcher.init(self.allocator) catch |err| blk: {
+                if (verbose) std.debug.print("Metal init failed: {}, falling back to CPU\n", .{err});
+                self.metal_failed = true;
+                break :blk null;
+            };
+        }
+        return self.metal;
+    }
+
+    fn vulkanLocked(self: *GpuSession, verbose: bool) ?*gpu.vulkan.VulkanSearcher {
+        if (self.vulkan == null and !self.vulkan_failed) {
+            self.vulkan = gpu.vulkan.VulkanSearcher.init(self.allocator) catch |err| blk: {
+                if (verbose) std.debug.print("Vulkan init failed: {}, falling back to CPU\n", .{err});
+                self.vulkan_failed = true;
+                break :blk null;
+            };
+        }
+        return self.vulkan;
+    }
+
+    /// Search on Metal; null means the caller should fall back to the CPU
+    fn searchMetal(self: *GpuSession, text: []const u8, pattern: []const u8, options: SearchOptions, verbose: bool) ?gpu.SearchResult {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        const searcher = self.metalLocked(verbose) orelse return null;
+        // Use GPU regex for regex patterns (including PCRE), literal search for fixed strings
+        const use_regex = !options.fixed_string or options.perl;
+        if (use_regex) {
+            return searcher.searchRegex(text, pattern, options, self.allocator) catch |err| {
+                if (verbose) std.debug.print("Metal regex failed: {}, falling back to CPU\n", .{err});
+                return null;
+            };
+        }
+        return searcher.search(text, pattern, options, self.allocator) catch |err| {
+            if (verbose) std.debug.print("Metal search failed: {}, falling back to CPU\n", .{err});
+            return null;
+        };
+    }
+
+    /// Search on Vulkan; null means the caller should fall back to the CPU
+    fn searchVulkan(self: *GpuSession, text: []const u8, pattern: []const u8, options: SearchOptions, verbose: bool) ?gpu.SearchResult {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        const searcher = self.vulkanLocked(verbose) orelse return null;
+        // Use GPU regex for regex patterns (including PCRE), literal search for fixed strings
+        const use_regex = !options.fixed_string or options.perl;
+        if (use_regex) {
+            return searcher.searchRegex(text, pattern, options, self.allocator) catch |err| {
+                if (verbose) std.debug.print("Vulkan regex failed: {}, falling back to CPU\n", .{err});
+                return null;
+            };
+        }
+        return searcher.search(text, pattern, options, self.allocator) catch |err| {
+            if (verbose) std.debug.print("Vulkan search failed: {}, falling back to CPU\n", .{err});
+            return null;
+        };
+    }
+};
+
+/// Compiled forms of the search pattern, built on first use and reused for
+/// every input the owning worker searches
+const Matchers = struct {
+    allocator: std.mem.Allocator,
+    cpu_regex: ?cpu.CompiledRegex = null,
+    pcre_regex: ?pcre.PcreRegex = null,
+    pcre_failed: bool = false,
+    multi: ?cpu.MultiRegex = null,
+    multi_literals: ?[][]const u8 = null,
+    multi_failed: bool = false,
+    record_start: ?cpu.CompiledRegex = null,
+    histogram_field: ?cpu.CompiledRegex = null,
+    histogram_pcre: ?pcre.PcreRegex = null,
+
+    fn deinit(self: *Matchers) void {
+        if (self.cpu_regex) |*r| r.deinit();
+        if (self.record_start) |*r| r.deinit();
+        if (self.histogram_field) |*r| r.deinit();
+        if (self.histogram_pcre) |*r| r.deinit();
+        if (self.pcre_regex) |*r| r.deinit();
+        if (self.multi) |*m| m.deinit();
+        if (self.multi_literals) |l| self.allocator.free(l);
+    }
+
+    /// Union automaton over all -e patterns, or null when they need the
+    /// per-pattern path (GNU backend, -P, -U, lookaround, too many patterns)
+    fn multiRegex(self: *Matchers, ctx: *const Context) ?*cpu.MultiRegex {
+        if (self.multi == null and !self.multi_failed) {
+            self.multi_failed = true;
+            if (ctx.backend_mode == .cpu_gnu or ctx.options.perl or ctx.options.multiline) return null;
+
+            // Shared prefilter: one required literal per pattern, or none
+            self.multi_literals = self.allocator.alloc([]const u8, ctx.patterns.len) catch return null;
+            var literals: ?[]const []const u8 = self.multi_literals.?;
+            for (ctx.patterns, 0..) |pattern, idx| {
+                const lit = sidecar.requiredLiteral(pattern, ctx.options) orelse {
+                    literals = null;
+                    break;
+                };
+                self.multi_literals.?[idx] = lit;
+            }
+
+            const spans = ctx.output_opts.only_matching or ctx.output_opts.color_mode == .always;
+            self.multi = cpu.MultiRegex.init(self.allocator, ctx.patterns, ctx.options, literals, spans) catch |err| {
+                if (ctx.verbose) std.debug.print("Multi-pattern union unavailable ({}), searching patterns separately\n", .{err});
+                return null;
+            };
+            self.multi_failed = false;
         }
+        return if (self.multi) |*m| m else null;
+    }
+
+    fn cpuRegex(self: *Matchers, pattern: []const u8, options: SearchOptions) !*cpu.CompiledRegex {
+        if (self.cpu_regex == null) {
+            self.cpu_regex = try cpu.CompiledRegex.init(self.allocator, pattern, options);
+        }
+        return &self.cpu_regex.?;
+    }
+
+    /// The --record-start pattern, an ERE matched line by line
+    fn recordStart(self: *Matchers, pattern: []const u8) !*cpu.CompiledRegex {
+        if (self.record_start == null) {
+            self.record_start = try cpu.CompiledRegex.init(self.allocator, pattern, .{ .fixed_string = false, .extended = true });
+        }
+        return &self.record_start.?;
+    }
+
+    /// Matches of the --histogram field pattern in `text`, an ERE (or a
+    /// Perl pattern under -P) matched line by line
+    fn histogramField(self: *Matchers, pattern: []const u8, text: []const u8, perl: bool, eol: u8) !gpu.SearchResult {
+        const options = SearchOptions{ .fixed_string = false, .extended = true, .perl = perl, .record_sep = eol };
+        if (perl) {
+            if (self.histogram_pcre == null) self.histogram_pcre = try pcre.PcreRegex.compile(pattern, options);
+            return pcre.searchCompiled(&self.histogram_pcre.?, text, options, self.allocator);
+        }
+        if (self.histogram_field == null) self.histogram_field = try cpu.CompiledRegex.init(self.allocator, pattern, options);
+        return self.histogram_field.?.search(text, self.allocator);
+    }
+
+    fn pcreRegex(self: *Matchers, pattern: []const u8, options: SearchOptions) ?*pcre.PcreRegex {
+        if (self.pcre_regex == null and !self.pcre_failed) {
+            self.pcre_regex = pcre.PcreRegex.compile(pattern, options) catch blk: {
+                self.pcre_failed = true;
+                break :blk null;
+            };
+        }
+        return if (self.pcre_regex) |*r| r else null;
+    }
+};
+
+/// Per-thread search state. The sequential path uses one; each thread of a
+/// parallel run (-r, --files-from) owns its own.
+const Worker = struct {
+    out: output.Sink,
+    matchers: Matchers,
+    histogram: histogram.Partial, // --histogram counts, merged into the run's by publish() (deinit publishes too)
+
+    fn init(allocator: std.mem.Allocator) Worker {
+        return .{
+            .out = output.Sink.init(allocator),
+            .matchers = .{ .allocator = allocator },
+            .histogram = .{ .allocator = allocator },
+        };
+    }
+
+    fn deinit(self: *Worker) void {
+        self.out.deinit();
+        self.matchers.deinit();
+        self.histogram.deinit();
     }
+};
+
+fn printHardware(caps: gpu.GpuCapabilities, config: AutoSelectConfig) void {
+    std.debug.print("Hardware: Score={d}, MinSize={d}KB, MaxSize={d}MB, Bias={d}\n", .{
+        caps.performanceScore(),
+        config.min_gpu_file_size / 1024,
+        config.max_gpu_file_size / (1024 * 1024),
+        config.gpu_bias,
+    });
+}
+
+/// Select backend for an input of `size` bytes using hardware-adjusted config
+fn selectBackend(ctx: *const Context, name: []const u8, size: usize) gpu.Backend {
+    const adjusted_config = ctx.gpu_session.adjustedConfig(ctx);
 
     // Use first pattern for backend selection heuristics
-    const first_pattern = if (all_patterns.len > 0) all_patterns[0] else "";
+    const first_pattern = if (ctx.patterns.len > 0) ctx.patterns[0] else "";
 
-    const backend: gpu.Backend = switch (backend_mode) {
-        .auto => selectOptimalBackend(first_pattern, options, file_size, adjusted_config),
+    const backend: gpu.Backend = switch (ctx.backend_mode) {
+        .auto => selectOptimalBackend(first_pattern, ctx.options, size, adjusted_config),
         .gpu => if (build_options.is_macos) .metal else .vulkan,
         .cpu, .cpu_gnu => .cpu, // Both CPU backends use .cpu for dispatch
         .metal => .metal,
         .vulkan => .vulkan,
     };
 
-    if (verbose) {
-        std.debug.print("(standard input) ({d} bytes)\n", .{file_size});
-        if (backend_mode == .cpu_gnu) {
+    if (ctx.verbose) {
+        std.debug.print("File: {s} ({d} bytes)\n", .{ name, size });
+        if (ctx.backend_mode == .auto) {
+            std.debug.print("Auto-selected backend: {s}\n", .{@tagName(backend)});
+        } else if (ctx.backend_mode == .cpu_gnu) {
             std.debug.print("Backend: cpu_gnu (GNU grep)\n", .{});
         } else {
             std.debug.print("Backend: {s}\n", .{@tagName(backend)});
         }
     }
+    return backend;
+}
+
+/// Run the search on the selected backend, falling back to CPU when a GPU
+/// backend cannot be initialized or fails
+fn runSearch(ctx: *const Context, worker: *Worker, text: []const u8, backend: gpu.Backend) !gpu.SearchResult {
+    const verbose = ctx.verbose;
+    const first_pattern = if (ctx.patterns.len > 0) ctx.patterns[0] else "";
+
+    if (ctx.builtin_query) {
+        return builtin_query.search(text, ctx.options.invert_match, ctx.options.record_sep, ctx.allocator);
+    }
 
     // For multiple patterns, always use CPU multi-pattern search
-    var result = if (all_patterns.len > 1)
-        searchMultiPattern(allocator, text, all_patterns, options, backend_mode) catch {
-            return .{ .found = false, .had_error = true };
-        }
-    else switch (backend) {
-        .metal => blk: {
+    if (ctx.patterns.len > 1) {
+        return searchMultiPattern(ctx, worker, text);
+    }
+
+    // GPU kernels match within '\n'-terminated lines and fold ASCII only
+    if (ctx.options.record_sep != '\n' or ctx.options.multiline or cpu.isUnicodeLiteral(first_pattern, ctx.options)) {
+        return cpuSearch(ctx, worker, text);
+    }
+
+    var gpu_options = ctx.options;
+    gpu_options.lines_only = linesOnly(ctx);
+
+    switch (backend) {
+        .metal => {
             if (build_options.is_macos) {
-                const searcher = gpu.metal.MetalSearcher.init(allocator) catch |err| {
-                    if (verbose) std.debug.print("Metal init failed: {}, falling back to CPU\n", .{err});
-                    break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                        return .{ .found = false, .had_error = true };
-                    };
-                };
-                defer searcher.deinit();
-                // Use GPU regex for regex patterns (including PCRE), literal search for fixed strings
-                const use_regex = !options.fixed_string or options.perl;
-                if (use_regex) {
-                    break :blk searcher.searchRegex(text, first_pattern, options, allocator) catch |err| {
-                        if (verbose) std.debug.print("Metal regex failed: {}, falling back to CPU\n", .{err});
-                        break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                            return .{ .found = false, .had_error = true };
-                        };
-                    };
-                } else {
-                    break :blk searcher.search(text, first_pattern, options, allocator) catch |err| {
-                        if (verbose) std.debug.print("Metal search failed: {}, falling back to CPU\n", .{err});
-                        break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                            return .{ .found = false, .had_error = true };
-                        };
-                    };
-                }
-            } else {
-                break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                    return .{ .found = false, .had_error = true };
-                };
-            }
-        },
-        .vulkan => blk: {
-            const searcher = gpu.vulkan.VulkanSearcher.init(allocator) catch |err| {
-                if (verbose) std.debug.print("Vulkan init failed: {}, falling back to CPU\n", .{err});
-                break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                    return .{ .found = false, .had_error = true };
-                };
-            };
-            defer searcher.deinit();
-            // Use GPU regex for regex patterns (including PCRE), literal search for fixed strings
-            const use_regex = !options.fixed_string or options.perl;
-            if (use_regex) {
-                break :blk searcher.searchRegex(text, first_pattern, options, allocator) catch |err| {
-                    if (verbose) std.debug.print("Vulkan regex failed: {}, falling back to CPU\n", .{err});
-                    break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                        return .{ .found = false, .had_error = true };
-                    };
-                };
+                if (ctx.gpu_session.searchMetal(text, first_pattern, gpu_options, verbose)) |result| return result;
             } else {
-                break :blk searcher.search(text, first_pattern, options, allocator) catch |err| {
-                    if (verbose) std.debug.print("Vulkan search failed: {}, falling back to CPU\n", .{err});
-                    break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                        return .{ .found = false, .had_error = true };
-                    };
-                };
+                if (verbose) std.debug.print("Metal not available, falling back to CPU\n", .{});
             }
+            return cpuSearch(ctx, worker, text);
         },
-        .cpu => doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-            return .{ .found = false, .had_error = true };
+        .vulkan => {
+            if (ctx.gpu_session.searchVulkan(text, first_pattern, gpu_options, verbose)) |result| return result;
+            return cpuSearch(ctx, worker, text);
         },
-        .cuda, .opencl => doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-            return .{ .found = false, .had_error = true };
+        .cpu => return cpuSearch(ctx, worker, text),
+        // CUDA and OpenCL not yet supported - fall back to CPU
+        .cuda, .opencl => {
+            if (verbose) std.debug.print("{s} not supported, falling back to CPU\n", .{@tagName(backend)});
+            return cpuSearch(ctx, worker, text);
         },
+    }
+}
+
+/// Whether the output needs only which lines were selected, not where the
+/// matches sit in them; the GPU then returns a bitmap of matching lines
+/// rather than every match, and -v is applied to the bitmap
+fn linesOnly(ctx: *const Context) bool {
+    if (ctx.output_opts.only_matching or ctx.output_opts.color_mode == .always) return false;
+    // Fields and records map match positions back onto the input
+    return ctx.input_opts.fields == null and ctx.input_opts.record_start == null;
+}
+
+/// Single-pattern CPU search, reusing the worker's compiled regex when the
+/// engine has one
+fn cpuSearch(ctx: *const Context, worker: *Worker, text: []const u8) !gpu.SearchResult {
+    const pattern = if (ctx.patterns.len > 0) ctx.patterns[0] else "";
+    const options = ctx.options;
+    if (ctx.backend_mode == .cpu_gnu or options.fixed_string or cpu.isUnicodeLiteral(pattern, options)) {
+        return doSearch(text, pattern, options, ctx.allocator, ctx.backend_mode);
+    }
+    if (options.perl) {
+        // An invalid pattern takes doSearch's error path (no matches)
+        const compiled = worker.matchers.pcreRegex(pattern, options) orelse
+            return doSearch(text, pattern, options, ctx.allocator, ctx.backend_mode);
+        return pcre.searchCompiled(compiled, text, options, ctx.allocator);
+    }
+    const compiled = try worker.matchers.cpuRegex(pattern, options);
+    return compiled.search(text, ctx.allocator);
+}
+
+/// Search one input and print its results
+fn searchAndEmit(ctx: *const Context, worker: *Worker, in: SearchInput, backend: gpu.Backend) ProcessResult {
+    if (ctx.stats) |st| st.addInput(in.text.len);
+    // -U chunks carry their matches over the chunk edges themselves
+    if (Chunker.applies(ctx, in.text.len)) return searchChunked(ctx, worker, in, backend);
+    if (ctx.input_opts.record_start != null or ctx.options.multiline) return searchRecords(ctx, worker, in, backend);
+    var result = selectLines(ctx, worker, in.text, backend) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ in.list_name orelse "(standard input)", err });
+        return .{ .found = false, .had_error = true };
     };
     defer result.deinit();
 
-    const found = result.matches.len > 0;
+    emitResults(ctx, worker, in, result);
 
-    // For quiet mode, don't output anything
-    if (output_opts.quiet_mode) {
-        return .{ .found = found, .had_error = false };
+    if (ctx.verbose) {
+        std.debug.print("\nTotal matches: {d}\n\n", .{result.total_matches});
     }
+    return .{ .found = result.matches.len > 0, .had_error = false };
+}
 
-    // For files-without-match mode, only output filename if no matches
-    if (output_opts.files_without_match) {
-        if (!found) {
-            if (filename_prefix) |prefix| {
-                _ = std.posix.write(std.posix.STDOUT_FILENO, prefix) catch {};
-                _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
-            }
-        }
-        return .{ .found = found, .had_error = false };
-    }
+/// -U matches in `text`, found without -v (which applies to the lines the
+/// matches cover, once they are split by records.splitSpans)
+fn findSpans(ctx: *const Context, worker: *Worker, text: []const u8, backend: gpu.Backend) !gpu.SearchResult {
+    var line_ctx = ctx.*;
+    line_ctx.options.invert_match = false;
+    return runSearch(&line_ctx, worker, text, backend);
+}
+
+/// Search one input where what is selected can cover several lines: matches
+/// under -U and records under --record-start. The engines run without -v;
+/// -U matches are split into per-line pieces, records regroup those, and -v
+/// is applied to the outcome.
+fn searchRecords(ctx: *const Context, worker: *Worker, in: SearchInput, backend: gpu.Backend) ProcessResult {
+    const allocator = ctx.allocator;
+    const name = in.list_name orelse "(standard input)";
+    const invert = ctx.options.invert_match;
+
+    var map: ?records.RecordMap = null;
+    defer if (map) |*m| m.deinit();
+    if (ctx.input_opts.record_start) |start_pattern| {
+        const start_regex = worker.matchers.recordStart(start_pattern) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ name, err });
+            return .{ .found = false, .had_error = true };
+        };
+        var starts = start_regex.search(in.text, allocator) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ name, err });
+            return .{ .found = false, .had_error = true };
+        };
+        defer starts.deinit();
+        map = records.RecordMap.init(allocator, in.text, starts.matches) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ name, err });
+            return .{ .found = false, .had_error = true };
+        };
+    }
+
+    var line_ctx = ctx.*;
+    line_ctx.options.invert_match = false;
+    var result = runSearch(&line_ctx, worker, in.text, backend) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ name, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer result.deinit();
+
+    if (ctx.options.multiline) {
+        const pieces = records.splitSpans(allocator, in.text, ctx.options.record_sep, result, ctx.input_opts.max_span, invert and map == null) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ name, err });
+            return .{ .found = false, .had_error = true };
+        };
+        result.deinit();
+        result = pieces;
+    }
+    var record_in = in;
+    if (map) |*m| {
+        const grouped = m.regroup(allocator, result, invert) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ name, err });
+            return .{ .found = false, .had_error = true };
+        };
+        result.deinit();
+        result = grouped;
+        record_in.records = m;
+    }
+
+    emitResults(ctx, worker, record_in, result);
+
+    if (ctx.verbose) {
+        if (map) |m| std.debug.print("\nRecords: {d}, selected: {d}\n\n", .{ m.starts.len, result.matches.len });
+        if (map == null) std.debug.print("\nTotal matches: {d}\n\n", .{result.total_matches});
+    }
+    return .{ .found = result.matches.len > 0, .had_error = false };
+}
+
+/// Search only the --fields columns of each record. The selected fields are
+/// gathered one per line for the engines, which run without -v; matches are
+/// mapped back onto their records and -v is applied to the outcome.
+fn searchFields(ctx: *const Context, worker: *Worker, text: []const u8, backend: gpu.Backend) !gpu.SearchResult {
+    const eol = ctx.options.record_sep;
+    var extract = try fields.Extract.init(ctx.allocator, text, eol, &ctx.input_opts.fields.?);
+    defer extract.deinit();
+
+    var field_ctx = ctx.*;
+    field_ctx.options.invert_match = false;
+    var found = try runSearch(&field_ctx, worker, extract.buffer, backend);
+    defer found.deinit();
+
+    if (ctx.verbose) {
+        std.debug.print("Fields searched: {d} ({d} bytes)\n", .{ extract.segments.len, extract.buffer.len });
+    }
+    return extract.mapBack(ctx.allocator, text, eol, found, ctx.options.invert_match);
+}
+
+/// Selected lines of `text`: every match, or the lines selected by -v
+fn selectLines(ctx: *const Context, worker: *Worker, text: []const u8, backend: gpu.Backend) !gpu.SearchResult {
+    if (ctx.input_opts.fields != null) return searchFields(ctx, worker, text, backend);
+    return runSearch(ctx, worker, text, backend);
+}
+
+/// Search an input one line-aligned chunk at a time (--max-memory), so the
+/// engines' buffers and result arrays scale with the chunk, not the input.
+/// Lines are printed as each chunk completes; -c, -l, -L and -q are
+/// summarised once all chunks are in.
+const Chunker = struct {
+    ctx: *const Context,
+    worker: *Worker,
+    in: SearchInput, // labels and bases of the whole input
+    backend: gpu.Backend,
+    found: bool = false,
+    line_count: u64 = 0,
+    lines_before: u64 = 0, // lines in chunks already searched
+    bytes_before: usize = 0,
+
+    /// Inputs whose output only ever depends on the lines themselves, or
+    /// under -U on the lines within --max-span of a match (feedSpans)
+    fn applies(ctx: *const Context, len: usize) bool {
+        const chunk = ctx.input_opts.chunk_size;
+        if (chunk == 0 or len <= chunk) return false;
+        if (ctx.output_opts.before_context > 0 or ctx.output_opts.after_context > 0) return false;
+        return ctx.input_opts.record_start == null;
+    }
+
+    fn summarising(self: *const Chunker) bool {
+        const opts = self.ctx.output_opts;
+        return opts.quiet_mode or opts.files_with_matches or opts.files_without_match or opts.count_only;
+    }
+
+    /// Search the next chunk, which must end on a line boundary
+    fn feed(self: *Chunker, text: []const u8, source: ?output.FileRegion) !void {
+        var result = try selectLines(self.ctx, self.worker, text, self.backend);
+        defer result.deinit();
+        const lines: u32 = if (self.ctx.output_opts.line_numbers)
+            @intCast(input.countTerminators(text, self.ctx.options.record_sep))
+        else
+            0;
+        self.emit(text, source, result, lines);
+    }
+
+    /// -U: search `window`, the next chunk [0, owned) read on to
+    /// records.reach(), and print the chunk. Returns where printing stopped,
+    /// past `owned` when a match crosses the edge; the next chunk starts there.
+    fn feedSpans(self: *Chunker, window: []const u8, owned: usize, source: ?output.FileRegion) !usize {
+        var found = try findSpans(self.ctx, self.worker, window, self.backend);
+        defer found.deinit();
+        return self.emitSpans(window, found, 0, owned, source);
+    }
+
+    /// -U: print window[from..] up to the end of the matches `found` in it
+    /// that records.claimSpans gives this piece; returns that end. `source`
+    /// is the window's own file region.
+    fn emitSpans(self: *Chunker, window: []const u8, found: gpu.SearchResult, from: usize, owned: usize, source: ?output.FileRegion) !usize {
+        const ctx = self.ctx;
+        const eol = ctx.options.record_sep;
+        const max_span = ctx.input_opts.max_span;
+        var claim = try records.claimSpans(ctx.allocator, window, eol, found, from, owned, max_span);
+        defer claim.result.deinit();
+        const text = window[from..claim.end];
+        var pieces = try records.splitSpans(ctx.allocator, text, eol, claim.result, max_span, ctx.options.invert_match);
+        defer pieces.deinit();
+        const lines: u32 = if (ctx.output_opts.line_numbers) @intCast(input.countTerminators(text, eol)) else 0;
+        const text_source: ?output.FileRegion = if (source) |src| .{ .fd = src.fd, .offset = src.offset + from } else null;
+        self.emit(text, text_source, pieces, lines);
+        return claim.end;
+    }
+
+    /// Print (or tally) the results of the next chunk, which holds `lines`
+    /// terminators when -n needs them
+    fn emit(self: *Chunker, text: []const u8, source: ?output.FileRegion, result: gpu.SearchResult, lines: u32) void {
+        var part = self.in;
+        part.text = text;
+        part.source = source;
+        part.line_base = self.in.line_base + self.lines_before;
+        part.byte_base = self.in.byte_base + self.bytes_before;
+
+        if (result.matches.len > 0) self.found = true;
+        if (self.summarising()) {
+            self.line_count += countLines(result.matches);
+        } else {
+            emitResults(self.ctx, self.worker, part, result);
+        }
+        self.lines_before += lines;
+        self.bytes_before += text.len;
+    }
+
+    fn finish(self: *Chunker) ProcessResult {
+        if (self.summarising()) emitSummary(self.ctx.output_opts, &self.worker.out, self.in, self.found, self.line_count);
+        return .{ .found = self.found, .had_error = false };
+    }
+};
+
+/// Search a whole input already in memory in chunks
+fn searchChunked(ctx: *const Context, worker: *Worker, in: SearchInput, backend: gpu.Backend) ProcessResult {
+    const eol = ctx.options.record_sep;
+    const chunk = ctx.input_opts.chunk_size;
+    // The whole-input choice may have ruled the GPU out on size alone
+    const chunk_backend = if (ctx.backend_mode == .auto) selectBackend(ctx, in.list_name orelse "(standard input)", chunk) else backend;
+    var chunker = Chunker{ .ctx = ctx, .worker = worker, .in = in, .backend = chunk_backend };
+
+    var start: usize = 0;
+    while (start < in.text.len) {
+        if (ctx.output_opts.quiet_mode and chunker.found) break;
+        var end = chunkEnd(in.text, start, chunk, eol);
+        const source: ?output.FileRegion = if (in.source) |src| .{ .fd = src.fd, .offset = src.offset + start } else null;
+        // Read the next chunk of a mapping in while this one is searched
+        if (in.source != null) {
+            const ahead = in.text[end..@min(end + chunk, in.text.len)];
+            const requested = input.prefetchPages(ahead);
+            if (ctx.stats) |st| st.addPrefetch(requested);
+        }
+        if (ctx.options.multiline) {
+            const window = in.text[start..records.reach(in.text, end, ctx.input_opts.max_span, eol)];
+            const printed = chunker.feedSpans(window, end - start, source) catch |err| {
+                std.debug.print("grep: {s}: {}\n", .{ in.list_name orelse "(standard input)", err });
+                return .{ .found = chunker.found, .had_error = true };
+            };
+            end = start + printed;
+        } else {
+            chunker.feed(in.text[start..end], source) catch |err| {
+                std.debug.print("grep: {s}: {}\n", .{ in.list_name orelse "(standard input)", err });
+                return .{ .found = chunker.found, .had_error = true };
+            };
+        }
+        if (in.source != null) {
+            if (ctx.stats) |st| st.sampleMapping(in.text[start..end]);
+            // Searched pages of a mapping are not needed again
+            input.releasePages(in.text[start..end]);
+        }
+        start = end;
+    }
+    if (ctx.verbose) std.debug.print("\nChunks of {d}KB: {d} bytes searched\n\n", .{ chunk / 1024, chunker.bytes_before });
+    return chunker.finish();
+}
+
+/// Files at least this large are split across threads in single-file runs
+const SEGMENT_MIN_SIZE: usize = 16 * 1024 * 1024;
+
+/// Segments aim below this, leaving room for the line that ends one to run
+/// past it while its positions still fit a MatchResult
+const SEGMENT_MAX_SIZE: usize = 1 << 31;
+
+/// One large file searched as contiguous line-aligned segments, by up to
+/// segment_workers threads. Segments are dealt out to NUMA nodes in file
+/// order and each thread is pinned to its segment's node before it first
+/// touches the range, so the pages it faults in and the results it builds
+/// are node-local. Files past SEGMENT_MAX_SIZE per thread get more segments
+/// than threads, taken in turn. Results are printed in file order once
+/// every segment is done. Under -U each segment is searched on past its
+/// end by --max-span, and matches the previous segment already printed are
+/// dropped as the results are printed (Chunker.emitSpans).
+const SegmentRun = struct {
+    ctx: *const Context,
+    text: []const u8,
+    topology: *const numa.Topology,
+    segments: []Segment,
+    stride: usize, // threads sharing the segments
+
+    const Segment = struct {
+        start: usize,
+        end: usize,
+        window_end: usize, // end of the bytes searched: `end`, or further under -U
+        node: usize,
+        result: ?gpu.SearchResult = null, // under -U, the matches in the whole window
+        lines: u32 = 0, // terminators in the segment, for -n
+        err: ?anyerror = null,
+    };
+
+    /// Same restrictions as chunking
+    fn applies(ctx: *const Context, len: usize) bool {
+        if (ctx.input_opts.segment_workers < 2 or len < SEGMENT_MIN_SIZE) return false;
+        if (ctx.output_opts.before_context > 0 or ctx.output_opts.after_context > 0) return false;
+        return ctx.input_opts.record_start == null;
+    }
+
+    /// Search segments first, first + stride, ...
+    fn thread(self: *SegmentRun, first: usize) void {
+        var worker = Worker.init(self.ctx.allocator);
+        defer worker.deinit();
+        var idx = first;
+        while (idx < self.segments.len) : (idx += self.stride) self.search(&worker, &self.segments[idx]);
+    }
+
+    fn search(self: *SegmentRun, worker: *Worker, seg: *Segment) void {
+        const ctx = self.ctx;
+        self.topology.pin(seg.node);
+        const text = self.text[seg.start..seg.window_end];
+        if (text.len > std.math.maxInt(u32)) {
+            seg.err = error.FileTooBig; // one line longer than 2GB
+            return;
+        }
+        // Fault the range in from this node before the scan reads it
+        _ = input.prefetchPages(text);
+        const backend = selectBackend(ctx, "(segment)", text.len);
+        const found = if (ctx.options.multiline) findSpans(ctx, worker, text, backend) else selectLines(ctx, worker, text, backend);
+        seg.result = found catch |err| blk: {
+            seg.err = err;
+            break :blk null;
+        };
+        // -U counts the lines it prints, known only once they are
+        if (ctx.output_opts.line_numbers and !ctx.options.multiline) seg.lines = @intCast(input.countTerminators(text, ctx.options.record_sep));
+        if (ctx.stats) |st| {
+            const placement = numa.remotePages(text, seg.node);
+            st.addPlacement(self.topology.num_nodes, placement.sampled, placement.remote);
+            st.sampleMapping(text);
+        }
+    }
+};
+
+/// Search one large file on segment_workers threads
+fn searchSegments(ctx: *const Context, worker: *Worker, file: std.fs.File, filepath: []const u8, file_size: u64, label: ?[]const u8) ProcessResult {
+    const allocator = ctx.allocator;
+    // Not populated here: each segment's thread faults in its own range
+    var mapped = input.MappedFile.init(allocator, file, file_size, .partial) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer mapped.deinit();
+    const text = mapped.data;
+    const eol = ctx.options.record_sep;
+
+    const topology = numa.Topology.detect();
+    const workers = ctx.input_opts.segment_workers;
+    const count = @max(workers, std.math.divCeil(usize, text.len, SEGMENT_MAX_SIZE) catch unreachable);
+    const segments = allocator.alloc(SegmentRun.Segment, count) catch {
+        std.debug.print("grep: out of memory\n", .{});
+        return .{ .found = false, .had_error = true };
+    };
+    defer allocator.free(segments);
+    var start: usize = 0;
+    var used: usize = 0;
+    for (segments, 0..) |*seg, idx| {
+        if (start >= text.len) break;
+        const end = chunkEnd(text, start, (text.len - start) / (count - idx), eol);
+        const window_end = if (ctx.options.multiline) records.reach(text, end, ctx.input_opts.max_span, eol) else end;
+        seg.* = .{ .start = start, .end = end, .window_end = window_end, .node = topology.nodeFor(idx, count) };
+        start = end;
+        used += 1;
+    }
+    const stride = @min(workers, used);
+    if (ctx.verbose) std.debug.print("Segments: {s}: {d} on {d} threads, {d} NUMA node(s)\n", .{ filepath, used, stride, topology.num_nodes });
+
+    var run = SegmentRun{ .ctx = ctx, .text = text, .topology = &topology, .segments = segments[0..used], .stride = stride };
+    const threads = allocator.alloc(std.Thread, stride) catch {
+        std.debug.print("grep: out of memory\n", .{});
+        return .{ .found = false, .had_error = true };
+    };
+    defer allocator.free(threads);
+    var started: usize = 0;
+    for (threads, 0..) |*t, idx| {
+        t.* = std.Thread.spawn(.{}, SegmentRun.thread, .{ &run, idx }) catch break;
+        started += 1;
+    }
+    // Shares without a thread are searched here
+    for (started..stride) |first| run.thread(first);
+    for (threads[0..started]) |t| t.join();
+    defer for (run.segments) |*seg| {
+        if (seg.result) |*r| r.deinit();
+    };
+
+    // Print in file order, as one chunked search would
+    const source: ?output.FileRegion = if (mapped.mapping != null) .{ .fd = file.handle, .offset = 0 } else null;
+    var chunker = Chunker{
+        .ctx = ctx,
+        .worker = worker,
+        .in = .{ .text = text, .label = label, .list_name = filepath, .source = source },
+        .backend = .cpu,
+    };
+    var had_error = false;
+    var printed: usize = 0; // -U: the previous segment may print past its end
+    for (run.segments) |*seg| {
+        const seg_source: ?output.FileRegion = if (source) |src| .{ .fd = src.fd, .offset = seg.start } else null;
+        if (seg.err) |err| {
+            std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+            had_error = true;
+        } else if (ctx.options.multiline) {
+            const window = text[seg.start..seg.window_end];
+            const from = @max(printed, seg.start) - seg.start;
+            const end = chunker.emitSpans(window, seg.result.?, from, seg.end - seg.start, seg_source) catch |err| {
+                std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+                had_error = true;
+                continue;
+            };
+            printed = seg.start + end;
+        } else {
+            chunker.emit(text[seg.start..seg.end], seg_source, seg.result.?, seg.lines);
+        }
+    }
+    var result = chunker.finish();
+    result.had_error = had_error;
+    if (ctx.stats) |st| st.addInput(text.len);
+    return result;
+}
+
+/// End of the chunk of about `size` bytes starting at `start`: after the last
+/// terminator in range, or after the first one beyond it for a longer line
+fn chunkEnd(text: []const u8, start: usize, size: usize, eol: u8) usize {
+    const limit = start + size;
+    if (limit >= text.len) return text.len;
+    if (std.mem.lastIndexOfScalar(u8, text[start..limit], eol)) |nl| return start + nl + 1;
+    const nl = std.mem.indexOfScalarPos(u8, text, limit, eol) orelse return text.len;
+    return nl + 1;
+}
+
+/// Where the next chunk of a streamed input ends in `pending`, and where the
+/// window searched with it ends (-U reads on by `margin`, as records.reach)
+const StreamCut = struct { end: usize, window_end: usize };
+
+/// The next cut of `pending`, or null until it holds a chunk and the window
+/// after it up to a line end (or the input has ended)
+fn streamCut(pending: []const u8, eof: bool, chunk: usize, margin: ?usize, eol: u8) ?StreamCut {
+    if (!eof and pending.len < chunk) return null;
+    const end = chunkEnd(pending, 0, chunk, eol);
+    if (!eof and pending[end - 1] != eol) return null;
+    const span = margin orelse return .{ .end = end, .window_end = end };
+    if (!eof and end +| span >= pending.len) return null;
+    const window_end = records.reach(pending, end, span, eol);
+    if (!eof and pending[window_end - 1] != eol) return null;
+    return .{ .end = end, .window_end = window_end };
+}
+
+/// Search an input chunk by chunk as `source.read()` delivers it (0 at the
+/// end), through `pending`, which may already hold its first bytes. What
+/// follows each chunk's last printed line is carried into the next.
+fn streamChunks(chunker: *Chunker, pending: *std.ArrayListUnmanaged(u8), source: anytype) !void {
+    const ctx = chunker.ctx;
+    const chunk = ctx.input_opts.chunk_size;
+    const eol = ctx.options.record_sep;
+    const margin: ?usize = if (ctx.options.multiline) ctx.input_opts.max_span else null;
+    var eof = false;
+    var ready = true;
+    while (!eof or pending.items.len > 0) {
+        if (ctx.output_opts.quiet_mode and chunker.found) return;
+        const cut = (if (ready) streamCut(pending.items, eof, chunk, margin, eol) else null) orelse {
+            const before = pending.items.len;
+            try pending.ensureUnusedCapacity(ctx.allocator, 64 * 1024);
+            const bytes_read = try source.read(pending.unusedCapacitySlice());
+            pending.items.len += bytes_read;
+            eof = bytes_read == 0;
+            // A long line is not rescanned on every read that does not end it
+            ready = eof or (before < chunk and pending.items.len >= chunk) or
+                std.mem.indexOfScalar(u8, pending.items[before..], eol) != null;
+            continue;
+        };
+
+        var end = cut.end;
+        if (margin != null) {
+            end = try chunker.feedSpans(pending.items[0..cut.window_end], cut.end, null);
+        } else {
+            try chunker.feed(pending.items[0..end], null);
+        }
+        const carry = pending.items.len - end;
+        std.mem.copyForwards(u8, pending.items[0..carry], pending.items[end..]);
+        pending.items.len = carry;
+    }
+}
+
+/// Number of distinct lines among `matches`, which are in text order
+fn countLines(matches: []const gpu.MatchResult) u64 {
+    var line_count: u64 = 0;
+    var last_line_start: u32 = std.math.maxInt(u32);
+    for (matches) |match| {
+        if (match.line_start != last_line_start) {
+            last_line_start = match.line_start;
+            line_count += 1;
+        }
+    }
+    return line_count;
+}
+
+/// Print the per-input summary of -q, -L, -l or -c
+fn emitSummary(output_opts: OutputOptions, out: *output.Sink, in: SearchInput, found: bool, line_count: u64) void {
+    // For quiet mode, don't output anything
+    if (output_opts.quiet_mode) return;
+
+    // For files-without-match mode, only output filename if no matches
+    if (output_opts.files_without_match) {
+        if (!found) {
+            if (in.list_name) |name| {
+                out.write(name);
+                out.write("\n");
+            }
+        }
+        return;
+    }
 
     // For files-with-matches mode, only output filename if matches found
     if (output_opts.files_with_matches) {
         if (found) {
-            if (filename_prefix) |prefix| {
-                _ = std.posix.write(std.posix.STDOUT_FILENO, prefix) catch {};
-                _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
+            if (in.list_name) |name| {
+                out.write(name);
+                out.write("\n");
             }
         }
-        return .{ .found = found, .had_error = false };
+        return;
     }
 
-    if (output_opts.count_only) {
-        // Count unique lines with matches
-        var line_count: u64 = 0;
-        var last_line_start: u32 = std.math.maxInt(u32);
-        for (result.matches) |match| {
-            if (match.line_start != last_line_start) {
-                last_line_start = match.line_start;
-                line_count += 1;
-            }
-        }
-        var count_buf: [32]u8 = undefined;
-        const count_str = std.fmt.bufPrint(&count_buf, "{d}\n", .{line_count}) catch return .{ .found = found, .had_error = false };
-        if (filename_prefix) |prefix| {
-            _ = std.posix.write(std.posix.STDOUT_FILENO, prefix) catch {};
-            _ = std.posix.write(std.posix.STDOUT_FILENO, ":") catch {};
-        }
-        _ = std.posix.write(std.posix.STDOUT_FILENO, count_str) catch {};
-    } else if (output_opts.only_matching) {
+    // Count of matching lines
+    var count_buf: [32]u8 = undefined;
+    const count_str = std.fmt.bufPrint(&count_buf, "{d}\n", .{line_count}) catch return;
+    if (in.label) |prefix| {
+        out.write(prefix);
+        out.write(":");
+    }
+    out.write(count_str);
+}
+
+/// Print search results according to the output options
+fn emitResults(ctx: *const Context, worker: *Worker, in: SearchInput, result: gpu.SearchResult) void {
+    const out = &worker.out;
+    const output_opts = ctx.output_opts;
+    const text = in.text;
+    const eol = ctx.options.record_sep;
+    const terminator = [1]u8{eol};
+
+    if (ctx.histogram) |hist| {
+        countHistogram(ctx, worker, hist, in, result.matches) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ in.list_name orelse "(standard input)", err });
+        };
+        return;
+    }
+
+    if (output_opts.quiet_mode or output_opts.files_without_match or output_opts.files_with_matches or output_opts.count_only) {
+        const line_count = if (output_opts.count_only) countLines(result.matches) else 0;
+        emitSummary(output_opts, out, in, result.matches.len > 0, line_count);
+        return;
+    }
+
+    if (output_opts.only_matching) {
         // Output only the matching text, not the whole line
         for (result.matches) |match| {
-            if (filename_prefix) |prefix| {
-                _ = std.posix.write(std.posix.STDOUT_FILENO, prefix) catch {};
-                _ = std.posix.write(std.posix.STDOUT_FILENO, ":") catch {};
+            if (in.label) |prefix| {
+                out.write(prefix);
+                out.write(":");
             }
             if (output_opts.line_numbers) {
                 // Use GPU-computed line number if available, otherwise compute on CPU
-                const line_num = if (match.line_num > 0) match.line_num else blk: {
+                const local_line_num = if (match.line_num > 0) match.line_num else blk: {
                     var ln: u32 = 1;
                     var pos: usize = 0;
                     while (pos < match.line_start) : (pos += 1) {
-                        if (text[pos] == '\n') ln += 1;
+                        if (text[pos] == eol) ln += 1;
                     }
                     break :blk ln;
                 };
-                var num_buf: [16]u8 = undefined;
-                const num_str = std.fmt.bufPrint(&num_buf, "{d}:", .{line_num}) catch continue;
-                _ = std.posix.write(std.posix.STDOUT_FILENO, num_str) catch {};
+                var num_buf: [24]u8 = undefined;
+                const num_str = std.fmt.bufPrint(&num_buf, "{d}:", .{in.line_base + local_line_num}) catch continue;
+                out.write(num_str);
             }
+            if (output_opts.byte_offset) writeByteOffset(out, in, match.position, ":");
             // Output the matched text (with color if enabled)
             const match_end = match.position + match.match_len;
             if (match_end <= text.len) {
                 if (output_opts.color_mode == .always) {
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, COLOR_MATCH_START) catch {};
+                    out.write(COLOR_MATCH_START);
                 }
-                _ = std.posix.write(std.posix.STDOUT_FILENO, text[match.position..match_end]) catch {};
+                out.write(text[match.position..match_end]);
                 if (output_opts.color_mode == .always) {
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, COLOR_RESET) catch {};
+                    out.write(COLOR_RESET);
                 }
             }
-            _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
+            out.write(&terminator);
         }
     } else if (output_opts.before_context > 0 or output_opts.after_context > 0) {
         // Output with context lines
-        outputWithContext(text, result.matches, output_opts, filename_prefix, allocator);
+        outputWithContext(out, in, eol, result.matches, output_opts, ctx.allocator);
+    } else if (in.source != null and in.label == null and !output_opts.line_numbers and !output_opts.byte_offset and output_opts.color_mode != .always) {
+        // Bare lines are byte ranges of the input file
+        emitLineRuns(out, in, eol, result.matches);
     } else {
         // Output matching lines
         var last_line_start: u32 = std.math.maxInt(u32);
@@ -944,42 +2108,180 @@ fn processStdin(allocator: std.mem.Allocator, all_patterns: []const []const u8,
             if (match.line_start != last_line_start) {
                 last_line_start = match.line_start;
 
-                var line_end = match.line_start;
-                while (line_end < text.len and text[line_end] != '\n') line_end += 1;
+                const line_end = recordEnd(in, eol, match.line_start);
 
-                if (filename_prefix) |prefix| {
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, prefix) catch {};
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, ":") catch {};
+                if (in.label) |prefix| {
+                    out.write(prefix);
+                    out.write(":");
                 }
                 if (output_opts.line_numbers) {
                     // Use GPU-computed line number if available, otherwise fall back to CPU computation
-                    const line_num = if (match.line_num > 0) match.line_num else blk: {
+                    const local_line_num = if (match.line_num > 0) match.line_num else blk: {
                         // Fall back to counting newlines on CPU
                         var pos: usize = last_line_counted;
                         while (pos < match.line_start) : (pos += 1) {
-                            if (text[pos] == '\n') current_line_num += 1;
+                            if (text[pos] == eol) current_line_num += 1;
                         }
                         last_line_counted = match.line_start;
                         break :blk current_line_num;
                     };
-                    var num_buf: [16]u8 = undefined;
-                    const num_str = std.fmt.bufPrint(&num_buf, "{d}:", .{line_num}) catch continue;
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, num_str) catch {};
+                    var num_buf: [24]u8 = undefined;
+                    const num_str = std.fmt.bufPrint(&num_buf, "{d}:", .{in.line_base + local_line_num}) catch continue;
+                    out.write(num_str);
                 }
+                if (output_opts.byte_offset) writeByteOffset(out, in, match.line_start, ":");
                 // Output line with color highlighting if enabled
-                outputLineWithColor(text, match.line_start, line_end, result.matches, output_opts.color_mode == .always);
-                _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
+                outputLineWithColor(out, text, match.line_start, line_end, result.matches, output_opts.color_mode == .always);
+                out.write(&terminator);
             }
         }
     }
+}
+
+/// --histogram: count the selected lines of `in` in the worker's partial
+/// histogram. The lines are gathered into one buffer so the field pattern
+/// runs once per input rather than once per line.
+fn countHistogram(ctx: *const Context, worker: *Worker, hist: *histogram.Histogram, in: SearchInput, matches: []const gpu.MatchResult) !void {
+    if (matches.len == 0) return;
+    const allocator = ctx.allocator;
+    const eol = ctx.options.record_sep;
+    worker.histogram.shared = hist;
+
+    var lines: std.ArrayListUnmanaged(u8) = .{};
+    defer lines.deinit(allocator);
+    var last_line_start: u32 = std.math.maxInt(u32);
+    for (matches) |match| {
+        if (match.line_start == last_line_start) continue;
+        last_line_start = match.line_start;
+        try lines.appendSlice(allocator, in.text[match.line_start..recordEnd(in, eol, match.line_start)]);
+        try lines.append(allocator, eol);
+    }
 
-    if (verbose) {
-        std.debug.print("\nTotal matches: {d}\n", .{result.total_matches});
+    if (hist.spec.field.len == 0) return worker.histogram.countLines(hist.spec, lines.items, eol, null);
+    var found = try worker.matchers.histogramField(hist.spec.field, lines.items, ctx.options.perl, eol);
+    defer found.deinit();
+    try worker.histogram.countLines(hist.spec, lines.items, eol, found.matches);
+}
+
+/// Print whole matching lines without prefixes. Adjacent lines are merged into
+/// runs of the input, which the sink can copy from the file in the kernel, so
+/// dense matches and -v on mostly-clean input skip the userspace copy.
+fn emitLineRuns(out: *output.Sink, in: SearchInput, eol: u8, matches: []const gpu.MatchResult) void {
+    const text = in.text;
+    const src = in.source.?;
+    var run_start: usize = 0;
+    var run_end: usize = 0;
+    var last_line_start: u32 = std.math.maxInt(u32);
+
+    for (matches) |match| {
+        if (match.line_start == last_line_start) continue;
+        last_line_start = match.line_start;
+
+        const line_end = recordEnd(in, eol, match.line_start);
+        if (match.line_start != run_end) {
+            if (run_end > run_start) {
+                out.writeFrom(text[run_start..run_end], .{ .fd = src.fd, .offset = src.offset + run_start });
+            }
+            run_start = match.line_start;
+        }
+        run_end = @min(line_end + 1, text.len);
+    }
+    if (run_end > run_start) {
+        out.writeFrom(text[run_start..run_end], .{ .fd = src.fd, .offset = src.offset + run_start });
+        // The last line of the input may lack its newline
+        if (text[run_end - 1] != eol) out.write(&[1]u8{eol});
+    }
+}
+
+/// Narrow `data` to the --since/--until window when one is set. Under -n
+/// the lines before the window are counted, which reads all of them unless
+/// a fresh sidecar `index` of `data` gives the count from its blocks.
+fn applyTimeWindow(ctx: *const Context, name: []const u8, data: []const u8, index: ?*const sidecar.Index) SearchInput {
+    const range = ctx.input_opts.time_range orelse return .{ .text = data };
+    const window = range.locate(data);
+    // Line numbers stay relative to the whole input
+    const line_base: u64 = if (!ctx.output_opts.line_numbers)
+        0
+    else if (index) |idx|
+        idx.lineAt(data, window.start)
+    else
+        input.countTerminators(data[0..window.start], ctx.options.record_sep);
+    if (ctx.verbose) {
+        std.debug.print("Time window: {s} bytes {d}..{d} of {d}\n", .{ name, window.start, window.end, data.len });
+    }
+    return .{ .text = data[window.start..window.end], .line_base = line_base, .byte_base = window.start };
+}
+
+fn processStdin(ctx: *const Context, worker: *Worker, filename_prefix: ?[]const u8) ProcessResult {
+    const allocator = ctx.allocator;
+
+    // Read all stdin into a buffer
+    var stdin_list: std.ArrayListUnmanaged(u8) = .{};
+    defer stdin_list.deinit(allocator);
+
+    var buf: [4096]u8 = undefined;
+    while (true) {
+        const bytes_read = std.posix.read(std.posix.STDIN_FILENO, &buf) catch |err| {
+            if (err == error.WouldBlock) continue;
+            std.debug.print("grep: error reading stdin: {}\n", .{err});
+            return .{ .found = false, .had_error = true };
+        };
+        if (bytes_read == 0) break;
+        stdin_list.appendSlice(allocator, buf[0..bytes_read]) catch {
+            std.debug.print("grep: out of memory\n", .{});
+            return .{ .found = false, .had_error = true };
+        };
+        // Under --max-memory, search the rest as it arrives
+        if (stdin_list.items.len >= ctx.input_opts.chunk_size and Chunker.applies(ctx, stdin_list.items.len + 1) and
+            ctx.input_opts.time_range == null and input.detectEncoding(stdin_list.items) == .utf8)
+        {
+            return streamStdin(ctx, worker, filename_prefix, &stdin_list);
+        }
+        if (stdin_list.items.len > gpu.MAX_GPU_BUFFER_SIZE) break;
+    }
+
+    const encoding = input.detectEncoding(stdin_list.items);
+    if (encoding != .utf8) {
+        return searchTranscoded(ctx, worker, "(standard input)", stdin_list.items, encoding, filename_prefix, filename_prefix);
     }
 
-    return .{ .found = found, .had_error = false };
+    var in = applyTimeWindow(ctx, "(standard input)", stdin_list.items, null);
+    in.label = filename_prefix;
+    in.list_name = filename_prefix;
+
+    const backend = selectBackend(ctx, "(standard input)", in.text.len);
+    return searchAndEmit(ctx, worker, in, backend);
+}
+
+/// Search standard input chunk by chunk as it is read (--max-memory); the
+/// partial last line of each chunk is carried into the next. `pending`
+/// holds what has been read so far.
+fn streamStdin(ctx: *const Context, worker: *Worker, filename_prefix: ?[]const u8, pending: *std.ArrayListUnmanaged(u8)) ProcessResult {
+    var chunker = Chunker{
+        .ctx = ctx,
+        .worker = worker,
+        .in = .{ .text = &.{}, .label = filename_prefix, .list_name = filename_prefix },
+        .backend = selectBackend(ctx, "(standard input)", ctx.input_opts.chunk_size),
+    };
+    streamChunks(&chunker, pending, StdinReader{}) catch |err| {
+        std.debug.print("grep: (standard input): {}\n", .{err});
+        return .{ .found = chunker.found, .had_error = true };
+    };
+    return chunker.finish();
 }
 
+/// Standard input as a streamChunks() source
+const StdinReader = struct {
+    fn read(_: StdinReader, buffer: []u8) !usize {
+        while (true) {
+            return std.posix.read(std.posix.STDIN_FILENO, buffer) catch |err| switch (err) {
+                error.WouldBlock => continue,
+                else => |e| e,
+            };
+        }
+    }
+};
+
 /// Parse size string with optional K/M/G suffix
 fn parseSize(str: []const u8) !usize {
     if (str.len == 0) return error.InvalidSize;
@@ -1128,328 +2430,1186 @@ fn isLikelyRarePattern(pattern: []const u8) bool {
     return false;
 }
 
-/// Process a directory recursively
-fn processDirectory(allocator: std.mem.Allocator, path: []const u8, all_patterns: []const []const u8, options: SearchOptions, backend_mode: BackendMode, config: AutoSelectConfig, verbose: bool, output_opts: OutputOptions, found_match: *bool, had_error: *bool, quiet_mode: bool) void {
-    var dir = std.fs.cwd().openDir(path, .{ .iterate = true }) catch |err| {
-        std.debug.print("grep: {s}: {}\n", .{ path, err });
-        had_error.* = true;
-        return;
-    };
-    defer dir.close();
+/// A path handed to a worker thread
+const Job = struct {
+    path: []u8, // owned by the job
+    labelled: bool, // always print the path (files found by walking a directory)
+    seq: u64, // position in input order, for --sort=path
 
-    var iter = dir.iterate();
-    while (iter.next() catch |err| {
-        std.debug.print("grep: {s}: {}\n", .{ path, err });
-        had_error.* = true;
-        return;
-    }) |entry| {
+    fn seqOf(job: Job) u64 {
+        return job.seq;
+    }
+};
+
+/// Shared state of a parallel multi-file run (-r, --files-from)
+const FileRun = struct {
+    ctx: *const Context,
+    recursive: bool,
+    queue: scheduler.RoutedQueue(Job, Job.seqOf),
+    route_gpu: bool, // GPU-bound files go to the GPU lane and its submitter
+    order: ?*output.Order, // null with --sort=none
+    next_seq: u64 = 0, // producer side only
+    found: std.atomic.Value(bool) = .init(false),
+    had_error: std.atomic.Value(bool) = .init(false),
+
+    fn record(self: *FileRun, result: ProcessResult) void {
+        if (result.found) self.found.store(true, .release);
+        if (result.had_error) self.had_error.store(true, .release);
+    }
+
+    /// For quiet mode, stop once any match has been found
+    fn stopped(self: *FileRun) bool {
+        return self.ctx.output_opts.quiet_mode and self.found.load(.acquire);
+    }
+
+    fn push(self: *FileRun, path: []const u8, labelled: bool) void {
+        const owned = self.ctx.allocator.dupe(u8, path) catch {
+            std.debug.print("grep: out of memory\n", .{});
+            self.had_error.store(true, .release);
+            return;
+        };
+        // Routing needs the file's size, so the CPU worker that pops it decides
+        self.queue.push(.{ .path = owned, .labelled = labelled, .seq = self.takeSeq() }, .cpu);
+    }
+
+    /// The GPU lane for files the auto selector would search on the GPU,
+    /// judged from their size before they are opened. Called by the CPU
+    /// workers, so the producer never waits on a stat.
+    fn laneFor(self: *FileRun, path: []const u8) scheduler.Lane {
+        if (!self.route_gpu) return .cpu;
+        const ctx = self.ctx;
+        // runSearch keeps these on the CPU whatever the size
+        if (ctx.patterns.len > 1 or ctx.options.record_sep != '\n' or ctx.options.multiline) return .cpu;
+        const stat = std.fs.cwd().statFile(path) catch return .cpu;
+        const size = std.math.cast(usize, stat.size) orelse return .cpu;
+        const config = ctx.gpu_session.adjustedConfig(ctx);
+        const first_pattern = if (ctx.patterns.len > 0) ctx.patterns[0] else "";
+        return if (selectOptimalBackend(first_pattern, ctx.options, size, config) == .cpu) .cpu else .gpu;
+    }
+
+    fn takeSeq(self: *FileRun) u64 {
+        defer self.next_seq += 1;
+        return self.next_seq;
+    }
+
+    /// Queue an operand or --files-from entry; directories are walked with -r
+    fn addPath(self: *FileRun, path: []const u8) void {
+        if (self.recursive) {
+            const stat = std.fs.cwd().statFile(path) catch |err| {
+                std.debug.print("grep: {s}: {}\n", .{ path, err });
+                self.had_error.store(true, .release);
+                return;
+            };
+            if (stat.kind == .directory) {
+                self.walkDirectory(path);
+                return;
+            }
+        }
+        self.push(path, false);
+    }
+
+    /// Queue every regular file below `path`
+    fn walkDirectory(self: *FileRun, path: []const u8) void {
+        const allocator = self.ctx.allocator;
+        var dir = std.fs.cwd().openDir(path, .{ .iterate = true }) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ path, err });
+            self.had_error.store(true, .release);
+            return;
+        };
+        defer dir.close();
+
+        // In path order, entries are taken by name rather than as stored
+        var sorted: std.ArrayListUnmanaged(DirEntry) = .{};
+        defer {
+            for (sorted.items) |e| allocator.free(e.name);
+            sorted.deinit(allocator);
+        }
+
+        var iter = dir.iterate();
+        while (iter.next() catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ path, err });
+            self.had_error.store(true, .release);
+            return;
+        }) |entry| {
+            if (self.stopped()) return;
+            if (self.order == null) {
+                self.visit(path, entry.name, entry.kind);
+                continue;
+            }
+            const name = allocator.dupe(u8, entry.name) catch {
+                self.had_error.store(true, .release);
+                return;
+            };
+            sorted.append(allocator, .{ .name = name, .kind = entry.kind }) catch {
+                allocator.free(name);
+                self.had_error.store(true, .release);
+                return;
+            };
+        }
+
+        std.mem.sort(DirEntry, sorted.items, {}, DirEntry.lessThan);
+        for (sorted.items) |entry| {
+            if (self.stopped()) return;
+            self.visit(path, entry.name, entry.kind);
+        }
+    }
+
+    /// Queue or descend into entry `name` of directory `path`
+    fn visit(self: *FileRun, path: []const u8, name: []const u8, kind: std.fs.Dir.Entry.Kind) void {
+        const allocator = self.ctx.allocator;
         // Build full path
-        const full_path = std.fs.path.join(allocator, &.{ path, entry.name }) catch {
-            had_error.* = true;
-            continue;
+        const full_path = std.fs.path.join(allocator, &.{ path, name }) catch {
+            self.had_error.store(true, .release);
+            return;
         };
         defer allocator.free(full_path);
 
-        if (entry.kind == .directory) {
+        if (kind == .directory) {
             // Skip hidden directories (starting with .)
-            if (entry.name.len > 0 and entry.name[0] == '.') continue;
+            if (name.len > 0 and name[0] == '.') return;
             // Recurse into subdirectory
-            processDirectory(allocator, full_path, all_patterns, options, backend_mode, config, verbose, output_opts, found_match, had_error, quiet_mode);
-        } else if (entry.kind == .file) {
-            // Process file
-            const result = processFile(allocator, full_path, all_patterns, options, backend_mode, config, verbose, output_opts);
-            if (result.found) found_match.* = true;
-            if (result.had_error) had_error.* = true;
+            self.walkDirectory(full_path);
+        } else if (kind == .file) {
+            // Sidecar indexes describe their data files, they are not data
+            if (isSidecarPath(name)) return;
+            self.push(full_path, true);
         }
         // Skip symlinks and other special files
-
-        // For quiet mode, exit early on first match
-        if (quiet_mode and found_match.*) return;
     }
-}
 
-fn processFile(allocator: std.mem.Allocator, filepath: []const u8, all_patterns: []const []const u8, options: SearchOptions, backend_mode: BackendMode, config: AutoSelectConfig, verbose: bool, output_opts: OutputOptions) ProcessResult {
-    const file = std.fs.cwd().openFile(filepath, .{}) catch |err| {
-        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
-        return .{ .found = false, .had_error = true };
-    };
-    defer file.close();
+    const DirEntry = struct {
+        name: []const u8,
+        kind: std.fs.Dir.Entry.Kind,
 
-    const stat = file.stat() catch |err| {
-        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
-        return .{ .found = false, .had_error = true };
+        fn lessThan(_: void, a: DirEntry, b: DirEntry) bool {
+            return std.mem.lessThan(u8, a.name, b.name);
+        }
     };
-    const file_size = stat.size;
 
-    // For auto mode, detect hardware capabilities to adjust thresholds
-    var adjusted_config = config;
-    if (backend_mode == .auto and !config.hardware_detected) {
-        // Try to detect GPU capabilities
-        if (build_options.is_macos) {
-            if (gpu.metal.MetalSearcher.init(allocator)) |searcher| {
-                adjusted_config.applyHardwareCapabilities(searcher.capabilities);
-                if (verbose) {
-                    const score = searcher.capabilities.performanceScore();
-                    std.debug.print("Hardware: Score={d}, MinSize={d}KB, MaxSize={d}MB, Bias={d}\n", .{
-                        score,
-                        adjusted_config.min_gpu_file_size / 1024,
-                        adjusted_config.max_gpu_file_size / (1024 * 1024),
-                        adjusted_config.gpu_bias,
-                    });
-                }
-                searcher.deinit();
-            } else |_| {}
-        } else {
-            if (gpu.vulkan.VulkanSearcher.init(allocator)) |searcher| {
-                adjusted_config.applyHardwareCapabilities(searcher.capabilities);
-                if (verbose) {
-                    const score = searcher.capabilities.performanceScore();
-                    std.debug.print("Hardware: Score={d}, MinSize={d}KB, MaxSize={d}MB, Bias={d}\n", .{
-                        score,
-                        adjusted_config.min_gpu_file_size / 1024,
-                        adjusted_config.max_gpu_file_size / (1024 * 1024),
-                        adjusted_config.gpu_bias,
-                    });
-                }
-                searcher.deinit();
-            } else |_| {}
+    /// Stream --files-from entries into the queue ("-" reads the list from stdin)
+    fn addPathList(self: *FileRun, list_path: []const u8) void {
+        const list_file: ?std.fs.File = if (std.mem.eql(u8, list_path, "-")) null else std.fs.cwd().openFile(list_path, .{}) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ list_path, err });
+            self.had_error.store(true, .release);
+            return;
+        };
+        defer if (list_file) |f| f.close();
+
+        var reader = scheduler.PathReader.init(if (list_file) |f| f.handle else std.posix.STDIN_FILENO);
+        while (reader.next() catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ list_path, err });
+            self.had_error.store(true, .release);
+            return;
+        }) |path| {
+            if (self.stopped()) return;
+            self.addPath(path);
         }
     }
+};
 
-    // Use first pattern for backend selection heuristics
-    const first_pattern = if (all_patterns.len > 0) all_patterns[0] else "";
+fn fileWorker(run: *FileRun) void {
+    var worker = Worker.init(run.ctx.allocator);
+    defer worker.deinit();
 
-    // Select backend using hardware-adjusted config
-    const backend: gpu.Backend = switch (backend_mode) {
-        .auto => selectOptimalBackend(first_pattern, options, file_size, adjusted_config),
-        .gpu => if (build_options.is_macos) .metal else .vulkan,
-        .cpu, .cpu_gnu => .cpu, // Both CPU backends use .cpu for dispatch
-        .metal => .metal,
-        .vulkan => .vulkan,
-    };
+    // Files stolen from the GPU lane are searched here, on the CPU, as are
+    // GPU-bound files while the GPU lane is full
+    while (run.queue.popCpu()) |popped| {
+        defer run.queue.finished();
+        if (!popped.stolen and run.laneFor(popped.item.path) == .gpu and run.queue.reroute(popped.item)) continue;
+        runJob(run, &worker, popped.item, popped.stolen);
+    }
+}
 
-    if (verbose) {
-        std.debug.print("File: {s} ({d} bytes)\n", .{ filepath, file_size });
-        if (backend_mode == .auto) {
-            std.debug.print("Auto-selected backend: {s}\n", .{@tagName(backend)});
-        } else if (backend_mode == .cpu_gnu) {
-            std.debug.print("Backend: cpu_gnu (GNU grep)\n", .{});
+/// The one thread feeding the GPU in a routed run
+fn gpuSubmitter(run: *FileRun) void {
+    var worker = Worker.init(run.ctx.allocator);
+    defer worker.deinit();
+
+    while (run.queue.popGpu()) |job| runJob(run, &worker, job, false);
+}
+
+fn runJob(run: *FileRun, worker: *Worker, job: Job, cpu_only: bool) void {
+    defer run.ctx.allocator.free(job.path);
+    if (run.order) |order| worker.out.begin(order, job.seq);
+    // Keep draining after a quiet-mode match so the producer never blocks
+    if (run.stopped()) {
+        worker.out.finish();
+        return;
+    }
+    var job_ctx = run.ctx.*;
+    if (job.labelled) job_ctx.output_opts.show_filename = true;
+    if (cpu_only) job_ctx.backend_mode = .cpu;
+    const result = processFile(&job_ctx, worker, job.path);
+    worker.out.finish();
+    run.record(result);
+}
+
+/// Search many files on a pool of worker threads. The calling thread produces
+/// the paths: operands, walked directories (-r) and --files-from entries.
+/// Workers share the context, including its GPU session, and each keeps its
+/// own compiled matchers and output buffer; a file's output is written as a
+/// unit. With --sort=path files appear in input order through a bounded
+/// reorder window; with --sort=none, in completion order. Under auto backend
+/// selection an extra thread takes the files the selector gives the GPU,
+/// and the CPU workers take the rest plus any GPU backlog.
+fn searchFiles(ctx: *const Context, operands: []const []const u8, files_from: ?[]const u8, recursive: bool, num_workers: usize) ProcessResult {
+    const allocator = ctx.allocator;
+    const route_gpu = ctx.backend_mode == .auto and num_workers > 1;
+    const num_threads = num_workers + @intFromBool(route_gpu);
+    var order: ?output.Order = null;
+    if (ctx.output_opts.sort == .path) {
+        order = output.Order.init(allocator, num_threads * scheduler.REORDER_WINDOW_PER_WORKER) catch {
+            std.debug.print("grep: out of memory\n", .{});
+            return .{ .found = false, .had_error = true };
+        };
+    }
+    defer if (order) |*o| o.deinit();
+
+    var run = FileRun{
+        .ctx = ctx,
+        .recursive = recursive,
+        .route_gpu = route_gpu,
+        .order = if (order) |*o| o else null,
+        .queue = scheduler.RoutedQueue(Job, Job.seqOf).init(allocator, num_workers * scheduler.QUEUE_DEPTH_PER_WORKER, scheduler.QUEUE_DEPTH_PER_WORKER) catch {
+            std.debug.print("grep: out of memory\n", .{});
+            return .{ .found = false, .had_error = true };
+        },
+    };
+    defer run.queue.deinit(allocator);
+
+    const threads = allocator.alloc(std.Thread, num_threads) catch {
+        std.debug.print("grep: out of memory\n", .{});
+        return .{ .found = false, .had_error = true };
+    };
+    defer allocator.free(threads);
+    var started: usize = 0;
+    for (threads, 0..) |*thread, i| {
+        // Thread 0 of a routed run drains the GPU lane
+        const submitter = route_gpu and i == 0;
+        thread.* = (if (submitter)
+            std.Thread.spawn(.{}, gpuSubmitter, .{&run})
+        else
+            std.Thread.spawn(.{}, fileWorker, .{&run})) catch |err| {
+            // Each lane needs a thread of its own
+            if (submitter or started == @intFromBool(route_gpu)) {
+                std.debug.print("grep: cannot start worker thread: {}\n", .{err});
+                run.queue.close();
+                for (threads[0..started]) |started_thread| started_thread.join();
+                return .{ .found = false, .had_error = true };
+            }
+            break;
+        };
+        started += 1;
+    }
+    if (ctx.verbose) std.debug.print("Workers: {d}{s}\n", .{ started - @intFromBool(route_gpu), if (route_gpu) " + GPU submitter" else "" });
+
+    // Standard input is searched here; the queue only carries paths
+    var stdin_worker = Worker.init(allocator);
+    defer stdin_worker.deinit();
+
+    for (operands) |path| {
+        if (run.stopped()) break;
+        if (std.mem.eql(u8, path, "-")) {
+            if (run.order) |o| stdin_worker.out.begin(o, run.takeSeq());
+            const result = processStdin(ctx, &stdin_worker, if (ctx.output_opts.show_filename) "(standard input)" else null);
+            stdin_worker.out.finish();
+            run.record(result);
         } else {
-            std.debug.print("Backend: {s}\n", .{@tagName(backend)});
+            run.addPath(path);
         }
     }
+    if (files_from) |list_path| {
+        if (!run.stopped()) run.addPathList(list_path);
+    }
 
-    const text = file.readToEndAlloc(allocator, gpu.MAX_GPU_BUFFER_SIZE) catch |err| {
+    run.queue.close();
+    for (threads[0..started]) |thread| thread.join();
+    return .{ .found = run.found.load(.acquire), .had_error = run.had_error.load(.acquire) };
+}
+
+fn processFile(ctx: *const Context, worker: *Worker, filepath: []const u8) ProcessResult {
+    const allocator = ctx.allocator;
+    const file = std.fs.cwd().openFile(filepath, .{}) catch |err| {
         std.debug.print("grep: {s}: {}\n", .{ filepath, err });
         return .{ .found = false, .had_error = true };
     };
-    defer allocator.free(text);
+    defer file.close();
 
-    // For multiple patterns, always use CPU multi-pattern search
-    var result = if (all_patterns.len > 1)
-        searchMultiPattern(allocator, text, all_patterns, options, backend_mode) catch {
-            return .{ .found = false, .had_error = true };
-        }
-    else switch (backend) {
-        .metal => blk: {
-            if (build_options.is_macos) {
-                const searcher = gpu.metal.MetalSearcher.init(allocator) catch |err| {
-                    if (verbose) std.debug.print("Metal init failed: {}, falling back to CPU\n", .{err});
-                    break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                        return .{ .found = false, .had_error = true };
-                    };
-                };
-                defer searcher.deinit();
-                // Use GPU regex for regex patterns (including PCRE), literal search for fixed strings
-                const use_regex = !options.fixed_string or options.perl;
-                if (use_regex) {
-                    break :blk searcher.searchRegex(text, first_pattern, options, allocator) catch |err| {
-                        if (verbose) std.debug.print("Metal regex failed: {}, falling back to CPU\n", .{err});
-                        break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                            return .{ .found = false, .had_error = true };
-                        };
-                    };
-                } else {
-                    break :blk searcher.search(text, first_pattern, options, allocator) catch |err| {
-                        if (verbose) std.debug.print("Metal search failed: {}, falling back to CPU\n", .{err});
-                        break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                            return .{ .found = false, .had_error = true };
-                        };
-                    };
-                }
-            } else {
-                if (verbose) std.debug.print("Metal not available, falling back to CPU\n", .{});
-                break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
+    const stat = file.stat() catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    const file_size = stat.size;
+    const label: ?[]const u8 = if (ctx.output_opts.show_filename) filepath else null;
+
+    if (ctx.input_opts.within != null or ctx.save_candidates != null) {
+        return processFileCandidates(ctx, worker, file, filepath, stat, label);
+    }
+
+    if (ctx.input_opts.archive_workers > 0) {
+        if (processArchive(ctx, worker, file, filepath, file_size)) |result| return result;
+    }
+
+    // UTF-16 is decoded whole, ahead of the index and time-window paths
+    var bom: [2]u8 = undefined;
+    const bom_len = if (file_size >= 2) file.pread(&bom, 0) catch 0 else 0;
+    const encoding = input.detectEncoding(bom[0..bom_len]);
+    if (encoding != .utf8) {
+        return processFileTranscoded(ctx, worker, file, filepath, file_size, label, encoding);
+    }
+
+    if (ctx.input_opts.use_sidecar and file_size >= sidecar.BLOCK_SIZE) {
+        if (processFileIndexed(ctx, worker, file, filepath, stat, label)) |result| return result;
+    }
+
+    if (ctx.input_opts.time_range != null) {
+        return processFileWindow(ctx, worker, file, filepath, stat, label);
+    }
+
+    const backend = selectBackend(ctx, filepath, file_size);
+
+    if (SegmentRun.applies(ctx, file_size)) {
+        return searchSegments(ctx, worker, file, filepath, file_size, label);
+    }
+    // Segments and chunks are searched a piece at a time; only a whole-file
+    // search is bounded by the size of one search
+    const chunked = Chunker.applies(ctx, file_size);
+    if (!chunked and file_size > gpu.MAX_GPU_BUFFER_SIZE) {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, error.FileTooBig });
+        return .{ .found = false, .had_error = true };
+    }
+
+    // A chunked search prefetches ahead of itself instead
+    const access: input.Access = if (chunked) .partial else .whole;
+    var mapped = input.MappedFile.init(allocator, file, file_size, access) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer mapped.deinit();
+
+    // Read-back files (procfs) are not the bytes on disk at any offset
+    const source: ?output.FileRegion = if (mapped.mapping != null) .{ .fd = file.handle, .offset = 0 } else null;
+    const result = searchAndEmit(ctx, worker, .{ .text = mapped.data, .label = label, .list_name = filepath, .source = source }, backend);
+    if (ctx.stats) |st| {
+        if (mapped.mapping != null and access == .whole) st.sampleMapping(mapped.data);
+    }
+    return result;
+}
+
+/// Search each member of a tar, tar.gz or zip archive as its own input,
+/// labelled `archive:member`. Returns null when the file is not an archive.
+fn processArchive(ctx: *const Context, worker: *Worker, file: std.fs.File, filepath: []const u8, file_size: u64) ?ProcessResult {
+    const allocator = ctx.allocator;
+    var head: [512]u8 = undefined;
+    const head_len = file.pread(&head, 0) catch return null;
+    if (head_len < 4) return null;
+    // A gzip stream needs more than its first block to classify
+    const quick = archive.detect(head[0..head_len]) orelse return null;
+
+    var mapped = input.MappedFile.init(allocator, file, file_size, .whole) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer mapped.deinit();
+    const format = if (quick == .gzip) archive.detect(mapped.data) orelse return null else quick;
+    if (ctx.verbose) std.debug.print("Archive: {s} ({s})\n", .{ filepath, @tagName(format) });
+
+    switch (format) {
+        .zip => return searchZip(ctx, worker, filepath, mapped.data),
+        .gzip => {
+            const stem = std.fs.path.basename(filepath);
+            const name = if (std.mem.endsWith(u8, stem, ".gz")) stem[0 .. stem.len - 3] else stem;
+            // Its size is only known once inflated, so under a budget it is always streamed
+            if (memberStreamSize(ctx) != std.math.maxInt(u64)) {
+                const inflater = allocator.create(archive.Inflater) catch {
+                    std.debug.print("grep: out of memory\n", .{});
                     return .{ .found = false, .had_error = true };
                 };
+                defer allocator.destroy(inflater);
+                const stream = inflater.init(mapped.data, .gzip, std.math.maxInt(u64));
+                return searchMember(ctx, worker, filepath, .{ .name = name, .data = &.{}, .stream = stream });
             }
-        },
-        .vulkan => blk: {
-            const searcher = gpu.vulkan.VulkanSearcher.init(allocator) catch |err| {
-                if (verbose) std.debug.print("Vulkan init failed: {}, falling back to CPU\n", .{err});
-                break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                    return .{ .found = false, .had_error = true };
-                };
+            const text = archive.gunzip(allocator, mapped.data) catch |err| {
+                std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+                return .{ .found = false, .had_error = true };
             };
-            defer searcher.deinit();
-            // Use GPU regex for regex patterns (including PCRE), literal search for fixed strings
-            const use_regex = !options.fixed_string or options.perl;
-            if (use_regex) {
-                break :blk searcher.searchRegex(text, first_pattern, options, allocator) catch |err| {
-                    if (verbose) std.debug.print("Vulkan regex failed: {}, falling back to CPU\n", .{err});
-                    break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                        return .{ .found = false, .had_error = true };
-                    };
-                };
-            } else {
-                break :blk searcher.search(text, first_pattern, options, allocator) catch |err| {
-                    if (verbose) std.debug.print("Vulkan search failed: {}, falling back to CPU\n", .{err});
-                    break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-                        return .{ .found = false, .had_error = true };
-                    };
-                };
-            }
+            defer allocator.free(text);
+            return searchMember(ctx, worker, filepath, .{ .name = name, .data = text });
         },
-        .cpu => doSearch(text, first_pattern, options, allocator, backend_mode) catch {
-            return .{ .found = false, .had_error = true };
-        },
-        // CUDA and OpenCL not yet supported - fall back to CPU
-        .cuda, .opencl => blk: {
-            if (verbose) std.debug.print("{s} not supported, falling back to CPU\n", .{@tagName(backend)});
-            break :blk doSearch(text, first_pattern, options, allocator, backend_mode) catch {
+        .tar, .tar_gz => {
+            const stream = allocator.create(archive.TarStream) catch {
+                std.debug.print("grep: out of memory\n", .{});
                 return .{ .found = false, .had_error = true };
             };
+            defer allocator.destroy(stream);
+            stream.init(allocator, mapped.data, format);
+            defer stream.deinit();
+
+            var total = ProcessResult{ .found = false, .had_error = false };
+            const stream_over = memberStreamSize(ctx);
+            while (stream.next(stream_over) catch |err| {
+                std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+                total.had_error = true;
+                return total;
+            }) |member| {
+                const result = searchMember(ctx, worker, filepath, member);
+                total.found = total.found or result.found;
+                total.had_error = total.had_error or result.had_error;
+                if (ctx.output_opts.quiet_mode and total.found) break;
+            }
+            return total;
         },
+    }
+}
+
+/// Archive members larger than this are searched as they are inflated, a
+/// chunk at a time, rather than held whole: past a chunk whenever inputs
+/// are chunked at all (--max-memory), except under a time window, which
+/// needs the whole member to bisect
+fn memberStreamSize(ctx: *const Context) u64 {
+    if (!Chunker.applies(ctx, std.math.maxInt(usize)) or ctx.input_opts.time_range != null) return std.math.maxInt(u64);
+    return ctx.input_opts.chunk_size;
+}
+
+/// Search one archive member, labelled `archive:member`
+fn searchMember(ctx: *const Context, worker: *Worker, filepath: []const u8, member: archive.Member) ProcessResult {
+    const name = std.fmt.allocPrint(ctx.allocator, "{s}:{s}", .{ filepath, member.name }) catch {
+        std.debug.print("grep: out of memory\n", .{});
+        return .{ .found = false, .had_error = true };
     };
-    defer result.deinit();
+    defer ctx.allocator.free(name);
+    if (member.oversized) {
+        std.debug.print("grep: {s}: {}\n", .{ name, error.FileTooBig });
+        return .{ .found = false, .had_error = true };
+    }
+    if (member.stream) |stream| return streamMember(ctx, worker, name, stream);
 
-    const found = result.matches.len > 0;
+    const encoding = input.detectEncoding(member.data);
+    if (encoding != .utf8) return searchTranscoded(ctx, worker, name, member.data, encoding, name, name);
 
-    // For quiet mode, don't output anything
-    if (output_opts.quiet_mode) {
-        return .{ .found = found, .had_error = false };
+    var in = applyTimeWindow(ctx, name, member.data, null);
+    in.label = name;
+    in.list_name = name;
+    const backend = selectBackend(ctx, name, in.text.len);
+    return searchAndEmit(ctx, worker, in, backend);
+}
+
+/// Search an archive member as it is inflated, a chunk at a time
+/// (--max-memory), holding no more of it than a chunk and the line that runs
+/// past it. A UTF-16 member is read whole and transcoded, like any other.
+fn streamMember(ctx: *const Context, worker: *Worker, name: []const u8, stream: *archive.Stream) ProcessResult {
+    const allocator = ctx.allocator;
+    var pending: std.ArrayListUnmanaged(u8) = .{};
+    defer pending.deinit(allocator);
+
+    var bom: [2]u8 = undefined;
+    const head = stream.read(&bom) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ name, err });
+        return .{ .found = false, .had_error = true };
+    };
+    pending.appendSlice(allocator, bom[0..head]) catch {
+        std.debug.print("grep: out of memory\n", .{});
+        return .{ .found = false, .had_error = true };
+    };
+    const encoding = input.detectEncoding(pending.items);
+    if (encoding != .utf8) {
+        stream.readAll(allocator, &pending) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ name, err });
+            return .{ .found = false, .had_error = true };
+        };
+        return searchTranscoded(ctx, worker, name, pending.items, encoding, name, name);
     }
 
-    // For files-without-match mode, only output filename if no matches
-    if (output_opts.files_without_match) {
-        if (!found) {
-            _ = std.posix.write(std.posix.STDOUT_FILENO, filepath) catch {};
-            _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
+    var chunker = Chunker{
+        .ctx = ctx,
+        .worker = worker,
+        .in = .{ .text = &.{}, .label = name, .list_name = name },
+        .backend = selectBackend(ctx, name, ctx.input_opts.chunk_size),
+    };
+    streamChunks(&chunker, &pending, stream) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ name, err });
+        return .{ .found = chunker.found, .had_error = true };
+    };
+    return chunker.finish();
+}
+
+/// Shared state of one zip archive searched member by member
+const ZipRun = struct {
+    ctx: *const Context,
+    filepath: []const u8,
+    zip: *const archive.Zip,
+    order: ?*output.Order, // members printed in directory order (--sort=path)
+    nested: bool, // the caller's output holds a slot of an outer order
+    next: std.atomic.Value(usize) = .init(0),
+    found: std.atomic.Value(bool) = .init(false),
+    had_error: std.atomic.Value(bool) = .init(false),
+
+    /// Claim and search members until none are left
+    fn drain(self: *ZipRun, worker: *Worker) void {
+        const allocator = self.ctx.allocator;
+        var inflated: std.ArrayListUnmanaged(u8) = .{};
+        defer inflated.deinit(allocator);
+        var inflater: ?*archive.Inflater = null;
+        defer if (inflater) |f| allocator.destroy(f);
+
+        while (true) {
+            if (self.ctx.output_opts.quiet_mode and self.found.load(.acquire)) return;
+            const idx = self.next.fetchAdd(1, .monotonic);
+            if (idx >= self.zip.entries.len) return;
+            if (self.order) |order| worker.out.begin(order, idx);
+            const member = self.prepare(idx, &inflater, &inflated) catch |err| {
+                std.debug.print("grep: {s}:{s}: {}\n", .{ self.filepath, self.zip.entries[idx].name, err });
+                self.had_error.store(true, .release);
+                if (!self.nested) worker.out.finish();
+                continue;
+            };
+            const result = searchMember(self.ctx, worker, self.filepath, member);
+            if (!self.nested) worker.out.finish();
+            if (result.found) self.found.store(true, .release);
+            if (result.had_error) self.had_error.store(true, .release);
         }
-        return .{ .found = found, .had_error = false };
     }
 
-    // For files-with-matches mode, only output filename if matches found
-    if (output_opts.files_with_matches) {
-        if (found) {
-            _ = std.posix.write(std.posix.STDOUT_FILENO, filepath) catch {};
-            _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
+    /// Entry `idx` ready to search: deflated members past memberStreamSize
+    /// are inflated as they are searched, the rest extracted whole
+    fn prepare(self: *ZipRun, idx: usize, inflater: *?*archive.Inflater, inflated: *std.ArrayListUnmanaged(u8)) !archive.Member {
+        const allocator = self.ctx.allocator;
+        const entry = self.zip.entries[idx];
+        if (entry.size > memberStreamSize(self.ctx)) {
+            if (inflater.* == null) inflater.* = try allocator.create(archive.Inflater);
+            if (try self.zip.open(idx, inflater.*.?)) |stream| return .{ .name = entry.name, .data = &.{}, .stream = stream };
         }
-        return .{ .found = found, .had_error = false };
+        return .{ .name = entry.name, .data = try self.zip.extract(idx, allocator, inflated) };
     }
 
-    if (output_opts.count_only) {
-        // Count unique lines with matches
-        var line_count: u64 = 0;
-        var last_line_start: u32 = std.math.maxInt(u32);
+    fn thread(self: *ZipRun) void {
+        var worker = Worker.init(self.ctx.allocator);
+        defer worker.deinit();
+        self.drain(&worker);
+    }
+};
+
+/// Search the members listed in a zip's central directory. Members are
+/// independent, so up to archive_workers threads (the caller's included)
+/// inflate and search them in parallel; output appears per member, in
+/// directory order unless --sort=none. An archive met in a parallel run
+/// (-r, --files-from) already owns a slot of that run's order: its members
+/// are searched one by one into that slot, which stays open until the last.
+fn searchZip(ctx: *const Context, worker: *Worker, filepath: []const u8, data: []const u8) ProcessResult {
+    const allocator = ctx.allocator;
+    var zip = archive.Zip.init(allocator, data) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer zip.deinit();
+
+    const nested = worker.out.order != null;
+    const extra = if (nested) 0 else @min(ctx.input_opts.archive_workers, zip.entries.len) -| 1;
+    var order: ?output.Order = null;
+    if (extra > 0 and ctx.output_opts.sort == .path) {
+        order = output.Order.init(allocator, (extra + 1) * scheduler.REORDER_WINDOW_PER_WORKER) catch {
+            std.debug.print("grep: out of memory\n", .{});
+            return .{ .found = false, .had_error = true };
+        };
+    }
+    defer if (order) |*o| o.deinit();
+
+    var run = ZipRun{ .ctx = ctx, .filepath = filepath, .zip = &zip, .order = if (order) |*o| o else null, .nested = nested };
+    var threads: [scheduler.MAX_DEFAULT_WORKERS]std.Thread = undefined;
+    var started: usize = 0;
+    while (started < @min(extra, threads.len)) : (started += 1) {
+        threads[started] = std.Thread.spawn(.{}, ZipRun.thread, .{&run}) catch break;
+    }
+    if (ctx.verbose) std.debug.print("Zip: {s}: {d} members, {d} threads\n", .{ filepath, zip.entries.len, started + 1 });
+
+    if (!nested) worker.out.finish();
+    run.drain(worker);
+    for (threads[0..started]) |t| t.join();
+    return .{ .found = run.found.load(.acquire), .had_error = run.had_error.load(.acquire) };
+}
+
+/// Search a UTF-16 file through its UTF-8 transcoding
+fn processFileTranscoded(ctx: *const Context, worker: *Worker, file: std.fs.File, filepath: []const u8, file_size: u64, label: ?[]const u8, encoding: input.Encoding) ProcessResult {
+    // The transcoding is searched in chunks when it can be (it is never
+    // longer than the file); searchTranscoded bounds it to 32-bit positions
+    if (!Chunker.applies(ctx, file_size) and file_size > gpu.MAX_GPU_BUFFER_SIZE) {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, error.FileTooBig });
+        return .{ .found = false, .had_error = true };
+    }
+    var mapped = input.MappedFile.init(ctx.allocator, file, file_size, .whole) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer mapped.deinit();
+    return searchTranscoded(ctx, worker, filepath, mapped.data, encoding, label, filepath);
+}
+
+/// Transcode a UTF-16 input to UTF-8 in one vectorized pass and search that.
+/// Line numbers carry over unchanged and -b offsets are mapped back to the
+/// source; output lines are printed as UTF-8.
+fn searchTranscoded(ctx: *const Context, worker: *Worker, name: []const u8, data: []const u8, encoding: input.Encoding, label: ?[]const u8, list_name: ?[]const u8) ProcessResult {
+    var utf8 = input.Transcoded.init(ctx.allocator, data, encoding) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ name, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer utf8.deinit();
+    if (utf8.text.len > std.math.maxInt(u32)) {
+        std.debug.print("grep: {s}: {}\n", .{ name, error.FileTooBig });
+        return .{ .found = false, .had_error = true };
+    }
+    if (ctx.verbose) {
+        std.debug.print("Encoding: {s} is {s}, {d} bytes as UTF-8\n", .{ name, @tagName(encoding), utf8.text.len });
+    }
+
+    var in = applyTimeWindow(ctx, name, utf8.text, null);
+    in.label = label;
+    in.list_name = list_name;
+    in.transcoded = &utf8;
+
+    const backend = selectBackend(ctx, name, in.text.len);
+    return searchAndEmit(ctx, worker, in, backend);
+}
+
+/// Search a file through its sidecar index, scanning only the blocks whose
+/// bloom filter (and timestamps, with --since/--until) admit a match.
+/// Returns null when there is no fresh index or nothing to filter on, and the
+/// caller should search the file normally.
+fn processFileIndexed(ctx: *const Context, worker: *Worker, file: std.fs.File, filepath: []const u8, stat: std.fs.File.Stat, label: ?[]const u8) ?ProcessResult {
+    const allocator = ctx.allocator;
+    // Context lines and records may live in skipped blocks; positions must fit MatchResult
+    if (ctx.output_opts.before_context > 0 or ctx.output_opts.after_context > 0) return null;
+    if (ctx.input_opts.record_start != null or ctx.input_opts.fields != null or ctx.options.record_sep != '\n') return null;
+    if (ctx.options.multiline and ctx.options.invert_match) return null;
+    if (stat.size > std.math.maxInt(u32)) return null;
+
+    const index_path = std.mem.concat(allocator, u8, &.{ filepath, sidecar.SUFFIX }) catch return null;
+    defer allocator.free(index_path);
+    var index = sidecar.Index.load(allocator, index_path) catch return null;
+    defer index.deinit();
+    if (!index.isFresh(stat.size, stat.mtime)) {
+        if (ctx.verbose) std.debug.print("Sidecar: {s} is stale, ignoring (rebuild with --sidecar-build)\n", .{index_path});
+        return null;
+    }
+
+    var query = sidecar.Query.init(allocator, ctx.patterns, ctx.options) catch return null;
+    defer if (query) |*q| q.deinit();
+    const range = ctx.input_opts.time_range;
+    if (query == null and range == null) return null;
+
+    var mapped = input.MappedFile.init(allocator, file, stat.size, .partial) catch return null;
+    defer mapped.deinit();
+    const data = mapped.data;
+
+    // Block timestamps bound the time window, the binary search trims it exactly
+    var window = timerange.Window{ .start = 0, .end = data.len };
+    if (range) |*r| {
+        const span = if (std.mem.eql(u8, index.time_format, r.format.spec)) index.timeSpan(r, data.len) else window;
+        const w = r.locate(data[span.start..span.end]);
+        window = .{ .start = span.start + w.start, .end = span.start + w.end };
+    }
+
+    const candidate_runs = index.candidateRuns(allocator, data, if (query) |*q| q else null, window) catch return null;
+    defer allocator.free(candidate_runs);
+    const runs = if (ctx.options.multiline) widenRuns(data, candidate_runs, ctx.input_opts.max_span) else candidate_runs;
+
+    var candidate_bytes: usize = 0;
+    for (runs) |run| candidate_bytes += run.end - run.start;
+    if (ctx.verbose) {
+        std.debug.print("Sidecar: {s}: searching {d} of {d} bytes in {d} run(s)\n", .{ filepath, candidate_bytes, data.len, runs.len });
+    }
+    const backend = selectBackend(ctx, filepath, candidate_bytes);
+
+    // Search each run and rebase its matches onto the whole file
+    var matches: std.ArrayListUnmanaged(gpu.MatchResult) = .{};
+    defer matches.deinit(allocator);
+    var total_matches: u64 = 0;
+    for (runs) |run| {
+        const text = data[run.start..run.end];
+        var result = runSearch(ctx, worker, text, backend) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+            return .{ .found = false, .had_error = true };
+        };
+        defer result.deinit();
+        total_matches += result.total_matches;
+
+        var lines_before: u64 = 0;
+        var counted: usize = 0;
         for (result.matches) |match| {
-            if (match.line_start != last_line_start) {
-                last_line_start = match.line_start;
-                line_count += 1;
+            var rebased = match;
+            rebased.position += @intCast(run.start);
+            rebased.line_start += @intCast(run.start);
+            if (ctx.output_opts.line_numbers) {
+                if (match.line_num > 0) {
+                    rebased.line_num = @intCast(run.first_line + match.line_num);
+                } else {
+                    if (match.line_start < counted) {
+                        lines_before = 0;
+                        counted = 0;
+                    }
+                    lines_before += input.countNewlines(text[counted..match.line_start]);
+                    counted = match.line_start;
+                    rebased.line_num = @intCast(run.first_line + lines_before + 1);
+                }
             }
+            matches.append(allocator, rebased) catch {
+                std.debug.print("grep: out of memory\n", .{});
+                return .{ .found = false, .had_error = true };
+            };
         }
-        var count_buf: [32]u8 = undefined;
-        const count_str = std.fmt.bufPrint(&count_buf, "{d}\n", .{line_count}) catch return .{ .found = found, .had_error = false };
-        if (output_opts.show_filename) {
-            _ = std.posix.write(std.posix.STDOUT_FILENO, filepath) catch {};
-            _ = std.posix.write(std.posix.STDOUT_FILENO, ":") catch {};
+    }
+
+    var merged = gpu.SearchResult{ .matches = matches.items, .total_matches = total_matches, .allocator = allocator };
+    var pieces: ?gpu.SearchResult = null;
+    defer if (pieces) |*p| p.deinit();
+    if (ctx.options.multiline) {
+        pieces = records.splitSpans(allocator, data, '\n', merged, ctx.input_opts.max_span, false) catch {
+            std.debug.print("grep: out of memory\n", .{});
+            return .{ .found = false, .had_error = true };
+        };
+        merged = pieces.?;
+    }
+    const source: ?output.FileRegion = if (mapped.mapping != null) .{ .fd = file.handle, .offset = 0 } else null;
+    emitResults(ctx, worker, .{ .text = data, .label = label, .list_name = filepath, .source = source }, merged);
+    if (ctx.verbose) {
+        std.debug.print("\nTotal matches: {d}\n\n", .{total_matches});
+    }
+    return .{ .found = merged.matches.len > 0, .had_error = false };
+}
+
+/// --within and --save-candidates: search only the lines the saved set
+/// selected in this file (all of it without --within, none of it when the
+/// set has no lines here), then record the lines selected now
+fn processFileCandidates(ctx: *const Context, worker: *Worker, file: std.fs.File, filepath: []const u8, stat: std.fs.File.Stat, label: ?[]const u8) ProcessResult {
+    const allocator = ctx.allocator;
+    const eol = ctx.options.record_sep;
+    // Positions must fit MatchResult
+    if (stat.size > std.math.maxInt(u32)) {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, error.FileTooBig });
+        return .{ .found = false, .had_error = true };
+    }
+
+    var mapped = input.MappedFile.init(allocator, file, stat.size, .partial) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer mapped.deinit();
+    const data = mapped.data;
+
+    const whole = [1]candidates.Run{.{ .start = 0, .end = data.len, .first_line = 0 }};
+    var runs: []const candidates.Run = &whole;
+    if (ctx.input_opts.within) |set| {
+        if (set.get(filepath)) |saved| {
+            if (saved.isFresh(stat.size, stat.mtime)) {
+                runs = saved.runs;
+            } else if (ctx.verbose) {
+                std.debug.print("Candidates: {s} changed since the set was saved, searching all of it\n", .{filepath});
+            }
+        } else {
+            runs = &.{};
         }
-        _ = std.posix.write(std.posix.STDOUT_FILENO, count_str) catch {};
-    } else if (output_opts.only_matching) {
-        // Output only the matching text, not the whole line
+    }
+
+    var candidate_bytes: usize = 0;
+    for (runs) |run| candidate_bytes += run.end - run.start;
+    if (ctx.verbose and ctx.input_opts.within != null) {
+        std.debug.print("Candidates: {s}: searching {d} of {d} bytes in {d} run(s)\n", .{ filepath, candidate_bytes, data.len, runs.len });
+    }
+    const backend = selectBackend(ctx, filepath, candidate_bytes);
+
+    // Search each run and rebase its matches onto the whole file, numbering
+    // their lines for -n and the saved set
+    var matches: std.ArrayListUnmanaged(gpu.MatchResult) = .{};
+    defer matches.deinit(allocator);
+    var total_matches: u64 = 0;
+    for (runs) |run| {
+        const text = data[run.start..run.end];
+        var result = selectLines(ctx, worker, text, backend) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+            return .{ .found = false, .had_error = true };
+        };
+        defer result.deinit();
+        total_matches += result.total_matches;
+
+        var lines_before: u64 = 0;
+        var counted: usize = 0;
         for (result.matches) |match| {
-            if (output_opts.show_filename) {
-                _ = std.posix.write(std.posix.STDOUT_FILENO, filepath) catch {};
-                _ = std.posix.write(std.posix.STDOUT_FILENO, ":") catch {};
-            }
-            if (output_opts.line_numbers) {
-                // Use GPU-computed line number if available, otherwise compute on CPU
-                const line_num = if (match.line_num > 0) match.line_num else blk: {
-                    var ln: u32 = 1;
-                    var pos: usize = 0;
-                    while (pos < match.line_start) : (pos += 1) {
-                        if (text[pos] == '\n') ln += 1;
-                    }
-                    break :blk ln;
-                };
-                var num_buf: [16]u8 = undefined;
-                const num_str = std.fmt.bufPrint(&num_buf, "{d}:", .{line_num}) catch continue;
-                _ = std.posix.write(std.posix.STDOUT_FILENO, num_str) catch {};
-            }
-            // Output the matched text (with color if enabled)
-            const match_end = match.position + match.match_len;
-            if (match_end <= text.len) {
-                if (output_opts.color_mode == .always) {
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, COLOR_MATCH_START) catch {};
-                }
-                _ = std.posix.write(std.posix.STDOUT_FILENO, text[match.position..match_end]) catch {};
-                if (output_opts.color_mode == .always) {
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, COLOR_RESET) catch {};
-                }
+            if (match.line_start < counted) {
+                lines_before = 0;
+                counted = 0;
             }
-            _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
+            lines_before += input.countTerminators(text[counted..match.line_start], eol);
+            counted = match.line_start;
+            var rebased = match;
+            rebased.position += @intCast(run.start);
+            rebased.line_start += @intCast(run.start);
+            rebased.line_num = @intCast(run.first_line + lines_before + 1);
+            matches.append(allocator, rebased) catch {
+                std.debug.print("grep: out of memory\n", .{});
+                return .{ .found = false, .had_error = true };
+            };
         }
-    } else if (output_opts.before_context > 0 or output_opts.after_context > 0) {
-        // Output with context lines
-        const filename_prefix: ?[]const u8 = if (output_opts.show_filename) filepath else null;
-        outputWithContext(text, result.matches, output_opts, filename_prefix, allocator);
-    } else {
-        // Output matching lines
-        var last_line_start: u32 = std.math.maxInt(u32);
-        var current_line_num: u32 = 1;
-        var last_line_counted: u32 = 0;
+    }
 
-        for (result.matches) |match| {
-            if (match.line_start != last_line_start) {
-                last_line_start = match.line_start;
+    const merged = gpu.SearchResult{ .matches = matches.items, .total_matches = total_matches, .allocator = allocator };
+    const source: ?output.FileRegion = if (mapped.mapping != null) .{ .fd = file.handle, .offset = 0 } else null;
+    emitResults(ctx, worker, .{ .text = data, .label = label, .list_name = filepath, .source = source }, merged);
+    if (ctx.save_candidates) |set| {
+        set.add(filepath, stat, data, eol, merged.matches) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+            return .{ .found = merged.matches.len > 0, .had_error = true };
+        };
+    }
+    if (ctx.verbose) {
+        std.debug.print("\nTotal matches: {d}\n\n", .{total_matches});
+    }
+    return .{ .found = merged.matches.len > 0, .had_error = false };
+}
 
-                // Find line end
-                var line_end = match.line_start;
-                while (line_end < text.len and text[line_end] != '\n') line_end += 1;
+/// Store the lines selected by this run as --save-candidates=ID
+fn saveCandidates(set: *candidates.Set, id: []const u8) bool {
+    set.save(id) catch |err| {
+        std.debug.print("grep: --save-candidates={s}: {}\n", .{ id, err });
+        return false;
+    };
+    return true;
+}
 
-                if (output_opts.show_filename) {
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, filepath) catch {};
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, ":") catch {};
-                }
-                if (output_opts.line_numbers) {
-                    // Use GPU-computed line number if available, otherwise fall back to CPU computation
-                    const line_num = if (match.line_num > 0) match.line_num else blk: {
-                        // Fall back to counting newlines on CPU
-                        var pos: usize = last_line_counted;
-                        while (pos < match.line_start) : (pos += 1) {
-                            if (text[pos] == '\n') current_line_num += 1;
-                        }
-                        last_line_counted = match.line_start;
-                        break :blk current_line_num;
-                    };
-                    var num_buf: [16]u8 = undefined;
-                    const num_str = std.fmt.bufPrint(&num_buf, "{d}:", .{line_num}) catch continue;
-                    _ = std.posix.write(std.posix.STDOUT_FILENO, num_str) catch {};
-                }
-                // Output line with color highlighting if enabled
-                outputLineWithColor(text, match.line_start, line_end, result.matches, output_opts.color_mode == .always);
-                _ = std.posix.write(std.posix.STDOUT_FILENO, "\n") catch {};
-            }
+/// Print the merged --histogram once every worker has published its counts
+fn writeHistogram(allocator: std.mem.Allocator, hist: *histogram.Histogram, format: histogram.OutputFormat) void {
+    var out = output.Sink.init(allocator);
+    defer out.deinit();
+    hist.write(&out, format) catch |err| std.debug.print("grep: --histogram: {}\n", .{err});
+    out.finish();
+}
+
+/// -U over index-selected runs: grow each run by the maximum match span so a
+/// match crossing into a skipped block is still found whole, merging runs
+/// that now overlap. Works in place; returns the shortened slice.
+fn widenRuns(data: []const u8, runs: []sidecar.Run, max_span: usize) []sidecar.Run {
+    var len: usize = 0;
+    for (runs) |run| {
+        const w = records.widen(data, run.start, run.end, max_span);
+        const first_line = run.first_line - input.countNewlines(data[w.start..run.start]);
+        if (len > 0 and w.start <= runs[len - 1].end) {
+            runs[len - 1].end = @max(runs[len - 1].end, w.end);
+        } else {
+            runs[len] = .{ .start = w.start, .end = w.end, .first_line = first_line };
+            len += 1;
         }
     }
+    return runs[0..len];
+}
 
+fn isSidecarPath(path: []const u8) bool {
+    return std.mem.endsWith(u8, path, sidecar.SUFFIX) or std.mem.endsWith(u8, path, sidecar.SUFFIX ++ ".tmp");
+}
+
+/// --sidecar-build: create or extend FILE.grepidx for each file, walking
+/// directories when -r is given. Files smaller than one block are skipped.
+fn buildSidecars(allocator: std.mem.Allocator, path: []const u8, recursive: bool, format: timerange.Format, verbose: bool) bool {
+    const stat = std.fs.cwd().statFile(path) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ path, err });
+        return false;
+    };
+    if (stat.kind == .directory) {
+        if (!recursive) {
+            std.debug.print("grep: {s}: Is a directory\n", .{path});
+            return false;
+        }
+        var dir = std.fs.cwd().openDir(path, .{ .iterate = true }) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ path, err });
+            return false;
+        };
+        defer dir.close();
+        var ok = true;
+        var iter = dir.iterate();
+        while (iter.next() catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ path, err });
+            return false;
+        }) |entry| {
+            if (entry.kind == .directory and entry.name.len > 0 and entry.name[0] == '.') continue;
+            if (entry.kind != .directory and entry.kind != .file) continue;
+            const full_path = std.fs.path.join(allocator, &.{ path, entry.name }) catch return false;
+            defer allocator.free(full_path);
+            if (!buildSidecars(allocator, full_path, recursive, format, verbose)) ok = false;
+        }
+        return ok;
+    }
+    if (isSidecarPath(path)) return true;
+    if (stat.size < sidecar.BLOCK_SIZE) {
+        if (verbose) std.debug.print("Sidecar: {s}: smaller than one block, skipped\n", .{path});
+        return true;
+    }
+    const built = sidecar.build(allocator, path, format) catch |err| {
+        std.debug.print("grep: {s}{s}: {}\n", .{ path, sidecar.SUFFIX, err });
+        return false;
+    };
     if (verbose) {
-        std.debug.print("\nTotal matches: {d}\n\n", .{result.total_matches});
+        std.debug.print("Sidecar: {s}{s}: {d} blocks ({d} reused)\n", .{ path, sidecar.SUFFIX, built.blocks, built.reused });
+    }
+    return true;
+}
+
+/// Search only the --since/--until window of a time-ordered file. The file is
+/// mapped rather than read, so locating the window touches only the pages the
+/// binary search probes, and files of any size can be windowed. -n reads
+/// every line before the window too, unless a fresh sidecar index (with
+/// --sidecar) has the line count of the block the window starts in.
+fn processFileWindow(ctx: *const Context, worker: *Worker, file: std.fs.File, filepath: []const u8, stat: std.fs.File.Stat, label: ?[]const u8) ProcessResult {
+    var mapped = input.MappedFile.init(ctx.allocator, file, stat.size, .partial) catch |err| {
+        std.debug.print("grep: {s}: {}\n", .{ filepath, err });
+        return .{ .found = false, .had_error = true };
+    };
+    defer mapped.deinit();
+
+    var index: ?sidecar.Index = null;
+    defer if (index) |*idx| idx.deinit();
+    if (ctx.output_opts.line_numbers and ctx.input_opts.use_sidecar and ctx.options.record_sep == '\n') {
+        index = loadFreshIndex(ctx.allocator, filepath, stat);
     }
 
-    return .{ .found = found, .had_error = false };
+    var in = applyTimeWindow(ctx, filepath, mapped.data, if (index) |*idx| idx else null);
+    if (in.text.len > std.math.maxInt(u32)) {
+        std.debug.print("grep: {s}: time window too large ({d} bytes)\n", .{ filepath, in.text.len });
+        return .{ .found = false, .had_error = true };
+    }
+    in.label = label;
+    in.list_name = filepath;
+    if (mapped.mapping != null) {
+        in.source = .{ .fd = file.handle, .offset = @intFromPtr(in.text.ptr) - @intFromPtr(mapped.data.ptr) };
+    }
+
+    const backend = selectBackend(ctx, filepath, in.text.len);
+    return searchAndEmit(ctx, worker, in, backend);
+}
+
+/// The sidecar index of `filepath` if it describes the file as it is now
+fn loadFreshIndex(allocator: std.mem.Allocator, filepath: []const u8, stat: std.fs.File.Stat) ?sidecar.Index {
+    const index_path = std.mem.concat(allocator, u8, &.{ filepath, sidecar.SUFFIX }) catch return null;
+    defer allocator.free(index_path);
+    var index = sidecar.Index.load(allocator, index_path) catch return null;
+    if (!index.isFresh(stat.size, stat.mtime)) {
+        index.deinit();
+        return null;
+    }
+    return index;
 }
 
+/// --watch: search every file below `roots`, then follow inotify events and
+/// print how each file's selected lines change (watch.zig). Runs until
+/// killed or the event stream fails.
+fn runWatch(ctx: *const Context, roots: []const []const u8) u8 {
+    var run = WatchRun.init(ctx) catch |err| {
+        std.debug.print("grep: --watch: {}\n", .{err});
+        return 2;
+    };
+    defer run.deinit();
+
+    for (roots) |root| {
+        const stat = std.fs.cwd().statFile(root) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ root, err });
+            return 2;
+        };
+        if (stat.kind != .directory) {
+            std.debug.print("grep: {s}: --watch takes directories\n", .{root});
+            return 2;
+        }
+        run.addTree(root);
+    }
+    run.worker.out.finish();
+
+    while (true) {
+        var batch = run.tree.read() catch |err| {
+            std.debug.print("grep: --watch: {}\n", .{err});
+            return 2;
+        };
+        defer batch.deinit();
+        for (batch.events.items) |event| switch (event.change) {
+            .file => run.refresh(event.path),
+            .file_gone => run.forget(event.path),
+            .dir => run.addTree(event.path),
+            .dir_gone => {
+                run.tree.removeDir(event.path);
+                run.forgetMatching(event.path, false);
+            },
+            .overflow => run.rescan(roots),
+        };
+        run.worker.out.finish();
+    }
+}
+
+/// Watches and per-file results of a --watch run
+const WatchRun = struct {
+    ctx: *const Context,
+    tree: watch.Tree,
+    worker: Worker,
+    files: std.StringHashMapUnmanaged(watch.FileState) = .{}, // keys owned
+
+    fn init(ctx: *const Context) !WatchRun {
+        const tree = try watch.Tree.init(ctx.allocator);
+        return .{ .ctx = ctx, .tree = tree, .worker = Worker.init(ctx.allocator) };
+    }
+
+    fn deinit(self: *WatchRun) void {
+        const allocator = self.ctx.allocator;
+        var it = self.files.iterator();
+        while (it.next()) |entry| {
+            entry.value_ptr.deinit(allocator);
+            allocator.free(entry.key_ptr.*);
+        }
+        self.files.deinit(allocator);
+        self.tree.deinit();
+        self.worker.deinit();
+    }
+
+    /// Watch `path` and the directories below it, and search their files
+    fn addTree(self: *WatchRun, path: []const u8) void {
+        const allocator = self.ctx.allocator;
+        self.tree.addDir(path) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ path, err });
+            return;
+        };
+        var dir = std.fs.cwd().openDir(path, .{ .iterate = true }) catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ path, err });
+            return;
+        };
+        defer dir.close();
+
+        // By name, so the initial deltas come out in a stable order
+        var sorted: std.ArrayListUnmanaged(FileRun.DirEntry) = .{};
+        defer {
+            for (sorted.items) |e| allocator.free(e.name);
+            sorted.deinit(allocator);
+        }
+        var iter = dir.iterate();
+        while (iter.next() catch |err| {
+            std.debug.print("grep: {s}: {}\n", .{ path, err });
+            return;
+        }) |entry| {
+            const name = allocator.dupe(u8, entry.name) catch break;
+            sorted.append(allocator, .{ .name = name, .kind = entry.kind }) catch {
+                allocator.free(name);
+                break;
+            };
+        }
+        std.mem.sort(FileRun.DirEntry, sorted.items, {}, FileRun.DirEntry.lessThan);
+
+        for (sorted.items) |entry| {
+            // Hidden directories are skipped as by -r
+            if (entry.kind == .directory and entry.name.len > 0 and entry.name[0] == '.') continue;
+            if (entry.kind != .directory and entry.kind != .file) continue;
+            const full_path = std.fs.path.join(allocator, &.{ path, entry.name }) catch {
+                std.debug.print("grep: out of memory\n", .{});
+                return;
+            };
+            defer allocator.free(full_path);
+            if (entry.kind == .directory) self.addTree(full_path) else self.refresh(full_path);
+        }
+    }
+
+    /// Search `path` again, or only its new tail when it was appended to
+    fn refresh(self: *WatchRun, path: []const u8) void {
+        if (isSidecarPath(std.fs.path.basename(path))) return;
+        self.update(path) catch |err| switch (err) {
+            error.FileNotFound => self.forget(path),
+            else => std.debug.print("grep: {s}: {}\n", .{ path, err }),
+        };
+    }
+
+    fn update(self: *WatchRun, path: []const u8) !void {
+        const allocator = self.ctx.allocator;
+        const eol = self.ctx.options.record_sep;
+        const file = try std.fs.cwd().openFile(path, .{});
+        defer file.close();
+        const stat = try file.stat();
+        if (stat.kind != .file) return;
+
+        const entry = try self.files.getOrPut(allocator, path);
+        if (!entry.found_existing) {
+            entry.key_ptr.* = allocator.dupe(u8, path) catch |err| {
+                self.files.removeByPtr(entry.key_ptr);
+                return err;
+            };
+            entry.value_ptr.* = .{};
+        }
+        const state = entry.value_ptr;
+        state.seen = true;
+        if (state.unchanged(stat)) return;
+
+        // Appended to: the same file, grown past its searched end, with the
+        // bytes before that end as they were
+        const appended = stat.inode == state.inode and stat.size >= state.scanned and
+            (watch.tailHash(file, state.scanned) catch 0) == state.tail_hash;
+        const base: u64 = if (appended) state.scanned else 0;
+        const first_number: u64 = if (appended) state.lines_before + 1 else 1;
+
+        const len = std.math.cast(usize, stat.size - base) orelse return error.FileTooBig;
+        const buf = try allocator.alloc(u8, len);
+        defer allocator.free(buf);
+        const text = buf[0..try file.preadAll(buf, base)];
+
+        var result = try selectLines(self.ctx, &self.worker, text, selectBackend(self.ctx, path, text.len));
+        defer result.deinit();
+        const lines = try watch.collectLines(allocator, text, eol, result.matches, first_number);
+        defer allocator.free(lines);
+        state.replaceFrom(allocator, &self.worker.out, entry.key_ptr.*, first_number, lines) catch |err| {
+            for (lines) |line| allocator.free(line.text);
+            return err;
+        };
+
+        // A trailing partial line is searched again once it is completed
+        if (std.mem.lastIndexOfScalar(u8, text, eol)) |last| {
+            state.scanned = base + last + 1;
+            state.lines_before = first_number - 1 + input.countTerminators(text[0 .. last + 1], eol);
+        } else {
+            state.scanned = base;
+            state.lines_before = first_number - 1;
+        }
+        state.tail_hash = try watch.tailHash(file, state.scanned);
+        state.inode = stat.inode;
+        state.size = stat.size;
+        state.mtime = stat.mtime;
+    }
+
+    /// Drop `path`, reporting its results as removed
+    fn forget(self: *WatchRun, path: []const u8) void {
+        const allocator = self.ctx.allocator;
+        var kv = self.files.fetchRemove(path) orelse return;
+        kv.value.removeAll(&self.worker.out, kv.key);
+        kv.value.deinit(allocator);
+        allocator.free(kv.key);
+    }
+
+    /// Search every file under `roots` again after lost events: changed files
+    /// report their deltas, files no longer present are dropped
+    fn rescan(self: *WatchRun, roots: []const []const u8) void {
+        var it = self.files.valueIterator();
+        while (it.next()) |state| state.seen = false;
+        for (roots) |root| self.addTree(root);
+        self.forgetMatching("", true);
+    }
+
+    /// Forget the files below `dir` (every file for ""), or with
+    /// `unseen_only` those the current rescan did not find
+    fn forgetMatching(self: *WatchRun, dir: []const u8, unseen_only: bool) void {
+        const allocator = self.ctx.allocator;
+        var gone: std.ArrayListUnmanaged([]const u8) = .{};
+        defer gone.deinit(allocator);
+        var it = self.files.iterator();
+        while (it.next()) |entry| {
+            if (dir.len > 0 and !watch.isWithin(entry.key_ptr.*, dir)) continue;
+            if (unseen_only and entry.value_ptr.seen) continue;
+            gone.append(allocator, entry.key_ptr.*) catch break;
+        }
+        std.mem.sort([]const u8, gone.items, {}, lessThanPath);
+        for (gone.items) |path| self.forget(path);
+    }
+
+    fn lessThanPath(_: void, a: []const u8, b: []const u8) bool {
+        return std.mem.lessThan(u8, a, b);
+    }
+};
+
 fn printUsage() void {
     const help_text =
         \\Usage: grep [OPTION]... PATTERN [FILE]...
@@ -1466,7 +3626,13 @@ fn printUsage() void {
         \\  -F, --fixed-strings       PATTERN is a literal string (default) [GPU+SIMD]
         \\  -i, --ignore-case         case-insensitive matching             [GPU+SIMD]
         \\  -w, --word-regexp         match only whole words                [GPU+SIMD]
+        \\  -x, --line-regexp         match only whole lines                [GPU+SIMD]
         \\  -v, --invert-match        select non-matching lines             [GPU+SIMD]
+        \\  -z, --null-data           lines are terminated by NUL, not newline [SIMD]
+        \\  -U, --multiline           let matches span lines (\n in PATTERN)  [SIMD]
+        \\      --max-span=SIZE       longest -U match (default 64K)
+        \\      --record-start=REGEX  records start at lines matching REGEX (ERE);
+        \\                            continuation lines belong to the record [SIMD]
         \\
         \\Output control:
         \\  -A NUM, --after-context=NUM   print NUM lines after match       [GPU+SIMD]
@@ -1477,10 +3643,61 @@ fn printUsage() void {
         \\  -l, --files-with-matches  print filenames with matches          [GPU+SIMD]
         \\  -L, --files-without-match print filenames without matches       [GPU+SIMD]
         \\  -n, --line-number         print line numbers (GPU-computed)     [GPU+SIMD]
+        \\  -b, --byte-offset         print the byte offset of each line    [GPU+SIMD]
         \\  -o, --only-matching       print only matched parts              [GPU+SIMD]
         \\  -q, --quiet, --silent     suppress output (exit status only)    [GPU+SIMD]
         \\  -r, -R, --recursive       search directories recursively        [GPU+SIMD]
+        \\      --builtin-query=NAME  search with the literal set compiled in by
+        \\                            zig build -Dquery-file=NAME.txt           [SIMD]
+        \\      --files-from=FILE     search the paths listed in FILE (- = stdin),
+        \\                            one per line or NUL-separated
+        \\      --threads=NUM         worker threads for -r/--files-from, or for one large
+        \\                            file split by NUMA node (0 = auto); in auto mode
+        \\                            one more thread feeds GPU-sized files to the GPU
+        \\      --sort=MODE           output order of parallel runs: path (input order,
+        \\                            directories by name; default) or none (as each
+        \\                            file completes)
+        \\      --max-memory=SIZE     memory budget (K/M/G suffixes): limits workers and
+        \\                            GPU use; larger inputs are searched in chunks
+        \\      --save-candidates=ID  remember the selected lines of each FILE as ID
+        \\      --within=ID           search only the lines saved as ID (by default
+        \\                            in the files it names), so each refinement
+        \\                            reads only the previous result        [GPU+SIMD]
+        \\      --watch               follow DIRECTORY operands with inotify and print
+        \\                            added/removed lines as JSON, one per line;
+        \\                            changed files are searched again, appended
+        \\                            files only from their old end         [GPU+SIMD]
+        \\      --search-archives     search inside .tar, .tar.gz, .gz and .zip files;
+        \\                            matches print as ARCHIVE:MEMBER:LINE
         \\  -V, --verbose             print backend and timing info
+        \\      --stats               print throughput, huge-page coverage and NUMA
+        \\                            placement on exit
+        \\
+        \\Delimited data (CSV/TSV, delimited logs):
+        \\      --fields=LIST         search only these fields of each line, e.g.
+        \\                            '7', '1,3-5', '4-'; ^ and $ anchor to the field
+        \\      --field-sep=C         field separator (default TAB; '\t' accepted)
+        \\      --csv                 quote-aware CSV: separator ',' unless given,
+        \\                            separators inside "..." do not split a field
+        \\
+        \\Time windows (time-ordered logs):
+        \\      --since=TIME          skip lines stamped before TIME
+        \\      --until=TIME          skip lines stamped after TIME
+        \\                            TIME may be a prefix, e.g. '2024-05-01 14'
+        \\      --time-format=FMT     timestamp layout (default '%Y-%m-%d %H:%M:%S')
+        \\                            %Y %m %d %e %H %M %S %b %f; window is found by
+        \\                            binary search, only its bytes are searched
+        \\      --histogram=FIELD_REGEX:BUCKET
+        \\                            count selected lines per BUCKET (e.g. 30s, 5m,
+        \\                            1h, 1d) of the time stamped in FIELD_REGEX's
+        \\                            match (empty: the line) instead of printing them
+        \\      --histogram-format=FMT  table (default) or json
+        \\
+        \\Sidecar index (large, mostly-static files):
+        \\      --sidecar-build       write or extend FILE.grepidx for each FILE: per 1MB
+        \\                            block a trigram bloom filter, line and timestamps;
+        \\                            later searches scan only blocks that can match
+        \\      --no-sidecar          ignore FILE.grepidx indexes
         \\
         \\Backend selection:
         \\  --auto                    auto-select optimal backend (default)
@@ -1574,6 +3791,26 @@ test "backend selection - cpu bias" {
     try std.testing.expectEqual(gpu.Backend.cpu, backend);
 }
 
+test "stream cuts wait for whole lines and the -U window" {
+    const text = "alpha\nbeta\ngamma\ndelta\n";
+    try std.testing.expect(streamCut(text[0..5], false, 8, null, '\n') == null);
+    try std.testing.expect(streamCut(text[0..8], false, 8, null, '\n') == null);
+    try std.testing.expectEqual(StreamCut{ .end = 6, .window_end = 6 }, streamCut(text[0..11], false, 8, null, '\n').?);
+    try std.testing.expect(streamCut(text[0..8], false, 8, 4, '\n') == null);
+    try std.testing.expectEqual(StreamCut{ .end = 6, .window_end = 11 }, streamCut(text[0..11], false, 8, 4, '\n').?);
+    try std.testing.expectEqual(StreamCut{ .end = 5, .window_end = 5 }, streamCut("gamma", true, 8, null, '\n').?);
+
+    // A member past the chunk size is cut into whole lines that cover it
+    var rest: []const u8 = text;
+    var pieces: usize = 0;
+    while (rest.len > 0) : (pieces += 1) {
+        const cut = streamCut(rest, true, 8, null, '\n').?;
+        try std.testing.expectEqual(@as(u8, '\n'), rest[cut.end - 1]);
+        rest = rest[cut.end..];
+    }
+    try std.testing.expectEqual(@as(usize, 4), pieces);
+}
+
 test "parse size" {
     try std.testing.expectEqual(@as(usize, 1024), try parseSize("1K"));
     try std.testing.expectEqual(@as(usize, 1024), try parseSize("1k"));
@@ -1582,3 +3819,21 @@ test "parse size" {
     try std.testing.expectEqual(@as(usize, 500), try parseSize("500"));
     try std.testing.expectEqual(@as(usize, 128 * 1024), try parseSize("128K"));
 }
+
+test {
+    _ = input;
+    _ = timerange;
+    _ = sidecar;
+    _ = output;
+    _ = scheduler;
+    _ = records;
+    _ = fields;
+    _ = archive;
+    _ = budget;
+    _ = stats;
+    _ = numa;
+    _ = watch;
+    _ = candidates;
+    _ = histogram;
+    _ = builtin_query;
+}
@@ -0,0 +1,490 @@
+const std = @import("std");
+const gpu = @import("gpu");
+const regex = @import("regex");
+const cpu = @import("cpu_optimized.zig");
+
+const SearchOptions = gpu.SearchOptions;
+const SearchResult = gpu.SearchResult;
+const MatchResult = gpu.MatchResult;
+const RegexStateType = gpu.RegexStateType;
+
+// ============================================================================
+// Union automaton for several patterns (-e P1 -e P2 ...)
+//
+// Every pattern is compiled by the regex engine and its Thompson NFA copied
+// into one state array, with each pattern's accept state tagged by its index.
+// A single pass per line then reports which patterns match it, instead of one
+// full scan per pattern followed by a merge. When every pattern has a required
+// literal, only lines containing at least one of them are run through the NFA.
+// ============================================================================
+
+/// Line tags are kept in a u64
+pub const MAX_PATTERNS: usize = 64;
+
+const NONE = std.math.maxInt(u32);
+
+const Kind = enum(u8) {
+    literal,
+    class,
+    dot, // any byte except newline
+    any,
+    epsilon, // split (out, out2) or group marker (out)
+    match,
+    line_start,
+    line_end,
+    word_boundary,
+    not_word_boundary,
+    not_word_before, // -w's (?<!\w)
+    not_word_after, // -w's (?!\w)
+};
+
+const Node = struct {
+    kind: Kind,
+    out: u32 = NONE,
+    out2: u32 = NONE,
+    byte: u8 = 0,
+    fold: bool = false, // literal compares case-insensitively
+    negated: bool = false,
+    class: u32 = 0, // index into MultiRegex.classes
+    tag: u8 = 0, // pattern index of a match node
+};
+
+/// Byte range of one line or one match inside the searched text
+const Span = struct {
+    start: usize,
+    end: usize,
+};
+
+pub const MultiRegex = struct {
+    allocator: std.mem.Allocator,
+    nodes: []Node,
+    classes: [][32]u8,
+    starts: []u32, // start node of each pattern
+    anchored_start: u64, // patterns that only match at line start
+    anchored_end: u64, // patterns that only match at line end
+    compiled: []regex.Regex, // per-pattern engines, for match spans
+    literals: ?[]const []const u8, // shared prefilter: lines must contain one
+    options: SearchOptions,
+    spans: bool, // report match spans (-o, --color) rather than whole lines
+
+    /// Build the union of `patterns`. `literals`, when given, holds one
+    /// required literal per pattern. Returns error.UnsupportedPattern for
+    /// constructs the union cannot run (lookaround), and the regex engine's
+    /// errors for patterns it rejects; callers fall back to per-pattern search.
+    pub fn init(
+        allocator: std.mem.Allocator,
+        patterns: []const []const u8,
+        options: SearchOptions,
+        literals: ?[]const []const u8,
+        spans: bool,
+    ) !MultiRegex {
+        if (patterns.len == 0 or patterns.len > MAX_PATTERNS) return error.UnsupportedPattern;
+
+        var compiled: std.ArrayListUnmanaged(regex.Regex) = .{};
+        errdefer {
+            for (compiled.items) |*c| c.deinit();
+            compiled.deinit(allocator);
+        }
+        var nodes: std.ArrayListUnmanaged(Node) = .{};
+        defer nodes.deinit(allocator);
+        var classes: std.ArrayListUnmanaged([32]u8) = .{};
+        defer classes.deinit(allocator);
+        const starts = try allocator.alloc(u32, patterns.len);
+        errdefer allocator.free(starts);
+
+        var anchored_start: u64 = 0;
+        var anchored_end: u64 = 0;
+        for (patterns, 0..) |pattern, p| {
+            const source = try unionSource(allocator, pattern, options);
+            defer allocator.free(source);
+            var re = try regex.Regex.compile(allocator, source, .{
+                .case_insensitive = options.case_insensitive,
+                .extended = true,
+                .multiline = true,
+            });
+            compiled.append(allocator, re) catch |err| {
+                re.deinit();
+                return err;
+            };
+
+            const base: u32 = @intCast(nodes.items.len);
+            starts[p] = base + @as(u32, @intCast(re.start_state));
+            const bit = @as(u64, 1) << @intCast(p);
+            if (re.anchored_start) anchored_start |= bit;
+            if (re.anchored_end) anchored_end |= bit;
+
+            for (re.states, 0..) |state, idx| {
+                const kind_tag = std.meta.intToEnum(RegexStateType, @intFromEnum(state.type)) catch return error.UnsupportedPattern;
+                var node = Node{
+                    .kind = undefined,
+                    .out = if (state.out == regex.State.NONE) NONE else base + @as(u32, @intCast(state.out)),
+                    .out2 = if (state.out2 == regex.State.NONE) NONE else base + @as(u32, @intCast(state.out2)),
+                };
+                switch (kind_tag) {
+                    .literal => {
+                        node.kind = .literal;
+                        node.byte = state.data.literal.char;
+                        node.fold = state.data.literal.case_insensitive;
+                    },
+                    .char_class => {
+                        node.kind = .class;
+                        node.negated = state.data.char_class.negated;
+                        node.class = @intCast(classes.items.len);
+                        try classes.append(allocator, state.data.char_class.bitmap.bitmap);
+                    },
+                    .dot => node.kind = .dot,
+                    .any => node.kind = .any,
+                    .split, .group_start, .group_end => node.kind = .epsilon,
+                    .match => {
+                        node.kind = .match;
+                        node.tag = @intCast(p);
+                    },
+                    .line_start => node.kind = .line_start,
+                    .line_end => node.kind = .line_end,
+                    .word_boundary => node.kind = .word_boundary,
+                    .not_word_boundary => node.kind = .not_word_boundary,
+                    // Only the -w edges; other lookaround needs the regex engine
+                    .lookbehind_neg, .lookahead_neg => node.kind = switch (gpu.regex_compiler.wordAssertion(re.states, idx) orelse
+                        return error.UnsupportedPattern) {
+                        .not_word_before => .not_word_before,
+                        else => .not_word_after,
+                    },
+                    else => return error.UnsupportedPattern,
+                }
+                if (node.kind != .epsilon) node.out2 = NONE;
+                try nodes.append(allocator, node);
+            }
+        }
+
+        // An empty literal admits every line, so it cannot prefilter
+        var prefilter = literals;
+        if (literals) |lits| {
+            for (lits) |lit| {
+                if (lit.len == 0) prefilter = null;
+            }
+        }
+
+        const owned_nodes = try nodes.toOwnedSlice(allocator);
+        errdefer allocator.free(owned_nodes);
+        return .{
+            .allocator = allocator,
+            .nodes = owned_nodes,
+            .classes = try classes.toOwnedSlice(allocator),
+            .starts = starts,
+            .anchored_start = anchored_start,
+            .anchored_end = anchored_end,
+            .compiled = try compiled.toOwnedSlice(allocator),
+            .literals = prefilter,
+            .options = options,
+            .spans = spans,
+        };
+    }
+
+    pub fn deinit(self: *MultiRegex) void {
+        for (self.compiled) |*c| c.deinit();
+        self.allocator.free(self.compiled);
+        self.allocator.free(self.nodes);
+        self.allocator.free(self.classes);
+        self.allocator.free(self.starts);
+    }
+
+    /// One pass over `text`: every line that matches any pattern (or none,
+    /// with -v) is reported once, tagged with the first pattern that matched
+    pub fn search(self: *MultiRegex, text: []const u8, allocator: std.mem.Allocator) !SearchResult {
+        var matches: std.ArrayListUnmanaged(MatchResult) = .{};
+        defer matches.deinit(allocator);
+
+        var sim = try Simulation.init(allocator, self.nodes.len);
+        defer sim.deinit(allocator);
+
+        const candidates = if (self.literals != null and !self.options.invert_match)
+            try self.candidateLines(text, allocator)
+        else
+            null;
+        defer if (candidates) |c| allocator.free(c);
+
+        var total_matches: u64 = 0;
+        if (candidates) |spans| {
+            for (spans) |span| {
+                var line_start = span.start;
+                while (line_start < span.end) {
+                    const line_end = std.mem.indexOfScalarPos(u8, text, line_start, self.options.record_sep) orelse text.len;
+                    total_matches += try self.searchLine(text, .{ .start = line_start, .end = line_end }, &sim, &matches, allocator);
+                    line_start = line_end + 1;
+                }
+            }
+        } else {
+            var line_start: usize = 0;
+            while (line_start < text.len) {
+                const line_end = std.mem.indexOfScalarPos(u8, text, line_start, self.options.record_sep) orelse text.len;
+                total_matches += try self.searchLine(text, .{ .start = line_start, .end = line_end }, &sim, &matches, allocator);
+                line_start = line_end + 1;
+            }
+        }
+
+        const result = try matches.toOwnedSlice(allocator);
+        return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
+    }
+
+    fn searchLine(
+        self: *MultiRegex,
+        text: []const u8,
+        line: Span,
+        sim: *Simulation,
+        matches: *std.ArrayListUnmanaged(MatchResult),
+        allocator: std.mem.Allocator,
+    ) !u64 {
+        const bytes = text[line.start..line.end];
+        const tags = sim.run(self, bytes);
+
+        if (self.options.invert_match) {
+            if (tags != 0) return 0;
+            try matches.append(allocator, .{
+                .position = @intCast(line.start),
+                .pattern_idx = 0,
+                .match_len = @intCast(bytes.len),
+                .line_start = @intCast(line.start),
+            });
+            return 1;
+        }
+        if (tags == 0) return 0;
+
+        if (!self.spans) {
+            try matches.append(allocator, .{
+                .position = @intCast(line.start),
+                .pattern_idx = @ctz(tags),
+                .match_len = @intCast(bytes.len),
+                .line_start = @intCast(line.start),
+            });
+            return 1;
+        }
+
+        // Matched text from each pattern that hit this line, leftmost first,
+        // longest on ties, without overlaps
+        var spans: std.ArrayListUnmanaged(MatchResult) = .{};
+        defer spans.deinit(allocator);
+        var remaining = tags;
+        while (remaining != 0) : (remaining &= remaining - 1) {
+            const p = @ctz(remaining);
+            const found = try self.compiled[p].findAll(bytes, allocator);
+            defer {
+                for (found) |*m| m.deinit();
+                allocator.free(found);
+            }
+            for (found) |m| {
+                try spans.append(allocator, .{
+                    .position = @intCast(line.start + m.start),
+                    .pattern_idx = p,
+                    .match_len = @intCast(m.end - m.start),
+                    .line_start = @intCast(line.start),
+                });
+            }
+        }
+        std.mem.sort(MatchResult, spans.items, {}, struct {
+            fn lessThan(_: void, a: MatchResult, b: MatchResult) bool {
+                if (a.position != b.position) return a.position < b.position;
+                return a.match_len > b.match_len;
+            }
+        }.lessThan);
+
+        var added: u64 = 0;
+        var covered: usize = line.start;
+        for (spans.items) |span| {
+            if (added > 0 and span.position < covered) continue;
+            try matches.append(allocator, span);
+            covered = span.position + span.match_len;
+            added += 1;
+        }
+        return added;
+    }
+
+    /// Lines containing at least one required literal, sorted and merged
+    fn candidateLines(self: *MultiRegex, text: []const u8, allocator: std.mem.Allocator) ![]Span {
+        var spans: std.ArrayListUnmanaged(Span) = .{};
+        errdefer spans.deinit(allocator);
+
+        for (self.literals.?) |lit| {
+            var pos: usize = 0;
+            while (pos < text.len) {
+                const hit = if (self.options.case_insensitive)
+                    std.ascii.indexOfIgnoreCasePos(text, pos, lit)
+                else
+                    std.mem.indexOfPos(u8, text, pos, lit);
+                const at = hit orelse break;
+                const start = if (std.mem.lastIndexOfScalar(u8, text[0..at], self.options.record_sep)) |nl| nl + 1 else 0;
+                const end = std.mem.indexOfScalarPos(u8, text, at, self.options.record_sep) orelse text.len;
+                try spans.append(allocator, .{ .start = start, .end = end });
+                pos = end + 1;
+            }
+        }
+
+        std.mem.sort(Span, spans.items, {}, struct {
+            fn lessThan(_: void, a: Span, b: Span) bool {
+                return a.start < b.start;
+            }
+        }.lessThan);
+
+        // Merge duplicates (one line hit by several literals)
+        var merged: usize = 0;
+        for (spans.items) |span| {
+            if (merged > 0 and span.start <= spans.items[merged - 1].end) {
+                spans.items[merged - 1].end = @max(spans.items[merged - 1].end, span.end);
+            } else {
+                spans.items[merged] = span;
+                merged += 1;
+            }
+        }
+        spans.shrinkRetainingCapacity(merged);
+        return spans.toOwnedSlice(allocator);
+    }
+};
+
+/// Thompson simulation of the union over one line. Zero-width assertions are
+/// resolved while computing epsilon closures, where both neighbours of the
+/// current position are known.
+const Simulation = struct {
+    current: []u32,
+    next: []u32,
+    stack: []u32,
+    marks: []u32, // generation in which a node was last added
+    generation: u32 = 0,
+
+    fn init(allocator: std.mem.Allocator, num_nodes: usize) !Simulation {
+        const buf = try allocator.alloc(u32, num_nodes * 4);
+        @memset(buf[num_nodes * 3 ..], 0);
+        return .{
+            .current = buf[0..num_nodes],
+            .next = buf[num_nodes .. num_nodes * 2],
+            .stack = buf[num_nodes * 2 .. num_nodes * 3],
+            .marks = buf[num_nodes * 3 ..],
+        };
+    }
+
+    fn deinit(self: *Simulation, allocator: std.mem.Allocator) void {
+        allocator.free(self.current.ptr[0 .. self.current.len * 4]);
+    }
+
+    /// Bitmask of the patterns that match somewhere in `line`
+    fn run(self: *Simulation, m: *const MultiRegex, line: []const u8) u64 {
+        const all: u64 = if (m.starts.len == 64) std.math.maxInt(u64) else (@as(u64, 1) << @intCast(m.starts.len)) - 1;
+        var tags: u64 = 0;
+        var current_len: usize = 0;
+        var pos: usize = 0;
+        while (true) : (pos += 1) {
+            // Threads carried over from the previous byte, then new starts
+            self.generation +%= 1;
+            if (self.generation == 0) {
+                @memset(self.marks, 0);
+                self.generation = 1;
+            }
+            var next_len: usize = 0;
+            for (self.current[0..current_len]) |idx| {
+                next_len = self.closure(m, idx, line, pos, self.next, next_len);
+            }
+            for (m.starts, 0..) |start, p| {
+                const bit = @as(u64, 1) << @intCast(p);
+                if (tags & bit != 0) continue;
+                if (m.anchored_start & bit != 0 and pos > 0) continue;
+                next_len = self.closure(m, start, line, pos, self.next, next_len);
+            }
+
+            // Accepting threads
+            for (self.next[0..next_len]) |idx| {
+                const node = m.nodes[idx];
+                if (node.kind != .match) continue;
+                const bit = @as(u64, 1) << @intCast(node.tag);
+                if (m.anchored_end & bit != 0 and pos != line.len) continue;
+                tags |= bit;
+            }
+            if (tags == all or pos == line.len) return tags;
+
+            // Consume line[pos]
+            const c = line[pos];
+            current_len = 0;
+            for (self.next[0..next_len]) |idx| {
+                const node = m.nodes[idx];
+                const ok = switch (node.kind) {
+                    .literal => if (node.fold) std.ascii.toLower(c) == std.ascii.toLower(node.byte) else c == node.byte,
+                    .class => (m.classes[node.class][c >> 3] & (@as(u8, 1) << @intCast(c & 7)) != 0) != node.negated,
+                    .dot => c != m.options.record_sep,
+                    .any => true,
+                    else => false,
+                };
+                if (ok and node.out != NONE) {
+                    self.current[current_len] = node.out;
+                    current_len += 1;
+                }
+            }
+        }
+    }
+
+    /// Add `start` and everything reachable from it without consuming input
+    /// to `set`; returns the new set length
+    fn closure(self: *Simulation, m: *const MultiRegex, start: u32, line: []const u8, pos: usize, set: []u32, len_in: usize) usize {
+        var len = len_in;
+        var top: usize = 0;
+        if (start == NONE or self.marks[start] == self.generation) return len;
+        self.marks[start] = self.generation;
+        self.stack[top] = start;
+        top += 1;
+
+        const prev_word = pos > 0 and isWordChar(line[pos - 1]);
+        const next_word = pos < line.len and isWordChar(line[pos]);
+
+        while (top > 0) {
+            top -= 1;
+            const idx = self.stack[top];
+            const node = m.nodes[idx];
+            const follow: [2]u32 = switch (node.kind) {
+                .epsilon => .{ node.out, node.out2 },
+                .line_start => .{ if (pos == 0) node.out else NONE, NONE },
+                .line_end => .{ if (pos == line.len) node.out else NONE, NONE },
+                .word_boundary => .{ if (prev_word != next_word) node.out else NONE, NONE },
+                .not_word_boundary => .{ if (prev_word == next_word) node.out else NONE, NONE },
+                .not_word_before => .{ if (!prev_word) node.out else NONE, NONE },
+                .not_word_after => .{ if (!next_word) node.out else NONE, NONE },
+                else => {
+                    // Consuming and match nodes are the members of the set
+                    set[len] = idx;
+                    len += 1;
+                    continue;
+                },
+            };
+            for (follow) |out| {
+                if (out == NONE or self.marks[out] == self.generation) continue;
+                self.marks[out] = self.generation;
+                self.stack[top] = out;
+                top += 1;
+            }
+        }
+        return len;
+    }
+};
+
+inline fn isWordChar(c: u8) bool {
+    return std.ascii.isAlphanumeric(c) or c == '_';
+}
+
+/// ERE source for one member of the union: BRE is converted, fixed strings
+/// are escaped, and -w and -x are compiled in as word boundaries and anchors
+fn unionSource(allocator: std.mem.Allocator, pattern: []const u8, options: SearchOptions) ![]u8 {
+    if (options.word_boundary or options.line_regexp) return cpu.boundSource(allocator, pattern, options);
+
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    errdefer out.deinit(allocator);
+
+    if (options.fixed_string) {
+        for (pattern) |c| {
+            if (std.mem.indexOfScalar(u8, "\\.[]()*+?{}|^$", c) != null) try out.append(allocator, '\\');
+            try out.append(allocator, c);
+        }
+    } else if (!options.extended) {
+        const ere = try cpu.convertBREtoERE(pattern, allocator);
+        defer allocator.free(ere);
+        try out.appendSlice(allocator, ere);
+    } else {
+        try out.appendSlice(allocator, pattern);
+    }
+
+    return out.toOwnedSlice(allocator);
+}
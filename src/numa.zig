@@ -0,0 +1,129 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const linux = std.os.linux;
+
+// ============================================================================
+// NUMA placement for parallel segment search
+//
+// A large file searched by several threads is split into one contiguous
+// range per thread, and the ranges are dealt out to memory nodes in order,
+// so each node scans one stretch of the file. Threads are pinned to the CPUs
+// of their node before touching their range: page-cache and heap pages are
+// allocated on the node that first touches them, so both the file pages a
+// thread faults in and the result arrays it builds stay local. Machines
+// without NUMA (or non-Linux systems) see a single node and no pinning.
+// ============================================================================
+
+/// Upper bound on nodes and CPUs tracked
+pub const MAX_NODES = 16;
+const MAX_CPUS = 1024;
+
+const CpuSet = std.bit_set.StaticBitSet(MAX_CPUS);
+
+pub const Topology = struct {
+    cpus: [MAX_NODES]CpuSet = undefined,
+    num_nodes: usize = 1,
+
+    /// Read the node layout from sysfs; one node when it is unavailable
+    pub fn detect() Topology {
+        var topo = Topology{};
+        topo.cpus[0] = CpuSet.initEmpty();
+        if (builtin.os.tag != .linux) return topo;
+
+        var found: usize = 0;
+        for (0..MAX_NODES) |node| {
+            var path_buf: [64]u8 = undefined;
+            const path = std.fmt.bufPrint(&path_buf, "/sys/devices/system/node/node{d}/cpulist", .{node}) catch break;
+            var list_buf: [1024]u8 = undefined;
+            const list = readSmallFile(path, &list_buf) orelse break;
+            topo.cpus[node] = parseCpuList(std.mem.trim(u8, list, " \n")) orelse break;
+            found += 1;
+        }
+        topo.num_nodes = @max(found, 1);
+        return topo;
+    }
+
+    pub fn isNuma(self: *const Topology) bool {
+        return self.num_nodes > 1;
+    }
+
+    /// Node serving segment `idx` of `count`: contiguous runs per node
+    pub fn nodeFor(self: *const Topology, idx: usize, count: usize) usize {
+        return idx * self.num_nodes / @max(count, 1);
+    }
+
+    /// Restrict the calling thread to the CPUs of `node`
+    pub fn pin(self: *const Topology, node: usize) void {
+        if (builtin.os.tag != .linux or !self.isNuma()) return;
+        const mask = self.cpus[node].masks;
+        _ = linux.syscall3(.sched_setaffinity, 0, @sizeOf(@TypeOf(mask)), @intFromPtr(&mask));
+    }
+};
+
+fn readSmallFile(path: []const u8, buf: []u8) ?[]const u8 {
+    const file = std.fs.openFileAbsolute(path, .{}) catch return null;
+    defer file.close();
+    const n = file.read(buf) catch return null;
+    return buf[0..n];
+}
+
+/// Parse a sysfs CPU list such as "0-15,32-47"
+fn parseCpuList(list: []const u8) ?CpuSet {
+    var set = CpuSet.initEmpty();
+    if (list.len == 0) return set; // memory-only node
+    var items = std.mem.splitScalar(u8, list, ',');
+    while (items.next()) |item| {
+        var bounds = std.mem.splitScalar(u8, item, '-');
+        const lo = std.fmt.parseInt(usize, bounds.first(), 10) catch return null;
+        const hi = if (bounds.next()) |h| std.fmt.parseInt(usize, h, 10) catch return null else lo;
+        if (hi >= MAX_CPUS or lo > hi) return null;
+        set.setRangeValue(.{ .start = lo, .end = hi + 1 }, true);
+    }
+    return set;
+}
+
+/// Pages of `bytes` sampled for placement, one per this many
+const SAMPLE_STRIDE_PAGES = 64;
+const SAMPLE_MAX = 256;
+
+/// Of the sampled resident pages of `bytes`, how many live on a node other
+/// than `node` (move_pages with no targets only reports placement)
+pub fn remotePages(bytes: []const u8, node: usize) struct { sampled: u64, remote: u64 } {
+    if (builtin.os.tag != .linux or bytes.len == 0) return .{ .sampled = 0, .remote = 0 };
+    const page = std.heap.pageSize();
+    const first = std.mem.alignBackward(usize, @intFromPtr(bytes.ptr), page);
+    const last = @intFromPtr(bytes.ptr) + bytes.len;
+
+    var pages: [SAMPLE_MAX]usize = undefined;
+    var count: usize = 0;
+    var addr = first;
+    while (addr < last and count < SAMPLE_MAX) : (addr += page * SAMPLE_STRIDE_PAGES) {
+        pages[count] = addr;
+        count += 1;
+    }
+    var status: [SAMPLE_MAX]i32 = undefined;
+    const rc = linux.syscall6(.move_pages, 0, count, @intFromPtr(&pages), 0, @intFromPtr(&status), 0);
+    if (std.posix.errno(rc) != .SUCCESS) return .{ .sampled = 0, .remote = 0 };
+
+    var sampled: u64 = 0;
+    var remote: u64 = 0;
+    for (status[0..count]) |s| {
+        if (s < 0) continue; // not resident
+        sampled += 1;
+        if (@as(usize, @intCast(s)) != node) remote += 1;
+    }
+    return .{ .sampled = sampled, .remote = remote };
+}
+
+test "numa: cpu lists and node assignment" {
+    const set = parseCpuList("0-3,8,10-11").?;
+    try std.testing.expectEqual(@as(usize, 7), set.count());
+    try std.testing.expect(set.isSet(8) and !set.isSet(9));
+    try std.testing.expect(parseCpuList("3-1") == null);
+
+    const topo = Topology{ .num_nodes = 2 };
+    try std.testing.expectEqual(@as(usize, 0), topo.nodeFor(0, 8));
+    try std.testing.expectEqual(@as(usize, 0), topo.nodeFor(3, 8));
+    try std.testing.expectEqual(@as(usize, 1), topo.nodeFor(4, 8));
+    try std.testing.expectEqual(@as(usize, 1), topo.nodeFor(7, 8));
+}
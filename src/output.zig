@@ -0,0 +1,316 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+// ============================================================================
+// Buffered result output shared by the sequential and parallel search paths
+// ============================================================================
+
+/// Buffered output above this size is written through instead of staged
+pub const SPILL_SIZE: usize = 256 * 1024;
+
+/// Runs at least this long are copied file-to-stdout by the kernel
+pub const ZERO_COPY_MIN: usize = 16 * 1024;
+
+/// Serializes writers to the same descriptor across worker threads
+var fd_mutex: std.Thread.Mutex = .{};
+
+/// Output sink for one worker. Everything printed for an input is staged and
+/// published by finish() in one piece, so results from files searched in
+/// parallel never interleave. An input whose output outgrows SPILL_SIZE takes
+/// the descriptor lock early and streams the rest of its output, keeping
+/// memory bounded; other workers wait in finish() until it is done.
+///
+/// Between begin() and finish() an input's output belongs to a sequence
+/// number of an Order, and is published in sequence rather than on finish.
+pub const Sink = struct {
+    allocator: std.mem.Allocator,
+    fd: std.posix.fd_t = std.posix.STDOUT_FILENO,
+    buffer: std.ArrayListUnmanaged(u8) = .{},
+    owns_fd: bool = false,
+    target: ?Target = null, // what `fd` is, probed on first zero-copy write
+    order: ?*Order = null, // set from begin() to finish()
+    seq: u64 = 0,
+
+    /// How bytes can reach `fd` without passing through userspace
+    const Target = enum {
+        none, // terminal, socket, non-Linux: plain write()
+        pipe, // splice() from the source file
+        file, // copy_file_range() from the source file
+    };
+
+    pub fn init(allocator: std.mem.Allocator) Sink {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Sink) void {
+        self.finish();
+        self.buffer.deinit(self.allocator);
+    }
+
+    /// Start the output of input `seq` of `order`. Blocks while `seq` is
+    /// further ahead of the output than the order's window allows.
+    pub fn begin(self: *Sink, order: *Order, seq: u64) void {
+        order.admit(seq);
+        self.order = order;
+        self.seq = seq;
+    }
+
+    pub fn write(self: *Sink, bytes: []const u8) void {
+        if (self.buffer.items.len + bytes.len > SPILL_SIZE) {
+            self.acquire();
+            writeAll(self.fd, self.buffer.items);
+            self.buffer.clearRetainingCapacity();
+            if (bytes.len > SPILL_SIZE) {
+                writeAll(self.fd, bytes);
+                return;
+            }
+        }
+        self.buffer.appendSlice(self.allocator, bytes) catch writeAll(self.fd, bytes);
+    }
+
+    /// Write `bytes`, which are also stored in `source` at source.offset.
+    /// Long runs go straight from the source file to `fd` (splice into a
+    /// pipe, copy_file_range into a regular file) so they are never copied
+    /// through userspace; anything else is buffered as usual.
+    pub fn writeFrom(self: *Sink, bytes: []const u8, source: ?FileRegion) void {
+        const src = source orelse return self.write(bytes);
+        if (bytes.len < ZERO_COPY_MIN or self.probe() == .none) return self.write(bytes);
+
+        // Staged output must reach the descriptor first
+        self.acquire();
+        writeAll(self.fd, self.buffer.items);
+        self.buffer.clearRetainingCapacity();
+
+        const copied = self.kernelCopy(src, bytes.len);
+        writeAll(self.fd, bytes[copied..]);
+    }
+
+    /// Take the descriptor to stream; in an order, once every earlier input
+    /// has been published
+    fn acquire(self: *Sink) void {
+        if (self.owns_fd) return;
+        if (self.order) |order| order.awaitTurn(self.seq);
+        fd_mutex.lock();
+        self.owns_fd = true;
+    }
+
+    fn probe(self: *Sink) Target {
+        if (self.target) |t| return t;
+        var target: Target = .none;
+        if (builtin.os.tag == .linux) {
+            if (std.posix.fstat(self.fd)) |st| {
+                if (std.posix.S.ISFIFO(st.mode)) target = .pipe;
+                if (std.posix.S.ISREG(st.mode)) target = .file;
+            } else |_| {}
+        }
+        self.target = target;
+        return target;
+    }
+
+    /// Copy up to `len` bytes of `src` to `fd` in the kernel; returns how many
+    /// were copied. On an unsupported pairing (EXDEV, EINVAL, an O_APPEND
+    /// output, ...) zero-copy is switched off for this sink.
+    fn kernelCopy(self: *Sink, src: FileRegion, len: usize) usize {
+        if (builtin.os.tag != .linux) return 0;
+        const linux = std.os.linux;
+        var offset: i64 = @intCast(src.offset);
+        var done: usize = 0;
+        while (done < len) {
+            const rc = switch (self.target.?) {
+                .pipe => linux.splice(src.fd, &offset, self.fd, null, len - done, 0),
+                .file => linux.copy_file_range(src.fd, &offset, self.fd, null, len - done, 0),
+                .none => unreachable,
+            };
+            switch (std.posix.errno(rc)) {
+                .SUCCESS => {
+                    if (rc == 0) break; // source shorter than expected (truncated)
+                    done += rc;
+                },
+                .INTR => continue,
+                else => {
+                    self.target = .none;
+                    break;
+                },
+            }
+        }
+        return done;
+    }
+
+    /// Publish the current input's output and release the descriptor. In
+    /// an order, output not yet streamed is handed over as the input's block.
+    pub fn finish(self: *Sink) void {
+        if (self.order) |order| {
+            if (self.owns_fd) {
+                writeAll(self.fd, self.buffer.items);
+                self.buffer.clearRetainingCapacity();
+                fd_mutex.unlock();
+                self.owns_fd = false;
+            }
+            self.order = null;
+            order.complete(self.seq, self.fd, &self.buffer);
+            return;
+        }
+        if (self.buffer.items.len > 0) {
+            if (!self.owns_fd) fd_mutex.lock();
+            writeAll(self.fd, self.buffer.items);
+            self.buffer.clearRetainingCapacity();
+            fd_mutex.unlock();
+        } else if (self.owns_fd) {
+            fd_mutex.unlock();
+        }
+        self.owns_fd = false;
+    }
+};
+
+/// How the output of inputs searched in parallel is ordered (--sort)
+pub const SortMode = enum {
+    path, // input order, directories walked by name
+    none, // each input as soon as it completes
+};
+
+/// Reorder window for output published in input order. Every input takes
+/// the next sequence number; its output is kept as a block in the window
+/// until all earlier inputs are published. Workers may not start an input
+/// more than `window` ahead of the output, so at most `window` blocks (each
+/// under SPILL_SIZE) are held, and a slow input throttles the others rather
+/// than letting buffered output grow.
+pub const Order = struct {
+    allocator: std.mem.Allocator,
+    slots: []Slot,
+    next: u64 = 0, // first sequence number not yet published
+    mutex: std.Thread.Mutex = .{},
+    advanced: std.Thread.Condition = .{},
+
+    const Slot = struct {
+        done: bool = false,
+        block: std.ArrayListUnmanaged(u8) = .{},
+    };
+
+    pub fn init(allocator: std.mem.Allocator, window: usize) !Order {
+        const slots = try allocator.alloc(Slot, @max(window, 1));
+        @memset(slots, .{});
+        return .{ .allocator = allocator, .slots = slots };
+    }
+
+    pub fn deinit(self: *Order) void {
+        for (self.slots) |*slot| slot.block.deinit(self.allocator);
+        self.allocator.free(self.slots);
+    }
+
+    fn admit(self: *Order, seq: u64) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        while (seq >= self.next + self.slots.len) self.advanced.wait(&self.mutex);
+    }
+
+    fn awaitTurn(self: *Order, seq: u64) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        while (self.next != seq) self.advanced.wait(&self.mutex);
+    }
+
+    /// Take the output of `seq` (swapping in the slot's emptied buffer, so
+    /// buffers are recycled) and publish every block now in sequence
+    fn complete(self: *Order, seq: u64, fd: std.posix.fd_t, buffer: *std.ArrayListUnmanaged(u8)) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        const slot = &self.slots[seq % self.slots.len];
+        std.mem.swap(std.ArrayListUnmanaged(u8), &slot.block, buffer);
+        slot.done = true;
+
+        while (true) {
+            const head = &self.slots[self.next % self.slots.len];
+            if (!head.done) break;
+            if (head.block.items.len > 0) {
+                fd_mutex.lock();
+                writeAll(fd, head.block.items);
+                fd_mutex.unlock();
+                head.block.clearRetainingCapacity();
+            }
+            head.done = false;
+            self.next += 1;
+        }
+        self.advanced.broadcast();
+    }
+};
+
+/// Where a run of output bytes can also be read from
+pub const FileRegion = struct {
+    fd: std.posix.fd_t,
+    offset: u64, // file offset of the first byte
+};
+
+fn writeAll(fd: std.posix.fd_t, bytes: []const u8) void {
+    var rest = bytes;
+    while (rest.len > 0) {
+        const n = std.posix.write(fd, rest) catch return;
+        if (n == 0) return;
+        rest = rest[n..];
+    }
+}
+
+test "output: sink publishes on finish" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    var sink = Sink{ .allocator = std.testing.allocator, .fd = fds[1] };
+    defer sink.deinit();
+    sink.write("a:1\n");
+    sink.write("b:2\n");
+
+    var buf: [16]u8 = undefined;
+    sink.finish();
+    const n = try std.posix.read(fds[0], &buf);
+    try std.testing.expectEqualStrings("a:1\nb:2\n", buf[0..n]);
+}
+
+test "output: ordered blocks are published in sequence" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    var order = try Order.init(std.testing.allocator, 4);
+    defer order.deinit();
+    var first = Sink{ .allocator = std.testing.allocator, .fd = fds[1] };
+    defer first.deinit();
+    var second = Sink{ .allocator = std.testing.allocator, .fd = fds[1] };
+    defer second.deinit();
+
+    // The later input completes first and waits in the window
+    first.begin(&order, 0);
+    second.begin(&order, 1);
+    second.write("b:2\n");
+    second.finish();
+    try std.testing.expectEqual(@as(u64, 0), order.next);
+    first.write("a:1\n");
+    first.finish();
+    try std.testing.expectEqual(@as(u64, 2), order.next);
+
+    var buf: [16]u8 = undefined;
+    const n = try std.posix.read(fds[0], &buf);
+    try std.testing.expectEqualStrings("a:1\nb:2\n", buf[0..n]);
+}
+
+test "output: long runs are copied from the source file" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const line = "2024-05-01 10:00:00 request ok\n";
+    const content = line ** 1024;
+    try tmp.dir.writeFile(.{ .sub_path = "in.log", .data = content });
+    const src = try tmp.dir.openFile("in.log", .{});
+    defer src.close();
+    const dst = try tmp.dir.createFile("out.log", .{ .read = true });
+    defer dst.close();
+
+    var sink = Sink{ .allocator = std.testing.allocator, .fd = dst.handle };
+    defer sink.deinit();
+    sink.write("head\n");
+    sink.writeFrom(content[line.len..], .{ .fd = src.handle, .offset = line.len });
+    sink.finish();
+
+    const written = try tmp.dir.readFileAlloc(std.testing.allocator, "out.log", 1 << 20);
+    defer std.testing.allocator.free(written);
+    try std.testing.expectEqualStrings("head\n", written[0..5]);
+    try std.testing.expectEqualStrings(content[line.len..], written[5..]);
+}
@@ -83,8 +83,9 @@ pub const PcreRegex = struct {
 
     /// Find all matches in text
     pub fn findAll(self: *Self, text: []const u8, allocator: std.mem.Allocator) ![]PcreMatch {
-        // Allocate buffer for results (max 1M matches like other backends)
-        const max_results: usize = 1000000;
+        // Allocate buffer for results (max 1M matches like other backends);
+        // a text cannot hold more matches than it has positions
+        const max_results: usize = @min(1000000, text.len + 1);
         const results_buf = try allocator.alloc(PcreMatch, max_results);
         errdefer allocator.free(results_buf);
 
@@ -106,32 +107,29 @@ pub const PcreRegex = struct {
     }
 };
 
-/// Find line start position (scan backwards for newline)
-fn findLineStart(text: []const u8, pos: usize) u32 {
+/// Find line start position (scan backwards for the record terminator)
+fn findLineStart(text: []const u8, pos: usize, eol: u8) u32 {
     if (pos == 0) return 0;
     var i = pos - 1;
-    while (i > 0 and text[i] != '\n') : (i -= 1) {}
-    if (text[i] == '\n' and i < pos) return @intCast(i + 1);
+    while (i > 0 and text[i] != eol) : (i -= 1) {}
+    if (text[i] == eol and i < pos) return @intCast(i + 1);
     return @intCast(i);
 }
 
-/// Count newlines before position
-fn countNewlines(text: []const u8, end: usize) u32 {
+/// Count record terminators before position
+fn countNewlines(text: []const u8, end: usize, eol: u8) u32 {
     var count: u32 = 0;
     for (text[0..end]) |ch| {
-        if (ch == '\n') count += 1;
+        if (ch == eol) count += 1;
     }
     return count;
 }
 
 /// Search text using Perl regex (PCRE2)
 pub fn searchPcre(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
-    // Handle invert match separately
-    if (options.invert_match) {
-        return searchPcreInverted(text, pattern, options, allocator);
-    }
-
     var pcre = PcreRegex.compile(pattern, options) catch {
+        // On regex error, all lines are "non-matching"
+        if (options.invert_match) return searchAllLines(text, options.record_sep, allocator);
         // Return empty result on regex error (match GNU grep behavior)
         return SearchResult{
             .matches = &[_]MatchResult{},
@@ -141,6 +139,17 @@ pub fn searchPcre(text: []const u8, pattern: []const u8, options: SearchOptions,
     };
     defer pcre.deinit();
 
+    return searchCompiled(&pcre, text, options, allocator);
+}
+
+/// Search text with an already compiled pattern. Callers searching many
+/// inputs compile once per thread; a PcreRegex must not be shared between threads.
+pub fn searchCompiled(pcre: *PcreRegex, text: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
+    // Handle invert match separately
+    if (options.invert_match) {
+        return searchPcreInverted(pcre, text, options.record_sep, allocator);
+    }
+
     const pcre_matches = try pcre.findAll(text, allocator);
     defer allocator.free(pcre_matches);
 
@@ -150,8 +159,8 @@ pub fn searchPcre(text: []const u8, pattern: []const u8, options: SearchOptions,
 
     for (pcre_matches) |m| {
         if (m.valid != 0) {
-            const line_start = findLineStart(text, m.start);
-            const line_num = 1 + countNewlines(text, line_start);
+            const line_start = findLineStart(text, m.start, options.record_sep);
+            const line_num = 1 + countNewlines(text, line_start, options.record_sep);
 
             try matches.append(allocator, MatchResult{
                 .position = @intCast(m.start),
@@ -172,13 +181,7 @@ pub fn searchPcre(text: []const u8, pattern: []const u8, options: SearchOptions,
 }
 
 /// Search for non-matching lines using PCRE
-fn searchPcreInverted(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
-    var pcre = PcreRegex.compile(pattern, options) catch {
-        // On regex error, all lines are "non-matching"
-        return searchAllLines(text, allocator);
-    };
-    defer pcre.deinit();
-
+fn searchPcreInverted(pcre: *PcreRegex, text: []const u8, eol: u8, allocator: std.mem.Allocator) !SearchResult {
     const pcre_matches = try pcre.findAll(text, allocator);
     defer allocator.free(pcre_matches);
 
@@ -188,7 +191,7 @@ fn searchPcreInverted(text: []const u8, pattern: []const u8, options: SearchOpti
 
     for (pcre_matches) |m| {
         if (m.valid != 0) {
-            const line_start = findLineStart(text, m.start);
+            const line_start = findLineStart(text, m.start, eol);
             try matching_lines.put(line_start, {});
         }
     }
@@ -203,7 +206,7 @@ fn searchPcreInverted(text: []const u8, pattern: []const u8, options: SearchOpti
     while (line_start < text.len) {
         // Find end of line
         var line_end = line_start;
-        while (line_end < text.len and text[line_end] != '\n') : (line_end += 1) {}
+        while (line_end < text.len and text[line_end] != eol) : (line_end += 1) {}
 
         // Check if this line is NOT in matching set
         if (!matching_lines.contains(@intCast(line_start))) {
@@ -230,7 +233,7 @@ fn searchPcreInverted(text: []const u8, pattern: []const u8, options: SearchOpti
 }
 
 /// Return all lines (for empty pattern or regex error in inverted mode)
-fn searchAllLines(text: []const u8, allocator: std.mem.Allocator) !SearchResult {
+fn searchAllLines(text: []const u8, eol: u8, allocator: std.mem.Allocator) !SearchResult {
     var matches: std.ArrayListUnmanaged(MatchResult) = .{};
     defer matches.deinit(allocator);
 
@@ -239,7 +242,7 @@ fn searchAllLines(text: []const u8, allocator: std.mem.Allocator) !SearchResult
 
     while (line_start < text.len) {
         var line_end = line_start;
-        while (line_end < text.len and text[line_end] != '\n') : (line_end += 1) {}
+        while (line_end < text.len and text[line_end] != eol) : (line_end += 1) {}
 
         try matches.append(allocator, MatchResult{
             .position = @intCast(line_start),
@@ -0,0 +1,297 @@
+const std = @import("std");
+const gpu = @import("gpu");
+
+// ============================================================================
+// Multi-line records (--record-start=REGEX) and matches (-U)
+//
+// A record begins at every line matching the record-start pattern and runs up
+// to the next such line, so a log entry keeps its continuation lines (stack
+// traces, wrapped messages); lines before the first start form a record of
+// their own. The engines keep searching line by line at full speed and their
+// matches are regrouped onto the records containing them, so selection, -v,
+// -c and output all work per record without rewriting the input.
+// ============================================================================
+
+pub const RecordMap = struct {
+    text: []const u8,
+    starts: []u32, // sorted record start offsets, starts[0] == 0
+    allocator: std.mem.Allocator,
+
+    /// Build from the matches of the record-start pattern over `text`
+    pub fn init(allocator: std.mem.Allocator, text: []const u8, start_matches: []const gpu.MatchResult) !RecordMap {
+        var starts: std.ArrayListUnmanaged(u32) = .{};
+        errdefer starts.deinit(allocator);
+        try starts.append(allocator, 0);
+        for (start_matches) |m| try starts.append(allocator, m.line_start);
+
+        std.mem.sort(u32, starts.items, {}, std.sort.asc(u32));
+        var len: usize = 1;
+        for (starts.items[1..]) |s| {
+            if (s != starts.items[len - 1]) {
+                starts.items[len] = s;
+                len += 1;
+            }
+        }
+        starts.shrinkRetainingCapacity(len);
+        return .{ .text = text, .starts = try starts.toOwnedSlice(allocator), .allocator = allocator };
+    }
+
+    pub fn deinit(self: *RecordMap) void {
+        self.allocator.free(self.starts);
+    }
+
+    /// Index of the record containing `pos`
+    pub fn indexOf(self: *const RecordMap, pos: usize) usize {
+        var lo: usize = 0;
+        var hi: usize = self.starts.len;
+        while (lo + 1 < hi) {
+            const mid = (lo + hi) / 2;
+            if (self.starts[mid] <= pos) lo = mid else hi = mid;
+        }
+        return lo;
+    }
+
+    /// End of record `idx`, before the newline that terminates it
+    pub fn end(self: *const RecordMap, idx: usize) usize {
+        const next = if (idx + 1 < self.starts.len) self.starts[idx + 1] else self.text.len;
+        if (next > self.starts[idx] and self.text[next - 1] == '\n') return next - 1;
+        return next;
+    }
+
+    /// Turn line matches into record matches: each match is moved onto its
+    /// record's start, or with `invert` every record without a match is
+    /// returned whole. `lines` must be in text order.
+    pub fn regroup(self: *const RecordMap, allocator: std.mem.Allocator, lines: gpu.SearchResult, invert: bool) !gpu.SearchResult {
+        var matches: std.ArrayListUnmanaged(gpu.MatchResult) = .{};
+        defer matches.deinit(allocator);
+
+        if (!invert) {
+            for (lines.matches) |m| {
+                var moved = m;
+                moved.line_start = self.starts[self.indexOf(m.line_start)];
+                moved.line_num = 0; // counted from the record start when printed
+                try matches.append(allocator, moved);
+            }
+        } else {
+            var hit = try std.DynamicBitSetUnmanaged.initEmpty(allocator, self.starts.len);
+            defer hit.deinit(allocator);
+            for (lines.matches) |m| hit.set(self.indexOf(m.line_start));
+            for (self.starts, 0..) |start, idx| {
+                if (hit.isSet(idx) or start == self.text.len) continue;
+                const record_end = self.end(idx);
+                try matches.append(allocator, .{
+                    .position = start,
+                    .pattern_idx = 0,
+                    .match_len = @intCast(record_end - start),
+                    .line_start = start,
+                });
+            }
+        }
+
+        const result = try matches.toOwnedSlice(allocator);
+        return .{ .matches = result, .total_matches = result.len, .allocator = allocator };
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Matches spanning lines (-U)
+// ----------------------------------------------------------------------------
+
+/// Default for --max-span: the longest -U match, and the overlap carried
+/// across segment boundaries so such a match is never cut in two
+pub const DEFAULT_MAX_SPAN: usize = 64 * 1024;
+
+/// Split matches that cross line ends into one piece per line they cover, so
+/// every covered line is printed and highlighted. Matches longer than
+/// `max_span` are dropped. With `invert`, the lines no match covers are
+/// returned instead. `lines` must be in text order.
+pub fn splitSpans(allocator: std.mem.Allocator, text: []const u8, eol: u8, lines: gpu.SearchResult, max_span: usize, invert: bool) !gpu.SearchResult {
+    var pieces: std.ArrayListUnmanaged(gpu.MatchResult) = .{};
+    defer pieces.deinit(allocator);
+
+    for (lines.matches) |m| {
+        if (m.match_len > max_span) continue;
+        const end = m.position + m.match_len;
+        var line_start: usize = m.line_start;
+        var pos: usize = m.position;
+        while (true) {
+            const line_end = std.mem.indexOfScalarPos(u8, text, line_start, eol) orelse text.len;
+            try pieces.append(allocator, .{
+                .position = @intCast(pos),
+                .pattern_idx = m.pattern_idx,
+                .match_len = @intCast(@min(end, line_end) - pos),
+                .line_start = @intCast(line_start),
+            });
+            // A match ending on the terminator does not reach the next line
+            if (end <= line_end + 1 or line_end >= text.len) break;
+            line_start = line_end + 1;
+            pos = line_start;
+        }
+    }
+
+    if (invert) {
+        var uncovered: std.ArrayListUnmanaged(gpu.MatchResult) = .{};
+        defer uncovered.deinit(allocator);
+        var next: usize = 0; // first piece not yet passed
+        var line_start: usize = 0;
+        while (line_start < text.len) {
+            const line_end = std.mem.indexOfScalarPos(u8, text, line_start, eol) orelse text.len;
+            while (next < pieces.items.len and pieces.items[next].line_start < line_start) next += 1;
+            const covered = next < pieces.items.len and pieces.items[next].line_start == line_start;
+            if (!covered) {
+                try uncovered.append(allocator, .{
+                    .position = @intCast(line_start),
+                    .pattern_idx = 0,
+                    .match_len = @intCast(line_end - line_start),
+                    .line_start = @intCast(line_start),
+                });
+            }
+            line_start = line_end + 1;
+        }
+        const result = try uncovered.toOwnedSlice(allocator);
+        return .{ .matches = result, .total_matches = result.len, .allocator = allocator };
+    }
+
+    const result = try pieces.toOwnedSlice(allocator);
+    return .{ .matches = result, .total_matches = lines.total_matches, .allocator = allocator };
+}
+
+/// Widen segment [start, end) of `text` by `margin` bytes on each side,
+/// snapped outwards to line boundaries, so a match of up to `margin` bytes
+/// that crosses the segment edge is found whole
+pub fn widen(text: []const u8, start: usize, end: usize, margin: usize) struct { start: usize, end: usize } {
+    const lo = start -| margin;
+    const hi = @min(end +| margin, text.len);
+    const new_start = if (std.mem.lastIndexOfScalar(u8, text[0..lo], '\n')) |nl| nl + 1 else 0;
+    const new_end = if (std.mem.indexOfScalarPos(u8, text, hi, '\n')) |nl| nl + 1 else text.len;
+    return .{ .start = new_start, .end = new_end };
+}
+
+/// End of the window a -U search of input piece [.., end) must read: the
+/// end of the line reaching `margin` bytes past `end`, so every match of up
+/// to `margin` bytes that starts in the piece is found whole
+pub fn reach(text: []const u8, end: usize, margin: usize, eol: u8) usize {
+    const limit = @min(end +| margin, text.len);
+    return if (std.mem.indexOfScalarPos(u8, text, limit, eol)) |nl| nl + 1 else text.len;
+}
+
+/// The -U matches one piece of a chunked or segmented input prints
+pub const Claim = struct {
+    result: gpu.SearchResult, // positions relative to `from`
+    end: usize, // end of the printed text in the window; the next piece starts here
+};
+
+/// Of the matches found in `window` (read up to reach() past `owned`), keep
+/// those starting in [from, owned), where `from` is where the previous piece
+/// stopped printing, plus any starting on a line a kept match reaches into,
+/// since that line is printed here. Matches longer than `max_span` are
+/// dropped, as splitSpans drops them. `from` and `owned` are line starts.
+pub fn claimSpans(allocator: std.mem.Allocator, window: []const u8, eol: u8, found: gpu.SearchResult, from: usize, owned: usize, max_span: usize) !Claim {
+    var kept: std.ArrayListUnmanaged(gpu.MatchResult) = .{};
+    defer kept.deinit(allocator);
+    var end = @max(owned, from);
+    for (found.matches) |m| {
+        if (m.position < from or m.match_len > max_span) continue;
+        if (m.position >= end) break;
+        var moved = m;
+        moved.position -= @intCast(from);
+        moved.line_start -= @intCast(from);
+        try kept.append(allocator, moved);
+        // A match ending on a terminator does not reach the next line
+        const last = m.position + m.match_len -| 1;
+        const line_end = if (std.mem.indexOfScalarPos(u8, window, @max(last, m.position), eol)) |nl| nl + 1 else window.len;
+        end = @max(end, line_end);
+    }
+    const result = try kept.toOwnedSlice(allocator);
+    return .{ .result = .{ .matches = result, .total_matches = result.len, .allocator = allocator }, .end = end };
+}
+
+test "records: line matches regroup onto records" {
+    const allocator = std.testing.allocator;
+    const text =
+        \\2024-05-01 boot
+        \\2024-05-01 error: NullPointerException
+        \\    at Foo.bar(Foo.java:10)
+        \\    at Main.main(Main.java:3)
+        \\2024-05-01 done
+        \\
+    ;
+    const second = std.mem.indexOf(u8, text, "2024-05-01 error").?;
+    const third = std.mem.indexOf(u8, text, "2024-05-01 done").?;
+    const starts = [_]gpu.MatchResult{
+        .{ .position = 0, .pattern_idx = 0, .match_len = 10, .line_start = 0 },
+        .{ .position = @intCast(second), .pattern_idx = 0, .match_len = 10, .line_start = @intCast(second) },
+        .{ .position = @intCast(third), .pattern_idx = 0, .match_len = 10, .line_start = @intCast(third) },
+    };
+    var map = try RecordMap.init(allocator, text, &starts);
+    defer map.deinit();
+    try std.testing.expectEqual(@as(usize, 3), map.starts.len);
+    try std.testing.expectEqualStrings("    at Main.main(Main.java:3)", text[map.end(1) - 29 .. map.end(1)]);
+
+    // "Main.java" sits on a continuation line of the second record
+    const at = std.mem.indexOf(u8, text, "Main.java").?;
+    const line = std.mem.lastIndexOfScalar(u8, text[0..at], '\n').? + 1;
+    var line_matches = [_]gpu.MatchResult{.{ .position = @intCast(at), .pattern_idx = 0, .match_len = 9, .line_start = @intCast(line) }};
+    const lines = gpu.SearchResult{ .matches = &line_matches, .total_matches = 1, .allocator = allocator };
+
+    var selected = try map.regroup(allocator, lines, false);
+    defer selected.deinit();
+    try std.testing.expectEqual(@as(u32, @intCast(second)), selected.matches[0].line_start);
+
+    var others = try map.regroup(allocator, lines, true);
+    defer others.deinit();
+    try std.testing.expectEqual(@as(usize, 2), others.matches.len);
+    try std.testing.expectEqualStrings("2024-05-01 done", text[others.matches[1].position..][0..others.matches[1].match_len]);
+}
+
+test "records: -U matches split across the lines they cover" {
+    const allocator = std.testing.allocator;
+    const text = "ok\nException: boom\n    at com.foo.Bar\nok\n";
+    const start = std.mem.indexOf(u8, text, "Exception").?;
+    const end = std.mem.indexOf(u8, text, "com.foo").? + "com.foo".len;
+    var found = [_]gpu.MatchResult{.{ .position = @intCast(start), .pattern_idx = 0, .match_len = @intCast(end - start), .line_start = @intCast(start) }};
+    const lines = gpu.SearchResult{ .matches = &found, .total_matches = 1, .allocator = allocator };
+
+    var pieces = try splitSpans(allocator, text, '\n', lines, DEFAULT_MAX_SPAN, false);
+    defer pieces.deinit();
+    try std.testing.expectEqual(@as(usize, 2), pieces.matches.len);
+    try std.testing.expectEqualStrings("Exception: boom", text[pieces.matches[0].position..][0..pieces.matches[0].match_len]);
+    try std.testing.expectEqualStrings("    at com.foo", text[pieces.matches[1].position..][0..pieces.matches[1].match_len]);
+
+    var others = try splitSpans(allocator, text, '\n', lines, DEFAULT_MAX_SPAN, true);
+    defer others.deinit();
+    try std.testing.expectEqual(@as(usize, 2), others.matches.len);
+
+    var capped = try splitSpans(allocator, text, '\n', lines, 8, false);
+    defer capped.deinit();
+    try std.testing.expectEqual(@as(usize, 0), capped.matches.len);
+}
+
+test "records: -U matches straddling a chunk edge are claimed once" {
+    const allocator = std.testing.allocator;
+    const text = "ok\nException: boom\n    at com.foo.Bar\nException: again\nok\n";
+    const edge = std.mem.indexOf(u8, text, "    at").?; // first chunk owns up to here
+    const first = std.mem.indexOf(u8, text, "Exception").?;
+    const second = std.mem.lastIndexOf(u8, text, "Exception").?;
+    const span = "Exception: boom\n    at com.foo".len;
+
+    // First chunk: the match crosses the edge, so its last line is printed too
+    const window = text[0..reach(text, edge, 16, '\n')];
+    var found = [_]gpu.MatchResult{.{ .position = @intCast(first), .pattern_idx = 0, .match_len = span, .line_start = @intCast(first) }};
+    var claim = try claimSpans(allocator, window, '\n', .{ .matches = &found, .total_matches = 1, .allocator = allocator }, 0, edge, 64);
+    defer claim.result.deinit();
+    try std.testing.expectEqual(@as(usize, 1), claim.result.matches.len);
+    try std.testing.expectEqual(@as(usize, second), claim.end);
+
+    // A parallel segment starting at the edge saw a match in the overlap the
+    // first one printed ("at" alone, say): dropped, and it prints from there
+    var overlap = [_]gpu.MatchResult{
+        .{ .position = 4, .pattern_idx = 0, .match_len = 2, .line_start = 0 },
+        .{ .position = @intCast(second - edge), .pattern_idx = 0, .match_len = 9, .line_start = @intCast(second - edge) },
+    };
+    var next = try claimSpans(allocator, text[edge..], '\n', .{ .matches = &overlap, .total_matches = 2, .allocator = allocator }, claim.end - edge, text.len - edge, 64);
+    defer next.result.deinit();
+    try std.testing.expectEqual(@as(usize, 1), next.result.matches.len);
+    try std.testing.expectEqual(@as(u32, 0), next.result.matches[0].position);
+    try std.testing.expectEqual(text.len - edge, next.end);
+}
@@ -0,0 +1,338 @@
+const std = @import("std");
+
+// ============================================================================
+// Work distribution for multi-file searches (-r, --files-from)
+//
+// The main thread produces paths (walking directories or streaming a path
+// list) into a bounded queue; worker threads pop and search them. The bound
+// keeps a fast producer from running ahead of the workers, so listing
+// millions of files costs a fixed amount of memory. Under auto backend
+// selection, files the selector would give the GPU go to a separate lane
+// with its own submitter thread, so small-file CPU searches and GPU
+// searches overlap instead of CPU workers queueing on the GPU.
+// ============================================================================
+
+/// Paths queued per worker before the producer blocks
+pub const QUEUE_DEPTH_PER_WORKER: usize = 64;
+
+/// Inputs a worker may run ahead of the output in input order (--sort=path)
+pub const REORDER_WINDOW_PER_WORKER: usize = 8;
+
+/// Upper bound for the default worker count
+pub const MAX_DEFAULT_WORKERS: usize = 16;
+
+/// Worker count for --threads=0 (auto)
+pub fn defaultWorkers() usize {
+    const cpus = std.Thread.getCpuCount() catch 1;
+    return std.math.clamp(cpus, 1, MAX_DEFAULT_WORKERS);
+}
+
+/// Queues of a heterogeneous run (-r under auto backend selection)
+pub const Lane = enum { gpu, cpu };
+
+/// Items a GPU lane may hold before CPU workers start taking them
+pub const STEAL_BACKLOG: usize = 2;
+
+/// Fixed-capacity FIFOs for one producer and any number of consumers: a CPU
+/// lane popped by the CPU workers and a GPU lane popped by the GPU submitter.
+/// push() blocks while the chosen lane is full. A CPU worker that finds an
+/// item belongs on the GPU hands it over with reroute(), so the producer
+/// never has to look at items to route them. popCpu() takes from the CPU
+/// lane and, once more than STEAL_BACKLOG items wait in the GPU lane, steals
+/// its oldest, so neither device idles while the other has a backlog. Pops
+/// block while nothing is available to them and return null once the queue
+/// has been closed and drained; popGpu() also waits out CPU items still
+/// being handled (until finished()), as they may yet be rerouted. A run that
+/// routes everything to the CPU lane is a plain bounded queue.
+///
+/// Consumers may block on output order (seqOf(item), see output.Order), so
+/// the GPU lane is kept sorted by seq and never takes an item below one the
+/// submitter has already started: that item would wait behind a later one
+/// that is itself waiting for it.
+pub fn RoutedQueue(comptime T: type, comptime seqOf: fn (T) u64) type {
+    return struct {
+        lanes: [2]Ring,
+        closed: bool = false,
+        busy: usize = 0, // items popCpu() handed out and not yet finished()
+        gpu_started: ?u64 = null, // highest seq popGpu() has returned
+        mutex: std.Thread.Mutex = .{},
+        changed: std.Thread.Condition = .{},
+
+        const Self = @This();
+
+        const Ring = struct {
+            items: []T,
+            head: usize = 0,
+            len: usize = 0,
+
+            fn full(self: *const Ring) bool {
+                return self.len == self.items.len;
+            }
+
+            fn put(self: *Ring, item: T) void {
+                self.items[(self.head + self.len) % self.items.len] = item;
+                self.len += 1;
+            }
+
+            /// Put `item` in seq order among the items already queued
+            fn insert(self: *Ring, item: T) void {
+                var i = self.len;
+                while (i > 0) : (i -= 1) {
+                    const prev = self.items[(self.head + i - 1) % self.items.len];
+                    if (seqOf(prev) <= seqOf(item)) break;
+                    self.items[(self.head + i) % self.items.len] = prev;
+                }
+                self.items[(self.head + i) % self.items.len] = item;
+                self.len += 1;
+            }
+
+            fn take(self: *Ring) T {
+                const item = self.items[self.head];
+                self.head = (self.head + 1) % self.items.len;
+                self.len -= 1;
+                return item;
+            }
+        };
+
+        /// A popped item and whether it was routed to the other lane
+        pub const Popped = struct { item: T, stolen: bool };
+
+        pub fn init(allocator: std.mem.Allocator, cpu_capacity: usize, gpu_capacity: usize) !Self {
+            const cpu_items = try allocator.alloc(T, @max(cpu_capacity, 1));
+            errdefer allocator.free(cpu_items);
+            // Room past the steal threshold, so a full GPU lane is always stealable
+            const gpu_items = try allocator.alloc(T, @max(gpu_capacity, STEAL_BACKLOG + 1));
+            return .{ .lanes = .{ .{ .items = gpu_items }, .{ .items = cpu_items } } };
+        }
+
+        pub fn deinit(self: *Self, allocator: std.mem.Allocator) void {
+            for (self.lanes) |lane| allocator.free(lane.items);
+        }
+
+        fn ring(self: *Self, lane: Lane) *Ring {
+            return &self.lanes[@intFromEnum(lane)];
+        }
+
+        pub fn push(self: *Self, item: T, lane: Lane) void {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            const r = self.ring(lane);
+            while (r.full()) self.changed.wait(&self.mutex);
+            if (lane == .gpu) r.insert(item) else r.put(item);
+            self.changed.broadcast();
+        }
+
+        pub fn popGpu(self: *Self) ?T {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            const r = self.ring(.gpu);
+            while (r.len == 0) {
+                if (self.closed and self.ring(.cpu).len == 0 and self.busy == 0) return null;
+                self.changed.wait(&self.mutex);
+            }
+            defer self.changed.broadcast();
+            const item = r.take();
+            self.gpu_started = @max(self.gpu_started orelse 0, seqOf(item));
+            return item;
+        }
+
+        pub fn popCpu(self: *Self) ?Popped {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            const own = self.ring(.cpu);
+            const other = self.ring(.gpu);
+            while (true) {
+                if (own.len > 0) {
+                    defer self.changed.broadcast();
+                    self.busy += 1;
+                    return .{ .item = own.take(), .stolen = false };
+                }
+                if (other.len > STEAL_BACKLOG) {
+                    defer self.changed.broadcast();
+                    self.busy += 1;
+                    return .{ .item = other.take(), .stolen = true };
+                }
+                if (self.closed) return null;
+                self.changed.wait(&self.mutex);
+            }
+        }
+
+        /// Move an item popped from the CPU lane to the GPU lane. Returns
+        /// false, leaving it to the caller, when the GPU lane is full or the
+        /// submitter has already started on a later item.
+        pub fn reroute(self: *Self, item: T) bool {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            const r = self.ring(.gpu);
+            if (r.full()) return false;
+            if (self.gpu_started) |started| {
+                if (seqOf(item) < started) return false;
+            }
+            r.insert(item);
+            self.changed.broadcast();
+            return true;
+        }
+
+        /// The item from the last popCpu() has been searched or rerouted
+        pub fn finished(self: *Self) void {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.busy -= 1;
+            self.changed.broadcast();
+        }
+
+        /// No more items will be pushed; wakes every waiting consumer
+        pub fn close(self: *Self) void {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.closed = true;
+            self.changed.broadcast();
+        }
+    };
+}
+
+/// Streams entries of a --files-from list without reading it whole. Entries
+/// are NUL-separated when the first block read contains a NUL (find -print0,
+/// git ls-files -z) and newline-separated otherwise; empty entries are skipped.
+pub const PathReader = struct {
+    fd: std.posix.fd_t,
+    buf: [64 * 1024]u8 = undefined,
+    start: usize = 0,
+    end: usize = 0,
+    eof: bool = false,
+    separator: ?u8 = null,
+
+    pub fn init(fd: std.posix.fd_t) PathReader {
+        return .{ .fd = fd };
+    }
+
+    /// Next path, valid until the following call
+    pub fn next(self: *PathReader) !?[]const u8 {
+        while (true) {
+            if (self.separator) |sep| {
+                if (std.mem.indexOfScalar(u8, self.buf[self.start..self.end], sep)) |i| {
+                    const entry = self.buf[self.start .. self.start + i];
+                    self.start += i + 1;
+                    if (entry.len == 0) continue;
+                    return entry;
+                }
+            }
+            if (self.eof) {
+                if (self.start == self.end) return null;
+                const entry = self.buf[self.start..self.end];
+                self.start = self.end;
+                return entry;
+            }
+
+            // Keep the partial entry and refill behind it
+            if (self.start > 0) {
+                std.mem.copyForwards(u8, self.buf[0 .. self.end - self.start], self.buf[self.start..self.end]);
+                self.end -= self.start;
+                self.start = 0;
+            }
+            if (self.end == self.buf.len) return error.NameTooLong;
+            const n = try std.posix.read(self.fd, self.buf[self.end..]);
+            if (n == 0) self.eof = true;
+            if (self.separator == null) {
+                const has_nul = std.mem.indexOfScalar(u8, self.buf[self.end .. self.end + n], 0) != null;
+                self.separator = if (has_nul) 0 else '\n';
+            }
+            self.end += n;
+        }
+    }
+};
+
+fn testSeq(item: u32) u64 {
+    return item;
+}
+
+test "scheduler: routed queue drains after close and steals a gpu backlog" {
+    var queue = try RoutedQueue(u32, testSeq).init(std.testing.allocator, 2, 4);
+    defer queue.deinit(std.testing.allocator);
+    queue.push(1, .cpu);
+    queue.push(2, .cpu);
+    try std.testing.expectEqual(@as(u32, 1), queue.popCpu().?.item);
+    queue.finished();
+
+    // Up to STEAL_BACKLOG items wait for the GPU; past that, CPU workers help
+    for (10..10 + STEAL_BACKLOG + 1) |i| queue.push(@intCast(i), .gpu);
+    try std.testing.expectEqual(@as(u32, 2), queue.popCpu().?.item);
+    queue.finished();
+    const stolen = queue.popCpu().?;
+    try std.testing.expect(stolen.stolen and stolen.item == 10);
+    queue.finished();
+    try std.testing.expectEqual(@as(?u32, 11), queue.popGpu());
+
+    queue.close();
+    try std.testing.expect(queue.popCpu() == null);
+    try std.testing.expectEqual(@as(?u32, 12), queue.popGpu());
+    try std.testing.expectEqual(@as(?u32, null), queue.popGpu());
+}
+
+test "scheduler: items rerouted by a cpu worker reach the gpu lane" {
+    var queue = try RoutedQueue(u32, testSeq).init(std.testing.allocator, 4, STEAL_BACKLOG + 1);
+    defer queue.deinit(std.testing.allocator);
+    for (1..STEAL_BACKLOG + 3) |i| queue.push(@intCast(i), .cpu);
+    queue.close();
+
+    // The GPU lane takes what fits; the rest stays with the worker
+    for (1..STEAL_BACKLOG + 3) |i| {
+        const popped = queue.popCpu().?;
+        try std.testing.expectEqual(@as(u32, @intCast(i)), popped.item);
+        try std.testing.expectEqual(i <= STEAL_BACKLOG + 1, queue.reroute(popped.item));
+        queue.finished();
+    }
+    // Closed, but the submitter still drains what was rerouted after the close
+    for (1..STEAL_BACKLOG + 2) |i| try std.testing.expectEqual(@as(?u32, @intCast(i)), queue.popGpu());
+    try std.testing.expectEqual(@as(?u32, null), queue.popGpu());
+}
+
+test "scheduler: path reader detects separators" {
+    const lists = [_]struct { input: []const u8, expected: []const []const u8 }{
+        .{ .input = "a.txt\nsub/b.txt\n\nc", .expected = &.{ "a.txt", "sub/b.txt", "c" } },
+        .{ .input = "name with\nnewline\x00d.log\x00", .expected = &.{ "name with\nnewline", "d.log" } },
+    };
+    for (lists) |list| {
+        const fds = try std.posix.pipe();
+        defer std.posix.close(fds[0]);
+        _ = try std.posix.write(fds[1], list.input);
+        std.posix.close(fds[1]);
+
+        var reader = PathReader.init(fds[0]);
+        for (list.expected) |want| {
+            const got = (try reader.next()) orelse return error.TestUnexpectedResult;
+            try std.testing.expectEqualStrings(want, got);
+        }
+        try std.testing.expect((try reader.next()) == null);
+    }
+}
+
+test "scheduler: out-of-order reroutes keep the gpu lane in seq order" {
+    var queue = try RoutedQueue(u32, testSeq).init(std.testing.allocator, 8, 4);
+    defer queue.deinit(std.testing.allocator);
+    for (0..6) |i| queue.push(@intCast(i), .cpu);
+    queue.close();
+    var popped: [6]u32 = undefined;
+    for (&popped) |*p| p.* = queue.popCpu().?.item;
+
+    // Workers finish their stats in any order
+    var drained = [_]bool{false} ** 6;
+    try std.testing.expect(queue.reroute(popped[3]));
+    try std.testing.expect(queue.reroute(popped[1]));
+    try std.testing.expectEqual(@as(?u32, 1), queue.popGpu());
+    drained[1] = true;
+    // The submitter has started on 1: 0 stays with its worker, 2 still fits
+    try std.testing.expect(!queue.reroute(popped[0]));
+    drained[0] = true;
+    try std.testing.expect(queue.reroute(popped[2]));
+    try std.testing.expect(queue.reroute(popped[5]));
+    try std.testing.expect(queue.reroute(popped[4]));
+    for (popped) |_| queue.finished();
+
+    var expected: u32 = 2;
+    while (queue.popGpu()) |seq| : (expected += 1) {
+        try std.testing.expectEqual(expected, seq);
+        drained[seq] = true;
+    }
+    for (drained) |d| try std.testing.expect(d);
+}
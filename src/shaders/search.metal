@@ -24,7 +24,7 @@ struct SearchConfig {
     uint flags;
     uint positions_per_thread;
     uint batch_offset;          // Starting position for this batch
-    uint _pad2;
+    uint probe_offset;          // Pattern byte compared before a full match
     uint _pad3;
 };
 
@@ -43,50 +43,127 @@ struct MatchResult {
 // to_lower, to_lower4, char_match, match4, is_word_char, is_newline,
 // match_at_position, check_word_boundary, find_line_start
 
+// ============================================================================
+// Ordered result passes
+// ============================================================================
+//
+// The search kernels run three times, selected by PassConfig::pass, so that
+// results are written in text order without a host-side sort:
+//   PASS_COUNT  each thread counts its matches; the threadgroup scans the
+//               counts into thread_offsets and records its total
+//   PASS_SCAN   one threadgroup turns group totals into exclusive offsets
+//               after the results already written (earlier batches)
+//   PASS_WRITE  each thread writes its matches from its offsets on
+// When only the matching lines matter, one PASS_LINES dispatch sets the bit
+// of each matching line's first byte in line_bits instead.
+// ============================================================================
+
+constant uint PASS_COUNT = 0u;
+constant uint PASS_SCAN = 1u;
+constant uint PASS_LINES = 3u;
+constant uint MAX_GROUP_THREADS = 256u;
+
+struct PassConfig {
+    uint pass;
+    uint num_groups;    // threadgroups of the count and write passes
+    uint _pad1;
+    uint _pad2;
+};
+
+// Exclusive scan of one value per thread over the first `count` threads of
+// the threadgroup; leaves the sum in *total. Every thread must reach it.
+uint threadgroup_exclusive_scan(threadgroup uint* values, threadgroup uint* total, uint value, uint lid, uint count) {
+    values[lid] = value;
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    if (lid == 0) {
+        uint sum = 0;
+        for (uint i = 0; i < count; i++) {
+            uint v = values[i];
+            values[i] = sum;
+            sum += v;
+        }
+        *total = sum;
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    return values[lid];
+}
+
+// PASS_SCAN, run by a single threadgroup of `tg_size` threads
+void scan_group_offsets(
+    device uint* group_offsets,
+    device atomic_uint* result_count,
+    device atomic_uint* total_matches,
+    uint num_groups,
+    threadgroup uint* values,
+    threadgroup uint* total,
+    uint lid,
+    uint tg_size
+) {
+    uint per = (num_groups + tg_size - 1) / tg_size;
+    uint begin = min(lid * per, num_groups);
+    uint end = min(begin + per, num_groups);
+
+    uint sum = 0;
+    for (uint i = begin; i < end; i++) sum += group_offsets[i];
+    uint base = atomic_load_explicit(result_count, memory_order_relaxed) +
+        threadgroup_exclusive_scan(values, total, sum, lid, tg_size);
+    for (uint i = begin; i < end; i++) {
+        uint v = group_offsets[i];
+        group_offsets[i] = base;
+        base += v;
+    }
+    threadgroup_barrier(mem_flags::mem_device);
+    if (lid == 0) {
+        atomic_fetch_add_explicit(result_count, *total, memory_order_relaxed);
+        atomic_fetch_add_explicit(total_matches, *total, memory_order_relaxed);
+    }
+}
+
+// Set the bit of the line starting at `line_start`
+void mark_line(device atomic_uint* line_bits, uint line_start) {
+    atomic_fetch_or_explicit(&line_bits[line_start >> 5], 1u << (line_start & 31u), memory_order_relaxed);
+}
+
 // ============================================================================
 // Boyer-Moore-Horspool Search Kernel
 // ============================================================================
 
-kernel void bmh_search(
-    device const uchar* text [[buffer(0)]],
-    device const uchar* pattern [[buffer(1)]],
-    device const uchar* skip_table [[buffer(2)]],
-    device const SearchConfig* config [[buffer(3)]],
-    device MatchResult* results [[buffer(4)]],
-    device atomic_uint* result_count [[buffer(5)]],
-    device atomic_uint* total_matches [[buffer(6)]],
-    uint tid [[thread_position_in_grid]]
+// Search [start_pos, end_pos); with `emit`, write the matches from index
+// `out_idx` on. Returns the number of matches. With `mark_lines`, set the
+// line bit of each match and skip the rest of its line instead.
+uint bmh_search_range(
+    device const uchar* text,
+    device const uchar* pattern,
+    device const uchar* skip_table,
+    device const SearchConfig* config,
+    device MatchResult* results,
+    device atomic_uint* line_bits,
+    uint start_pos,
+    uint end_pos,
+    bool emit,
+    bool mark_lines,
+    uint out_idx
 ) {
     uint text_len = config->text_len;
     uint pattern_len = config->pattern_len;
     uint flags = config->flags;
-    uint chunk_size = config->positions_per_thread;
-    uint batch_offset = config->batch_offset;
-
-    if (pattern_len == 0 || text_len < pattern_len) return;
-
     bool case_insensitive = (flags & FLAG_CASE_INSENSITIVE) != 0;
     bool word_boundary = (flags & FLAG_WORD_BOUNDARY) != 0;
     bool invert = (flags & FLAG_INVERT_MATCH) != 0;
 
-    // Calculate this thread's search range using config-provided chunk size and batch offset
-    uint start_pos = batch_offset + tid * chunk_size;
-    uint end_pos = min(start_pos + chunk_size + pattern_len - 1, text_len);
-
-    if (start_pos >= text_len) return;
+    // The last byte for short patterns, the rarest one for long patterns
+    uint probe = config->probe_offset;
+    uchar probe_pattern_char = pattern[probe];
+    if (case_insensitive) probe_pattern_char = to_lower(probe_pattern_char);
 
+    uint count = 0;
     uint pos = start_pos;
 
     while (pos + pattern_len <= end_pos) {
-        uchar last_text_char = text[pos + pattern_len - 1];
-        uchar last_pattern_char = pattern[pattern_len - 1];
-
-        if (case_insensitive) {
-            last_text_char = to_lower(last_text_char);
-            last_pattern_char = to_lower(last_pattern_char);
-        }
+        uchar probe_text_char = text[pos + probe];
+        if (case_insensitive) probe_text_char = to_lower(probe_text_char);
 
-        if (last_text_char == last_pattern_char) {
+        if (probe_text_char == probe_pattern_char) {
             if (match_at_position(text, text_len, pos, pattern, pattern_len, case_insensitive)) {
                 bool valid = true;
 
@@ -94,10 +171,18 @@ kernel void bmh_search(
                     valid = check_word_boundary(text, text_len, pos, pos + pattern_len);
                 }
 
+                if (mark_lines && valid) {
+                    mark_line(line_bits, find_line_start(text, pos));
+                    count++;
+                    pos += pattern_len - 1;
+                    while (pos < text_len && !is_newline(text[pos])) pos++;
+                    pos++;
+                    continue;
+                }
                 if (valid != invert) {
-                    uint idx = atomic_fetch_add_explicit(result_count, 1, memory_order_relaxed);
+                    uint idx = out_idx + count;
 
-                    if (idx < 1000000) {
+                    if (emit && idx < 1000000) {
                         uint line_start = find_line_start(text, pos);
                         // Compute line number: 1 + count of newlines before this position
                         uint line_num = 1 + count_newlines_vec(text, 0, line_start);
@@ -109,7 +194,7 @@ kernel void bmh_search(
                         results[idx].line_num = line_num;
                     }
 
-                    atomic_fetch_add_explicit(total_matches, 1, memory_order_relaxed);
+                    count++;
                 }
             }
         }
@@ -117,6 +202,62 @@ kernel void bmh_search(
         uint skip = skip_table[text[pos + pattern_len - 1]];
         pos += max(skip, 1u);
     }
+    return count;
+}
+
+kernel void bmh_search(
+    device const uchar* text [[buffer(0)]],
+    device const uchar* pattern [[buffer(1)]],
+    device const uchar* skip_table [[buffer(2)]],
+    device const SearchConfig* config [[buffer(3)]],
+    device MatchResult* results [[buffer(4)]],
+    device atomic_uint* result_count [[buffer(5)]],
+    device atomic_uint* total_matches [[buffer(6)]],
+    device uint* thread_offsets [[buffer(7)]],
+    device uint* group_offsets [[buffer(8)]],
+    constant PassConfig& pass [[buffer(9)]],
+    device atomic_uint* line_bits [[buffer(10)]],
+    uint tid [[thread_position_in_grid]],
+    uint num_threads [[threads_per_grid]],
+    uint lid [[thread_position_in_threadgroup]],
+    uint tgid [[threadgroup_position_in_grid]],
+    uint tg_size [[threads_per_threadgroup]]
+) {
+    threadgroup uint scan_values[MAX_GROUP_THREADS];
+    threadgroup uint scan_total;
+
+    if (pass.pass == PASS_SCAN) {
+        scan_group_offsets(group_offsets, result_count, total_matches, pass.num_groups, scan_values, &scan_total, lid, tg_size);
+        return;
+    }
+
+    uint text_len = config->text_len;
+    uint pattern_len = config->pattern_len;
+    uint chunk_size = config->positions_per_thread;
+    uint batch_offset = config->batch_offset;
+
+    // Calculate this thread's search range using config-provided chunk size and batch offset
+    uint start_pos = batch_offset + tid * chunk_size;
+    uint end_pos = min(start_pos + chunk_size + pattern_len - 1, text_len);
+    bool active = pattern_len != 0 && text_len >= pattern_len && start_pos < text_len;
+
+    if (pass.pass == PASS_LINES) {
+        if (active) bmh_search_range(text, pattern, skip_table, config, results, line_bits, start_pos, end_pos, false, true, 0);
+        return;
+    }
+
+    if (pass.pass == PASS_COUNT) {
+        // Every thread takes part in the threadgroup scan; the last group may be partial
+        uint count = active ? bmh_search_range(text, pattern, skip_table, config, results, line_bits, start_pos, end_pos, false, false, 0) : 0;
+        uint group_threads = min(tg_size, num_threads - tgid * tg_size);
+        thread_offsets[tid] = threadgroup_exclusive_scan(scan_values, &scan_total, count, lid, group_threads);
+        if (lid == 0) group_offsets[tgid] = scan_total;
+        return;
+    }
+
+    if (active) {
+        bmh_search_range(text, pattern, skip_table, config, results, line_bits, start_pos, end_pos, true, false, group_offsets[tgid] + thread_offsets[tid]);
+    }
 }
 
 // ============================================================================
@@ -257,26 +398,22 @@ kernel void regex_search(
 // Line-based Regex Search Kernel (one thread per line)
 // ============================================================================
 
-kernel void regex_search_lines(
-    device const uchar* text [[buffer(0)]],
-    constant RegexState* states [[buffer(1)]],
-    constant uint* bitmaps [[buffer(2)]],
-    constant RegexSearchConfig& config [[buffer(3)]],
-    constant RegexHeader& header [[buffer(4)]],
-    device RegexMatchOutput* results [[buffer(5)]],
-    device atomic_uint* result_count [[buffer(6)]],
-    device atomic_uint* total_matches [[buffer(7)]],
-    device const uint* line_offsets [[buffer(8)]],
-    device const uint* line_lengths [[buffer(9)]],
-    uint gid [[thread_position_in_grid]],
-    uint num_lines [[threads_per_grid]]
+// Matches of one line; with `emit`, written from index `out_idx` on.
+// Returns the number of matches (0 or 1 with invert).
+uint regex_line_matches(
+    device const uchar* text,
+    constant RegexState* states,
+    constant uint* bitmaps,
+    constant RegexSearchConfig& config,
+    constant RegexHeader& header,
+    device RegexMatchOutput* results,
+    uint line_start,
+    uint line_len,
+    uint line_num,
+    bool emit,
+    uint out_idx
 ) {
-    if (gid >= num_lines) return;
-
-    uint line_start = line_offsets[gid];
-    uint line_len = line_lengths[gid];
     uint line_end = line_start + line_len;
-
     bool invert = (config.flags & FLAG_INVERT_MATCH) != 0;
 
     // For invert mode, we just check if any match exists
@@ -294,22 +431,19 @@ kernel void regex_search_lines(
         );
 
         // Record line if no match found (inverted)
-        if (!found) {
-            uint idx = atomic_fetch_add_explicit(result_count, 1, memory_order_relaxed);
-            atomic_fetch_add_explicit(total_matches, 1, memory_order_relaxed);
-
-            if (idx < config.max_results) {
-                results[idx].start = line_start;
-                results[idx].end = line_end;
-                results[idx].line_start = line_start;
-                results[idx].flags = 1;
-                results[idx].line_num = config.line_offset + gid + 1;
-            }
+        if (found) return 0;
+        if (emit && out_idx < config.max_results) {
+            results[out_idx].start = line_start;
+            results[out_idx].end = line_end;
+            results[out_idx].line_start = line_start;
+            results[out_idx].flags = 1;
+            results[out_idx].line_num = line_num;
         }
-        return;
+        return 1;
     }
 
     // Normal mode: find all matches on this line
+    uint count = 0;
     uint search_pos = 0;
     while (search_pos < line_len) {
         uint match_start, match_end;
@@ -327,18 +461,70 @@ kernel void regex_search_lines(
         if (!found) break;
 
         // Record this match
-        uint idx = atomic_fetch_add_explicit(result_count, 1, memory_order_relaxed);
-        atomic_fetch_add_explicit(total_matches, 1, memory_order_relaxed);
-
-        if (idx < config.max_results) {
+        uint idx = out_idx + count;
+        if (emit && idx < config.max_results) {
             results[idx].start = line_start + match_start;
             results[idx].end = line_start + match_end;
             results[idx].line_start = line_start;
             results[idx].flags = 1;
-            results[idx].line_num = config.line_offset + gid + 1;
+            results[idx].line_num = line_num;
         }
+        count++;
 
         // Move past this match to find the next one
         search_pos = (match_end > match_start) ? match_end : match_start + 1;
     }
+    return count;
+}
+
+kernel void regex_search_lines(
+    device const uchar* text [[buffer(0)]],
+    constant RegexState* states [[buffer(1)]],
+    constant uint* bitmaps [[buffer(2)]],
+    constant RegexSearchConfig& config [[buffer(3)]],
+    constant RegexHeader& header [[buffer(4)]],
+    device RegexMatchOutput* results [[buffer(5)]],
+    device atomic_uint* result_count [[buffer(6)]],
+    device atomic_uint* total_matches [[buffer(7)]],
+    device const uint* line_offsets [[buffer(8)]],
+    device const uint* line_lengths [[buffer(9)]],
+    device uint* thread_offsets [[buffer(10)]],
+    device uint* group_offsets [[buffer(11)]],
+    constant PassConfig& pass [[buffer(12)]],
+    device atomic_uint* line_bits [[buffer(13)]],
+    uint gid [[thread_position_in_grid]],
+    uint num_lines [[threads_per_grid]],
+    uint lid [[thread_position_in_threadgroup]],
+    uint tgid [[threadgroup_position_in_grid]],
+    uint tg_size [[threads_per_threadgroup]]
+) {
+    threadgroup uint scan_values[MAX_GROUP_THREADS];
+    threadgroup uint scan_total;
+
+    if (pass.pass == PASS_SCAN) {
+        scan_group_offsets(group_offsets, result_count, total_matches, pass.num_groups, scan_values, &scan_total, lid, tg_size);
+        return;
+    }
+
+    uint line_start = line_offsets[gid];
+    uint line_len = line_lengths[gid];
+    uint line_num = config.line_offset + gid + 1;
+
+    if (pass.pass == PASS_LINES) {
+        uint match_start, match_end;
+        if (regex_find(&header, states, bitmaps, text + line_start, line_len, 0, &match_start, &match_end)) {
+            mark_line(line_bits, line_start);
+        }
+        return;
+    }
+
+    if (pass.pass == PASS_COUNT) {
+        uint count = regex_line_matches(text, states, bitmaps, config, header, results, line_start, line_len, line_num, false, 0);
+        uint group_threads = min(tg_size, num_lines - tgid * tg_size);
+        thread_offsets[gid] = threadgroup_exclusive_scan(scan_values, &scan_total, count, lid, group_threads);
+        if (lid == 0) group_offsets[tgid] = scan_total;
+        return;
+    }
+
+    regex_line_matches(text, states, bitmaps, config, header, results, line_start, line_len, line_num, true, group_offsets[tgid] + thread_offsets[gid]);
 }
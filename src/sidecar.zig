@@ -0,0 +1,608 @@
+const std = @import("std");
+const gpu = @import("gpu");
+const input = @import("input.zig");
+const timerange = @import("timerange.zig");
+
+// ============================================================================
+// Sidecar block index (FILE.grepidx)
+//
+// Large, mostly-static files are split into ~1MB blocks that end on a line
+// boundary. Each block records its first line number, the first and last
+// timestamp it carries, and a bloom filter of the lowercased byte trigrams it
+// contains. A search consults the index first and only maps and scans the
+// blocks that can possibly hold a match.
+//
+// Layout (little endian):
+//   header (64 bytes) | time format (padded to 8) | block metadata | blooms
+// ============================================================================
+
+pub const SUFFIX = ".grepidx";
+pub const BLOCK_SIZE: usize = 1024 * 1024;
+pub const BLOOM_BYTES: usize = BLOOM_BITS / 8; // 64KB per block
+
+const MAGIC = "GRPIDX01";
+const VERSION: u32 = 1;
+const HEADER_SIZE: usize = 64;
+const META_SIZE: usize = 40;
+const BLOOM_LOG2 = 19;
+const BLOOM_BITS: u32 = 1 << BLOOM_LOG2;
+const BLOOM_SHIFT: u5 = 32 - BLOOM_LOG2;
+
+/// Metadata for one indexed block
+pub const Block = struct {
+    offset: u64,
+    len: u32,
+    first_line: u64, // number of lines before the block
+    min_ts: i64 = std.math.maxInt(i64), // first timestamp in the block (maxInt if none)
+    max_ts: i64 = std.math.minInt(i64), // last timestamp in the block (minInt if none)
+
+    fn hasTimestamps(self: Block) bool {
+        return self.min_ts <= self.max_ts;
+    }
+};
+
+/// Byte range of the data file to search, with the line count preceding it
+pub const Run = struct {
+    start: usize,
+    end: usize,
+    first_line: u64,
+};
+
+// ----------------------------------------------------------------------------
+// Bloom filter over lowercased trigrams
+// ----------------------------------------------------------------------------
+
+inline fn trigramAt(bytes: []const u8, i: usize) u32 {
+    return @as(u32, std.ascii.toLower(bytes[i])) << 16 |
+        @as(u32, std.ascii.toLower(bytes[i + 1])) << 8 |
+        @as(u32, std.ascii.toLower(bytes[i + 2]));
+}
+
+/// Three bit positions per trigram (double hashing on the high product bits)
+inline fn bloomBits(trigram: u32) [3]u32 {
+    const h1 = (trigram *% 0x9E3779B1) >> BLOOM_SHIFT;
+    const h2 = ((trigram *% 0x85EBCA77) >> BLOOM_SHIFT) | 1;
+    return .{ h1, (h1 +% h2) & (BLOOM_BITS - 1), (h1 +% 2 *% h2) & (BLOOM_BITS - 1) };
+}
+
+fn bloomAddBlock(bloom: []u8, bytes: []const u8) void {
+    if (bytes.len < 3) return;
+    var i: usize = 0;
+    while (i + 3 <= bytes.len) : (i += 1) {
+        for (bloomBits(trigramAt(bytes, i))) |bit| {
+            bloom[bit >> 3] |= @as(u8, 1) << @intCast(bit & 7);
+        }
+    }
+}
+
+fn bloomHasAll(bloom: []const u8, trigrams: []const u32) bool {
+    for (trigrams) |t| {
+        for (bloomBits(t)) |bit| {
+            if (bloom[bit >> 3] & (@as(u8, 1) << @intCast(bit & 7)) == 0) return false;
+        }
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Loading
+// ----------------------------------------------------------------------------
+
+pub const Index = struct {
+    mapped: input.MappedFile,
+    indexed_size: u64,
+    mtime: i64,
+    time_format: []const u8,
+    block_count: usize,
+    metas: []const u8,
+    blooms: []const u8,
+
+    pub fn load(allocator: std.mem.Allocator, index_path: []const u8) !Index {
+        const file = try std.fs.cwd().openFile(index_path, .{});
+        defer file.close();
+        const stat = try file.stat();
+        var mapped = try input.MappedFile.init(allocator, file, stat.size, .partial);
+        errdefer mapped.deinit();
+
+        const data = mapped.data;
+        if (data.len < HEADER_SIZE or !std.mem.eql(u8, data[0..8], MAGIC)) return error.InvalidIndex;
+        if (readInt(u32, data, 8) != VERSION or
+            readInt(u32, data, 12) != BLOCK_SIZE or
+            readInt(u32, data, 16) != BLOOM_BYTES) return error.InvalidIndex;
+
+        // Sizes come from the file: a corrupt count must not wrap around
+        const fmt_len = readInt(u32, data, 20);
+        const block_count = std.math.cast(usize, readInt(u64, data, 40)) orelse return error.InvalidIndex;
+        const metas_start = HEADER_SIZE + std.mem.alignForward(usize, fmt_len, 8);
+        const metas_len = std.math.mul(usize, block_count, META_SIZE) catch return error.InvalidIndex;
+        const blooms_len = std.math.mul(usize, block_count, BLOOM_BYTES) catch return error.InvalidIndex;
+        const blooms_start = std.math.add(usize, metas_start, metas_len) catch return error.InvalidIndex;
+        const end = std.math.add(usize, blooms_start, blooms_len) catch return error.InvalidIndex;
+        if (data.len != end) return error.InvalidIndex;
+
+        const index = Index{
+            .mapped = mapped,
+            .indexed_size = readInt(u64, data, 24),
+            .mtime = @bitCast(readInt(u64, data, 32)),
+            .time_format = data[HEADER_SIZE .. HEADER_SIZE + fmt_len],
+            .block_count = block_count,
+            .metas = data[metas_start..blooms_start],
+            .blooms = data[blooms_start..],
+        };
+        if (!index.validBlocks()) return error.InvalidIndex;
+        return index;
+    }
+
+    /// Blocks tile [0, indexed_size) in order, and first_line only grows,
+    /// by at most one line per byte
+    fn validBlocks(self: *const Index) bool {
+        var offset: u64 = 0;
+        var line: u64 = 0;
+        for (0..self.block_count) |i| {
+            const b = self.block(i);
+            if (b.offset != offset or b.len == 0 or b.first_line < line or b.first_line > offset) return false;
+            offset += b.len;
+            if (offset > self.indexed_size) return false;
+            line = b.first_line;
+        }
+        return offset == self.indexed_size;
+    }
+
+    pub fn deinit(self: *Index) void {
+        self.mapped.deinit();
+    }
+
+    /// The index describes exactly this version of the data file
+    pub fn isFresh(self: *const Index, size: u64, mtime: i128) bool {
+        return self.indexed_size == size and self.mtime == truncateMtime(mtime);
+    }
+
+    pub fn block(self: *const Index, i: usize) Block {
+        const m = self.metas[i * META_SIZE ..][0..META_SIZE];
+        return .{
+            .offset = readInt(u64, m, 0),
+            .len = readInt(u32, m, 8),
+            .first_line = readInt(u64, m, 16),
+            .min_ts = @bitCast(readInt(u64, m, 24)),
+            .max_ts = @bitCast(readInt(u64, m, 32)),
+        };
+    }
+
+    /// Lines before `offset` of the indexed file `data`: the first_line of
+    /// the block holding `offset` plus the lines before it in that block
+    pub fn lineAt(self: *const Index, data: []const u8, offset: usize) u64 {
+        if (self.block_count == 0) return input.countNewlines(data[0..offset]);
+        var lo: usize = 0;
+        var hi: usize = self.block_count;
+        while (lo + 1 < hi) {
+            const mid = (lo + hi) / 2;
+            if (self.block(mid).offset <= offset) lo = mid else hi = mid;
+        }
+        const b = self.block(lo);
+        return b.first_line + input.countNewlines(data[@intCast(b.offset)..offset]);
+    }
+
+    pub fn bloom(self: *const Index, i: usize) []const u8 {
+        return self.blooms[i * BLOOM_BYTES ..][0..BLOOM_BYTES];
+    }
+
+    /// Merge the blocks that may contain a match into runs, restricted to
+    /// [window.start, window.end) of the data file.
+    pub fn candidateRuns(self: *const Index, allocator: std.mem.Allocator, data: []const u8, query: ?*const Query, window: timerange.Window) ![]Run {
+        var runs: std.ArrayListUnmanaged(Run) = .{};
+        errdefer runs.deinit(allocator);
+
+        for (0..self.block_count) |i| {
+            const b = self.block(i);
+            const start: usize = @intCast(b.offset);
+            const end = start + b.len;
+            if (end <= window.start or start >= window.end) continue;
+            if (query) |q| {
+                if (!q.mayMatch(self.bloom(i))) continue;
+            }
+
+            const clipped_start = @max(start, window.start);
+            const clipped_end = @min(end, window.end);
+            if (runs.items.len > 0 and runs.items[runs.items.len - 1].end == clipped_start) {
+                runs.items[runs.items.len - 1].end = clipped_end;
+            } else {
+                const skipped_lines = input.countNewlines(data[start..clipped_start]);
+                try runs.append(allocator, .{ .start = clipped_start, .end = clipped_end, .first_line = b.first_line + skipped_lines });
+            }
+        }
+        return runs.toOwnedSlice(allocator);
+    }
+
+    /// Narrow the byte span worth binary-searching for a time window using
+    /// the per-block first/last timestamps (blocks entirely outside are dropped)
+    pub fn timeSpan(self: *const Index, range: *const timerange.TimeRange, data_len: usize) timerange.Window {
+        var first: usize = 0;
+        if (range.since) |since| {
+            while (first < self.block_count) : (first += 1) {
+                const b = self.block(first);
+                if (!b.hasTimestamps() or b.max_ts >= since) break;
+            }
+        }
+        var last: usize = self.block_count;
+        if (range.until) |until| {
+            while (last > first) : (last -= 1) {
+                const b = self.block(last - 1);
+                if (!b.hasTimestamps() or b.min_ts < until) break;
+            }
+        }
+        if (first >= last) return .{ .start = data_len, .end = data_len };
+        const start: usize = @intCast(self.block(first).offset);
+        const end_block = self.block(last - 1);
+        return .{ .start = start, .end = @as(usize, @intCast(end_block.offset)) + end_block.len };
+    }
+};
+
+fn readInt(comptime T: type, bytes: []const u8, offset: usize) T {
+    return std.mem.readInt(T, bytes[offset..][0..@sizeOf(T)], .little);
+}
+
+fn truncateMtime(mtime: i128) i64 {
+    return @truncate(mtime);
+}
+
+// ----------------------------------------------------------------------------
+// Query: which trigrams every match must contain
+// ----------------------------------------------------------------------------
+
+pub const Query = struct {
+    /// One trigram list per pattern; a block is a candidate if any list is fully present
+    alternatives: []const []const u32,
+    allocator: std.mem.Allocator,
+
+    /// Returns null when some pattern has no required literal of 3+ bytes,
+    /// in which case every block is a candidate.
+    pub fn init(allocator: std.mem.Allocator, patterns: []const []const u8, options: gpu.SearchOptions) !?Query {
+        if (options.invert_match) return null;
+
+        var alternatives: std.ArrayListUnmanaged([]const u32) = .{};
+        errdefer {
+            for (alternatives.items) |a| allocator.free(a);
+            alternatives.deinit(allocator);
+        }
+        for (patterns) |pattern| {
+            const literal = requiredLiteral(pattern, options) orelse {
+                for (alternatives.items) |a| allocator.free(a);
+                alternatives.deinit(allocator);
+                return null;
+            };
+            const trigrams = try allocator.alloc(u32, literal.len - 2);
+            for (trigrams, 0..) |*t, i| t.* = trigramAt(literal, i);
+            try alternatives.append(allocator, trigrams);
+        }
+        return .{ .alternatives = try alternatives.toOwnedSlice(allocator), .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Query) void {
+        for (self.alternatives) |a| self.allocator.free(a);
+        self.allocator.free(self.alternatives);
+    }
+
+    fn mayMatch(self: *const Query, block_bloom: []const u8) bool {
+        for (self.alternatives) |trigrams| {
+            if (bloomHasAll(block_bloom, trigrams)) return true;
+        }
+        return false;
+    }
+};
+
+/// Longest run of plain literal bytes that every match of `pattern` must
+/// contain, or null if there is none of at least 3 bytes. Conservative:
+/// alternation disables extraction, and groups, bracket expressions, escapes
+/// and optional (?, *, {) atoms all end a run.
+pub fn requiredLiteral(pattern: []const u8, options: gpu.SearchOptions) ?[]const u8 {
+    var best: ?[]const u8 = null;
+    if (options.fixed_string) {
+        best = pattern;
+    } else {
+        const bre = !options.extended and !options.perl;
+        var run_start: usize = 0;
+        var depth: usize = 0;
+        var i: usize = 0;
+        while (i <= pattern.len) {
+            const at_end = i == pattern.len;
+            const c: u8 = if (at_end) 0 else pattern[i];
+            const next: u8 = if (i + 1 < pattern.len) pattern[i + 1] else 0;
+
+            // Does pattern[i] continue a literal run?
+            var literal = !at_end and depth == 0;
+            var skip: usize = 1;
+            if (!at_end) switch (c) {
+                '\\' => {
+                    literal = false;
+                    skip = 2;
+                    if (next == '|') return null;
+                    if (bre and next == '(') depth += 1;
+                    if (bre and next == ')' and depth > 0) depth -= 1;
+                },
+                '|' => if (!bre) return null,
+                '(' => if (!bre) {
+                    literal = false;
+                    depth += 1;
+                },
+                ')' => if (!bre) {
+                    literal = false;
+                    if (depth > 0) depth -= 1;
+                },
+                '[' => {
+                    literal = false;
+                    skip = bracketLen(pattern[i..]);
+                },
+                '.', '^', '$', '*' => literal = false,
+                '+', '?', '{', '}' => if (!bre) {
+                    literal = false;
+                },
+                else => {},
+            };
+
+            // An atom followed by an optional quantifier is not required
+            const quantified = switch (next) {
+                '*' => true,
+                '?', '{' => !bre,
+                '\\' => bre and i + 2 < pattern.len and (pattern[i + 2] == '?' or pattern[i + 2] == '{'),
+                else => false,
+            };
+
+            if (!literal or quantified) {
+                if (i > run_start) {
+                    const run = pattern[run_start..i];
+                    if (best == null or run.len > best.?.len) best = run;
+                }
+                run_start = i + skip;
+            }
+            i += skip;
+        }
+    }
+
+    const lit = best orelse return null;
+    if (lit.len < 3) return null;
+    // The index folds ASCII only; other bytes have case variants it cannot see
+    if (options.case_insensitive) {
+        for (lit) |c| if (c >= 0x80) return null;
+    }
+    return lit;
+}
+
+/// Length of a bracket expression starting at `s[0] == '['`
+fn bracketLen(s: []const u8) usize {
+    var i: usize = 1;
+    if (i < s.len and s[i] == '^') i += 1;
+    if (i < s.len and s[i] == ']') i += 1;
+    while (i < s.len and s[i] != ']') : (i += 1) {
+        if (s[i] == '[' and i + 1 < s.len and (s[i + 1] == ':' or s[i + 1] == '.' or s[i + 1] == '=')) {
+            const close = std.mem.indexOfPos(u8, s, i + 2, &.{ s[i + 1], ']' }) orelse return s.len;
+            i = close + 1;
+        }
+    }
+    return @min(i + 1, s.len);
+}
+
+// ----------------------------------------------------------------------------
+// Building
+// ----------------------------------------------------------------------------
+
+pub const BuildStats = struct {
+    blocks: usize,
+    reused: usize,
+};
+
+/// Split `data[offset..]` into line-aligned blocks of about BLOCK_SIZE bytes
+fn nextBlockEnd(data: []const u8, offset: usize) usize {
+    const limit = @min(offset + BLOCK_SIZE, data.len);
+    if (limit == data.len) return data.len;
+    if (std.mem.lastIndexOfScalar(u8, data[offset..limit], '\n')) |nl| return offset + nl + 1;
+    // A single line longer than a block: extend to its end
+    const nl = std.mem.indexOfScalarPos(u8, data, limit, '\n') orelse return data.len;
+    return nl + 1;
+}
+
+fn blockTimestamps(format: timerange.Format, bytes: []const u8) struct { min: i64, max: i64 } {
+    // Logs are time-ordered: the first and last stamped lines bound the block
+    var min: i64 = std.math.maxInt(i64);
+    var max: i64 = std.math.minInt(i64);
+    var start: usize = 0;
+    while (start < bytes.len) {
+        const end = std.mem.indexOfScalarPos(u8, bytes, start, '\n') orelse bytes.len;
+        if (format.find(bytes[start..end])) |f| {
+            min = f.toSeconds();
+            break;
+        }
+        start = end + 1;
+    }
+    if (min == std.math.maxInt(i64)) return .{ .min = min, .max = max };
+    var end = bytes.len;
+    while (end > 0) {
+        if (bytes[end - 1] == '\n') end -= 1;
+        const line_start = if (std.mem.lastIndexOfScalar(u8, bytes[0..end], '\n')) |nl| nl + 1 else 0;
+        if (format.find(bytes[line_start..end])) |f| {
+            max = f.toSeconds();
+            break;
+        }
+        end = line_start;
+    }
+    return .{ .min = min, .max = max };
+}
+
+/// Build or incrementally extend the sidecar index for `path`. Blocks of a
+/// fresh-but-shorter index are kept when the file has only been appended to.
+pub fn build(allocator: std.mem.Allocator, path: []const u8, format: timerange.Format) !BuildStats {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    const stat = try file.stat();
+    var mapped = try input.MappedFile.init(allocator, file, stat.size, .partial);
+    defer mapped.deinit();
+    const data = mapped.data;
+
+    const index_path = try std.mem.concat(allocator, u8, &.{ path, SUFFIX });
+    defer allocator.free(index_path);
+
+    var blocks: std.ArrayListUnmanaged(Block) = .{};
+    defer blocks.deinit(allocator);
+    var blooms: std.ArrayListUnmanaged(u8) = .{};
+    defer blooms.deinit(allocator);
+
+    // Reuse the blocks of an older index if the file only grew
+    var old = Index.load(allocator, index_path) catch null;
+    defer if (old) |*o| o.deinit();
+    if (old) |*o| {
+        const same_format = std.mem.eql(u8, o.time_format, format.spec);
+        if (same_format and o.isFresh(stat.size, stat.mtime)) {
+            return .{ .blocks = o.block_count, .reused = o.block_count };
+        }
+        // Same size with a new mtime means rewritten, not appended
+        const appended = same_format and o.indexed_size < data.len;
+        if (appended) {
+            for (0..o.block_count) |i| {
+                const b = o.block(i);
+                const end: usize = @intCast(b.offset + b.len);
+                // A trailing block without a final newline may have been extended
+                if (end == o.indexed_size and end > 0 and data[end - 1] != '\n') break;
+                if (end > data.len or (end < data.len and data[end - 1] != '\n')) break;
+                try blocks.append(allocator, b);
+                try blooms.appendSlice(allocator, o.bloom(i));
+            }
+        }
+    }
+    const reused = blocks.items.len;
+
+    var offset: usize = 0;
+    var line: u64 = 0;
+    if (blocks.items.len > 0) {
+        const last = blocks.items[blocks.items.len - 1];
+        offset = @intCast(last.offset + last.len);
+        line = last.first_line + input.countNewlines(data[@intCast(last.offset)..offset]);
+    }
+    while (offset < data.len) {
+        const end = nextBlockEnd(data, offset);
+        const bytes = data[offset..end];
+        const ts = blockTimestamps(format, bytes);
+        try blocks.append(allocator, .{
+            .offset = offset,
+            .len = @intCast(bytes.len),
+            .first_line = line,
+            .min_ts = ts.min,
+            .max_ts = ts.max,
+        });
+        const bloom_start = blooms.items.len;
+        try blooms.appendNTimes(allocator, 0, BLOOM_BYTES);
+        bloomAddBlock(blooms.items[bloom_start..], bytes);
+        line += input.countNewlines(bytes);
+        offset = end;
+    }
+
+    try writeIndex(allocator, index_path, stat.size, stat.mtime, format.spec, blocks.items, blooms.items);
+    return .{ .blocks = blocks.items.len, .reused = reused };
+}
+
+fn writeIndex(allocator: std.mem.Allocator, index_path: []const u8, size: u64, mtime: i128, time_format: []const u8, blocks: []const Block, blooms: []const u8) !void {
+    var header = [_]u8{0} ** HEADER_SIZE;
+    @memcpy(header[0..8], MAGIC);
+    std.mem.writeInt(u32, header[8..12], VERSION, .little);
+    std.mem.writeInt(u32, header[12..16], BLOCK_SIZE, .little);
+    std.mem.writeInt(u32, header[16..20], BLOOM_BYTES, .little);
+    std.mem.writeInt(u32, header[20..24], @intCast(time_format.len), .little);
+    std.mem.writeInt(u64, header[24..32], size, .little);
+    std.mem.writeInt(u64, header[32..40], @bitCast(truncateMtime(mtime)), .little);
+    std.mem.writeInt(u64, header[40..48], blocks.len, .little);
+
+    const metas = try allocator.alloc(u8, blocks.len * META_SIZE);
+    defer allocator.free(metas);
+    @memset(metas, 0);
+    for (blocks, 0..) |b, i| {
+        const m = metas[i * META_SIZE ..][0..META_SIZE];
+        std.mem.writeInt(u64, m[0..8], b.offset, .little);
+        std.mem.writeInt(u32, m[8..12], b.len, .little);
+        std.mem.writeInt(u64, m[16..24], b.first_line, .little);
+        std.mem.writeInt(u64, m[24..32], @bitCast(b.min_ts), .little);
+        std.mem.writeInt(u64, m[32..40], @bitCast(b.max_ts), .little);
+    }
+    const padding = [_]u8{0} ** 8;
+    const pad_len = std.mem.alignForward(usize, time_format.len, 8) - time_format.len;
+
+    // Write to a temporary file and rename so readers never see a partial index
+    const tmp_path = try std.mem.concat(allocator, u8, &.{ index_path, ".tmp" });
+    defer allocator.free(tmp_path);
+    {
+        const out = try std.fs.cwd().createFile(tmp_path, .{});
+        defer out.close();
+        try out.writeAll(&header);
+        try out.writeAll(time_format);
+        try out.writeAll(padding[0..pad_len]);
+        try out.writeAll(metas);
+        try out.writeAll(blooms);
+    }
+    try std.fs.cwd().rename(tmp_path, index_path);
+}
+
+test "sidecar: required literal extraction" {
+    const ere = gpu.SearchOptions{ .fixed_string = false, .extended = true };
+    try std.testing.expectEqualStrings("timeout", requiredLiteral("timeout", .{}).?);
+    try std.testing.expectEqualStrings("connection ", requiredLiteral("connection [0-9]+ refused", ere).?);
+    try std.testing.expectEqualStrings("error: ", requiredLiteral("^error: x?y", ere).?);
+    try std.testing.expect(requiredLiteral("foo|barbaz", ere) == null);
+    try std.testing.expect(requiredLiteral("(abc)*", ere) == null);
+    try std.testing.expect(requiredLiteral("ab", .{}) == null);
+    // BRE: '+' is a literal, '\|' alternates
+    const bre = gpu.SearchOptions{ .fixed_string = false };
+    try std.testing.expectEqualStrings("a+b", requiredLiteral("a+b", bre).?);
+    try std.testing.expect(requiredLiteral("abc\\|def", bre) == null);
+}
+
+test "sidecar: bloom filter has no false negatives" {
+    const bloom = try std.testing.allocator.alloc(u8, BLOOM_BYTES);
+    defer std.testing.allocator.free(bloom);
+    @memset(bloom, 0);
+    bloomAddBlock(bloom, "Connection REFUSED by peer\n");
+    const hit = [_]u32{ trigramAt("ref", 0), trigramAt("use", 0) };
+    try std.testing.expect(bloomHasAll(bloom, &hit));
+    const miss = [_]u32{ trigramAt("zqx", 0), trigramAt("qxj", 0) };
+    try std.testing.expect(!bloomHasAll(bloom, &miss));
+}
+
+test "sidecar: corrupt block metadata is rejected" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const dir = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir);
+    const path = try std.fs.path.join(allocator, &.{ dir, "data.log" ++ SUFFIX });
+    defer allocator.free(path);
+
+    const blooms = try allocator.alloc(u8, 2 * BLOOM_BYTES);
+    defer allocator.free(blooms);
+    @memset(blooms, 0);
+    const good = [_]Block{
+        .{ .offset = 0, .len = 100, .first_line = 0 },
+        .{ .offset = 100, .len = 50, .first_line = 7 },
+    };
+    try writeIndex(allocator, path, 150, 0, "", &good, blooms);
+    var index = try Index.load(allocator, path);
+    // 100 bytes holding 7 lines, then the second block
+    const data = ("x\n" ** 7) ++ ("y" ** 86) ++ ("z\n" ** 25);
+    try std.testing.expectEqual(@as(u64, 7), index.lineAt(data, 100));
+    try std.testing.expectEqual(@as(u64, 9), index.lineAt(data, 104));
+    try std.testing.expectEqual(@as(u64, 3), index.lineAt(data, 6));
+    index.deinit();
+
+    const corrupt = [_][2]Block{
+        .{ good[0], .{ .offset = 90, .len = 60, .first_line = 7 } }, // overlapping
+        .{ good[0], .{ .offset = 100, .len = 80, .first_line = 7 } }, // past indexed_size
+        .{ .{ .offset = 0, .len = 100, .first_line = 9 }, good[1] }, // lines going back
+    };
+    for (corrupt) |blocks| {
+        try writeIndex(allocator, path, 150, 0, "", &blocks, blooms);
+        try std.testing.expectError(error.InvalidIndex, Index.load(allocator, path));
+    }
+
+    // A block count whose table size wraps around
+    const file = try std.fs.cwd().openFile(path, .{ .mode = .read_write });
+    defer file.close();
+    var count: [8]u8 = undefined;
+    std.mem.writeInt(u64, &count, std.math.maxInt(u64) / META_SIZE + 2, .little);
+    try file.pwriteAll(&count, 40);
+    try std.testing.expectError(error.InvalidIndex, Index.load(allocator, path));
+}
@@ -0,0 +1,122 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+// ============================================================================
+// Run statistics (--stats)
+//
+// Counters shared by every worker of a run, printed to stderr at exit. They
+// describe how the input was read (bytes searched, how much of the mapped
+// input ended up on huge pages, what was prefaulted) rather than what
+// matched, for comparing runs of the benchmark suite.
+// ============================================================================
+
+pub const Stats = struct {
+    timer: std.time.Timer,
+    inputs: std.atomic.Value(u64) = .init(0),
+    bytes_searched: std.atomic.Value(u64) = .init(0),
+    mapped_bytes: std.atomic.Value(u64) = .init(0), // file mappings sampled for page sizes
+    huge_bytes: std.atomic.Value(u64) = .init(0), // of which backed by huge pages
+    prefetched_bytes: std.atomic.Value(u64) = .init(0), // MADV_WILLNEED ahead of the scan
+    numa_nodes: std.atomic.Value(u64) = .init(0), // nodes used by parallel segment search
+    node_pages: std.atomic.Value(u64) = .init(0), // input pages sampled for placement
+    remote_pages: std.atomic.Value(u64) = .init(0), // of which on another node than their reader
+
+    pub fn init() Stats {
+        return .{ .timer = std.time.Timer.start() catch unreachable };
+    }
+
+    pub fn addInput(self: *Stats, len: usize) void {
+        _ = self.inputs.fetchAdd(1, .monotonic);
+        _ = self.bytes_searched.fetchAdd(len, .monotonic);
+    }
+
+    pub fn addPrefetch(self: *Stats, len: usize) void {
+        _ = self.prefetched_bytes.fetchAdd(len, .monotonic);
+    }
+
+    /// Record where a segment's sampled pages were placed
+    pub fn addPlacement(self: *Stats, nodes: usize, sampled: u64, remote: u64) void {
+        _ = self.numa_nodes.fetchMax(nodes, .monotonic);
+        _ = self.node_pages.fetchAdd(sampled, .monotonic);
+        _ = self.remote_pages.fetchAdd(remote, .monotonic);
+    }
+
+    /// Record how much of `mapping` the kernel backs with huge pages
+    pub fn sampleMapping(self: *Stats, mapping: []const u8) void {
+        _ = self.mapped_bytes.fetchAdd(mapping.len, .monotonic);
+        _ = self.huge_bytes.fetchAdd(hugePageBytes(mapping), .monotonic);
+    }
+
+    pub fn print(self: *Stats) void {
+        const elapsed_ns = self.timer.read();
+        const bytes = self.bytes_searched.load(.monotonic);
+        const mb = @as(f64, @floatFromInt(bytes)) / (1024 * 1024);
+        const secs = @as(f64, @floatFromInt(@max(elapsed_ns, 1))) / std.time.ns_per_s;
+        std.debug.print("Stats: {d} inputs, {d:.1} MB searched in {d:.3}s ({d:.1} MB/s)\n", .{
+            self.inputs.load(.monotonic), mb, secs, mb / secs,
+        });
+
+        const mapped = self.mapped_bytes.load(.monotonic);
+        const huge = self.huge_bytes.load(.monotonic);
+        const pct = if (mapped > 0) @as(f64, @floatFromInt(huge)) * 100 / @as(f64, @floatFromInt(mapped)) else 0;
+        std.debug.print("Huge pages: {d} KB of {d} KB mapped ({d:.1}%), {d} KB prefetched\n", .{
+            huge / 1024, mapped / 1024, pct, self.prefetched_bytes.load(.monotonic) / 1024,
+        });
+
+        const sampled = self.node_pages.load(.monotonic);
+        if (sampled > 0) {
+            const remote = self.remote_pages.load(.monotonic);
+            std.debug.print("NUMA: {d} nodes, {d} of {d} sampled pages read across nodes ({d:.1}%)\n", .{
+                self.numa_nodes.load(.monotonic), remote, sampled,
+                @as(f64, @floatFromInt(remote)) * 100 / @as(f64, @floatFromInt(sampled)),
+            });
+        }
+    }
+};
+
+/// Bytes of the mapping containing `region` that sit on huge pages, read
+/// from /proc/self/smaps (AnonHugePages for copies, FilePmdMapped for file
+/// pages); 0 where smaps is unavailable
+fn hugePageBytes(region: []const u8) u64 {
+    if (builtin.os.tag != .linux or region.len == 0) return 0;
+    const file = std.fs.openFileAbsolute("/proc/self/smaps", .{}) catch return 0;
+    defer file.close();
+
+    var buf: [4096]u8 = undefined;
+    var reader = file.reader(&buf);
+    const addr = @intFromPtr(region.ptr);
+    var inside = false;
+    var total: u64 = 0;
+    while (reader.interface.takeDelimiterInclusive('\n')) |full_line| {
+        const line = full_line[0 .. full_line.len - 1];
+        // Mapping headers start with "lo-hi "; field lines with a name
+        if (parseRange(line)) |range| {
+            if (inside) break;
+            inside = addr >= range.lo and addr < range.hi;
+            continue;
+        }
+        if (!inside) continue;
+        if (std.mem.startsWith(u8, line, "AnonHugePages:") or std.mem.startsWith(u8, line, "FilePmdMapped:")) {
+            var words = std.mem.tokenizeScalar(u8, line, ' ');
+            _ = words.next();
+            const kb = std.fmt.parseInt(u64, words.next() orelse "0", 10) catch 0;
+            total += kb * 1024;
+        }
+    } else |_| {}
+    return @min(total, region.len);
+}
+
+fn parseRange(line: []const u8) ?struct { lo: usize, hi: usize } {
+    const dash = std.mem.indexOfScalar(u8, line, '-') orelse return null;
+    const space = std.mem.indexOfScalarPos(u8, line, dash, ' ') orelse return null;
+    const lo = std.fmt.parseInt(usize, line[0..dash], 16) catch return null;
+    const hi = std.fmt.parseInt(usize, line[dash + 1 .. space], 16) catch return null;
+    return .{ .lo = lo, .hi = hi };
+}
+
+test "stats: smaps mapping headers" {
+    const range = parseRange("7f2a4c000000-7f2a4e000000 r--p 00000000 08:01 1234 /var/log/big.log").?;
+    try std.testing.expectEqual(@as(usize, 0x7f2a4c000000), range.lo);
+    try std.testing.expectEqual(@as(usize, 0x7f2a4e000000), range.hi);
+    try std.testing.expect(parseRange("AnonHugePages:      2048 kB") == null);
+}
@@ -0,0 +1,310 @@
+const std = @import("std");
+
+// ============================================================================
+// Timestamp windows (--since / --until)
+//
+// Log files are written in time order, so the byte range holding a time
+// window can be found with O(log n) probes of line starts instead of a full
+// scan. Only the bytes inside the window are handed to the search engines.
+// ============================================================================
+
+/// Default timestamp layout (ISO 8601; the date/time separator may be ' ' or 'T')
+pub const DEFAULT_FORMAT = "%Y-%m-%d %H:%M:%S";
+
+/// How far into a line the timestamp may start (skips "[", log levels, hosts)
+pub const MAX_STAMP_OFFSET: usize = 64;
+
+const MONTH_NAMES = [_][]const u8{ "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec" };
+
+/// Calendar fields parsed from a timestamp; fields absent from the text stay null
+pub const Fields = struct {
+    year: ?i64 = null,
+    month: ?i64 = null,
+    day: ?i64 = null,
+    hour: ?i64 = null,
+    minute: ?i64 = null,
+    second: ?i64 = null,
+
+    /// Seconds on a proleptic Gregorian timeline; missing fields take their minimum
+    pub fn toSeconds(self: Fields) i64 {
+        var year = self.year orelse 0;
+        var month = self.month orelse 1;
+        // Month may have been bumped past December by roundUp()
+        year += @divFloor(month - 1, 12);
+        month = @mod(month - 1, 12) + 1;
+        const days = daysFromCivil(year, month, self.day orelse 1);
+        return days * 86400 + (self.hour orelse 0) * 3600 + (self.minute orelse 0) * 60 + (self.second orelse 0);
+    }
+
+    /// Advance the least significant field that was specified by one unit, so
+    /// that "--until=2024-05-01" covers the whole of May 1st.
+    pub fn roundUp(self: Fields) Fields {
+        var next = self;
+        if (next.second) |s| {
+            next.second = s + 1;
+        } else if (next.minute) |m| {
+            next.minute = m + 1;
+        } else if (next.hour) |h| {
+            next.hour = h + 1;
+        } else if (next.day) |d| {
+            next.day = d + 1;
+        } else if (next.month) |m| {
+            next.month = m + 1;
+        } else if (next.year) |y| {
+            next.year = y + 1;
+        }
+        return next;
+    }
+};
+
+/// Days since 1970-01-01 for a civil date (Howard Hinnant's algorithm)
+fn daysFromCivil(year: i64, month: i64, day: i64) i64 {
+    const y = if (month <= 2) year - 1 else year;
+    const era = @divFloor(y, 400);
+    const yoe = y - era * 400;
+    const mp = @mod(month + 9, 12); // March = 0
+    const doy = @divFloor(153 * mp + 2, 5) + day - 1;
+    const doe = yoe * 365 + @divFloor(yoe, 4) - @divFloor(yoe, 100) + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/// strftime-style timestamp layout.
+/// Supported: %Y %m %d %e %H %M %S %b (month name) %f (fraction, ignored) %%.
+/// A ' ' or 'T' in the layout matches either character.
+pub const Format = struct {
+    spec: []const u8 = DEFAULT_FORMAT,
+
+    /// Validate the layout itself (unknown % directives are rejected)
+    pub fn validate(self: Format) !void {
+        var i: usize = 0;
+        while (i < self.spec.len) : (i += 1) {
+            if (self.spec[i] != '%') continue;
+            i += 1;
+            if (i >= self.spec.len) return error.InvalidTimeFormat;
+            switch (self.spec[i]) {
+                'Y', 'm', 'd', 'e', 'H', 'M', 'S', 'b', 'f', '%' => {},
+                else => return error.InvalidTimeFormat,
+            }
+        }
+    }
+
+    /// Parse a timestamp at the start of `text`. With `partial` set the text
+    /// may end before the layout does (bounds such as "2024-05-01 14").
+    pub fn parse(self: Format, text: []const u8, partial: bool) ?Fields {
+        var fields = Fields{};
+        var any = false;
+        var i: usize = 0;
+        var p: usize = 0;
+        while (i < self.spec.len) {
+            if (p >= text.len) {
+                return if (partial and any) fields else null;
+            }
+            const c = self.spec[i];
+            if (c != '%' or i + 1 >= self.spec.len) {
+                const ok = if (c == ' ' or c == 'T') (text[p] == ' ' or text[p] == 'T') else text[p] == c;
+                if (!ok) return null;
+                i += 1;
+                p += 1;
+                continue;
+            }
+            const directive = self.spec[i + 1];
+            i += 2;
+            switch (directive) {
+                'Y' => {
+                    const n = readNumber(text[p..], 4, 4) orelse return null;
+                    fields.year = n.value;
+                    p += n.len;
+                },
+                'm', 'd', 'H', 'M', 'S', 'e' => {
+                    if (directive == 'e' and text[p] == ' ') p += 1;
+                    if (p >= text.len) return if (partial and any) fields else null;
+                    const n = readNumber(text[p..], 1, 2) orelse return null;
+                    switch (directive) {
+                        'm' => fields.month = n.value,
+                        'd', 'e' => fields.day = n.value,
+                        'H' => fields.hour = n.value,
+                        'M' => fields.minute = n.value,
+                        'S' => fields.second = n.value,
+                        else => unreachable,
+                    }
+                    p += n.len;
+                },
+                'b' => {
+                    if (text.len - p < 3) return null;
+                    fields.month = monthFromName(text[p .. p + 3]) orelse return null;
+                    p += 3;
+                },
+                'f' => {
+                    const n = readNumber(text[p..], 1, 9) orelse return null;
+                    p += n.len;
+                },
+                '%' => {
+                    if (text[p] != '%') return null;
+                    p += 1;
+                    continue;
+                },
+                else => return null,
+            }
+            any = true;
+        }
+        return fields;
+    }
+
+    /// Locate and parse the timestamp of one line. The stamp may start within
+    /// the first MAX_STAMP_OFFSET bytes, but not in the middle of a number.
+    pub fn find(self: Format, line: []const u8) ?Fields {
+        const limit = @min(line.len, MAX_STAMP_OFFSET);
+        var offset: usize = 0;
+        while (offset < limit) : (offset += 1) {
+            if (offset > 0 and std.ascii.isDigit(line[offset - 1]) and std.ascii.isDigit(line[offset])) continue;
+            if (self.parse(line[offset..], false)) |fields| return fields;
+        }
+        return null;
+    }
+};
+
+fn readNumber(text: []const u8, min_digits: usize, max_digits: usize) ?struct { value: i64, len: usize } {
+    var value: i64 = 0;
+    var len: usize = 0;
+    while (len < max_digits and len < text.len and std.ascii.isDigit(text[len])) : (len += 1) {
+        value = value * 10 + (text[len] - '0');
+    }
+    if (len < min_digits) return null;
+    return .{ .value = value, .len = len };
+}
+
+fn monthFromName(name: []const u8) ?i64 {
+    for (MONTH_NAMES, 1..) |month, idx| {
+        if (std.ascii.eqlIgnoreCase(name, month)) return @intCast(idx);
+    }
+    return null;
+}
+
+/// Byte range [start, end) of a buffer
+pub const Window = struct {
+    start: usize,
+    end: usize,
+};
+
+/// A --since/--until window over time-ordered, line-oriented input
+pub const TimeRange = struct {
+    format: Format = .{},
+    since: ?i64 = null, // inclusive lower bound (seconds)
+    until: ?i64 = null, // exclusive upper bound (seconds, rounded up to the bound's precision)
+
+    pub fn init(format: Format, since_text: ?[]const u8, until_text: ?[]const u8) !TimeRange {
+        try format.validate();
+        var range = TimeRange{ .format = format };
+        if (since_text) |s| {
+            const fields = format.parse(s, true) orelse return error.InvalidTimestamp;
+            range.since = fields.toSeconds();
+        }
+        if (until_text) |u| {
+            const fields = format.parse(u, true) orelse return error.InvalidTimestamp;
+            range.until = fields.roundUp().toSeconds();
+        }
+        return range;
+    }
+
+    /// Find the lines whose timestamps fall inside the range. Lines without a
+    /// timestamp (continuations, stack traces) travel with the line before them.
+    pub fn locate(self: *const TimeRange, text: []const u8) Window {
+        const start = if (self.since) |since| self.lowerBound(text, since) else 0;
+        const end = if (self.until) |until| self.lowerBound(text, until) else text.len;
+        return .{ .start = start, .end = @max(start, end) };
+    }
+
+    /// Offset of the first timestamped line with a time >= target (text.len if none).
+    /// Binary search over byte offsets: each probe snaps forward to a line start
+    /// and then to the next line that carries a timestamp.
+    pub fn lowerBound(self: *const TimeRange, text: []const u8, target: i64) usize {
+        var lo: usize = 0;
+        var hi: usize = text.len;
+        while (lo < hi) {
+            const mid = lo + (hi - lo) / 2;
+            const probe = self.firstStampedLine(text, lineStartAtOrAfter(text, mid)) orelse {
+                hi = mid;
+                continue;
+            };
+            if (probe.seconds < target) {
+                lo = @min(probe.line_end + 1, text.len);
+            } else {
+                hi = mid;
+            }
+        }
+        const start = lineStartAtOrAfter(text, lo);
+        // Skip leading unstamped lines so the window starts on a real entry
+        if (self.firstStampedLine(text, start)) |probe| return probe.line_start;
+        return text.len;
+    }
+
+    const Probe = struct {
+        seconds: i64,
+        line_start: usize,
+        line_end: usize,
+    };
+
+    fn firstStampedLine(self: *const TimeRange, text: []const u8, from: usize) ?Probe {
+        var line_start = from;
+        while (line_start < text.len) {
+            const line_end = std.mem.indexOfScalarPos(u8, text, line_start, '\n') orelse text.len;
+            if (self.format.find(text[line_start..line_end])) |fields| {
+                return .{ .seconds = fields.toSeconds(), .line_start = line_start, .line_end = line_end };
+            }
+            line_start = line_end + 1;
+        }
+        return null;
+    }
+};
+
+/// Start of the first line beginning at or after `pos`
+fn lineStartAtOrAfter(text: []const u8, pos: usize) usize {
+    if (pos == 0) return 0;
+    if (pos >= text.len) return text.len;
+    const nl = std.mem.indexOfScalarPos(u8, text, pos - 1, '\n') orelse return text.len;
+    return nl + 1;
+}
+
+test "timerange: parse full and partial timestamps" {
+    const fmt = Format{};
+    const full = fmt.parse("2024-05-01T14:30:05 GET /", false).?;
+    try std.testing.expectEqual(@as(?i64, 2024), full.year);
+    try std.testing.expectEqual(@as(?i64, 5), full.second);
+    try std.testing.expect(fmt.parse("2024-05-01", false) == null);
+    const partial = fmt.parse("2024-05-01 14", true).?;
+    try std.testing.expectEqual(@as(?i64, 14), partial.hour);
+    try std.testing.expectEqual(@as(?i64, null), partial.minute);
+
+    const syslog = Format{ .spec = "%b %e %H:%M:%S" };
+    const s = syslog.find("May  1 09:15:00 host sshd[1]: ok").?;
+    try std.testing.expectEqual(@as(?i64, 5), s.month);
+    try std.testing.expectEqual(@as(?i64, 1), s.day);
+}
+
+test "timerange: locate window in ordered log" {
+    const log =
+        "2024-05-01 10:00:00 a\n" ++
+        "2024-05-01 11:00:00 b\n" ++
+        "  continuation of b\n" ++
+        "2024-05-01 12:00:00 c\n" ++
+        "2024-05-02 09:00:00 d\n";
+    const range = try TimeRange.init(.{}, "2024-05-01 11", "2024-05-01 12");
+    const w = range.locate(log);
+    try std.testing.expectEqualStrings(
+        "2024-05-01 11:00:00 b\n  continuation of b\n2024-05-01 12:00:00 c\n",
+        log[w.start..w.end],
+    );
+
+    const day = try TimeRange.init(.{}, "2024-05-02", null);
+    const d = day.locate(log);
+    try std.testing.expectEqualStrings("2024-05-02 09:00:00 d\n", log[d.start..d.end]);
+
+    const empty = try TimeRange.init(.{}, "2025", null);
+    const e = empty.locate(log);
+    try std.testing.expectEqual(e.start, e.end);
+}
+
+test "timerange: rejects bad bounds" {
+    try std.testing.expectError(error.InvalidTimestamp, TimeRange.init(.{}, "yesterday", null));
+    try std.testing.expectError(error.InvalidTimeFormat, TimeRange.init(.{ .spec = "%Q" }, null, null));
+}
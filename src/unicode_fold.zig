@@ -0,0 +1,307 @@
+const std = @import("std");
+const gpu = @import("gpu");
+
+const SearchOptions = gpu.SearchOptions;
+const SearchResult = gpu.SearchResult;
+const MatchResult = gpu.MatchResult;
+
+const Vec32 = @Vector(32, u8);
+
+// ============================================================================
+// Case-insensitive literal search over UTF-8 (Unicode simple case folding)
+//
+// The pattern is folded once. Candidates are found by scanning 32 bytes at a
+// time for any byte that can start the first pattern character in some case
+// variant (for "привет": the lead bytes of п and П), and each candidate is
+// verified by folding the text one code point at a time. Invalid UTF-8 is
+// compared byte for byte.
+// ============================================================================
+
+/// Upper bound on code points sharing one fold (θ Θ ϑ ϴ)
+const MAX_VARIANTS = 6;
+
+/// Raw bytes of invalid UTF-8 map above the code point range
+const RAW_BYTE_BASE: u21 = 0x110000;
+
+/// Runs of uppercase letters that fold to `cp + delta`
+const Shift = struct { lo: u21, hi: u21, delta: u21 };
+const shifts = [_]Shift{
+    .{ .lo = 0x41, .hi = 0x5A, .delta = 32 }, // Basic Latin
+    .{ .lo = 0xC0, .hi = 0xD6, .delta = 32 }, // Latin-1
+    .{ .lo = 0xD8, .hi = 0xDE, .delta = 32 },
+    .{ .lo = 0x386, .hi = 0x386, .delta = 38 }, // Greek with tonos
+    .{ .lo = 0x388, .hi = 0x38A, .delta = 37 },
+    .{ .lo = 0x38C, .hi = 0x38C, .delta = 64 },
+    .{ .lo = 0x38E, .hi = 0x38F, .delta = 63 },
+    .{ .lo = 0x391, .hi = 0x3A1, .delta = 32 }, // Greek
+    .{ .lo = 0x3A3, .hi = 0x3AB, .delta = 32 },
+    .{ .lo = 0x400, .hi = 0x40F, .delta = 80 }, // Cyrillic Ѐ..Џ
+    .{ .lo = 0x410, .hi = 0x42F, .delta = 32 }, // Cyrillic А..Я
+    .{ .lo = 0x531, .hi = 0x556, .delta = 48 }, // Armenian
+    .{ .lo = 0x10A0, .hi = 0x10C5, .delta = 7264 }, // Georgian
+    .{ .lo = 0x2160, .hi = 0x216F, .delta = 16 }, // Roman numerals
+    .{ .lo = 0x24B6, .hi = 0x24CF, .delta = 26 }, // circled letters
+    .{ .lo = 0xFF21, .hi = 0xFF3A, .delta = 32 }, // fullwidth Latin
+};
+
+/// Ranges of alternating upper/lower pairs starting with an uppercase at `lo`
+const Pairs = struct { lo: u21, hi: u21 };
+const pairs = [_]Pairs{
+    .{ .lo = 0x100, .hi = 0x12F }, .{ .lo = 0x132, .hi = 0x137 },   .{ .lo = 0x139, .hi = 0x148 },
+    .{ .lo = 0x14A, .hi = 0x177 }, .{ .lo = 0x179, .hi = 0x17E },   .{ .lo = 0x182, .hi = 0x185 },
+    .{ .lo = 0x1A0, .hi = 0x1A5 }, .{ .lo = 0x1CD, .hi = 0x1DC },   .{ .lo = 0x1DE, .hi = 0x1EF },
+    .{ .lo = 0x1F8, .hi = 0x21F }, .{ .lo = 0x222, .hi = 0x233 },   .{ .lo = 0x246, .hi = 0x24F },
+    .{ .lo = 0x370, .hi = 0x373 }, .{ .lo = 0x3D8, .hi = 0x3EF },   .{ .lo = 0x460, .hi = 0x481 },
+    .{ .lo = 0x48A, .hi = 0x4BF }, .{ .lo = 0x4C1, .hi = 0x4CE },   .{ .lo = 0x4D0, .hi = 0x52F },
+    .{ .lo = 0x1E00, .hi = 0x1E95 }, .{ .lo = 0x1EA0, .hi = 0x1EFF }, .{ .lo = 0x2C80, .hi = 0x2CE3 },
+    .{ .lo = 0xA640, .hi = 0xA66D }, .{ .lo = 0xA680, .hi = 0xA69B }, .{ .lo = 0xA722, .hi = 0xA72F },
+    .{ .lo = 0xA732, .hi = 0xA76F }, .{ .lo = 0xA77E, .hi = 0xA787 }, .{ .lo = 0xA790, .hi = 0xA793 },
+    .{ .lo = 0xA796, .hi = 0xA7A9 },
+};
+
+/// One-off folds (symbol variants, signs that alias letters)
+const Single = struct { from: u21, to: u21 };
+const singles = [_]Single{
+    .{ .from = 0xB5, .to = 0x3BC }, // µ micro sign
+    .{ .from = 0x178, .to = 0xFF }, // Ÿ
+    .{ .from = 0x17F, .to = 0x73 }, // ſ long s
+    .{ .from = 0x345, .to = 0x3B9 }, // combining ypogegrammeni
+    .{ .from = 0x3C2, .to = 0x3C3 }, // ς final sigma
+    .{ .from = 0x3CF, .to = 0x3D7 },
+    .{ .from = 0x3D0, .to = 0x3B2 }, // ϐ
+    .{ .from = 0x3D1, .to = 0x3B8 }, // ϑ
+    .{ .from = 0x3D5, .to = 0x3C6 }, // ϕ
+    .{ .from = 0x3D6, .to = 0x3C0 }, // ϖ
+    .{ .from = 0x3F0, .to = 0x3BA }, // ϰ
+    .{ .from = 0x3F1, .to = 0x3C1 }, // ϱ
+    .{ .from = 0x3F4, .to = 0x3B8 }, // ϴ
+    .{ .from = 0x3F5, .to = 0x3B5 }, // ϵ
+    .{ .from = 0x4C0, .to = 0x4CF }, // Ӏ palochka
+    .{ .from = 0x1E9B, .to = 0x1E61 },
+    .{ .from = 0x1E9E, .to = 0xDF }, // ẞ capital sharp s
+    .{ .from = 0x1FBE, .to = 0x3B9 },
+    .{ .from = 0x2126, .to = 0x3C9 }, // Ω ohm sign
+    .{ .from = 0x212A, .to = 0x6B }, // K kelvin sign
+    .{ .from = 0x212B, .to = 0xE5 }, // Å angstrom sign
+};
+
+/// Simple case fold of one code point
+pub fn fold(cp: u21) u21 {
+    if (cp < 0x80) return if (cp >= 'A' and cp <= 'Z') cp + 32 else cp;
+    for (shifts) |s| {
+        if (cp >= s.lo and cp <= s.hi) return cp + s.delta;
+    }
+    for (pairs) |p| {
+        if (cp >= p.lo and cp <= p.hi and (cp - p.lo) % 2 == 0) return cp + 1;
+    }
+    for (singles) |s| {
+        if (cp == s.from) return s.to;
+    }
+    return cp;
+}
+
+/// Every code point whose fold is `folded` (including itself)
+fn variants(folded: u21, buf: *[MAX_VARIANTS]u21) []const u21 {
+    var n: usize = 0;
+    buf[n] = folded;
+    n += 1;
+    if (folded >= RAW_BYTE_BASE) return buf[0..n];
+    for (shifts) |s| {
+        if (folded >= s.lo + s.delta and folded <= s.hi + s.delta and n < MAX_VARIANTS) {
+            buf[n] = folded - s.delta;
+            n += 1;
+        }
+    }
+    for (pairs) |p| {
+        if (folded > p.lo and folded <= p.hi and (folded - 1 - p.lo) % 2 == 0 and n < MAX_VARIANTS) {
+            buf[n] = folded - 1;
+            n += 1;
+        }
+    }
+    for (singles) |s| {
+        if (s.to == folded and n < MAX_VARIANTS) {
+            buf[n] = s.from;
+            n += 1;
+        }
+    }
+    return buf[0..n];
+}
+
+/// Decode one code point; invalid sequences yield a raw byte of length 1
+inline fn decode(bytes: []const u8) struct { cp: u21, len: usize } {
+    const b = bytes[0];
+    if (b < 0x80) return .{ .cp = b, .len = 1 };
+    const len = std.unicode.utf8ByteSequenceLength(b) catch return .{ .cp = RAW_BYTE_BASE + b, .len = 1 };
+    if (len > bytes.len) return .{ .cp = RAW_BYTE_BASE + b, .len = 1 };
+    const cp = std.unicode.utf8Decode(bytes[0..len]) catch return .{ .cp = RAW_BYTE_BASE + b, .len = 1 };
+    return .{ .cp = cp, .len = len };
+}
+
+/// True when any byte is outside ASCII
+pub fn hasNonAscii(bytes: []const u8) bool {
+    for (bytes) |c| {
+        if (c >= 0x80) return true;
+    }
+    return false;
+}
+
+/// True when -i should use this engine: the pattern is a plain literal (no
+/// metacharacters for its syntax) containing non-ASCII bytes. ASCII-only
+/// patterns keep the SIMD ASCII fast path.
+pub fn isUnicodeLiteral(pattern: []const u8, options: SearchOptions) bool {
+    if (!options.case_insensitive or !hasNonAscii(pattern)) return false;
+    if (options.fixed_string) return true;
+    const specials: []const u8 = if (options.extended or options.perl) "\\.[]()*+?{}|^$" else "\\.[]*^$";
+    return std.mem.indexOfAny(u8, pattern, specials) == null;
+}
+
+/// Folded pattern plus the bytes that can start a match
+const Folded = struct {
+    cps: []u21,
+    leads: [MAX_VARIANTS]u8 = undefined,
+    num_leads: usize = 0,
+
+    fn init(allocator: std.mem.Allocator, pattern: []const u8) !Folded {
+        var cps: std.ArrayListUnmanaged(u21) = .{};
+        errdefer cps.deinit(allocator);
+        var i: usize = 0;
+        while (i < pattern.len) {
+            const d = decode(pattern[i..]);
+            try cps.append(allocator, fold(d.cp));
+            i += d.len;
+        }
+        var self = Folded{ .cps = try cps.toOwnedSlice(allocator) };
+
+        var buf: [MAX_VARIANTS]u21 = undefined;
+        for (variants(self.cps[0], &buf)) |v| {
+            var enc: [4]u8 = undefined;
+            const lead: u8 = if (v >= RAW_BYTE_BASE)
+                @intCast(v - RAW_BYTE_BASE)
+            else blk: {
+                _ = std.unicode.utf8Encode(v, &enc) catch continue;
+                break :blk enc[0];
+            };
+            if (std.mem.indexOfScalar(u8, self.leads[0..self.num_leads], lead) == null) {
+                self.leads[self.num_leads] = lead;
+                self.num_leads += 1;
+            }
+        }
+        return self;
+    }
+
+    fn deinit(self: *Folded, allocator: std.mem.Allocator) void {
+        allocator.free(self.cps);
+    }
+
+    /// Next position at or after `from` holding a possible first byte
+    fn nextCandidate(self: *const Folded, text: []const u8, from: usize) ?usize {
+        const leads = self.leads[0..self.num_leads];
+        var i = from;
+        while (i + 32 <= text.len) : (i += 32) {
+            const chunk: Vec32 = text[i..][0..32].*;
+            var mask: u32 = 0;
+            for (leads) |lead| {
+                mask |= @as(u32, @bitCast(chunk == @as(Vec32, @splat(lead))));
+            }
+            if (mask != 0) return i + @ctz(mask);
+        }
+        while (i < text.len) : (i += 1) {
+            if (std.mem.indexOfScalar(u8, leads, text[i]) != null) return i;
+        }
+        return null;
+    }
+
+    /// Length in bytes of the match at `pos`, if the folded text matches
+    fn matchAt(self: *const Folded, text: []const u8, pos: usize) ?usize {
+        var p = pos;
+        for (self.cps) |want| {
+            if (p >= text.len) return null;
+            const d = decode(text[p..]);
+            if (fold(d.cp) != want) return null;
+            p += d.len;
+        }
+        return p - pos;
+    }
+};
+
+/// Word characters for -w; bytes of multi-byte sequences count as letters
+inline fn isWordByte(c: u8) bool {
+    return std.ascii.isAlphanumeric(c) or c == '_' or c >= 0x80;
+}
+
+/// Case-insensitive literal search with Unicode simple case folding
+pub fn search(text: []const u8, pattern: []const u8, options: SearchOptions, allocator: std.mem.Allocator) !SearchResult {
+    var folded = try Folded.init(allocator, pattern);
+    defer folded.deinit(allocator);
+
+    const eol = options.record_sep;
+    var matches: std.ArrayListUnmanaged(MatchResult) = .{};
+    defer matches.deinit(allocator);
+    var total_matches: u64 = 0;
+
+    // Lines with no match, for -v
+    var line_start: usize = 0;
+
+    var pos: usize = 0;
+    while (folded.nextCandidate(text, pos)) |cand| {
+        const len = folded.matchAt(text, cand) orelse {
+            pos = cand + 1;
+            continue;
+        };
+        pos = cand + len;
+        if (options.line_regexp) {
+            // -x: the match must span its whole record
+            if (cand > 0 and text[cand - 1] != eol) continue;
+            if (cand + len < text.len and text[cand + len] != eol) continue;
+        } else if (options.word_boundary) {
+            if (cand > 0 and isWordByte(text[cand - 1])) continue;
+            if (cand + len < text.len and isWordByte(text[cand + len])) continue;
+        }
+
+        const match_line = if (std.mem.lastIndexOfScalar(u8, text[0..cand], eol)) |nl| nl + 1 else 0;
+        if (options.invert_match) {
+            // Emit the clean lines before this one, then skip past it
+            try appendLines(&matches, allocator, text, eol, line_start, match_line, &total_matches);
+            line_start = if (std.mem.indexOfScalarPos(u8, text, cand, eol)) |nl| nl + 1 else text.len;
+            pos = @max(pos, line_start);
+            continue;
+        }
+        try matches.append(allocator, .{
+            .position = @intCast(cand),
+            .pattern_idx = 0,
+            .match_len = @intCast(len),
+            .line_start = @intCast(match_line),
+        });
+        total_matches += 1;
+    }
+    if (options.invert_match) {
+        try appendLines(&matches, allocator, text, eol, line_start, text.len, &total_matches);
+    }
+
+    const result = try matches.toOwnedSlice(allocator);
+    return SearchResult{ .matches = result, .total_matches = total_matches, .allocator = allocator };
+}
+
+/// Append every line starting in [from, to) as a whole-line match
+fn appendLines(
+    matches: *std.ArrayListUnmanaged(MatchResult),
+    allocator: std.mem.Allocator,
+    text: []const u8,
+    eol: u8,
+    from: usize,
+    to: usize,
+    total: *u64,
+) !void {
+    var line_start = from;
+    while (line_start < to) {
+        const line_end = std.mem.indexOfScalarPos(u8, text, line_start, eol) orelse text.len;
+        try matches.append(allocator, .{
+            .position = @intCast(line_start),
+            .pattern_idx = 0,
+            .match_len = @intCast(line_end - line_start),
+            .line_start = @intCast(line_start),
+        });
+        total.* += 1;
+        line_start = line_end + 1;
+    }
+}
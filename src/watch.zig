@@ -0,0 +1,369 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const gpu = @import("gpu");
+const input = @import("input.zig");
+const output = @import("output.zig");
+const linux = std.os.linux;
+
+// ============================================================================
+// Directory watch (--watch)
+//
+// Every directory below the operands gets an inotify watch, and every file
+// keeps the lines it currently contributes to the results. A change event
+// re-searches only that file; when the file has only grown (same inode, and
+// the bytes before the last searched line end are unchanged) only the new
+// tail is read and searched. The new lines are merged against the old ones
+// and the difference is written as one JSON object per line:
+//
+//   {"op":"add","path":"conf/a.yml","line":12,"text":"..."}
+//   {"op":"remove","path":"conf/a.yml","line":12,"text":"..."}
+//
+// Deltas for one file are ordered by line number, a removal before the
+// addition replacing it. The initial scan reports every result as "add".
+// ============================================================================
+
+/// Bytes before a file's searched end that must be unchanged for a growing
+/// file to count as appended to
+pub const TAIL_CHECK: usize = 64;
+
+const DIR_MASK: u32 = linux.IN.MODIFY | linux.IN.CLOSE_WRITE | linux.IN.CREATE | linux.IN.DELETE |
+    linux.IN.MOVED_FROM | linux.IN.MOVED_TO | linux.IN.ONLYDIR;
+
+/// What an event means for the tree
+pub const Change = enum {
+    file, // created or written: search it again
+    file_gone, // deleted or moved away
+    dir, // created or moved in: watch and search it
+    dir_gone, // deleted or moved away: forget everything below it
+    overflow, // the kernel dropped events: rescan everything
+};
+
+pub const Event = struct {
+    change: Change,
+    path: []u8, // owned by the batch; empty for overflow
+};
+
+/// Events from one read, at most one per path (the last one wins)
+pub const Batch = struct {
+    allocator: std.mem.Allocator,
+    events: std.ArrayListUnmanaged(Event) = .{},
+
+    pub fn deinit(self: *Batch) void {
+        for (self.events.items) |e| self.allocator.free(e.path);
+        self.events.deinit(self.allocator);
+    }
+
+    fn add(self: *Batch, change: Change, path: []u8) !void {
+        for (self.events.items) |*e| {
+            if (std.mem.eql(u8, e.path, path)) {
+                self.allocator.free(path);
+                e.change = change;
+                return;
+            }
+        }
+        try self.events.append(self.allocator, .{ .change = change, .path = path });
+    }
+};
+
+/// inotify watches over one or more directory trees
+pub const Tree = struct {
+    allocator: std.mem.Allocator,
+    fd: i32,
+    dirs: std.AutoHashMapUnmanaged(i32, []u8) = .{}, // watch descriptor -> directory
+
+    pub fn init(allocator: std.mem.Allocator) !Tree {
+        if (builtin.os.tag != .linux) return error.Unsupported;
+        const fd = try std.posix.inotify_init1(linux.IN.CLOEXEC);
+        return .{ .allocator = allocator, .fd = fd };
+    }
+
+    pub fn deinit(self: *Tree) void {
+        var it = self.dirs.valueIterator();
+        while (it.next()) |path| self.allocator.free(path.*);
+        self.dirs.deinit(self.allocator);
+        std.posix.close(self.fd);
+    }
+
+    /// Watch directory `path` (not its subdirectories)
+    pub fn addDir(self: *Tree, path: []const u8) !void {
+        if (builtin.os.tag != .linux) return error.Unsupported;
+        const wd = try std.posix.inotify_add_watch(self.fd, path, DIR_MASK);
+        const owned = try self.allocator.dupe(u8, path);
+        errdefer self.allocator.free(owned);
+        const entry = try self.dirs.getOrPut(self.allocator, wd);
+        // Watching a directory again returns its existing descriptor
+        if (entry.found_existing) self.allocator.free(entry.value_ptr.*);
+        entry.value_ptr.* = owned;
+    }
+
+    /// Drop the watches on `path` and every directory below it
+    pub fn removeDir(self: *Tree, path: []const u8) void {
+        if (builtin.os.tag != .linux) return;
+        var gone: std.ArrayListUnmanaged(i32) = .{};
+        defer gone.deinit(self.allocator);
+        var it = self.dirs.iterator();
+        while (it.next()) |entry| {
+            if (isWithin(entry.value_ptr.*, path)) gone.append(self.allocator, entry.key_ptr.*) catch break;
+        }
+        for (gone.items) |wd| {
+            std.posix.inotify_rm_watch(self.fd, wd);
+            if (self.dirs.fetchRemove(wd)) |kv| self.allocator.free(kv.value);
+        }
+    }
+
+    /// Block until events arrive and return them
+    pub fn read(self: *Tree) !Batch {
+        if (builtin.os.tag != .linux) return error.Unsupported;
+        var buf: [16 * 1024]u8 align(@alignOf(linux.inotify_event)) = undefined;
+        const len = try std.posix.read(self.fd, &buf);
+
+        var batch = Batch{ .allocator = self.allocator };
+        errdefer batch.deinit();
+        var offset: usize = 0;
+        while (offset < len) {
+            const event: *const linux.inotify_event = @ptrCast(@alignCast(&buf[offset]));
+            offset += @sizeOf(linux.inotify_event) + event.len;
+
+            if (event.mask & linux.IN.Q_OVERFLOW != 0) {
+                try batch.add(.overflow, try self.allocator.dupe(u8, ""));
+                continue;
+            }
+            const dir = self.dirs.get(event.wd) orelse continue;
+            if (event.mask & linux.IN.IGNORED != 0) {
+                // The directory itself went away without an event in a
+                // watched parent (a removed operand)
+                try batch.add(.dir_gone, try self.allocator.dupe(u8, dir));
+                if (self.dirs.fetchRemove(event.wd)) |kv| self.allocator.free(kv.value);
+                continue;
+            }
+            const name = event.getName() orelse continue;
+            const is_dir = event.mask & linux.IN.ISDIR != 0;
+            const gone = event.mask & (linux.IN.DELETE | linux.IN.MOVED_FROM) != 0;
+            const change: Change = if (is_dir)
+                (if (gone) .dir_gone else if (event.mask & (linux.IN.CREATE | linux.IN.MOVED_TO) != 0) .dir else continue)
+            else if (gone) .file_gone else .file;
+            try batch.add(change, try std.fs.path.join(self.allocator, &.{ dir, name }));
+        }
+        return batch;
+    }
+};
+
+/// Whether `path` is `dir` or lies below it
+pub fn isWithin(path: []const u8, dir: []const u8) bool {
+    if (!std.mem.startsWith(u8, path, dir)) return false;
+    return path.len == dir.len or path[dir.len] == std.fs.path.sep;
+}
+
+/// One selected line
+pub const Line = struct {
+    number: u64, // 1-based
+    text: []u8, // owned, without its terminator
+};
+
+pub const Op = enum { add, remove };
+
+/// What is known about one file between events
+pub const FileState = struct {
+    inode: std.fs.File.INode = 0,
+    size: u64 = 0,
+    mtime: i128 = 0,
+    scanned: u64 = 0, // end of the last complete line searched
+    lines_before: u64 = 0, // lines in [0, scanned)
+    tail_hash: u64 = 0, // hash of the TAIL_CHECK bytes before `scanned`
+    results: std.ArrayListUnmanaged(Line) = .{}, // by line number
+    seen: bool = true, // found again by the current rescan
+
+    pub fn deinit(self: *FileState, allocator: std.mem.Allocator) void {
+        for (self.results.items) |line| allocator.free(line.text);
+        self.results.deinit(allocator);
+    }
+
+    /// Whether `stat` shows nothing new since the last search
+    pub fn unchanged(self: *const FileState, stat: std.fs.File.Stat) bool {
+        return stat.inode == self.inode and stat.size == self.size and stat.mtime == self.mtime;
+    }
+
+    /// Replace the results from line `from` on with `fresh` (sorted, owned;
+    /// taken over), writing the difference to `out`
+    pub fn replaceFrom(self: *FileState, allocator: std.mem.Allocator, out: *output.Sink, path: []const u8, from: u64, fresh: []Line) !void {
+        var keep: usize = 0;
+        while (keep < self.results.items.len and self.results.items[keep].number < from) keep += 1;
+        try self.results.ensureTotalCapacity(allocator, keep + fresh.len);
+        const old = self.results.items[keep..];
+
+        var i: usize = 0;
+        var j: usize = 0;
+        while (i < old.len or j < fresh.len) {
+            if (j == fresh.len or (i < old.len and old[i].number < fresh[j].number)) {
+                writeDelta(out, .remove, path, old[i]);
+                i += 1;
+            } else if (i == old.len or fresh[j].number < old[i].number) {
+                writeDelta(out, .add, path, fresh[j]);
+                j += 1;
+            } else {
+                if (!std.mem.eql(u8, old[i].text, fresh[j].text)) {
+                    writeDelta(out, .remove, path, old[i]);
+                    writeDelta(out, .add, path, fresh[j]);
+                }
+                i += 1;
+                j += 1;
+            }
+        }
+
+        for (old) |line| allocator.free(line.text);
+        self.results.shrinkRetainingCapacity(keep);
+        self.results.appendSliceAssumeCapacity(fresh);
+    }
+
+    /// Report every result as removed (the file is gone)
+    pub fn removeAll(self: *FileState, out: *output.Sink, path: []const u8) void {
+        for (self.results.items) |line| writeDelta(out, .remove, path, line);
+    }
+};
+
+/// The lines of `text` holding matches (or selected by -v), numbered from
+/// `first_number`. The texts are owned by the caller.
+pub fn collectLines(allocator: std.mem.Allocator, text: []const u8, eol: u8, matches: []const gpu.MatchResult, first_number: u64) ![]Line {
+    const starts = try allocator.alloc(u32, matches.len);
+    defer allocator.free(starts);
+    for (matches, starts) |m, *s| s.* = m.line_start;
+    std.mem.sort(u32, starts, {}, std.sort.asc(u32));
+
+    var lines: std.ArrayListUnmanaged(Line) = .{};
+    errdefer {
+        for (lines.items) |line| allocator.free(line.text);
+        lines.deinit(allocator);
+    }
+    var number = first_number;
+    var counted: usize = 0;
+    for (starts, 0..) |start, idx| {
+        if (idx > 0 and start == starts[idx - 1]) continue;
+        number += input.countTerminators(text[counted..start], eol);
+        counted = start;
+        const end = std.mem.indexOfScalarPos(u8, text, start, eol) orelse text.len;
+        const owned = try allocator.dupe(u8, text[start..end]);
+        lines.append(allocator, .{ .number = number, .text = owned }) catch |err| {
+            allocator.free(owned);
+            return err;
+        };
+    }
+    return lines.toOwnedSlice(allocator);
+}
+
+/// Hash of the TAIL_CHECK bytes of `file` before `end`
+pub fn tailHash(file: std.fs.File, end: u64) !u64 {
+    var buf: [TAIL_CHECK]u8 = undefined;
+    const start = end - @min(end, TAIL_CHECK);
+    const len = try file.preadAll(buf[0..@intCast(end - start)], start);
+    return std.hash.Wyhash.hash(0, buf[0..len]);
+}
+
+/// Write one delta as a JSON object on its own line
+pub fn writeDelta(out: *output.Sink, op: Op, path: []const u8, line: Line) void {
+    var buf: [64]u8 = undefined;
+    out.write("{\"op\":\"");
+    out.write(@tagName(op));
+    out.write("\",\"path\":");
+    writeJsonString(out, path);
+    out.write(std.fmt.bufPrint(&buf, ",\"line\":{d},\"text\":", .{line.number}) catch unreachable);
+    writeJsonString(out, line.text);
+    out.write("}\n");
+}
+
+/// Write `bytes` as a JSON string. Bytes that are not valid UTF-8 become
+/// U+FFFD, so every line of output stays parseable.
+pub fn writeJsonString(out: *output.Sink, bytes: []const u8) void {
+    out.write("\"");
+    var plain: usize = 0; // start of the bytes not yet written
+    var i: usize = 0;
+    while (i < bytes.len) {
+        const c = bytes[i];
+        var escape: ?[]const u8 = null;
+        var buf: [6]u8 = undefined;
+        var len: usize = 1;
+        if (c == '"') {
+            escape = "\\\"";
+        } else if (c == '\\') {
+            escape = "\\\\";
+        } else if (c == '\n') {
+            escape = "\\n";
+        } else if (c == '\r') {
+            escape = "\\r";
+        } else if (c == '\t') {
+            escape = "\\t";
+        } else if (c < 0x20 or c == 0x7f) {
+            escape = std.fmt.bufPrint(&buf, "\\u{x:0>4}", .{c}) catch unreachable;
+        } else if (c >= 0x80) {
+            len = std.unicode.utf8ByteSequenceLength(c) catch 0;
+            if (len == 0 or i + len > bytes.len or !std.unicode.utf8ValidateSlice(bytes[i..][0..len])) {
+                escape = "\\ufffd";
+                len = 1;
+            }
+        }
+        if (escape) |e| {
+            out.write(bytes[plain..i]);
+            out.write(e);
+            plain = i + len;
+        }
+        i += len;
+    }
+    out.write(bytes[plain..]);
+    out.write("\"");
+}
+
+test "watch: deltas between old and new results" {
+    const allocator = std.testing.allocator;
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    var out = output.Sink{ .allocator = allocator, .fd = fds[1] };
+    defer out.deinit();
+    var buf: [512]u8 = undefined;
+
+    var state = FileState{};
+    defer state.deinit(allocator);
+    const first = try collectLines(allocator, "a x\nb\nc x\n", '\n', &.{
+        .{ .position = 2, .pattern_idx = 0, .match_len = 1, .line_start = 0 },
+        .{ .position = 8, .pattern_idx = 0, .match_len = 1, .line_start = 6 },
+    }, 1);
+    defer allocator.free(first);
+    try state.replaceFrom(allocator, &out, "f", 1, first);
+    out.finish();
+    var n = try std.posix.read(fds[0], &buf);
+    try std.testing.expectEqualStrings(
+        \\{"op":"add","path":"f","line":1,"text":"a x"}
+        \\{"op":"add","path":"f","line":3,"text":"c x"}
+        \\
+    , buf[0..n]);
+
+    // Line 3 rewritten, line 2 now matches
+    const second = try collectLines(allocator, "b x\nc y x\n", '\n', &.{
+        .{ .position = 2, .pattern_idx = 0, .match_len = 1, .line_start = 0 },
+        .{ .position = 8, .pattern_idx = 0, .match_len = 1, .line_start = 4 },
+    }, 2);
+    defer allocator.free(second);
+    try state.replaceFrom(allocator, &out, "f", 2, second);
+    out.finish();
+    n = try std.posix.read(fds[0], &buf);
+    try std.testing.expectEqualStrings(
+        \\{"op":"add","path":"f","line":2,"text":"b x"}
+        \\{"op":"remove","path":"f","line":3,"text":"c x"}
+        \\{"op":"add","path":"f","line":3,"text":"c y x"}
+        \\
+    , buf[0..n]);
+    try std.testing.expectEqual(@as(usize, 3), state.results.items.len);
+}
+
+test "watch: JSON strings stay valid" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    var out = output.Sink{ .allocator = std.testing.allocator, .fd = fds[1] };
+    defer out.deinit();
+
+    writeJsonString(&out, "tab\there \"q\" \\ \x01 caf\xc3\xa9 \xff");
+    out.finish();
+    var buf: [64]u8 = undefined;
+    const n = try std.posix.read(fds[0], &buf);
+    try std.testing.expectEqualStrings("\"tab\\there \\\"q\\\" \\\\ \\u0001 caf\xc3\xa9 \\ufffd\"", buf[0..n]);
+}
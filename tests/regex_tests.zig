@@ -484,6 +484,86 @@ test "regex: overlapping potential matches" {
     try std.testing.expect(result.total_matches >= 2);
 }
 
+// ----------------------------------------------------------------------------
+// Multiple Patterns - grep -e P1 -e P2 (union automaton, one pass)
+// ----------------------------------------------------------------------------
+
+test "multi: one pass tags lines with the first matching pattern" {
+    const allocator = std.testing.allocator;
+    const patterns = [_][]const u8{ "err(or)?", "^warn", "[0-9]+ms$" };
+    const literals = [_][]const u8{ "err", "warn", "ms" };
+    var m = try cpu.MultiRegex.init(allocator, &patterns, .{ .fixed_string = false, .extended = true }, &literals, false);
+    defer m.deinit();
+
+    const text = "ok\nerror: disk\nsee warn\nwarn: slow 150ms\nfine 20ms later\n";
+    var result = try m.search(text, allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2), result.matches.len);
+    try std.testing.expectEqual(@as(u32, 3), result.matches[0].line_start);
+    try std.testing.expectEqual(@as(u32, 0), result.matches[0].pattern_idx);
+    try std.testing.expectEqual(@as(u32, 24), result.matches[1].line_start);
+    try std.testing.expectEqual(@as(u32, 1), result.matches[1].pattern_idx);
+}
+
+test "multi: invert selects lines matching no pattern" {
+    const allocator = std.testing.allocator;
+    const patterns = [_][]const u8{ "a.b", "(x)" };
+    var m = try cpu.MultiRegex.init(allocator, &patterns, .{ .fixed_string = true, .invert_match = true }, null, false);
+    defer m.deinit();
+
+    var result = try m.search("a.b\naxb\n(x)\n", allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 1), result.matches.len);
+    try std.testing.expectEqual(@as(u32, 4), result.matches[0].line_start);
+}
+
+test "multi: spans from several patterns do not overlap" {
+    const allocator = std.testing.allocator;
+    const patterns = [_][]const u8{ "foo", "foobar", "baz" };
+    var m = try cpu.MultiRegex.init(allocator, &patterns, .{ .fixed_string = true }, null, true);
+    defer m.deinit();
+
+    var result = try m.search("foobar baz\n", allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2), result.matches.len);
+    try std.testing.expectEqual(@as(u32, 6), result.matches[0].match_len);
+    try std.testing.expectEqual(@as(u32, 7), result.matches[1].position);
+}
+
+test "multi: dot crosses newlines inside -z records" {
+    const allocator = std.testing.allocator;
+    const patterns = [_][]const u8{ "a.b", "^x$" };
+    var m = try cpu.MultiRegex.init(allocator, &patterns, .{ .fixed_string = false, .extended = true, .record_sep = 0 }, null, false);
+    defer m.deinit();
+
+    var result = try m.search("a\nb\x00ab\x00x\x00", allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2), result.matches.len);
+    try std.testing.expectEqual(@as(u32, 0), result.matches[0].line_start);
+    try std.testing.expectEqual(@as(u32, 0), result.matches[0].pattern_idx);
+    try std.testing.expectEqual(@as(u32, 7), result.matches[1].line_start);
+    try std.testing.expectEqual(@as(u32, 1), result.matches[1].pattern_idx);
+}
+
+test "multi: -w edges on patterns with non-word ends" {
+    const allocator = std.testing.allocator;
+    const patterns = [_][]const u8{ "-v", "+x" };
+    var m = try cpu.MultiRegex.init(allocator, &patterns, .{ .fixed_string = true, .word_boundary = true }, null, false);
+    defer m.deinit();
+
+    var result = try m.search("use -v now\nx-v\na +x\na+x\n", allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2), result.matches.len);
+    try std.testing.expectEqual(@as(u32, 0), result.matches[0].line_start);
+    try std.testing.expectEqual(@as(u32, 15), result.matches[1].line_start);
+    try std.testing.expectEqual(@as(u32, 1), result.matches[1].pattern_idx);
+}
+
 // ----------------------------------------------------------------------------
 // PCRE Extensions - grep -P (Perl-compatible regex)
 // Lookahead, lookbehind, and non-capturing groups
@@ -119,6 +119,166 @@ test "cpu: invert match" {
     try std.testing.expectEqual(@as(u64, 1), result.total_matches);
 }
 
+test "cpu: invert match emits the gaps between matching lines" {
+    const allocator = std.testing.allocator;
+    const text = "ab x\nkeep1\nkeep2\nx x\nlast";
+
+    var result = try cpu.search(text, "x", .{ .invert_match = true }, allocator);
+    defer result.deinit();
+    try std.testing.expectEqual(@as(u64, 3), result.total_matches);
+    try std.testing.expectEqual(@as(u32, 5), result.matches[0].line_start);
+    try std.testing.expectEqual(@as(u32, 11), result.matches[1].line_start);
+    try std.testing.expectEqual(@as(u32, 21), result.matches[2].line_start);
+    try std.testing.expectEqual(@as(u32, 4), result.matches[2].match_len);
+
+    var regex_result = try cpu.searchRegex(text, "k.*2", .{ .invert_match = true }, allocator);
+    defer regex_result.deinit();
+    try std.testing.expectEqual(@as(u64, 4), regex_result.total_matches);
+    try std.testing.expectEqual(@as(u32, 17), regex_result.matches[2].line_start);
+
+    // An empty pattern matches every line, so -v selects none
+    var empty = try cpu.search(text, "", .{ .invert_match = true }, allocator);
+    defer empty.deinit();
+    try std.testing.expectEqual(@as(u64, 0), empty.total_matches);
+}
+
+test "cpu: -w and -x compiled into the regex" {
+    const allocator = std.testing.allocator;
+
+    // The longest match "foo bar" ends inside "bar1"; "foo " is a whole word
+    var words = try cpu.searchRegex("foo bar1\n", "foo[ a-z]*", .{ .fixed_string = false, .extended = true, .word_boundary = true }, allocator);
+    defer words.deinit();
+    try std.testing.expectEqual(@as(u64, 1), words.total_matches);
+    try std.testing.expectEqual(@as(u32, 0), words.matches[0].position);
+
+    // Backreferences are renumbered past the added group
+    var backref = try cpu.searchRegex("aab aa\n", "(a)\\1", .{ .fixed_string = false, .extended = true, .word_boundary = true }, allocator);
+    defer backref.deinit();
+    try std.testing.expectEqual(@as(u64, 1), backref.total_matches);
+    try std.testing.expectEqual(@as(u32, 4), backref.matches[0].position);
+
+    var lines = try cpu.searchRegex("a.b\naxb\na.bc\n", "a.b", .{ .line_regexp = true }, allocator);
+    defer lines.deinit();
+    try std.testing.expectEqual(@as(u64, 1), lines.total_matches);
+    try std.testing.expectEqual(@as(u32, 0), lines.matches[0].line_start);
+
+    const source = try cpu.boundSource(allocator, "a\\(b\\)\\1", .{ .fixed_string = false, .line_regexp = true });
+    defer allocator.free(source);
+    try std.testing.expectEqualStrings("^(a(b)\\2)$", source);
+    try std.testing.expect(!cpu.boundOptions(.{ .line_regexp = true }).fixed_string);
+}
+
+test "cpu: -w on patterns with non-word ends" {
+    const allocator = std.testing.allocator;
+    const opts = SearchOptions{ .fixed_string = false, .word_boundary = true };
+
+    // No word character may touch the match, even where \b would not hold
+    var flag = try cpu.searchRegex("use -v now\nx-v\n-vv\n", "-v", opts, allocator);
+    defer flag.deinit();
+    try std.testing.expectEqual(@as(u64, 1), flag.total_matches);
+    try std.testing.expectEqual(@as(u32, 4), flag.matches[0].position);
+
+    // A non-ASCII byte after a word character is not a word start
+    var accent = try cpu.searchRegex("caf\xc3\xa9\n\xc3\xa9t\xc3\xa9 \xc3\xa9\n", "\xc3\xa9", opts, allocator);
+    defer accent.deinit();
+    try std.testing.expectEqual(@as(u64, 1), accent.total_matches);
+    try std.testing.expectEqual(@as(u32, 12), accent.matches[0].position);
+
+    const source = try cpu.boundSource(allocator, "-v", .{ .word_boundary = true });
+    defer allocator.free(source);
+    try std.testing.expectEqualStrings("(?<!\\w)(-v)(?!\\w)", source);
+}
+
+test "cpu: unicode case insensitive match" {
+    const allocator = std.testing.allocator;
+    const text = "Привет мир\nПРИВЕТ\nhello\nпРиВеТ\n";
+
+    var result = try cpu.search(text, "привет", .{ .case_insensitive = true }, allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(u64, 3), result.total_matches);
+    try std.testing.expectEqual(@as(u32, 12), result.matches[0].match_len);
+
+    // Final sigma and capital sigma fold together; -v keeps the other line
+    var greek = try cpu.search("ΟΔΟΣ\nκαφέ\n", "οδος", .{ .case_insensitive = true, .invert_match = true }, allocator);
+    defer greek.deinit();
+    try std.testing.expectEqual(@as(u64, 1), greek.total_matches);
+    try std.testing.expectEqual(@as(u32, 9), greek.matches[0].position);
+}
+
+test "cpu: unicode case folding under -w and -x" {
+    const allocator = std.testing.allocator;
+    const text = "ПРИВЕТ\nПРИВЕТ мир\nПРИВЕТЫ\n";
+    const pattern = "привет";
+
+    // A BRE pattern without metacharacters, not -F
+    var words = try cpu.searchRegex(text, pattern, .{ .case_insensitive = true, .fixed_string = false, .word_boundary = true }, allocator);
+    defer words.deinit();
+    try std.testing.expectEqual(@as(u64, 2), words.total_matches);
+
+    var lines = try cpu.searchRegex(text, pattern, .{ .case_insensitive = true, .fixed_string = false, .line_regexp = true }, allocator);
+    defer lines.deinit();
+    try std.testing.expectEqual(@as(u64, 1), lines.total_matches);
+    try std.testing.expectEqual(@as(u32, 0), lines.matches[0].line_start);
+
+    var others = try cpu.search(text, pattern, .{ .case_insensitive = true, .line_regexp = true, .invert_match = true }, allocator);
+    defer others.deinit();
+    try std.testing.expectEqual(@as(u64, 2), others.total_matches);
+}
+
+test "cpu: unicode case folding of variant lengths" {
+    const allocator = std.testing.allocator;
+    // Kelvin sign (3 bytes) folds to 'k'; É (2 bytes) to é
+    const text = "200 \xe2\x84\xaaELVIN CAFÉ\n";
+
+    var result = try cpu.search(text, "kelvin café", .{ .case_insensitive = true }, allocator);
+    defer result.deinit();
+
+    try std.testing.expectEqual(@as(u64, 1), result.total_matches);
+    try std.testing.expectEqual(@as(u32, 4), result.matches[0].position);
+    try std.testing.expectEqual(@as(u32, 14), result.matches[0].match_len);
+}
+
+test "cpu: nul-terminated records" {
+    const allocator = std.testing.allocator;
+    // With -z a newline is an ordinary byte inside a record
+    const text = "first\nline one\x00second\x00third one\x00";
+
+    var result = try cpu.search(text, "one", .{ .record_sep = 0 }, allocator);
+    defer result.deinit();
+    try std.testing.expectEqual(@as(u64, 2), result.total_matches);
+    try std.testing.expectEqual(@as(u32, 0), result.matches[0].line_start);
+    try std.testing.expectEqual(@as(u32, 22), result.matches[1].line_start);
+
+    var inverted = try cpu.search(text, "one", .{ .record_sep = 0, .invert_match = true }, allocator);
+    defer inverted.deinit();
+    try std.testing.expectEqual(@as(u64, 1), inverted.total_matches);
+    try std.testing.expectEqual(@as(u32, 15), inverted.matches[0].position);
+}
+
+test "cpu: long literal beyond the skip table" {
+    const allocator = std.testing.allocator;
+    const pattern = ("ABCDEFGHIJ" ** 60)[0..599] ++ "Q";
+    const text = "x\n" ++ ("abcdefghij" ** 60)[0..599] ++ "q\ny\n" ++ ("abcdefghij" ** 60)[0..599] ++ "\n";
+
+    var result = try cpu.search(text, pattern, .{ .case_insensitive = true }, allocator);
+    defer result.deinit();
+    try std.testing.expectEqual(@as(u64, 1), result.total_matches);
+    try std.testing.expectEqual(@as(u32, 2), result.matches[0].position);
+    try std.testing.expectEqual(@as(u32, 600), result.matches[0].match_len);
+
+    var inverted = try cpu.search(text, pattern, .{ .case_insensitive = true, .invert_match = true }, allocator);
+    defer inverted.deinit();
+    try std.testing.expectEqual(@as(u64, 3), inverted.total_matches);
+    try std.testing.expectEqual(@as(u32, 603), inverted.matches[1].line_start);
+
+    // A periodic pattern reports overlapping occurrences, like BMH does
+    var periodic = try cpu.search("ab" ** 202, "ab" ** 200, .{}, allocator);
+    defer periodic.deinit();
+    try std.testing.expectEqual(@as(u64, 3), periodic.total_matches);
+    try std.testing.expectEqual(@as(u32, 4), periodic.matches[2].position);
+}
+
 // ----------------------------------------------------------------------------
 // Metal GPU Tests (macOS only)
 // ----------------------------------------------------------------------------
@@ -266,3 +426,53 @@ test "vulkan: matches cpu results" {
         }
     }
 }
+
+test "vulkan: long literal beyond the skip table" {
+    const allocator = std.testing.allocator;
+
+    // Every shift is capped at 255, the last byte's is exact
+    const pattern = "Z" ++ ("ABCDEFGHIJ" ** 30)[0..298] ++ "Q";
+    const skip = gpu.buildSkipTable(pattern, true);
+    try std.testing.expectEqual(@as(u8, 255), skip['z']);
+    try std.testing.expectEqual(@as(u8, 1), skip['h']);
+    try std.testing.expectEqual(@as(u8, 255), skip['Q']);
+
+    const searcher = gpu.vulkan.VulkanSearcher.init(allocator) catch |err| {
+        std.debug.print("Vulkan init failed: {}\n", .{err});
+        return err;
+    };
+    defer searcher.deinit();
+
+    const text = "x\nz" ++ ("abcdefghij" ** 30)[0..298] ++ "q\ny\nz" ++ ("abcdefghij" ** 30)[0..298] ++ "\n";
+    var cpu_result = try cpu.search(text, pattern, .{ .case_insensitive = true }, allocator);
+    defer cpu_result.deinit();
+    var vulkan_result = try searcher.search(text, pattern, .{ .case_insensitive = true }, allocator);
+    defer vulkan_result.deinit();
+    try std.testing.expectEqual(@as(u64, 1), vulkan_result.total_matches);
+    try std.testing.expectEqual(cpu_result.matches[0].position, vulkan_result.matches[0].position);
+}
+
+// ----------------------------------------------------------------------------
+// Line Bitmap Tests
+// ----------------------------------------------------------------------------
+
+test "gpu: line bitmap selects whole lines" {
+    const allocator = std.testing.allocator;
+    const text = "alpha\nbeta\n\ngamma\ndelta";
+    // Lines start at 0, 6, 11, 12 and 18; mark "beta" and "delta"
+    const bits = [_]u32{(1 << 6) | (1 << 18)};
+
+    var selected = try gpu.linesFromBitmap(text, &bits, false, allocator);
+    defer selected.deinit();
+    try std.testing.expectEqual(@as(usize, 2), selected.matches.len);
+    try std.testing.expectEqual(@as(u32, 6), selected.matches[0].line_start);
+    try std.testing.expectEqual(@as(u32, 4), selected.matches[0].match_len);
+    try std.testing.expectEqual(@as(u32, 5), selected.matches[1].match_len);
+
+    var inverted = try gpu.linesFromBitmap(text, &bits, true, allocator);
+    defer inverted.deinit();
+    try std.testing.expectEqual(@as(usize, 3), inverted.matches.len);
+    try std.testing.expectEqual(@as(u32, 11), inverted.matches[1].line_start);
+    try std.testing.expectEqual(@as(u32, 0), inverted.matches[1].match_len);
+    try std.testing.expectEqual(@as(u32, 4), inverted.matches[2].line_num);
+}